@@ -47,7 +47,14 @@ static const float kSampleRate = 48000.0f;
 static const float kCorrectedSampleRate = 47872.34f;
 const float a0 = (440.0f / 8.0f) / kCorrectedSampleRate;
 
-const size_t kMaxBlockSize = 24;
+// Host builds rendering offline can raise the maximum block size, to spread
+// the per-block work of the voice over more samples. The control rate stays
+// tied to kBlockSize.
+#ifndef PLAITS_MAX_BLOCK_SIZE
+#define PLAITS_MAX_BLOCK_SIZE 24
+#endif  // PLAITS_MAX_BLOCK_SIZE
+
+const size_t kMaxBlockSize = PLAITS_MAX_BLOCK_SIZE;
 const size_t kBlockSize = 12;
 
 }  // namespace plaits
@@ -38,9 +38,10 @@ using namespace stmlib;
 void SwarmEngine::Init(BufferAllocator* allocator) {
   const float n = (kNumSwarmVoices - 1) / 2;
   for (int i = 0; i < kNumSwarmVoices; ++i) {
-    float rank = (static_cast<float>(i) - n) / n;
-    swarm_voice_[i].Init(rank);
+    rank_[i] = (static_cast<float>(i) - n) / n;
+    envelope_[i].Init();
   }
+  oscillators_.Init();
 }
 
 void SwarmEngine::Reset() { }
@@ -63,22 +64,26 @@ void SwarmEngine::Render(
   const bool burst_mode = !(parameters.trigger & TRIGGER_UNPATCHED);
   const bool start_burst = parameters.trigger & TRIGGER_RISING_EDGE;
 
-  fill(&out[0], &out[size], 0.0f);
-  fill(&aux[0], &aux[size], 0.0f);
+  const float scale = 1.0f / kNumSwarmVoices;
+  float frequency[kNumSwarmVoices];
+  float amplitude[kNumSwarmVoices];
   
+  // Control-rate updates, one voice after the other, so that each voice
+  // draws its random numbers in the same order as before.
   for (int i = 0; i < kNumSwarmVoices; ++i) {
-    swarm_voice_[i].Render(
-        f0,
-        density,
-        burst_mode,
-        start_burst,
-        spread,
-        size_ratio,
-        out,
-        aux,
-        size);
+    GrainEnvelope* e = &envelope_[i];
+    e->Step(density, burst_mode, start_burst);
+    amplitude[i] = e->amplitude(size_ratio) * scale;
+
+    const float expo_amount = e->frequency(size_ratio);
+    float f = f0 * SemitonesToRatio(48.0f * expo_amount * spread * rank_[i]);
+    
+    const float linear_amount = rank_[i] * (rank_[i] + 0.01f) * spread * 0.25f;
+    frequency[i] = f * (1.0f + linear_amount);
     size_ratio *= 0.97f;
   }
+  
+  oscillators_.Render(frequency, amplitude, out, aux, size);
 }
 
 }  // namespace plaits
@@ -29,6 +29,10 @@
 #ifndef PLAITS_DSP_ENGINE_SWARM_ENGINE_H_
 #define PLAITS_DSP_ENGINE_SWARM_ENGINE_H_
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif  // __SSE__
+
 #include "stmlib/dsp/polyblep.h"
 #include "stmlib/dsp/units.h"
 #include "stmlib/utils/random.h"
@@ -126,109 +130,282 @@ class GrainEnvelope {
   DISALLOW_COPY_AND_ASSIGN(GrainEnvelope);
 };
 
-class AdditiveSawOscillator {
+// The sawtooth and sine oscillators of all voices. Their states are stored
+// in parallel arrays, so that all voices are rendered in a single pass,
+// rather than one voice at a time.
+class SwarmOscillatorBank {
  public:
-  AdditiveSawOscillator() { }
-  ~AdditiveSawOscillator() { }
-
-  inline void Init() {
-    phase_ = 0.0f;
-    next_sample_ = 0.0f;
-    frequency_ = 0.01f;
-    gain_ = 0.0f;
-  }
+  SwarmOscillatorBank() { }
+  ~SwarmOscillatorBank() { }
 
-  inline void Render(
-      float frequency,
-      float level,
-      float* out,
+  void Init() {
+    for (int i = 0; i < kNumSwarmVoices; ++i) {
+      saw_phase_[i] = 0.0f;
+      saw_next_sample_[i] = 0.0f;
+      saw_frequency_[i] = 0.01f;
+      saw_gain_[i] = 0.0f;
+      sine_x_[i] = 1.0f;
+      sine_y_[i] = 0.0f;
+      sine_epsilon_[i] = 0.0f;
+      sine_amplitude_[i] = 0.0f;
+    }
+  }
+  
+  void Render(
+      const float* frequency,
+      const float* amplitude,
+      float* saw,
+      float* sine,
       size_t size) {
-    if (frequency >= kMaxFrequency) {
-      frequency = kMaxFrequency;
+#ifdef __SSE__
+    if (kNumSwarmVoices % 4 == 0) {
+      RenderSse(frequency, amplitude, saw, sine, size);
+      return;
     }
-    stmlib::ParameterInterpolator fm(&frequency_, frequency, size);
-    stmlib::ParameterInterpolator gain(&gain_, level, size);
-
-    float next_sample = next_sample_;
-    float phase = phase_;
-
-    while (size--) {
-      float this_sample = next_sample;
-      next_sample = 0.0f;
-
-      const float frequency = fm.Next();
-
-      phase += frequency;
+#endif  // __SSE__
+    RenderScalar(frequency, amplitude, saw, sine, size);
+  }
   
-      if (phase >= 1.0f) {
-        phase -= 1.0f;
-        float t = phase / frequency;
-        this_sample -= stmlib::ThisBlepSample(t);
-        next_sample -= stmlib::NextBlepSample(t);
+  // Same result as rendering each voice in turn with an AdditiveSawOscillator
+  // and a FastSineOscillator, down to the last bit.
+  void RenderScalar(
+      const float* frequency,
+      const float* amplitude,
+      float* saw,
+      float* sine,
+      size_t size) {
+    Parameters p;
+    ComputeParameters(frequency, amplitude, size, &p);
+    
+    while (size--) {
+      float saw_sum = 0.0f;
+      float sine_sum = 0.0f;
+      for (int i = 0; i < kNumSwarmVoices; ++i) {
+        float this_sample = saw_next_sample_[i];
+        float next_sample = 0.0f;
+        
+        saw_frequency_[i] += p.saw_frequency_increment[i];
+        const float f = saw_frequency_[i];
+        saw_phase_[i] += f;
+        if (saw_phase_[i] >= 1.0f) {
+          saw_phase_[i] -= 1.0f;
+          float t = saw_phase_[i] / f;
+          this_sample -= stmlib::ThisBlepSample(t);
+          next_sample -= stmlib::NextBlepSample(t);
+        }
+        saw_next_sample_[i] = next_sample + saw_phase_[i];
+        saw_gain_[i] += p.saw_gain_increment[i];
+        saw_sum += (2.0f * this_sample - 1.0f) * saw_gain_[i];
+        
+        sine_epsilon_[i] += p.sine_epsilon_increment[i];
+        const float e = sine_epsilon_[i];
+        sine_x_[i] += e * sine_y_[i];
+        sine_y_[i] -= e * sine_x_[i];
+        sine_amplitude_[i] += p.sine_amplitude_increment[i];
+        sine_sum += sine_amplitude_[i] * sine_x_[i];
       }
-
-      next_sample += phase;
-      *out++ += (2.0f * this_sample - 1.0f) * gain.Next();
+      *saw++ = saw_sum;
+      *sine++ = sine_sum;
     }
-    phase_ = phase;
-    next_sample_ = next_sample;
   }
 
  private:
-  // Oscillator state.
-  float phase_;
-  float next_sample_;
-
-  // For interpolation of parameters.
-  float frequency_;
-  float gain_;
-
-  DISALLOW_COPY_AND_ASSIGN(AdditiveSawOscillator);
-};
-
-class SwarmVoice {
- public:
-  SwarmVoice() { }
-  ~SwarmVoice() { }
+  // Values of the parameters at the end of the block, and their per-sample
+  // increments.
+  struct Parameters {
+    float saw_frequency[kNumSwarmVoices];
+    float saw_frequency_increment[kNumSwarmVoices];
+    float saw_gain[kNumSwarmVoices];
+    float saw_gain_increment[kNumSwarmVoices];
+    float sine_epsilon[kNumSwarmVoices];
+    float sine_epsilon_increment[kNumSwarmVoices];
+    float sine_amplitude[kNumSwarmVoices];
+    float sine_amplitude_increment[kNumSwarmVoices];
+  };
   
-  void Init(float rank) {
-    rank_ = rank;
-    envelope_.Init();
-    saw_.Init();
-    sine_.Init();
+  // Also keeps the amplitude of the sine oscillators from drifting.
+  void ComputeParameters(
+      const float* frequency,
+      const float* amplitude,
+      size_t size,
+      Parameters* p) {
+    const float size_f = static_cast<float>(size);
+    for (int i = 0; i < kNumSwarmVoices; ++i) {
+      float f = frequency[i];
+      if (f >= kMaxFrequency) {
+        f = kMaxFrequency;
+      }
+      p->saw_frequency[i] = f;
+      p->saw_gain[i] = amplitude[i];
+      
+      f = frequency[i];
+      float a = amplitude[i];
+      if (f >= 0.25f) {
+        f = 0.25f;
+        a = 0.0f;
+      } else {
+        a *= 1.0f - f * 4.0f;
+      }
+      p->sine_epsilon[i] = FastSineOscillator::Fast2Sin(f);
+      p->sine_amplitude[i] = a;
+      
+      p->saw_frequency_increment[i] = \
+          (p->saw_frequency[i] - saw_frequency_[i]) / size_f;
+      p->saw_gain_increment[i] = (p->saw_gain[i] - saw_gain_[i]) / size_f;
+      p->sine_epsilon_increment[i] = \
+          (p->sine_epsilon[i] - sine_epsilon_[i]) / size_f;
+      p->sine_amplitude_increment[i] = \
+          (p->sine_amplitude[i] - sine_amplitude_[i]) / size_f;
+      
+      const float norm = sine_x_[i] * sine_x_[i] + sine_y_[i] * sine_y_[i];
+      if (norm <= 0.5f || norm >= 2.0f) {
+        const float scale = stmlib::fast_rsqrt_carmack(norm);
+        sine_x_[i] *= scale;
+        sine_y_[i] *= scale;
+      }
+    }
   }
-  
-  void Render(
-      float f0,
-      float density,
-      bool burst_mode,
-      bool start_burst,
-      float spread,
-      float size_ratio,
+
+#ifdef __SSE__
+  // Same computations, 4 voices per vector. The contributions of the voices
+  // are summed 4 samples at a time, by transposing them.
+  void RenderSse(
+      const float* frequency,
+      const float* amplitude,
       float* saw,
       float* sine,
       size_t size) {
-    envelope_.Step(density, burst_mode, start_burst);
-    
-    const float scale = 1.0f / kNumSwarmVoices;
-    const float amplitude = envelope_.amplitude(size_ratio) * scale;
+    const int kNumVectors = kNumSwarmVoices / 4;
+    Parameters p;
+    ComputeParameters(frequency, amplitude, size, &p);
 
-    const float expo_amount = envelope_.frequency(size_ratio);
-    f0 *= stmlib::SemitonesToRatio(48.0f * expo_amount * spread * rank_);
+    __m128 saw_phase[kNumVectors];
+    __m128 saw_next_sample[kNumVectors];
+    __m128 saw_frequency[kNumVectors];
+    __m128 saw_frequency_increment[kNumVectors];
+    __m128 saw_gain[kNumVectors];
+    __m128 saw_gain_increment[kNumVectors];
+    __m128 sine_x[kNumVectors];
+    __m128 sine_y[kNumVectors];
+    __m128 sine_epsilon[kNumVectors];
+    __m128 sine_epsilon_increment[kNumVectors];
+    __m128 sine_amplitude[kNumVectors];
+    __m128 sine_amplitude_increment[kNumVectors];
+    for (int i = 0; i < kNumVectors; ++i) {
+      saw_phase[i] = _mm_loadu_ps(&saw_phase_[i * 4]);
+      saw_next_sample[i] = _mm_loadu_ps(&saw_next_sample_[i * 4]);
+      saw_frequency[i] = _mm_loadu_ps(&saw_frequency_[i * 4]);
+      saw_frequency_increment[i] = _mm_loadu_ps(
+          &p.saw_frequency_increment[i * 4]);
+      saw_gain[i] = _mm_loadu_ps(&saw_gain_[i * 4]);
+      saw_gain_increment[i] = _mm_loadu_ps(&p.saw_gain_increment[i * 4]);
+      sine_x[i] = _mm_loadu_ps(&sine_x_[i * 4]);
+      sine_y[i] = _mm_loadu_ps(&sine_y_[i * 4]);
+      sine_epsilon[i] = _mm_loadu_ps(&sine_epsilon_[i * 4]);
+      sine_epsilon_increment[i] = _mm_loadu_ps(
+          &p.sine_epsilon_increment[i * 4]);
+      sine_amplitude[i] = _mm_loadu_ps(&sine_amplitude_[i * 4]);
+      sine_amplitude_increment[i] = _mm_loadu_ps(
+          &p.sine_amplitude_increment[i * 4]);
+    }
     
-    const float linear_amount = rank_ * (rank_ + 0.01f) * spread * 0.25f;
-    f0 *= 1.0f + linear_amount;
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    while (size) {
+      __m128 saw_out[4];
+      __m128 sine_out[4];
+      const size_t block_size = size < 4 ? size : 4;
+      for (size_t t = 0; t < block_size; ++t) {
+        saw_out[t] = _mm_setzero_ps();
+        sine_out[t] = _mm_setzero_ps();
+        for (int i = 0; i < kNumVectors; ++i) {
+          __m128 this_sample = saw_next_sample[i];
+          
+          saw_frequency[i] = _mm_add_ps(
+              saw_frequency[i], saw_frequency_increment[i]);
+          saw_phase[i] = _mm_add_ps(saw_phase[i], saw_frequency[i]);
+          const __m128 wrap = _mm_cmpge_ps(saw_phase[i], one);
+          saw_phase[i] = _mm_sub_ps(saw_phase[i], _mm_and_ps(wrap, one));
+          // The lanes without a discontinuity are masked out, whatever the
+          // result of the division.
+          const __m128 t_0 = _mm_div_ps(saw_phase[i], saw_frequency[i]);
+          const __m128 t_1 = _mm_sub_ps(one, t_0);
+          this_sample = _mm_sub_ps(
+              this_sample,
+              _mm_and_ps(wrap, _mm_mul_ps(half, _mm_mul_ps(t_0, t_0))));
+          saw_next_sample[i] = _mm_add_ps(
+              _mm_and_ps(wrap, _mm_mul_ps(half, _mm_mul_ps(t_1, t_1))),
+              saw_phase[i]);
+          saw_gain[i] = _mm_add_ps(saw_gain[i], saw_gain_increment[i]);
+          saw_out[t] = _mm_add_ps(
+              saw_out[t],
+              _mm_mul_ps(
+                  _mm_sub_ps(_mm_mul_ps(two, this_sample), one),
+                  saw_gain[i]));
+          
+          sine_epsilon[i] = _mm_add_ps(
+              sine_epsilon[i], sine_epsilon_increment[i]);
+          sine_x[i] = _mm_add_ps(
+              sine_x[i], _mm_mul_ps(sine_epsilon[i], sine_y[i]));
+          sine_y[i] = _mm_sub_ps(
+              sine_y[i], _mm_mul_ps(sine_epsilon[i], sine_x[i]));
+          sine_amplitude[i] = _mm_add_ps(
+              sine_amplitude[i], sine_amplitude_increment[i]);
+          sine_out[t] = _mm_add_ps(
+              sine_out[t], _mm_mul_ps(sine_amplitude[i], sine_x[i]));
+        }
+      }
+      for (size_t t = block_size; t < 4; ++t) {
+        saw_out[t] = sine_out[t] = _mm_setzero_ps();
+      }
+      // Lane i of saw_out[j] is the contribution of voices i, i + 4... to
+      // sample j.
+      _MM_TRANSPOSE4_PS(saw_out[0], saw_out[1], saw_out[2], saw_out[3]);
+      _MM_TRANSPOSE4_PS(sine_out[0], sine_out[1], sine_out[2], sine_out[3]);
+      float saw_s[4];
+      float sine_s[4];
+      _mm_storeu_ps(saw_s, _mm_add_ps(
+          _mm_add_ps(saw_out[0], saw_out[1]),
+          _mm_add_ps(saw_out[2], saw_out[3])));
+      _mm_storeu_ps(sine_s, _mm_add_ps(
+          _mm_add_ps(sine_out[0], sine_out[1]),
+          _mm_add_ps(sine_out[2], sine_out[3])));
+      for (size_t t = 0; t < block_size; ++t) {
+        saw[t] = saw_s[t];
+        sine[t] = sine_s[t];
+      }
+      saw += block_size;
+      sine += block_size;
+      size -= block_size;
+    }
+    
+    for (int i = 0; i < kNumVectors; ++i) {
+      _mm_storeu_ps(&saw_phase_[i * 4], saw_phase[i]);
+      _mm_storeu_ps(&saw_next_sample_[i * 4], saw_next_sample[i]);
+      _mm_storeu_ps(&sine_x_[i * 4], sine_x[i]);
+      _mm_storeu_ps(&sine_y_[i * 4], sine_y[i]);
+      _mm_storeu_ps(&saw_frequency_[i * 4], saw_frequency[i]);
+      _mm_storeu_ps(&saw_gain_[i * 4], saw_gain[i]);
+      _mm_storeu_ps(&sine_epsilon_[i * 4], sine_epsilon[i]);
+      _mm_storeu_ps(&sine_amplitude_[i * 4], sine_amplitude[i]);
+    }
+  }
+#endif  // __SSE__
 
-    saw_.Render(f0, amplitude, saw, size);
-    sine_.Render(f0, amplitude, sine, size);
-  };
-  
- private:
-  float rank_;
+  // Oscillator state.
+  float saw_phase_[kNumSwarmVoices];
+  float saw_next_sample_[kNumSwarmVoices];
+  float sine_x_[kNumSwarmVoices];
+  float sine_y_[kNumSwarmVoices];
 
-  GrainEnvelope envelope_;
-  AdditiveSawOscillator saw_;
-  FastSineOscillator sine_;
+  // For interpolation of parameters.
+  float saw_frequency_[kNumSwarmVoices];
+  float saw_gain_[kNumSwarmVoices];
+  float sine_epsilon_[kNumSwarmVoices];
+  float sine_amplitude_[kNumSwarmVoices];
+  
+  DISALLOW_COPY_AND_ASSIGN(SwarmOscillatorBank);
 };
 
 class SwarmEngine : public Engine {
@@ -245,7 +422,9 @@ class SwarmEngine : public Engine {
       bool* already_enveloped);
   
  private:
-  SwarmVoice swarm_voice_[kNumSwarmVoices];
+  float rank_[kNumSwarmVoices];
+  GrainEnvelope envelope_[kNumSwarmVoices];
+  SwarmOscillatorBank oscillators_;
   
   DISALLOW_COPY_AND_ASSIGN(SwarmEngine);
 };
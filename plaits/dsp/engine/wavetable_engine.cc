@@ -29,6 +29,7 @@
 #include "plaits/dsp/engine/wavetable_engine.h"
 
 #include <algorithm>
+#include <cmath>
 
 #include "plaits/resources.h"
 
@@ -53,11 +54,19 @@ void WavetableEngine::Init(BufferAllocator* allocator) {
   previous_z_ = 0.0f;
   previous_f0_ = a0;
 
+  slice_caching_ = true;
+  slice_valid_ = false;
+  current_slice_ = 0;
+  slice_[0] = allocator->Allocate<float>(kSliceSize);
+  slice_[1] = allocator->Allocate<float>(kSliceSize);
+  slice_x_ = slice_y_ = slice_z_ = 0.0f;
+
   diff_out_.Init();
 }
 
 void WavetableEngine::Reset() {
-  
+  // The other engines share the RAM holding the slices.
+  slice_valid_ = false;
 }
 
 inline float Clamp(float x, float amount) {
@@ -71,6 +80,21 @@ inline float Clamp(float x, float amount) {
 const size_t table_size = 256;
 const float table_size_f = float(table_size);
 
+// Below this distance (in waves) between the current position in the terrain
+// and the one of the slice, the slice is reused. On the sweep of
+// TestWavetableSliceCaching, the error peaks at -41dB of the output (-21dB
+// with 1/128).
+const float kSliceTolerance = 1.0f / 1024.0f;
+
+// Above this distance travelled during a block, slices would be rebuilt too
+// often to be worth it.
+const float kSliceMaxTravel = kSliceTolerance * 0.25f;
+
+inline const int16_t* Wave(int x, int y, int z, int randomize) {
+  int wave = ((x + y * 8 + z * 64) * randomize) % 192;
+  return wav_integrated_waves + wave * (table_size + 4);
+}
+
 inline float ReadWave(
     int x,
     int y,
@@ -78,13 +102,110 @@ inline float ReadWave(
     int randomize,
     int phase_integral,
     float phase_fractional) {
-  int wave = ((x + y * 8 + z * 64) * randomize) % 192;
   return InterpolateWaveHermite(
-      wav_integrated_waves + wave * (table_size + 4),
+      Wave(x, y, z, randomize),
       phase_integral,
       phase_fractional);
 }
 
+inline int FoldZ(int z) {
+  return z >= 4 ? 7 - z : z;
+}
+
+inline int Randomize(int z) {
+  return z == 3 ? 101 : 1;
+}
+
+inline float Distance(
+    float x0,
+    float y0,
+    float z0,
+    float x1,
+    float y1,
+    float z1) {
+  return max(max(fabsf(x1 - x0), fabsf(y1 - y0)), fabsf(z1 - z0));
+}
+
+inline float ReadTerrain(
+    float x,
+    float y,
+    float z,
+    int p_integral,
+    float p_fractional) {
+  MAKE_INTEGRAL_FRACTIONAL(x);
+  MAKE_INTEGRAL_FRACTIONAL(y);
+  MAKE_INTEGRAL_FRACTIONAL(z);
+
+  int x0 = x_integral;
+  int x1 = x_integral + 1;
+  int y0 = y_integral;
+  int y1 = y_integral + 1;
+  int z0 = FoldZ(z_integral);
+  int z1 = FoldZ(z_integral + 1);
+
+  int r0 = Randomize(z0);
+  int r1 = Randomize(z1);
+
+  float x0y0z0 = ReadWave(x0, y0, z0, r0, p_integral, p_fractional);
+  float x1y0z0 = ReadWave(x1, y0, z0, r0, p_integral, p_fractional);
+  float xy0z0 = x0y0z0 + (x1y0z0 - x0y0z0) * x_fractional;
+
+  float x0y1z0 = ReadWave(x0, y1, z0, r0, p_integral, p_fractional);
+  float x1y1z0 = ReadWave(x1, y1, z0, r0, p_integral, p_fractional);
+  float xy1z0 = x0y1z0 + (x1y1z0 - x0y1z0) * x_fractional;
+
+  float xyz0 = xy0z0 + (xy1z0 - xy0z0) * y_fractional;
+
+  float x0y0z1 = ReadWave(x0, y0, z1, r1, p_integral, p_fractional);
+  float x1y0z1 = ReadWave(x1, y0, z1, r1, p_integral, p_fractional);
+  float xy0z1 = x0y0z1 + (x1y0z1 - x0y0z1) * x_fractional;
+
+  float x0y1z1 = ReadWave(x0, y1, z1, r1, p_integral, p_fractional);
+  float x1y1z1 = ReadWave(x1, y1, z1, r1, p_integral, p_fractional);
+  float xy1z1 = x0y1z1 + (x1y1z1 - x0y1z1) * x_fractional;
+
+  float xyz1 = xy0z1 + (xy1z1 - xy0z1) * y_fractional;
+
+  return xyz0 + (xyz1 - xyz0) * z_fractional;
+}
+
+// The Hermite interpolation is linear in the samples of the table, so reading
+// the blend of the 8 waves gives the same result as blending the 8 readings.
+void WavetableEngine::BuildSlice(float x, float y, float z, float* slice) {
+  MAKE_INTEGRAL_FRACTIONAL(x);
+  MAKE_INTEGRAL_FRACTIONAL(y);
+  MAKE_INTEGRAL_FRACTIONAL(z);
+
+  int x0 = x_integral;
+  int x1 = x_integral + 1;
+  int y0 = y_integral;
+  int y1 = y_integral + 1;
+  int z0 = FoldZ(z_integral);
+  int z1 = FoldZ(z_integral + 1);
+
+  int r0 = Randomize(z0);
+  int r1 = Randomize(z1);
+
+  const int16_t* x0y0z0 = Wave(x0, y0, z0, r0);
+  const int16_t* x1y0z0 = Wave(x1, y0, z0, r0);
+  const int16_t* x0y1z0 = Wave(x0, y1, z0, r0);
+  const int16_t* x1y1z0 = Wave(x1, y1, z0, r0);
+  const int16_t* x0y0z1 = Wave(x0, y0, z1, r1);
+  const int16_t* x1y0z1 = Wave(x1, y0, z1, r1);
+  const int16_t* x0y1z1 = Wave(x0, y1, z1, r1);
+  const int16_t* x1y1z1 = Wave(x1, y1, z1, r1);
+
+  for (size_t i = 0; i < kSliceSize; ++i) {
+    float xy0z0 = x0y0z0[i] + (x1y0z0[i] - x0y0z0[i]) * x_fractional;
+    float xy1z0 = x0y1z0[i] + (x1y1z0[i] - x0y1z0[i]) * x_fractional;
+    float xyz0 = xy0z0 + (xy1z0 - xy0z0) * y_fractional;
+    float xy0z1 = x0y0z1[i] + (x1y0z1[i] - x0y0z1[i]) * x_fractional;
+    float xy1z1 = x0y1z1[i] + (x1y1z1[i] - x0y1z1[i]) * x_fractional;
+    float xyz1 = xy0z1 + (xy1z1 - xy0z1) * y_fractional;
+    slice[i] = xyz0 + (xyz1 - xyz0) * z_fractional;
+  }
+}
+
 void WavetableEngine::Render(
     const EngineParameters& parameters,
     float* out,
@@ -121,24 +242,52 @@ void WavetableEngine::Render(
       &previous_z_, static_cast<float>(z_integral) + z_fractional, size);
 
   ParameterInterpolator f0_modulation(&previous_f0_, f0, size);
+
+  // Trajectory in the terrain during this block.
+  float x_lp[kMaxBlockSize];
+  float y_lp[kMaxBlockSize];
+  float z_lp[kMaxBlockSize];
+  const float x_start = x_lp_;
+  const float y_start = y_lp_;
+  const float z_start = z_lp_;
+  for (size_t i = 0; i < size; ++i) {
+    ONE_POLE(x_lp_, x_modulation.Next(), lp_coefficient);
+    ONE_POLE(y_lp_, y_modulation.Next(), lp_coefficient);
+    ONE_POLE(z_lp_, z_modulation.Next(), lp_coefficient);
+    x_lp[i] = x_lp_;
+    y_lp[i] = y_lp_;
+    z_lp[i] = z_lp_;
+  }
+
+  bool use_slice = slice_caching_ && Distance(
+      x_start, y_start, z_start, x_lp_, y_lp_, z_lp_) < kSliceMaxTravel;
+  const float* slice = slice_[current_slice_];
+  const float* next_slice = NULL;
+  if (!use_slice) {
+    slice_valid_ = false;
+  } else if (!slice_valid_ || Distance(
+      slice_x_, slice_y_, slice_z_, x_lp_, y_lp_, z_lp_) > kSliceTolerance) {
+    current_slice_ ^= 1;
+    BuildSlice(x_lp_, y_lp_, z_lp_, slice_[current_slice_]);
+    slice_x_ = x_lp_;
+    slice_y_ = y_lp_;
+    slice_z_ = z_lp_;
+    if (slice_valid_) {
+      next_slice = slice_[current_slice_];
+    } else {
+      // Nothing to crossfade from.
+      slice = slice_[current_slice_];
+      slice_valid_ = true;
+    }
+  }
   
-  while (size--) {
+  const float fade_increment = 1.0f / static_cast<float>(size);
+  float fade = 0.0f;
+  for (size_t i = 0; i < size; ++i) {
     const float f0 = f0_modulation.Next();
     
     const float gain = (1.0f / (f0 * 131072.0f)) * (0.95f - f0);
     const float cutoff = min(table_size_f * f0, 1.0f);
-    
-    ONE_POLE(x_lp_, x_modulation.Next(), lp_coefficient);
-    ONE_POLE(y_lp_, y_modulation.Next(), lp_coefficient);
-    ONE_POLE(z_lp_, z_modulation.Next(), lp_coefficient);
-    
-    const float x = x_lp_;
-    const float y = y_lp_;
-    const float z = z_lp_;
-
-    MAKE_INTEGRAL_FRACTIONAL(x);
-    MAKE_INTEGRAL_FRACTIONAL(y);
-    MAKE_INTEGRAL_FRACTIONAL(z);
 
     phase_ += f0;
     if (phase_ >= 1.0f) {
@@ -148,49 +297,21 @@ void WavetableEngine::Render(
     const float p = phase_ * table_size_f;
     MAKE_INTEGRAL_FRACTIONAL(p);
     
-    {
-      int x0 = x_integral;
-      int x1 = x_integral + 1;
-      int y0 = y_integral;
-      int y1 = y_integral + 1;
-      int z0 = z_integral;
-      int z1 = z_integral + 1;
-      
-      if (z0 >= 4) {
-        z0 = 7 - z0;
-      }
-      if (z1 >= 4) {
-        z1 = 7 - z1;
+    float mix;
+    if (!use_slice) {
+      mix = ReadTerrain(x_lp[i], y_lp[i], z_lp[i], p_integral, p_fractional);
+    } else {
+      mix = InterpolateWaveHermite(slice, p_integral, p_fractional);
+      if (next_slice) {
+        fade += fade_increment;
+        float next = InterpolateWaveHermite(
+            next_slice, p_integral, p_fractional);
+        mix += (next - mix) * fade;
       }
-      
-      int r0 = z0 == 3 ? 101 : 1;
-      int r1 = z1 == 3 ? 101 : 1;
-
-      float x0y0z0 = ReadWave(x0, y0, z0, r0, p_integral, p_fractional);
-      float x1y0z0 = ReadWave(x1, y0, z0, r0, p_integral, p_fractional);
-      float xy0z0 = x0y0z0 + (x1y0z0 - x0y0z0) * x_fractional;
-
-      float x0y1z0 = ReadWave(x0, y1, z0, r0, p_integral, p_fractional); 
-      float x1y1z0 = ReadWave(x1, y1, z0, r0, p_integral, p_fractional);
-      float xy1z0 = x0y1z0 + (x1y1z0 - x0y1z0) * x_fractional;
-
-      float xyz0 = xy0z0 + (xy1z0 - xy0z0) * y_fractional;
-
-      float x0y0z1 = ReadWave(x0, y0, z1, r1, p_integral, p_fractional);
-      float x1y0z1 = ReadWave(x1, y0, z1, r1, p_integral, p_fractional);
-      float xy0z1 = x0y0z1 + (x1y0z1 - x0y0z1) * x_fractional;
-
-      float x0y1z1 = ReadWave(x0, y1, z1, r1, p_integral, p_fractional);
-      float x1y1z1 = ReadWave(x1, y1, z1, r1, p_integral, p_fractional);
-      float xy1z1 = x0y1z1 + (x1y1z1 - x0y1z1) * x_fractional;
-      
-      float xyz1 = xy0z1 + (xy1z1 - xy0z1) * y_fractional;
-
-      float mix = xyz0 + (xyz1 - xyz0) * z_fractional;
-      mix = diff_out_.Process(cutoff, mix) * gain;
-      *out++ = mix;
-      *aux++ = static_cast<float>(static_cast<int>(mix * 32.0f)) / 32.0f;
     }
+    mix = diff_out_.Process(cutoff, mix) * gain;
+    *out++ = mix;
+    *aux++ = static_cast<float>(static_cast<int>(mix * 32.0f)) / 32.0f;
   }
 }
 
@@ -48,8 +48,23 @@ class WavetableEngine : public Engine {
       float* aux,
       size_t size,
       bool* already_enveloped);
+
+  // When the position in the terrain moves slowly, the 8 waves surrounding
+  // it are blended once into a single wave (a "slice"), which is then read
+  // with one lookup per sample instead of 8. Consecutive slices are
+  // crossfaded. Fast movements are still rendered directly from the terrain.
+  inline void set_slice_caching(bool slice_caching) {
+    slice_caching_ = slice_caching;
+    slice_valid_ = false;
+  }
   
  private:
+  // One wave of the terrain, with the guard samples needed by the
+  // interpolation.
+  static const size_t kSliceSize = 256 + 4;
+
+  void BuildSlice(float x, float y, float z, float* slice);
+
   float phase_;
   
   float x_pre_lp_;
@@ -64,6 +79,14 @@ class WavetableEngine : public Engine {
   float previous_y_;
   float previous_z_;
   float previous_f0_;
+
+  bool slice_caching_;
+  bool slice_valid_;
+  int current_slice_;
+  float* slice_[2];
+  float slice_x_;
+  float slice_y_;
+  float slice_z_;
   
   Differentiator diff_out_;
   
@@ -31,6 +31,10 @@
 #ifndef PLAITS_DSP_OSCILLATOR_HARMONIC_OSCILLATOR_H_
 #define PLAITS_DSP_OSCILLATOR_HARMONIC_OSCILLATOR_H_
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif  // __SSE__
+
 #include "stmlib/dsp/dsp.h"
 #include "stmlib/dsp/parameter_interpolator.h"
 
@@ -38,6 +42,10 @@
 
 namespace plaits {
 
+// Harmonics whose amplitude stays below this level during a block are not
+// rendered.
+const float kHarmonicAudibilityThreshold = 1.0e-5f;
+
 template<int num_harmonics>
 class HarmonicOscillator {
  public:
@@ -52,6 +60,8 @@ class HarmonicOscillator {
     }
   }
   
+  // The recurrence is stopped after the last audible harmonic. Harmonics
+  // above Nyquist have a null amplitude, so they are never rendered.
   template<int first_harmonic_index>
   void Render(
       float frequency,
@@ -62,15 +72,102 @@ class HarmonicOscillator {
       frequency = 0.5f;
     }
     
-    stmlib::ParameterInterpolator am[num_harmonics];
-    stmlib::ParameterInterpolator fm(&frequency_, frequency, size);
+    float target[num_harmonics];
+    ComputeTargetAmplitudes<first_harmonic_index>(
+        frequency, amplitudes, target);
+    int num_active = num_harmonics;
+    while (num_active && \
+        target[num_active - 1] < kHarmonicAudibilityThreshold && \
+        amplitude_[num_active - 1] < kHarmonicAudibilityThreshold) {
+      --num_active;
+      amplitude_[num_active] = target[num_active];
+    }
     
+    if (!num_active) {
+      stmlib::ParameterInterpolator fm(&frequency_, frequency, size);
+      while (size--) {
+        phase_ += fm.Next();
+        if (phase_ >= 1.0f) {
+          phase_ -= 1.0f;
+        }
+        if (first_harmonic_index == 1) {
+          *out++ = 0.0f;
+        }
+      }
+      return;
+    }
+
+#ifdef __SSE__
+    RenderSse<first_harmonic_index>(
+        frequency, target, num_active, out, size);
+#else
+    RenderScalar<first_harmonic_index>(
+        frequency, target, num_active, out, size);
+#endif  // __SSE__
+  }
+  
+  // Renders all harmonics, one sample at a time.
+  template<int first_harmonic_index>
+  void RenderScalar(
+      float frequency,
+      const float* amplitudes,
+      float* out,
+      size_t size) {
+    if (frequency >= 0.5f) {
+      frequency = 0.5f;
+    }
+    
+    float target[num_harmonics];
+    ComputeTargetAmplitudes<first_harmonic_index>(
+        frequency, amplitudes, target);
+    RenderScalar<first_harmonic_index>(
+        frequency, target, num_harmonics, out, size);
+  }
+
+ private:
+  template<int first_harmonic_index>
+  void ComputeTargetAmplitudes(
+      float frequency,
+      const float* amplitudes,
+      float* target) {
     for (int i = 0; i < num_harmonics; ++i) {
       float f = frequency * static_cast<float>(first_harmonic_index + i);
       if (f >= 0.5f) {
         f = 0.5f;
       }
-      am[i].Init(&amplitude_[i], amplitudes[i] * (1.0f - f * 2.0f), size);
+      target[i] = amplitudes[i] * (1.0f - f * 2.0f);
+    }
+  }
+  
+  template<int first_harmonic_index>
+  inline void ComputeRecurrenceSeeds(
+      float* two_x,
+      float* previous,
+      float* current) {
+    *two_x = 2.0f * stmlib::Interpolate(lut_sine, phase_, 1024.0f);
+    if (first_harmonic_index == 1) {
+      *previous = 1.0f;
+      *current = *two_x * 0.5f;
+    } else {
+      const float k = first_harmonic_index;
+      *previous = stmlib::InterpolateWrap(
+          lut_sine, phase_ * (k - 1.0f) + 0.25f, 1024.0f);
+      *current = stmlib::InterpolateWrap(lut_sine, phase_ * k, 1024.0f);
+    }
+  }
+  
+  template<int first_harmonic_index>
+  void RenderScalar(
+      float frequency,
+      const float* target,
+      int num_active,
+      float* out,
+      size_t size) {
+    stmlib::ParameterInterpolator am[num_harmonics];
+    stmlib::ParameterInterpolator fm(&frequency_, frequency, size);
+    
+    for (int i = 0; i < num_active; ++i) {
+      am[i].Init(&amplitude_[i], target[i], size);
     }
 
     while (size--) {
@@ -78,20 +175,12 @@ class HarmonicOscillator {
       if (phase_ >= 1.0f) {
         phase_ -= 1.0f;
       }
-      const float two_x = 2.0f * stmlib::Interpolate(lut_sine, phase_, 1024.0f);
-      float previous, current;
-      if (first_harmonic_index == 1) {
-        previous = 1.0f;
-        current = two_x * 0.5f;
-      } else {
-        const float k = first_harmonic_index;
-        previous = stmlib::InterpolateWrap(
-            lut_sine, phase_ * (k - 1.0f) + 0.25f, 1024.0f);
-        current = stmlib::InterpolateWrap(lut_sine, phase_ * k, 1024.0f);
-      }
+      float two_x, previous, current;
+      ComputeRecurrenceSeeds<first_harmonic_index>(
+          &two_x, &previous, &current);
       
       float sum = 0.0f;
-      for (int i = 0; i < num_harmonics; ++i) {
+      for (int i = 0; i < num_active; ++i) {
         sum += am[i].Next() * current;
         float temp = current;
         current = two_x * current - previous;
@@ -105,7 +194,79 @@ class HarmonicOscillator {
     }
   }
 
- private:
+#ifdef __SSE__
+  // The recurrence runs along the harmonics, so it cannot be split across
+  // lanes. Instead, each lane holds one of 4 consecutive samples.
+  template<int first_harmonic_index>
+  void RenderSse(
+      float frequency,
+      const float* target,
+      int num_active,
+      float* out,
+      size_t size) {
+    const float size_f = static_cast<float>(size);
+    float increment[num_harmonics];
+    for (int i = 0; i < num_active; ++i) {
+      increment[i] = (target[i] - amplitude_[i]) / size_f;
+    }
+    stmlib::ParameterInterpolator fm(&frequency_, frequency, size);
+    const __m128 ramp = _mm_set_ps(4.0f, 3.0f, 2.0f, 1.0f);
+    
+    while (size) {
+      const size_t n = size < 4 ? size : 4;
+      float two_x_s[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+      float previous_s[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+      float current_s[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+      for (size_t t = 0; t < n; ++t) {
+        phase_ += fm.Next();
+        if (phase_ >= 1.0f) {
+          phase_ -= 1.0f;
+        }
+        ComputeRecurrenceSeeds<first_harmonic_index>(
+            &two_x_s[t], &previous_s[t], &current_s[t]);
+      }
+      const __m128 two_x = _mm_loadu_ps(two_x_s);
+      __m128 previous = _mm_loadu_ps(previous_s);
+      __m128 current = _mm_loadu_ps(current_s);
+      __m128 sum = _mm_setzero_ps();
+      for (int i = 0; i < num_active; ++i) {
+        const __m128 amplitude = _mm_add_ps(
+            _mm_set1_ps(amplitude_[i]),
+            _mm_mul_ps(_mm_set1_ps(increment[i]), ramp));
+        sum = _mm_add_ps(sum, _mm_mul_ps(amplitude, current));
+        const __m128 temp = current;
+        current = _mm_sub_ps(_mm_mul_ps(two_x, current), previous);
+        previous = temp;
+        amplitude_[i] += increment[i] * static_cast<float>(n);
+      }
+      
+      if (n == 4) {
+        if (first_harmonic_index == 1) {
+          _mm_storeu_ps(out, sum);
+        } else {
+          _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), sum));
+        }
+      } else {
+        float sum_s[4];
+        _mm_storeu_ps(sum_s, sum);
+        for (size_t t = 0; t < n; ++t) {
+          if (first_harmonic_index == 1) {
+            out[t] = sum_s[t];
+          } else {
+            out[t] += sum_s[t];
+          }
+        }
+      }
+      out += n;
+      size -= n;
+    }
+    
+    for (int i = 0; i < num_active; ++i) {
+      amplitude_[i] = target[i];
+    }
+  }
+#endif  // __SSE__
+
   // Oscillator state.
   float phase_;
 
@@ -70,8 +70,9 @@ inline float InterpolateWave(
   return a + (b - a) * t;
 }
 
+template<typename T>
 inline float InterpolateWaveHermite(
-    const int16_t* table,
+    const T* table,
     int32_t index_integral,
     float index_fractional) {
   const float xm1 = table[index_integral];
@@ -131,6 +131,23 @@ void Resonator::Process(
     harmonic += f0;
     q *= q_loss;
   }
+  
+  // Render the modes of an incomplete batch, with silent modes filling the
+  // remaining slots.
+  if (batch_counter) {
+    for (int i = batch_counter; i < kModeBatchSize; ++i) {
+      mode_f[i] = 0.01f;
+      mode_q[i] = 1.0f;
+      mode_a[i] = 0.0f;
+    }
+    batch_processor->Process<FILTER_MODE_BAND_PASS, true>(
+        mode_f,
+        mode_q,
+        mode_a,
+        in,
+        out,
+        size);
+  }
 }
 
 }  // namespace plaits
@@ -29,12 +29,24 @@
 #ifndef PLAITS_DSP_PHYSICAL_MODELLING_RESONATOR_H_
 #define PLAITS_DSP_PHYSICAL_MODELLING_RESONATOR_H_
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif  // __SSE__
+
 #include "stmlib/dsp/filter.h"
 
 namespace plaits {
 
 const int kMaxNumModes = 24;
+
+#ifdef __SSE__
+// The recursion of each mode is a long chain of dependent operations. On x86
+// hosts, all modes are rendered in a single pass, so that the SIMD kernel has
+// 6 independent chains to interleave.
+const int kModeBatchSize = kMaxNumModes;
+#else
 const int kModeBatchSize = 4;
+#endif  // __SSE__
 
 // We render 4 modes simultaneously since there are enough registers to hold
 // all state variables.
@@ -58,18 +70,31 @@ class ResonatorSvf {
       const float* in,
       float* out,
       size_t size) {
+#ifdef __SSE__
+    if (batch_size % 4 == 0) {
+      ProcessSse<mode, add>(f, q, gain, in, out, size);
+      return;
+    }
+#endif  // __SSE__
+    ProcessScalar<mode, add>(f, q, gain, in, out, size);
+  }
+  
+  template<stmlib::FilterMode mode, bool add>
+  void ProcessScalar(
+      const float* f,
+      const float* q,
+      const float* gain,
+      const float* in,
+      float* out,
+      size_t size) {
     float g[batch_size];
-    float r[batch_size];
     float r_plus_g[batch_size];
     float h[batch_size];
     float state_1[batch_size];
     float state_2[batch_size];
     float gains[batch_size];
+    ComputeCoefficients(f, q, g, r_plus_g, h);
     for (int i = 0; i < batch_size; ++i) {
-      g[i] = stmlib::OnePole::tan<stmlib::FREQUENCY_FAST>(f[i]);
-      r[i] = 1.0f / q[i];
-      h[i] = 1.0f / (1.0f + r[i] * g[i] + g[i] * g[i]);
-      r_plus_g[i] = r[i] + g[i];
       state_1[i] = state_1_[i];
       state_2[i] = state_2_[i];
       gains[i] = gain[i];
@@ -97,8 +122,112 @@ class ResonatorSvf {
       state_2_[i] = state_2[i];
     }
   }
+
+#ifdef __SSE__
+  // Same computations, 4 modes per vector. The contributions of the modes
+  // are summed 4 samples at a time, by transposing them, rather than once
+  // per sample. With a batch of 4 modes, the result is the same as the one
+  // of ProcessScalar, down to the last bit.
+  template<stmlib::FilterMode mode, bool add>
+  void ProcessSse(
+      const float* f,
+      const float* q,
+      const float* gain,
+      const float* in,
+      float* out,
+      size_t size) {
+    const int num_vectors = batch_size / 4;
+    float g_s[batch_size];
+    float r_plus_g_s[batch_size];
+    float h_s[batch_size];
+    ComputeCoefficients(f, q, g_s, r_plus_g_s, h_s);
+    
+    __m128 g[kNumVectors];
+    __m128 r_plus_g[kNumVectors];
+    __m128 h[kNumVectors];
+    __m128 gains[kNumVectors];
+    __m128 state_1[kNumVectors];
+    __m128 state_2[kNumVectors];
+    for (int i = 0; i < num_vectors; ++i) {
+      g[i] = _mm_loadu_ps(&g_s[i * 4]);
+      r_plus_g[i] = _mm_loadu_ps(&r_plus_g_s[i * 4]);
+      h[i] = _mm_loadu_ps(&h_s[i * 4]);
+      gains[i] = _mm_loadu_ps(&gain[i * 4]);
+      state_1[i] = _mm_loadu_ps(&state_1_[i * 4]);
+      state_2[i] = _mm_loadu_ps(&state_2_[i * 4]);
+    }
+    
+    while (size) {
+      __m128 s_out[4];
+      const size_t block_size = size < 4 ? size : 4;
+      for (size_t t = 0; t < block_size; ++t) {
+        const __m128 s_in = _mm_set1_ps(in[t]);
+        s_out[t] = _mm_setzero_ps();
+        for (int i = 0; i < num_vectors; ++i) {
+          const __m128 hp = _mm_mul_ps(
+              _mm_sub_ps(
+                  _mm_sub_ps(s_in, _mm_mul_ps(r_plus_g[i], state_1[i])),
+                  state_2[i]),
+              h[i]);
+          const __m128 bp = _mm_add_ps(_mm_mul_ps(g[i], hp), state_1[i]);
+          state_1[i] = _mm_add_ps(_mm_mul_ps(g[i], hp), bp);
+          const __m128 lp = _mm_add_ps(_mm_mul_ps(g[i], bp), state_2[i]);
+          state_2[i] = _mm_add_ps(_mm_mul_ps(g[i], bp), lp);
+          s_out[t] = _mm_add_ps(
+              s_out[t],
+              _mm_mul_ps(
+                  gains[i],
+                  (mode == stmlib::FILTER_MODE_LOW_PASS) ? lp : bp));
+        }
+      }
+      for (size_t t = block_size; t < 4; ++t) {
+        s_out[t] = _mm_setzero_ps();
+      }
+      // Lane i of s_out[j] is the contribution of mode i to sample j.
+      _MM_TRANSPOSE4_PS(s_out[0], s_out[1], s_out[2], s_out[3]);
+      __m128 sum = _mm_add_ps(
+          _mm_add_ps(_mm_add_ps(s_out[0], s_out[1]), s_out[2]), s_out[3]);
+      float sum_s[4];
+      _mm_storeu_ps(sum_s, sum);
+      for (size_t t = 0; t < block_size; ++t) {
+        if (add) {
+          out[t] += sum_s[t];
+        } else {
+          out[t] = sum_s[t];
+        }
+      }
+      in += block_size;
+      out += block_size;
+      size -= block_size;
+    }
+    for (int i = 0; i < num_vectors; ++i) {
+      _mm_storeu_ps(&state_1_[i * 4], state_1[i]);
+      _mm_storeu_ps(&state_2_[i * 4], state_2[i]);
+    }
+  }
+#endif  // __SSE__
   
  private:
+#ifdef __SSE__
+  // Never 0, so that the arrays are valid for the batch sizes which are not
+  // multiple of 4, and not processed with SSE.
+  static const int kNumVectors = (batch_size + 3) / 4;
+#endif  // __SSE__
+
+  void ComputeCoefficients(
+      const float* f,
+      const float* q,
+      float* g,
+      float* r_plus_g,
+      float* h) {
+    for (int i = 0; i < batch_size; ++i) {
+      g[i] = stmlib::OnePole::tan<stmlib::FREQUENCY_FAST>(f[i]);
+      const float r = 1.0f / q[i];
+      h[i] = 1.0f / (1.0f + r * g[i] + g[i] * g[i]);
+      r_plus_g[i] = r + g[i];
+    }
+  }
+
   float state_1_[batch_size];
   float state_2_[batch_size];
   
@@ -125,12 +125,31 @@ void LPCSpeechSynthWordBank::Reset() {
   loaded_bank_ = -1;
   num_frames_ = 0;
   num_words_ = 0;
-  fill(
-      &word_boundaries_[0],
-      &word_boundaries_[kLPCSpeechSynthMaxWords], 0);
+  decoded_words_ = 0;
+  word_boundaries_ = NULL;
 }
 
-size_t LPCSpeechSynthWordBank::LoadNextWord(const uint8_t* data) {
+void LPCSpeechSynthWordBank::DecodeWord(int word) {
+  if (decoded_words_ & (1UL << word)) {
+    return;
+  }
+  const LPCSpeechSynthWordBankData& bank = word_banks_[loaded_bank_];
+  int num_frames = word_boundaries_[word];
+  LoadNextWord(bank.data + bank.word_offsets[word], &num_frames);
+  decoded_words_ |= 1UL << word;
+}
+
+void LPCSpeechSynthWordBank::DecodeFrames(int first, int last) {
+  for (int word = 0; word < num_words_; ++word) {
+    if (word_boundaries_[word] <= last && word_boundaries_[word + 1] > first) {
+      DecodeWord(word);
+    }
+  }
+}
+
+size_t LPCSpeechSynthWordBank::LoadNextWord(
+    const uint8_t* data,
+    int* num_frames) {
   BitStream bitstream;
   bitstream.Init(data);
 
@@ -174,7 +193,7 @@ size_t LPCSpeechSynthWordBank::LoadNextWord(const uint8_t* data) {
         }
       }
     }
-    frames_[num_frames_++] = frame;
+    frames_[(*num_frames)++] = frame;
   }
   return bitstream.ptr() - data;
 }
@@ -184,21 +203,10 @@ bool LPCSpeechSynthWordBank::Load(int bank) {
     return false;
   }
 
-  num_frames_ = 0;
-  num_words_ = 0;
-  
-  const uint8_t* data = word_banks_[bank].data;
-  size_t size = word_banks_[bank].size;
-  
-  while (size) {
-    word_boundaries_[num_words_] = num_frames_;
-    size_t consumed = LoadNextWord(data);
-
-    data += consumed;
-    size -= consumed;
-    ++num_words_;
-  }
-  word_boundaries_[num_words_] = num_frames_;
+  num_words_ = word_banks_[bank].num_words;
+  word_boundaries_ = word_banks_[bank].word_boundaries;
+  num_frames_ = word_boundaries_[num_words_];
+  decoded_words_ = 0;
   loaded_bank_ = bank;
   return true;
 }
@@ -276,10 +284,12 @@ void LPCSpeechSynthController::Render(
   }
   
   if (playback_frame_ == -1 && remaining_frame_samples_ == 0) {
-    synth_.PlayFrame(
-        frames,
-        address * (static_cast<float>(num_frames) - 1.0001f),
-        true);
+    const float frame = address * (static_cast<float>(num_frames) - 1.0001f);
+    if (bank != -1) {
+      const int frame_integral = static_cast<int>(frame);
+      word_bank_->DecodeFrames(frame_integral, frame_integral + 1);
+    }
+    synth_.PlayFrame(frames, frame, true);
   } else {
     if (remaining_frame_samples_ == 0) {
       synth_.PlayFrame(frames, float(playback_frame_), false);
@@ -84,6 +84,7 @@ class BitStream {
   DISALLOW_COPY_AND_ASSIGN(BitStream);
 };
 
+// One bit per word in a bitmask of the decoded words.
 const int kLPCSpeechSynthMaxWords = 32;
 const int kLPCSpeechSynthMaxFrames = 1024;
 const int kLPCSpeechSynthNumVowels = 5;
@@ -95,6 +96,10 @@ const float kLPCSpeechSynthFPS = 40.0f;
 struct LPCSpeechSynthWordBankData {
   const uint8_t* data;
   size_t size;
+  int num_words;
+  const uint16_t* word_offsets;
+  // num_words + 1 entries, the last one being the number of frames.
+  const uint16_t* word_boundaries;
 };
 
 class LPCSpeechSynthWordBank {
@@ -107,9 +112,14 @@ class LPCSpeechSynthWordBank {
       int num_banks,
       stmlib::BufferAllocator* allocator);
   
+  // Loading a bank does not decode it. Its words are decoded when they are
+  // first played, so that no single block has to decode a whole bank.
   bool Load(int index);
   void Reset();
   
+  // Decodes the words containing the frames first to last, if needed.
+  void DecodeFrames(int first, int last);
+  
   inline int num_frames() const { return num_frames_; }
   inline const LPCSpeechSynth::Frame* frames() const { return frames_; }
   
@@ -121,13 +131,15 @@ class LPCSpeechSynthWordBank {
       if (word >= num_words_) {
         word = num_words_ - 1;
       }
+      DecodeWord(word);
       *start = word_boundaries_[word];
       *end = word_boundaries_[word + 1] - 1;
     }
   }
   
  private:
-  size_t LoadNextWord(const uint8_t* data);
+  void DecodeWord(int word);
+  size_t LoadNextWord(const uint8_t* data, int* num_frames);
   
   const LPCSpeechSynthWordBankData* word_banks_;
   
@@ -135,7 +147,8 @@ class LPCSpeechSynthWordBank {
   int loaded_bank_;
   int num_frames_;
   int num_words_;
-  int word_boundaries_[kLPCSpeechSynthMaxWords];
+  const uint16_t* word_boundaries_;
+  uint32_t decoded_words_;
   
   LPCSpeechSynth::Frame* frames_;
   
@@ -1561,13 +1561,74 @@ const uint8_t bank_4[] = {
   0xe0, 0xff
 };
 
+// Offset of each word in its bank, and index of its first frame once
+// decoded, followed by the number of frames in the bank. Finding the words
+// requires decoding the whole bank, so they are listed here rather than in
+// RAM.
+
+/* extern */
+const uint16_t bank_0_word_offsets[] = {
+  0, 123, 284, 481, 647, 812, 1034
+};
+
+/* extern */
+const uint16_t bank_0_word_boundaries[] = {
+  0, 26, 57, 92, 123, 153, 192, 229
+};
+
+/* extern */
+const uint16_t bank_1_word_offsets[] = {
+  0, 77, 144, 199, 274, 348, 430, 513, 606, 672, 817
+};
+
+/* extern */
+const uint16_t bank_1_word_boundaries[] = {
+  0, 24, 44, 61, 84, 104, 132, 155, 174, 189, 213, 229
+};
+
+/* extern */
+const uint16_t bank_2_word_offsets[] = {
+  0, 46, 95, 161, 211, 264, 321, 383, 442, 508, 574, 638, 700, 762, 825, 870,
+  924, 975, 1019, 1067, 1124, 1185, 1268, 1369, 1426, 1492
+};
+
+/* extern */
+const uint16_t bank_2_word_boundaries[] = {
+  0, 19, 37, 62, 72, 93, 112, 134, 160, 183, 205, 227, 244, 268, 289, 304,
+  322, 340, 354, 373, 392, 408, 433, 457, 479, 502, 524
+};
+
+/* extern */
+const uint16_t bank_3_word_offsets[] = {
+  0, 100, 188, 286, 369, 435, 583, 638, 755, 851, 952, 1028, 1095, 1161, 1316,
+  1409, 1474, 1545, 1640, 1790, 1909, 2035, 2149, 2238, 2354, 2452
+};
+
+/* extern */
+const uint16_t bank_3_word_boundaries[] = {
+  0, 20, 43, 61, 79, 100, 136, 157, 184, 204, 234, 256, 276, 296, 322, 348,
+  365, 388, 411, 439, 460, 493, 517, 542, 565, 585, 604
+};
+
+/* extern */
+const uint16_t bank_4_word_offsets[] = {
+  0, 198, 361, 516, 744, 922, 1202, 1378, 1642, 1894, 2102, 2259, 2453, 2687,
+  2972, 3203, 3432, 3591, 3832, 4119, 4353, 4544
+};
+
+/* extern */
+const uint16_t bank_4_word_boundaries[] = {
+  0, 36, 72, 108, 151, 186, 241, 277, 329, 375, 416, 445, 483, 524, 574, 617,
+  661, 692, 739, 797, 840, 880, 926
+};
+
 /* extern */
 LPCSpeechSynthWordBankData word_banks_[] = {
-  { bank_0, 1233 },
-  { bank_1, 900 },
-  { bank_2, 1552 },
-  { bank_3, 2524 },
-  { bank_4, 4802 },
+  { bank_0, 1233, 7, bank_0_word_offsets, bank_0_word_boundaries },
+  { bank_1, 900, 11, bank_1_word_offsets, bank_1_word_boundaries },
+  { bank_2, 1552, 26, bank_2_word_offsets, bank_2_word_boundaries },
+  { bank_3, 2524, 26, bank_3_word_offsets, bank_3_word_boundaries },
+  { bank_4, 4802, 22, bank_4_word_offsets, bank_4_word_boundaries },
 };
 
 }  // namespace plaits
\ No newline at end of file
@@ -41,6 +41,17 @@ extern const uint8_t bank_2[1552];
 extern const uint8_t bank_3[2524];
 extern const uint8_t bank_4[4802];
 
+extern const uint16_t bank_0_word_offsets[7];
+extern const uint16_t bank_0_word_boundaries[8];
+extern const uint16_t bank_1_word_offsets[11];
+extern const uint16_t bank_1_word_boundaries[12];
+extern const uint16_t bank_2_word_offsets[26];
+extern const uint16_t bank_2_word_boundaries[27];
+extern const uint16_t bank_3_word_offsets[26];
+extern const uint16_t bank_3_word_boundaries[27];
+extern const uint16_t bank_4_word_offsets[22];
+extern const uint16_t bank_4_word_boundaries[23];
+
 extern LPCSpeechSynthWordBankData word_banks_[LPC_SPEECH_SYNTH_NUM_WORD_BANKS];
 
 }  // namespace plaits
@@ -34,6 +34,33 @@ using namespace std;
 using namespace stmlib;
 
 void Voice::Init(BufferAllocator* allocator) {
+  RegisterEngines();
+  for (int i = 0; i < engines_.size(); ++i) {
+    // All engines will share the same RAM space.
+    allocator->Free();
+    engines_.get(i)->Init(allocator);
+  }
+#ifdef TEST
+  dedicated_ram_ = false;
+#endif  // TEST
+  InitState();
+}
+
+#ifdef TEST
+void Voice::InitWithDedicatedRam(BufferAllocator* allocator) {
+  RegisterEngines();
+  for (int i = 0; i < engines_.size(); ++i) {
+    const size_t size = kSharedRamSize / sizeof(float);
+    BufferAllocator engine_allocator(
+        allocator->Allocate<float>(size), size * sizeof(float));
+    engines_.get(i)->Init(&engine_allocator);
+  }
+  dedicated_ram_ = true;
+  InitState();
+}
+#endif  // TEST
+
+void Voice::RegisterEngines() {
   engines_.Init();
   engines_.RegisterInstance(&virtual_analog_engine_, false, 0.8f, 0.8f);
   engines_.RegisterInstance(&waveshaping_engine_, false, 0.7f, 0.6f);
@@ -52,24 +79,29 @@ void Voice::Init(BufferAllocator* allocator) {
   engines_.RegisterInstance(&bass_drum_engine_, true, 0.8f, 0.8f);
   engines_.RegisterInstance(&snare_drum_engine_, true, 0.8f, 0.8f);
   engines_.RegisterInstance(&hi_hat_engine_, true, 0.8f, 0.8f);
-  for (int i = 0; i < engines_.size(); ++i) {
-    // All engines will share the same RAM space.
-    allocator->Free();
-    engines_.get(i)->Init(allocator);
-  }
-  
+}
+
+void Voice::InitState() {
+#ifdef TEST
+  fading_engine_index_ = -1;
+  crossfade_position_ = 0;
+#endif  // TEST
   engine_quantizer_.Init();
   previous_engine_index_ = -1;
   engine_cv_ = 0.0f;
   
-  out_post_processor_.Init();
-  aux_post_processor_.Init();
+  for (int i = 0; i < kNumChannelPostProcessors; ++i) {
+    out_post_processor_[i].Init();
+    aux_post_processor_[i].Init();
+  }
+  post_processor_index_ = 0;
 
   decay_envelope_.Init();
   lpg_envelope_.Init();
   
   trigger_state_ = false;
   previous_note_ = 0.0f;
+  control_counter_ = 0;
   
   trigger_delay_.Init(trigger_delay_line_);
 }
@@ -84,7 +116,12 @@ void Voice::Render(
   // Delay trigger by 1ms to deal with sequencers or MIDI interfaces whose
   // CV out lags behind the GATE out.
   trigger_delay_.Write(modulations.trigger);
-  float trigger_value = trigger_delay_.Read(kTriggerDelay);
+  // kTriggerDelay is counted in blocks of kBlockSize samples, a delay of 1
+  // being the block just written.
+  size_t trigger_delay = min(
+      1 + (kTriggerDelay - 1) * kBlockSize / size,
+      static_cast<size_t>(kMaxTriggerDelay - 1));
+  float trigger_value = trigger_delay_.Read(trigger_delay);
   
   bool previous_trigger_state = trigger_state_;
   if (!previous_trigger_state) {
@@ -112,11 +149,27 @@ void Voice::Render(
       engines_.size(),
       0.25f);
   
+#ifdef TEST
+  if (fading_engine_index_ != -1) {
+    // One crossfade at a time. The next switch waits for this one to end.
+    engine_index = previous_engine_index_;
+  }
+#endif  // TEST
+  
   Engine* e = engines_.get(engine_index);
   
   if (engine_index != previous_engine_index_) {
+#ifdef TEST
+    if (dedicated_ram_ && previous_engine_index_ != -1) {
+      // The new engine starts from silence, which hides the time it takes
+      // for its filters and delay lines to fill up.
+      fading_engine_index_ = previous_engine_index_;
+      crossfade_position_ = 0;
+      post_processor_index_ ^= 1;
+    }
+#endif  // TEST
     e->Reset();
-    out_post_processor_.Reset();
+    out_post_processor_[post_processor_index_].Reset();
     previous_engine_index_ = engine_index;
   }
   EngineParameters p;
@@ -132,10 +185,18 @@ void Voice::Render(
     p.trigger = TRIGGER_UNPATCHED;
   }
   
+  // The envelopes are updated every kBlockSize samples, whatever the size of
+  // the block being rendered.
+  control_counter_ += size;
+  const size_t num_control_ticks = control_counter_ / kBlockSize;
+  control_counter_ -= num_control_ticks * kBlockSize;
+
   const float short_decay = (200.0f * kBlockSize) / kSampleRate *
       SemitonesToRatio(-96.0f * patch.decay);
 
-  decay_envelope_.Process(short_decay * 2.0f);
+  for (size_t i = 0; i < num_control_ticks; ++i) {
+    decay_envelope_.Process(short_decay * 2.0f);
+  }
 
   const float compressed_level = max(
       1.3f * modulations.level / (0.3f + fabsf(modulations.level)),
@@ -207,15 +268,17 @@ void Voice::Render(
     const float decay_tail = (20.0f * kBlockSize) / kSampleRate *
         SemitonesToRatio(-72.0f * patch.decay + 12.0f * hf) - short_decay;
     
-    if (modulations.level_patched) {
-      lpg_envelope_.ProcessLP(compressed_level, short_decay, decay_tail, hf);
-    } else {
-      const float attack = NoteToFrequency(p.note) * float(kBlockSize) * 2.0f;
-      lpg_envelope_.ProcessPing(attack, short_decay, decay_tail, hf);
+    const float attack = NoteToFrequency(p.note) * float(kBlockSize) * 2.0f;
+    for (size_t i = 0; i < num_control_ticks; ++i) {
+      if (modulations.level_patched) {
+        lpg_envelope_.ProcessLP(compressed_level, short_decay, decay_tail, hf);
+      } else {
+        lpg_envelope_.ProcessPing(attack, short_decay, decay_tail, hf);
+      }
     }
   }
   
-  out_post_processor_.Process(
+  out_post_processor_[post_processor_index_].Process(
       pp_s.out_gain,
       lpg_bypass,
       lpg_envelope_.gain(),
@@ -226,7 +289,7 @@ void Voice::Render(
       size,
       2);
 
-  aux_post_processor_.Process(
+  aux_post_processor_[post_processor_index_].Process(
       pp_s.aux_gain,
       lpg_bypass,
       lpg_envelope_.gain(),
@@ -236,6 +299,72 @@ void Voice::Render(
       &frames->aux,
       size,
       2);
+
+#ifdef TEST
+  if (fading_engine_index_ != -1) {
+    RenderFadingEngine(
+        p,
+        !modulations.level_patched && !modulations.trigger_patched,
+        frames,
+        size);
+  }
+#endif  // TEST
+}
+
+#ifdef TEST
+void Voice::RenderFadingEngine(
+    const EngineParameters& parameters,
+    bool lpg_bypass,
+    Frame* frames,
+    size_t size) {
+  Engine* e = engines_.get(fading_engine_index_);
+  const PostProcessingSettings& pp_s = e->post_processing_settings;
+  bool already_enveloped = pp_s.already_enveloped;
+  e->Render(
+      parameters,
+      fading_out_buffer_,
+      fading_aux_buffer_,
+      size,
+      &already_enveloped);
+  lpg_bypass = lpg_bypass || already_enveloped;
+  
+  const int index = post_processor_index_ ^ 1;
+  out_post_processor_[index].Process(
+      pp_s.out_gain,
+      lpg_bypass,
+      lpg_envelope_.gain(),
+      lpg_envelope_.frequency(),
+      lpg_envelope_.hf_bleed(),
+      fading_out_buffer_,
+      &fading_frames_[0].out,
+      size,
+      2);
+  aux_post_processor_[index].Process(
+      pp_s.aux_gain,
+      lpg_bypass,
+      lpg_envelope_.gain(),
+      lpg_envelope_.frequency(),
+      lpg_envelope_.hf_bleed(),
+      fading_aux_buffer_,
+      &fading_frames_[0].aux,
+      size,
+      2);
+  
+  for (size_t i = 0; i < size; ++i) {
+    ++crossfade_position_;
+    const float fade = crossfade_position_ >= kEngineCrossfadeSize
+        ? 1.0f
+        : static_cast<float>(crossfade_position_) / kEngineCrossfadeSize;
+    const Frame& fading = fading_frames_[i];
+    frames[i].out = fading.out + static_cast<short>(
+        static_cast<float>(frames[i].out - fading.out) * fade);
+    frames[i].aux = fading.aux + static_cast<short>(
+        static_cast<float>(frames[i].aux - fading.aux) * fade);
+  }
+  if (crossfade_position_ >= kEngineCrossfadeSize) {
+    fading_engine_index_ = -1;
+  }
 }
+#endif  // TEST
   
 }  // namespace plaits
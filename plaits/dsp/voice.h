@@ -59,10 +59,24 @@
 
 namespace plaits {
 
+// RAM shared by the engines. Some of them allocate buffers as large as a
+// block, hence the extra room when kMaxBlockSize is raised.
+const size_t kSharedRamSize = 16384 + (kMaxBlockSize - 24) * 2 * sizeof(float);
+
 const int kMaxEngines = 16;
 const int kMaxTriggerDelay = 8;
 const int kTriggerDelay = 5;
 
+#ifdef TEST
+// With this much RAM, each engine gets its own share of it, and keeps
+// running for a short crossfade after another engine has been selected.
+const size_t kDedicatedRamSize = kSharedRamSize * kMaxEngines;
+const size_t kEngineCrossfadeSize = 240;
+const int kNumChannelPostProcessors = 2;
+#else
+const int kNumChannelPostProcessors = 1;
+#endif  // TEST
+
 class ChannelPostProcessor {
  public:
   ChannelPostProcessor() { }
@@ -156,16 +170,36 @@ class Voice {
     short aux;
   };
   
+  // The allocator must provide kSharedRamSize bytes.
   void Init(stmlib::BufferAllocator* allocator);
+#ifdef TEST
+  // The allocator must provide kDedicatedRamSize bytes. Each engine gets its
+  // own share, for crossfades between engines.
+  void InitWithDedicatedRam(stmlib::BufferAllocator* allocator);
+#endif  // TEST
+  // size can be anything up to kMaxBlockSize. The envelopes run at the same
+  // rate whatever the size of the block, but the parameters of the engines
+  // are only updated once per block.
   void Render(
       const Patch& patch,
       const Modulations& modulations,
       Frame* frames,
       size_t size);
   inline int active_engine() const { return previous_engine_index_; }
+  inline int num_engines() const { return engines_.size(); }
+  inline Engine* engine(int index) { return engines_.get(index); }
     
  private:
+  void RegisterEngines();
+  void InitState();
   void ComputeDecayParameters(const Patch& settings);
+#ifdef TEST
+  void RenderFadingEngine(
+      const EngineParameters& parameters,
+      bool lpg_bypass,
+      Frame* frames,
+      size_t size);
+#endif  // TEST
   
   inline float ApplyModulations(
       float base_value,
@@ -213,6 +247,9 @@ class Voice {
   
   float previous_note_;
   bool trigger_state_;
+
+  // Samples rendered since the last update of the envelopes.
+  size_t control_counter_;
   
   DecayEnvelope decay_envelope_;
   LPGEnvelope lpg_envelope_;
@@ -220,14 +257,26 @@ class Voice {
   float trigger_delay_line_[kMaxTriggerDelay];
   DelayLine<float, kMaxTriggerDelay> trigger_delay_;
   
-  ChannelPostProcessor out_post_processor_;
-  ChannelPostProcessor aux_post_processor_;
+  // With crossfades, the engine fading out keeps its own post-processors.
+  ChannelPostProcessor out_post_processor_[kNumChannelPostProcessors];
+  ChannelPostProcessor aux_post_processor_[kNumChannelPostProcessors];
+  int post_processor_index_;
   
   EngineRegistry<kMaxEngines> engines_;
   
   float out_buffer_[kMaxBlockSize];
   float aux_buffer_[kMaxBlockSize];
   
+#ifdef TEST
+  bool dedicated_ram_;
+  int fading_engine_index_;
+  size_t crossfade_position_;
+  
+  float fading_out_buffer_[kMaxBlockSize];
+  float fading_aux_buffer_[kMaxBlockSize];
+  Frame fading_frames_[kMaxBlockSize];
+#endif  // TEST
+  
   DISALLOW_COPY_AND_ASSIGN(Voice);
 };
 
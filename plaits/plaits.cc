@@ -48,7 +48,7 @@ Settings settings;
 Ui ui;
 Voice voice;
 
-char shared_buffer[16384];
+char shared_buffer[kSharedRamSize];
 uint32_t test_ramp;
 
 // Default interrupt handlers.
@@ -114,7 +114,7 @@ void Init() {
   IWDG_WriteAccessCmd(IWDG_WriteAccess_Enable);
   IWDG_SetPrescaler(IWDG_Prescaler_16);
   
-  BufferAllocator allocator(shared_buffer, 16384);
+  BufferAllocator allocator(shared_buffer, kSharedRamSize);
   voice.Init(&allocator);
   
   volatile size_t counter = 1000000;
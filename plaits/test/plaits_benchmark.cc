@@ -0,0 +1,340 @@
+// Copyright 2021 Chris Rogers.
+//
+// Author: Chris Rogers
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -----------------------------------------------------------------------------
+//
+// Cost of each engine of the voice, over a grid of patch settings, at both
+// block sizes. The worst block matters as much as the average: a single slow
+// block is a dropout.
+//
+// Timings are divided by the cost of a reference oscillator measured in the
+// same run, so that a baseline recorded on one machine remains usable on
+// another. Run with --update to record a new baseline. Without it, a missing
+// or unreadable baseline, or a missing row for an engine and block size, fails
+// the run like a regression.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <xmmintrin.h>
+
+#include "plaits/dsp/dsp.h"
+#include "plaits/dsp/oscillator/oscillator.h"
+#include "plaits/dsp/voice.h"
+
+#include "stmlib/utils/random.h"
+
+using namespace std;
+using namespace stmlib;
+using namespace plaits;
+
+const char* const kDefaultBaselineFile = \
+    "plaits/test/plaits_benchmark_baseline.txt";
+
+// In the order of registration in Voice::Init.
+const char* const kEngineNames[] = {
+  "virtual_analog",
+  "waveshaping",
+  "fm",
+  "grain",
+  "additive",
+  "wavetable",
+  "chord",
+  "speech",
+  "swarm",
+  "noise",
+  "particle",
+  "string",
+  "modal",
+  "bass_drum",
+  "snare_drum",
+  "hi_hat",
+};
+
+const int kNumEngines = sizeof(kEngineNames) / sizeof(kEngineNames[0]);
+const size_t kBlockSizes[] = { kBlockSize, kMaxBlockSize };
+const int kNumBlockSizes = 2;
+
+const float kNotes[] = { 24.0f, 48.0f, 72.0f, 96.0f };
+const float kParameterValues[] = { 0.0f, 0.5f, 1.0f };
+const int kNumNotes = 4;
+const int kNumParameterValues = 3;
+
+// Each setting of the grid is rendered from a reset engine, a few times. The
+// fastest of the repetitions is kept for each block, which removes the
+// preemptions of the host without hiding blocks that are slow every time.
+const size_t kSamplesPerSetting = 2400;
+const int kNumRepetitions = 5;
+const size_t kMaxBlocksPerSetting = kSamplesPerSetting / kBlockSize;
+
+// Regression thresholds, relative to the baseline.
+const double kMeanTolerance = 1.5;
+const double kWorstBlockTolerance = 2.0;
+
+char ram_block[kSharedRamSize];
+
+struct Result {
+  double ns_per_sample;
+  double worst_block_ns;
+};
+
+struct Baseline {
+  char engine[32];
+  int block_size;
+  double relative_mean;
+  double relative_worst_block;
+};
+
+inline double NowNs() {
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+// ns/sample of a saw oscillator, in blocks of kMaxBlockSize.
+double MeasureReference() {
+  const size_t kNumSamples = kSampleRate * 20;
+  Oscillator osc;
+  osc.Init();
+  float out[kMaxBlockSize];
+  double best = 1e30;
+  float sink = 0.0f;
+  for (int repetition = 0; repetition < 5; ++repetition) {
+    double start = NowNs();
+    for (size_t i = 0; i < kNumSamples; i += kMaxBlockSize) {
+      osc.Render<OSCILLATOR_SHAPE_SAW>(0.01f, 0.5f, out, kMaxBlockSize);
+      sink += out[0];
+    }
+    best = min(best, (NowNs() - start) / kNumSamples);
+  }
+  // Keeps the rendering from being optimized away.
+  return best + (sink == 12345.0f ? 1e-9 : 0.0);
+}
+
+Result BenchmarkEngine(Engine* e, size_t block_size) {
+  float out[kMaxBlockSize];
+  float aux[kMaxBlockSize];
+  double block_ns[kMaxBlocksPerSetting];
+  const size_t num_blocks = kSamplesPerSetting / block_size;
+  const PostProcessingSettings& settings = e->post_processing_settings;
+
+  double total_ns = 0.0;
+  size_t total_samples = 0;
+  double worst_block_ns = 0.0;
+  int setting = 0;
+  for (int n = 0; n < kNumNotes; ++n) {
+    for (int h = 0; h < kNumParameterValues; ++h) {
+      for (int t = 0; t < kNumParameterValues; ++t) {
+        for (int m = 0; m < kNumParameterValues; ++m) {
+          EngineParameters p;
+          p.note = kNotes[n];
+          p.harmonics = kParameterValues[h];
+          p.timbre = kParameterValues[t];
+          p.morph = kParameterValues[m];
+          p.accent = 0.8f;
+          // Alternate between a triggered and a free-running engine.
+          bool triggered = setting++ & 1;
+
+          fill(&block_ns[0], &block_ns[num_blocks], 1e30);
+          for (int repetition = 0; repetition < kNumRepetitions; ++repetition) {
+            // Same random sequence at each repetition.
+            Random::Seed(setting);
+            e->Reset();
+            for (size_t b = 0; b < num_blocks; ++b) {
+              p.trigger = triggered
+                  ? (b == 0 ? TRIGGER_RISING_EDGE : TRIGGER_LOW)
+                  : TRIGGER_UNPATCHED;
+              bool already_enveloped = settings.already_enveloped;
+              double start = NowNs();
+              e->Render(p, out, aux, block_size, &already_enveloped);
+              block_ns[b] = min(block_ns[b], NowNs() - start);
+            }
+          }
+          for (size_t b = 0; b < num_blocks; ++b) {
+            total_ns += block_ns[b];
+            worst_block_ns = max(worst_block_ns, block_ns[b]);
+          }
+          total_samples += num_blocks * block_size;
+        }
+      }
+    }
+  }
+  Result r;
+  r.ns_per_sample = total_ns / total_samples;
+  r.worst_block_ns = worst_block_ns;
+  return r;
+}
+
+// Returns the number of rows read, or -1 if the file cannot be read.
+int ReadBaseline(const char* file_name, Baseline* baseline, int max_size) {
+  FILE* fp = fopen(file_name, "r");
+  if (!fp) {
+    return -1;
+  }
+  int size = 0;
+  int line_number = 0;
+  char line[256];
+  while (size < max_size && fgets(line, sizeof(line), fp)) {
+    ++line_number;
+    Baseline& b = baseline[size];
+    char first[2];
+    if (sscanf(line, " %1s", first) != 1 || first[0] == '#') {
+      continue;
+    }
+    if (sscanf(line, "%31s %d %lf %lf",
+            b.engine,
+            &b.block_size,
+            &b.relative_mean,
+            &b.relative_worst_block) != 4) {
+      printf("%s:%d: invalid baseline\n", file_name, line_number);
+      fclose(fp);
+      return -1;
+    }
+    ++size;
+  }
+  bool error = ferror(fp);
+  fclose(fp);
+  return error ? -1 : size;
+}
+
+const Baseline* FindBaseline(
+    const Baseline* baseline,
+    int size,
+    const char* engine,
+    size_t block_size) {
+  for (int i = 0; i < size; ++i) {
+    if (!strcmp(baseline[i].engine, engine) &&
+        baseline[i].block_size == static_cast<int>(block_size)) {
+      return &baseline[i];
+    }
+  }
+  return NULL;
+}
+
+int main(int argc, char** argv) {
+  _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+
+  bool update = false;
+  const char* baseline_file = kDefaultBaselineFile;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--update")) {
+      update = true;
+    } else {
+      baseline_file = argv[i];
+    }
+  }
+
+  BufferAllocator allocator(ram_block, sizeof(ram_block));
+  static Voice voice;
+  voice.Init(&allocator);
+  if (voice.num_engines() != kNumEngines) {
+    printf("%d engines registered, %d names known: FAIL\n",
+        voice.num_engines(), kNumEngines);
+    return 1;
+  }
+
+  static Baseline baseline[kNumEngines * kNumBlockSizes];
+  int baseline_size = update ? 0 : ReadBaseline(
+      baseline_file, baseline, kNumEngines * kNumBlockSizes);
+  if (baseline_size < 0) {
+    printf("Cannot read %s, run with --update to record it: FAIL\n",
+        baseline_file);
+    return 1;
+  }
+
+  printf("%-15s %5s %10s %14s %9s %9s\n",
+      "engine", "block", "ns/sample", "worst block us", "mean", "worst");
+
+  FILE* fp = NULL;
+  if (update) {
+    fp = fopen(baseline_file, "w");
+    if (!fp) {
+      printf("Cannot write %s\n", baseline_file);
+      return 1;
+    }
+    fprintf(fp, "# engine, block size, ns/sample and worst block ns, "
+        "relative to the reference oscillator ns/sample.\n");
+  }
+
+  int num_regressions = 0;
+  int num_missing = 0;
+  for (int i = 0; i < kNumEngines; ++i) {
+    for (int j = 0; j < kNumBlockSizes; ++j) {
+      size_t block_size = kBlockSizes[j];
+      // All engines share the same RAM space, so the one being measured
+      // must be the last one initialized.
+      allocator.Free();
+      voice.engine(i)->Init(&allocator);
+      // The reference is measured along with each engine, so that the
+      // ratio is not affected by the host changing its clock speed.
+      double reference = MeasureReference();
+      Result r = BenchmarkEngine(voice.engine(i), block_size);
+      double relative_mean = r.ns_per_sample / reference;
+      double relative_worst_block = r.worst_block_ns / reference;
+      printf("%-15s %5d %10.1f %14.2f",
+          kEngineNames[i],
+          static_cast<int>(block_size),
+          r.ns_per_sample,
+          r.worst_block_ns / 1000.0);
+
+      if (update) {
+        fprintf(fp, "%s %d %.3f %.3f\n",
+            kEngineNames[i],
+            static_cast<int>(block_size),
+            relative_mean,
+            relative_worst_block);
+        printf("\n");
+        continue;
+      }
+
+      const Baseline* b = FindBaseline(
+          baseline, baseline_size, kEngineNames[i], block_size);
+      if (!b) {
+        ++num_missing;
+        printf("   (no baseline) FAIL\n");
+        continue;
+      }
+      double mean_ratio = relative_mean / b->relative_mean;
+      double worst_ratio = relative_worst_block / b->relative_worst_block;
+      bool pass = mean_ratio < kMeanTolerance && \
+          worst_ratio < kWorstBlockTolerance;
+      num_regressions += !pass;
+      printf(" %+8.0f%% %+8.0f%% %s\n",
+          100.0 * (mean_ratio - 1.0),
+          100.0 * (worst_ratio - 1.0),
+          pass ? "OK" : "FAIL");
+    }
+  }
+
+  if (fp) {
+    if (ferror(fp) | fclose(fp)) {
+      printf("Cannot write %s\n", baseline_file);
+      return 1;
+    }
+    printf("Baseline written to %s\n", baseline_file);
+    return 0;
+  }
+  if (num_missing) {
+    printf("%d engine and block size pairs missing from %s, "
+        "run with --update to record them\n", num_missing, baseline_file);
+  }
+  if (num_regressions) {
+    printf("%d regressions\n", num_regressions);
+  }
+  return num_missing || num_regressions ? 1 : 0;
+}
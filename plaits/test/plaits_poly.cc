@@ -0,0 +1,229 @@
+// Copyright 2021 Chris Rogers.
+//
+// Author: Chris Rogers
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -----------------------------------------------------------------------------
+//
+// Renders a list of notes with a polyphonic pool of voices.
+//
+// Usage: plaits_poly [-j processes] [-n voices] [-g gain] [-o file.wav]
+//     events.txt
+//
+// The event list (see plaits_poly_events.txt) has one patch line, applied to
+// all voices, then one line per note:
+//
+// patch engine harmonics timbre morph decay lpg_colour
+// time note velocity duration
+//
+// Times and durations are in seconds. Notes start and end on the first block
+// boundary following their time. The speed of the rendering, relative to real
+// time, is printed at the end, along with the slowest block.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <xmmintrin.h>
+
+#include "plaits/dsp/dsp.h"
+#include "plaits/test/voice_pool.h"
+#include "plaits/test/wav_file.h"
+
+using namespace std;
+using namespace stmlib;
+using namespace plaits;
+
+const int kMaxEvents = 8192;
+
+// Rendering goes on for this time after the last note is released.
+const float kTail = 2.0f;
+
+struct Event {
+  size_t time;
+  int note;
+  // 0 for a note off.
+  float velocity;
+};
+
+bool operator<(const Event& a, const Event& b) {
+  // Note offs first, so that a note can be repeated at the time it ends.
+  return a.time < b.time || (a.time == b.time && a.velocity < b.velocity);
+}
+
+inline double NowNs() {
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+int ReadEvents(
+    const char* file_name,
+    Patch* patch,
+    Event* events,
+    int max_size) {
+  FILE* fp = fopen(file_name, "r");
+  if (!fp) {
+    return -1;
+  }
+  memset(patch, 0, sizeof(*patch));
+  bool has_patch = false;
+  int size = 0;
+  int line_number = 0;
+  char line[512];
+  while (size + 2 <= max_size && fgets(line, sizeof(line), fp)) {
+    ++line_number;
+    char first[2];
+    if (sscanf(line, " %1s", first) != 1 || first[0] == '#') {
+      continue;
+    }
+    if (!has_patch) {
+      int n = sscanf(line, "patch %d %f %f %f %f %f",
+          &patch->engine,
+          &patch->harmonics,
+          &patch->timbre,
+          &patch->morph,
+          &patch->decay,
+          &patch->lpg_colour);
+      if (n != 6 || patch->engine < 0 || patch->engine >= kMaxEngines) {
+        fprintf(stderr, "%s:%d: invalid patch\n", file_name, line_number);
+        fclose(fp);
+        return -1;
+      }
+      has_patch = true;
+      continue;
+    }
+    float time, velocity, duration;
+    int note;
+    int n = sscanf(line, "%f %d %f %f", &time, &note, &velocity, &duration);
+    if (n != 4 || time < 0.0f || duration <= 0.0f || velocity <= 0.0f) {
+      fprintf(stderr, "%s:%d: invalid note\n", file_name, line_number);
+      fclose(fp);
+      return -1;
+    }
+    Event& on = events[size++];
+    on.time = time * kSampleRate;
+    on.note = note;
+    on.velocity = velocity;
+    Event& off = events[size++];
+    off.time = (time + duration) * kSampleRate;
+    off.note = note;
+    off.velocity = 0.0f;
+  }
+  fclose(fp);
+  if (!has_patch) {
+    fprintf(stderr, "%s: no patch\n", file_name);
+    return -1;
+  }
+  return size;
+}
+
+int main(int argc, char** argv) {
+  _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+
+  int num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+  int num_voices = 16;
+  float gain = 0.25f;
+  const char* output_file = "plaits_poly.wav";
+  const char* event_file = NULL;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+      num_workers = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+      num_voices = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-g") && i + 1 < argc) {
+      gain = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      output_file = argv[++i];
+    } else {
+      event_file = argv[i];
+    }
+  }
+  if (!event_file) {
+    fprintf(stderr,
+        "Usage: %s [-j processes] [-n voices] [-g gain] [-o file.wav] "
+        "events.txt\n",
+        argv[0]);
+    return 1;
+  }
+
+  Patch patch;
+  static Event events[kMaxEvents];
+  int num_events = ReadEvents(event_file, &patch, events, kMaxEvents);
+  if (num_events < 0) {
+    fprintf(stderr, "Cannot read %s\n", event_file);
+    return 1;
+  }
+  sort(&events[0], &events[num_events]);
+
+  WavFile wav_file;
+  if (!wav_file.Open(output_file, 2)) {
+    fprintf(stderr, "Cannot write %s\n", output_file);
+    return 1;
+  }
+
+  static VoicePool pool;
+  if (!pool.Init(num_voices, num_workers)) {
+    fprintf(stderr, "Cannot start the workers\n");
+    return 1;
+  }
+  pool.set_patch(patch);
+
+  const size_t end = (num_events ? events[num_events - 1].time : 0) + \
+      kTail * kSampleRate;
+  Voice::Frame frames[kMaxBlockSize];
+  int next_event = 0;
+  int max_active_voices = 0;
+  double total_ns = 0.0;
+  double worst_load = 0.0;
+  for (size_t i = 0; i < end; ) {
+    while (next_event < num_events && events[next_event].time <= i) {
+      const Event& e = events[next_event++];
+      if (e.velocity > 0.0f) {
+        pool.NoteOn(e.note, e.velocity);
+      } else {
+        pool.NoteOff(e.note);
+      }
+    }
+    size_t size = min(kMaxBlockSize, end - i);
+
+    double start = NowNs();
+    pool.Render(gain, frames, size);
+    double block_ns = NowNs() - start;
+    total_ns += block_ns;
+    worst_load = max(worst_load, block_ns * kSampleRate / (size * 1e9));
+    max_active_voices = max(max_active_voices, pool.num_active_voices());
+
+    if (!wav_file.Write(&frames[0].out, size)) {
+      break;
+    }
+    i += size;
+  }
+  pool.Shutdown();
+  if (!wav_file.Close()) {
+    fprintf(stderr, "%s: %s\n", output_file, strerror(errno));
+    return 1;
+  }
+
+  const double duration_ns = end * 1e9 / kSampleRate;
+  printf("%d voices (up to %d active), %d processes\n",
+      num_voices, max_active_voices, num_workers);
+  printf("%.2fx real time, slowest block %.0f%% of its duration\n",
+      duration_ns / total_ns,
+      100.0 * worst_load);
+  return 0;
+}
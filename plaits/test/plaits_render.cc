@@ -0,0 +1,368 @@
+// Copyright 2021 Chris Rogers.
+//
+// Author: Chris Rogers
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -----------------------------------------------------------------------------
+//
+// Renders multisamples of a list of patches, one WAV file per note and
+// velocity layer.
+//
+// Usage: plaits_render [-j processes] [-o directory] [-aux] patches.txt
+//
+// Each line of the patch list describes a patch (see
+// plaits_render_patches.txt):
+//
+// name engine harmonics timbre morph decay lpg_colour
+//     lowest_note highest_note note_step velocity_layers gate duration
+//
+// Notes are rendered by a pool of processes, each owning its voice and its
+// RAM.
+// Each note is triggered with the velocity on the LEVEL input, held for
+// "gate" seconds, then released. The file ends after "duration" seconds, or
+// earlier if the voice has become silent after the release. Samples are
+// written to disk as they are rendered.
+//
+// The workers are processes rather than threads, so that each has its own
+// stmlib::Random state. It is seeded from the index of the note before
+// rendering it: the engines using noise give the same files whatever the
+// number of processes.
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <xmmintrin.h>
+
+#include "stmlib/utils/random.h"
+
+#include "plaits/dsp/dsp.h"
+#include "plaits/dsp/voice.h"
+#include "plaits/test/wav_file.h"
+#include "plaits/test/worker_processes.h"
+
+using namespace std;
+using namespace stmlib;
+using namespace plaits;
+
+const int kMaxPatches = 256;
+const int kMaxWorkers = 64;
+const int kMaxVelocityLayers = 16;
+
+// Parameters smooth out during this time, before the note is triggered.
+const size_t kPreRoll = kSampleRate * 0.05f;
+
+// The file ends when the output stays below this level for this time.
+const int kSilenceThreshold = 2;
+const size_t kSilenceDuration = kSampleRate * 0.1f;
+
+const float kTriggerDuration = 0.005f;
+
+struct RenderPatch {
+  char name[64];
+  int engine;
+  float harmonics;
+  float timbre;
+  float morph;
+  float decay;
+  float lpg_colour;
+  int lowest_note;
+  int highest_note;
+  int note_step;
+  int velocity_layers;
+  float gate;
+  float duration;
+};
+
+struct Job {
+  const RenderPatch* patch;
+  int note;
+  int layer;
+  uint32_t seed;
+};
+
+class Renderer {
+ public:
+  Renderer() { }
+  ~Renderer() { }
+
+  void Init(const char* directory, bool write_aux) {
+    directory_ = directory;
+    write_aux_ = write_aux;
+    allocator_.Init(ram_block_, sizeof(ram_block_));
+  }
+
+  bool Render(const Job& job) {
+    const RenderPatch& p = *job.patch;
+    char file_name[1024];
+    snprintf(file_name, sizeof(file_name), "%s/%s_%03d_v%02d.wav",
+        directory_, p.name, job.note, job.layer + 1);
+    WavFile wav_file;
+    if (!wav_file.Open(file_name, write_aux_ ? 2 : 1)) {
+      fprintf(stderr, "%s: %s\n", file_name, strerror(errno));
+      return false;
+    }
+
+    // A fresh voice for each note, so that the files do not depend on the
+    // order in which they are rendered.
+    allocator_.Free();
+    Random::Seed(job.seed);
+    voice_.Init(&allocator_);
+
+    patch_.engine = p.engine;
+    patch_.note = job.note;
+    patch_.harmonics = p.harmonics;
+    patch_.timbre = p.timbre;
+    patch_.morph = p.morph;
+    patch_.frequency_modulation_amount = 0.0f;
+    patch_.timbre_modulation_amount = 0.0f;
+    patch_.morph_modulation_amount = 0.0f;
+    patch_.decay = p.decay;
+    patch_.lpg_colour = p.lpg_colour;
+
+    memset(&modulations_, 0, sizeof(modulations_));
+    modulations_.trigger_patched = true;
+    modulations_.level_patched = true;
+
+    const float velocity = static_cast<float>(job.layer + 1) / \
+        static_cast<float>(p.velocity_layers);
+    const size_t trigger_end = kPreRoll + kTriggerDuration * kSampleRate;
+    const size_t gate_end = kPreRoll + p.gate * kSampleRate;
+    const size_t end = kPreRoll + p.duration * kSampleRate;
+    size_t silence = 0;
+    for (size_t i = 0; i < end && silence < kSilenceDuration; ) {
+      size_t size = min(kMaxBlockSize, end - i);
+      bool note_on = i >= kPreRoll && i < gate_end;
+      modulations_.trigger = note_on && i < trigger_end ? 1.0f : 0.0f;
+      modulations_.level = note_on ? velocity : 0.0f;
+      voice_.Render(patch_, modulations_, frames_, size);
+      if (i >= kPreRoll) {
+        for (size_t j = 0; j < size; ++j) {
+          if (write_aux_) {
+            samples_[j * 2] = frames_[j].out;
+            samples_[j * 2 + 1] = frames_[j].aux;
+          } else {
+            samples_[j] = frames_[j].out;
+          }
+          bool silent = abs(frames_[j].out) < kSilenceThreshold && \
+              abs(frames_[j].aux) < kSilenceThreshold;
+          silence = silent && i >= gate_end ? silence + 1 : 0;
+        }
+        if (!wav_file.Write(samples_, size)) {
+          break;
+        }
+      }
+      i += size;
+    }
+    if (!wav_file.Close()) {
+      // Not left behind as if it had been rendered.
+      fprintf(stderr, "%s: %s\n", file_name, strerror(errno));
+      remove(file_name);
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  Voice voice_;
+  BufferAllocator allocator_;
+  Patch patch_;
+  Modulations modulations_;
+  Voice::Frame frames_[kMaxBlockSize];
+  short samples_[kMaxBlockSize * 2];
+  const char* directory_;
+  bool write_aux_;
+  char ram_block_[kSharedRamSize];
+
+  DISALLOW_COPY_AND_ASSIGN(Renderer);
+};
+
+// Shared by the worker processes.
+struct WorkerState {
+  volatile int next_job;
+  int num_rendered[kMaxWorkers];
+  int num_failed[kMaxWorkers];
+};
+
+Job* jobs;
+int num_jobs;
+
+void RunWorker(WorkerState* state, int index, Renderer* renderer) {
+  _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+  while (true) {
+    int j = __sync_fetch_and_add(&state->next_job, 1);
+    if (j >= num_jobs) {
+      break;
+    }
+    if (renderer->Render(jobs[j])) {
+      ++state->num_rendered[index];
+    } else {
+      ++state->num_failed[index];
+    }
+  }
+}
+
+int ReadPatches(const char* file_name, RenderPatch* patches, int max_size) {
+  FILE* fp = fopen(file_name, "r");
+  if (!fp) {
+    return -1;
+  }
+  int size = 0;
+  int line_number = 0;
+  char line[512];
+  while (size < max_size && fgets(line, sizeof(line), fp)) {
+    ++line_number;
+    RenderPatch& p = patches[size];
+    char first[2];
+    if (sscanf(line, " %1s", first) != 1 || first[0] == '#') {
+      continue;
+    }
+    int n = sscanf(line, "%63s %d %f %f %f %f %f %d %d %d %d %f %f",
+        p.name,
+        &p.engine,
+        &p.harmonics,
+        &p.timbre,
+        &p.morph,
+        &p.decay,
+        &p.lpg_colour,
+        &p.lowest_note,
+        &p.highest_note,
+        &p.note_step,
+        &p.velocity_layers,
+        &p.gate,
+        &p.duration);
+    if (n != 13 ||
+        p.engine < 0 || p.engine >= kMaxEngines ||
+        p.note_step < 1 ||
+        p.velocity_layers < 1 || p.velocity_layers > kMaxVelocityLayers ||
+        p.gate > p.duration) {
+      fprintf(stderr, "%s:%d: invalid patch\n", file_name, line_number);
+      fclose(fp);
+      return -1;
+    }
+    ++size;
+  }
+  fclose(fp);
+  return size;
+}
+
+int main(int argc, char** argv) {
+  int num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+  const char* directory = ".";
+  const char* patch_file = NULL;
+  bool write_aux = false;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+      num_workers = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      directory = argv[++i];
+    } else if (!strcmp(argv[i], "-aux")) {
+      write_aux = true;
+    } else {
+      patch_file = argv[i];
+    }
+  }
+  if (!patch_file) {
+    fprintf(stderr,
+        "Usage: %s [-j processes] [-o directory] [-aux] patches.txt\n",
+        argv[0]);
+    return 1;
+  }
+  CONSTRAIN(num_workers, 1, kMaxWorkers);
+
+  static RenderPatch patches[kMaxPatches];
+  int num_patches = ReadPatches(patch_file, patches, kMaxPatches);
+  if (num_patches < 0) {
+    fprintf(stderr, "Cannot read %s\n", patch_file);
+    return 1;
+  }
+
+  num_jobs = 0;
+  for (int i = 0; i < num_patches; ++i) {
+    const RenderPatch& p = patches[i];
+    for (int note = p.lowest_note; note <= p.highest_note;
+         note += p.note_step) {
+      num_jobs += p.velocity_layers;
+    }
+  }
+  jobs = new Job[num_jobs];
+  Job* job = jobs;
+  for (int i = 0; i < num_patches; ++i) {
+    const RenderPatch& p = patches[i];
+    for (int note = p.lowest_note; note <= p.highest_note;
+         note += p.note_step) {
+      for (int layer = 0; layer < p.velocity_layers; ++layer) {
+        job->patch = &p;
+        job->note = note;
+        job->layer = layer;
+        job->seed = (job - jobs + 1) * 2654435761u;
+        ++job;
+      }
+    }
+  }
+  WorkerState* state = static_cast<WorkerState*>(
+      MapShared(sizeof(WorkerState)));
+  if (!state) {
+    perror("mmap");
+    return 1;
+  }
+
+  // Flushed, so that the children do not print it again.
+  fflush(stdout);
+  const int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+  int num_started = 0;
+  for (int i = 0; i < num_workers; ++i) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      PinToCore(i % num_cores);
+      Renderer* renderer = new Renderer;
+      renderer->Init(directory, write_aux);
+      RunWorker(state, i, renderer);
+      _exit(0);
+    } else if (pid > 0) {
+      ++num_started;
+    } else {
+      perror("fork");
+    }
+  }
+
+  int num_rendered = 0;
+  int num_failed = 0;
+  bool crashed = false;
+  for (int i = 0; i < num_started; ++i) {
+    int status;
+    wait(&status);
+    crashed = crashed || !WIFEXITED(status);
+  }
+  for (int i = 0; i < num_workers; ++i) {
+    num_rendered += state->num_rendered[i];
+    num_failed += state->num_failed[i];
+  }
+  delete[] jobs;
+  UnmapShared(state, sizeof(WorkerState));
+  if (!num_started || crashed) {
+    fprintf(stderr, "A worker process could not run\n");
+    return 1;
+  }
+
+  printf("%d files rendered with %d processes", num_rendered, num_started);
+  if (num_failed) {
+    printf(", %d could not be written to %s", num_failed, directory);
+  }
+  printf("\n");
+  return num_failed ? 1 : 0;
+}
@@ -51,9 +51,16 @@
 #include "plaits/dsp/oscillator/vosim_oscillator.h"
 #include "plaits/dsp/oscillator/z_oscillator.h"
 
+#include "plaits/dsp/physical_modelling/resonator.h"
+
+#include "plaits/dsp/speech/lpc_speech_synth_words.h"
+
 #include "plaits/dsp/voice.h"
 
+#include "plaits/test/voice_pool.h"
+
 #include "stmlib/test/wav_writer.h"
+#include "stmlib/utils/random.h"
 
 using namespace std;
 using namespace stmlib;
@@ -61,7 +68,7 @@ using namespace plaits;
 
 const size_t kAudioBlockSize = 24;
 
-char ram_block[16 * 1024];
+char ram_block[kSharedRamSize];
 
 void TestOscillator() {
   WavWriter wav_writer(1, kSampleRate, 20);
@@ -161,6 +168,86 @@ void TestHarmonicOscillator() {
   }
 }
 
+// Magnitude of the harmonics of the last kWindowSize samples, in dB. The
+// fundamental falls on the bin fundamental_bin.
+void HarmonicSpectrum(
+    const float* in,
+    size_t size,
+    int fundamental_bin,
+    int num_harmonics,
+    float* spectrum) {
+  const size_t kWindowSize = 4096;
+  in += size - kWindowSize;
+  for (int h = 1; h <= num_harmonics; ++h) {
+    double re = 0.0;
+    double im = 0.0;
+    for (size_t i = 0; i < kWindowSize; ++i) {
+      double phase = 2.0 * M_PI * h * fundamental_bin * i / kWindowSize;
+      re += in[i] * cos(phase);
+      im += in[i] * sin(phase);
+    }
+    spectrum[h - 1] = 20.0f * log10f(
+        2.0f * sqrtf(re * re + im * im) / kWindowSize + 1e-9f);
+  }
+}
+
+void TestHarmonicOscillatorKernels() {
+  const size_t kNumSamples = 4096 * 2;
+  const int kNumHarmonics = 24;
+  static float out[2][kNumSamples];
+  float spectrum[2][kNumHarmonics];
+  
+  float max_sample_error = 0.0f;
+  float max_spectrum_error = 0.0f;
+  for (int trial = 0; trial < 40; ++trial) {
+    // Up to 32 bins, so that the highest harmonics end above Nyquist.
+    int bin = 1 + trial % 32 * (trial & 1 ? 7 : 1);
+    float f0 = static_cast<float>(bin) / 4096.0f;
+    
+    HarmonicOscillator<12> osc[2][2];
+    for (int k = 0; k < 2; ++k) {
+      osc[k][0].Init();
+      osc[k][1].Init();
+    }
+    float amplitudes[kNumHarmonics];
+    for (size_t i = 0; i < kNumSamples; ) {
+      // Blocks of odd sizes, and amplitudes changing at each block (some of
+      // them down to silence) during the first window.
+      size_t size = min(kNumSamples - i, size_t(1 + i % 29));
+      if (i < kNumSamples / 2 || i == kNumSamples / 2) {
+        for (int h = 0; h < kNumHarmonics; ++h) {
+          float r = Random::GetFloat();
+          amplitudes[h] = r < 0.3f ? 0.0f : r / (h + 1);
+        }
+      }
+      osc[0][0].RenderScalar<1>(f0, &amplitudes[0], &out[0][i], size);
+      osc[0][1].RenderScalar<13>(f0, &amplitudes[12], &out[0][i], size);
+      osc[1][0].Render<1>(f0, &amplitudes[0], &out[1][i], size);
+      osc[1][1].Render<13>(f0, &amplitudes[12], &out[1][i], size);
+      i += size;
+    }
+    
+    for (size_t i = 0; i < kNumSamples; ++i) {
+      max_sample_error = max(
+          max_sample_error, fabsf(out[1][i] - out[0][i]));
+    }
+    for (int k = 0; k < 2; ++k) {
+      HarmonicSpectrum(
+          out[k], kNumSamples, bin, kNumHarmonics, spectrum[k]);
+    }
+    for (int h = 0; h < kNumHarmonics; ++h) {
+      if (spectrum[0][h] > -80.0f) {
+        max_spectrum_error = max(
+            max_spectrum_error, fabsf(spectrum[1][h] - spectrum[0][h]));
+      }
+    }
+  }
+  printf("HarmonicOscillator: max error %g %s\n",
+      max_sample_error, max_sample_error < 1e-4f ? "OK" : "FAIL");
+  printf("HarmonicOscillator: max harmonic level error %.4f dB %s\n",
+      max_spectrum_error, max_spectrum_error < 0.01f ? "OK" : "FAIL");
+}
+
 void TestFormantOscillator() {
   WavWriter wav_writer(1, kSampleRate, 20);
   wav_writer.Open("plaits_formant_oscillator.wav");
@@ -444,6 +531,75 @@ void TestSpeechEngine() {
   }
 }
 
+// Walks through the encoded words of a bank, to check the word offsets and
+// boundaries listed with it.
+bool CheckLPCSpeechSynthWordIndex(const LPCSpeechSynthWordBankData& bank) {
+  if (bank.num_words > kLPCSpeechSynthMaxWords) {
+    return false;
+  }
+  BitStream bitstream;
+  bitstream.Init(bank.data);
+  int word = 0;
+  int num_frames = 0;
+  while (bitstream.ptr() < bank.data + bank.size) {
+    if (word >= bank.num_words ||
+        bitstream.ptr() - bank.data != bank.word_offsets[word] ||
+        num_frames != bank.word_boundaries[word]) {
+      return false;
+    }
+    while (true) {
+      int energy = bitstream.GetBits(4);
+      if (energy == 0xf) {
+        bitstream.Flush();
+        break;
+      } else if (energy) {
+        bool repeat = bitstream.GetBits(1);
+        bool voiced = bitstream.GetBits(6) != 0;
+        // Sizes of k0 to k9, the last 6 for voiced frames only.
+        const int kCoefficientBits[] = { 5, 5, 4, 4, 4, 4, 4, 3, 3, 3 };
+        for (int k = 0; !repeat && k < (voiced ? 10 : 4); ++k) {
+          bitstream.GetBits(kCoefficientBits[k]);
+        }
+      }
+      ++num_frames;
+    }
+    ++word;
+  }
+  return word == bank.num_words && num_frames == bank.word_boundaries[word];
+}
+
+void TestLPCSpeechSynthWordBank() {
+  // Words decoded on demand, in reverse order, must give the same frames as
+  // words decoded from the start to the end of the bank.
+  const size_t kFramesSize = kLPCSpeechSynthMaxFrames * \
+      sizeof(LPCSpeechSynth::Frame);
+  static char ram[2][kFramesSize];
+  LPCSpeechSynthWordBank word_bank[2];
+  for (int i = 0; i < 2; ++i) {
+    BufferAllocator allocator(ram[i], kFramesSize);
+    word_bank[i].Init(word_banks_, LPC_SPEECH_SYNTH_NUM_WORD_BANKS, &allocator);
+  }
+  
+  for (int bank = 0; bank < LPC_SPEECH_SYNTH_NUM_WORD_BANKS; ++bank) {
+    fill(&ram[0][0], &ram[0][kFramesSize], 0);
+    fill(&ram[1][0], &ram[1][kFramesSize], 0);
+    word_bank[0].Load(bank);
+    word_bank[1].Load(bank);
+    int num_frames = word_bank[0].num_frames();
+    word_bank[0].DecodeFrames(0, num_frames - 1);
+    for (int frame = num_frames - 1; frame >= 0; --frame) {
+      word_bank[1].DecodeFrames(frame, frame);
+    }
+    bool match = num_frames == word_bank[1].num_frames() && !memcmp(
+        word_bank[0].frames(),
+        word_bank[1].frames(),
+        num_frames * sizeof(LPCSpeechSynth::Frame));
+    match = match && CheckLPCSpeechSynthWordIndex(word_banks_[bank]);
+    printf("LPC word bank %d: %d frames %s\n",
+        bank, num_frames, match ? "OK" : "FAIL");
+  }
+}
+
 void GenerateStringTuningData() {
   for (int pass = 0; pass < 21; ++pass) {
     WavWriter wav_writer(1, kSampleRate, 4);
@@ -654,8 +810,9 @@ void TestWavetableEngine() {
   WavWriter wav_writer(2, kSampleRate, 5);
   wav_writer.Open("plaits_wavetable_engine.wav");
   
+  BufferAllocator allocator(ram_block, sizeof(ram_block));
   WavetableEngine e;
-  e.Init(NULL);
+  e.Init(&allocator);
   e.Reset();
   
   EngineParameters p;
@@ -680,8 +837,9 @@ void EnumerateWavetables() {
   WavWriter wav_writer(1, kSampleRate, 64);
   wav_writer.Open("plaits_wavetable_enumeration.wav");
   
+  BufferAllocator allocator(ram_block, sizeof(ram_block));
   WavetableEngine e;
-  e.Init(NULL);
+  e.Init(&allocator);
   e.Reset();
   
   EngineParameters p;
@@ -710,6 +868,199 @@ void EnumerateWavetables() {
   }
 }
 
+void TestWavetableSliceCaching() {
+  // A slow sweep through the terrain, rendered from slices and directly.
+  const size_t kNumSamples = kSampleRate * 10;
+  float* rendered[2];
+  for (int caching = 0; caching < 2; ++caching) {
+    BufferAllocator allocator(ram_block, sizeof(ram_block));
+    WavetableEngine e;
+    e.Init(&allocator);
+    e.Reset();
+    e.set_slice_caching(caching);
+    rendered[caching] = new float[kNumSamples];
+    
+    EngineParameters p;
+    p.trigger = TRIGGER_LOW;
+    p.note = 48.0f;
+    
+    for (size_t i = 0; i < kNumSamples; i += kAudioBlockSize) {
+      float aux[kAudioBlockSize];
+      float t = static_cast<float>(i) / kNumSamples;
+      p.timbre = t;
+      p.morph = 0.5f + 0.5f * sinf(t * 6.28f);
+      p.harmonics = t;
+      bool already_enveloped;
+      e.Render(p, rendered[caching] + i, aux, kAudioBlockSize,
+          &already_enveloped);
+    }
+  }
+  
+  // The differentiator starts from rest: the first few ms are a transient
+  // 40 times louder than the rest, common to both renders.
+  const size_t kTransientSize = kSampleRate / 100;
+  float peak = 0.0f;
+  float error = 0.0f;
+  for (size_t i = kTransientSize; i < kNumSamples; ++i) {
+    peak = max(peak, fabsf(rendered[0][i]));
+    error = max(error, fabsf(rendered[1][i] - rendered[0][i]));
+  }
+  printf("Wavetable slices: peak %f, max error %f (%.1f dB)\n",
+      peak, error, 20.0f * log10f(error / peak + 1e-9f));
+  delete[] rendered[0];
+  delete[] rendered[1];
+}
+
+void TestWavetableEngineSwitch() {
+  // As in the voice, the string engine reuses the RAM of the slices while the
+  // wavetable engine is not selected. The result is compared with a wavetable
+  // engine which has its own RAM, and renders the same blocks.
+  const size_t kNumBlocks = 400;
+  static char reference_ram[kSharedRamSize];
+  BufferAllocator allocator(ram_block, sizeof(ram_block));
+  BufferAllocator reference_allocator(reference_ram, sizeof(reference_ram));
+  WavetableEngine wavetable[2];
+  StringEngine string;
+  wavetable[0].Init(&reference_allocator);
+  wavetable[0].Reset();
+  wavetable[1].Init(&allocator);
+  wavetable[1].Reset();
+  allocator.Free();
+  string.Init(&allocator);
+  
+  EngineParameters p;
+  p.trigger = TRIGGER_LOW;
+  p.note = 48.0f;
+  p.timbre = 0.3f;
+  p.morph = 0.6f;
+  p.harmonics = 0.2f;
+  p.accent = 0.8f;
+  
+  float out[2][kAudioBlockSize];
+  float aux[kAudioBlockSize];
+  bool already_enveloped;
+  float error = 0.0f;
+  for (int pass = 0; pass < 2; ++pass) {
+    for (size_t block = 0; block < kNumBlocks; ++block) {
+      for (int i = 0; i < 2; ++i) {
+        wavetable[i].Render(
+            p, out[i], aux, kAudioBlockSize, &already_enveloped);
+      }
+      for (size_t j = 0; j < kAudioBlockSize; ++j) {
+        error = max(error, fabsf(out[1][j] - out[0][j]));
+      }
+    }
+    if (pass == 0) {
+      string.Reset();
+      for (size_t block = 0; block < kNumBlocks; ++block) {
+        p.trigger = block == 0 ? TRIGGER_RISING_EDGE : TRIGGER_LOW;
+        string.Render(p, out[1], aux, kAudioBlockSize, &already_enveloped);
+      }
+      p.trigger = TRIGGER_LOW;
+      wavetable[0].Reset();
+      wavetable[1].Reset();
+    }
+  }
+  printf("Wavetable after the string engine: max error %f (0 expected)\n",
+      error);
+}
+
+template<int batch_size>
+float CompareResonatorSvfKernels(bool low_pass) {
+  const size_t kNumSamples = 4801;  // Not a multiple of the SIMD width.
+  static float in[kNumSamples];
+  static float out[2][kNumSamples];
+  float f[batch_size];
+  float q[batch_size];
+  float gain[batch_size];
+  for (int i = 0; i < batch_size; ++i) {
+    f[i] = 0.001f + 0.45f * Random::GetFloat();
+    q[i] = 1.0f + 500.0f * Random::GetFloat();
+    gain[i] = Random::GetFloat() - 0.5f;
+  }
+  for (size_t i = 0; i < kNumSamples; ++i) {
+    in[i] = i < 48 ? Random::GetFloat() - 0.5f : 0.0f;
+    out[0][i] = out[1][i] = 0.1f;
+  }
+  
+  ResonatorSvf<batch_size> resonator[2];
+  resonator[0].Init();
+  resonator[1].Init();
+  // Blocks of odd sizes, to check that the state carries over.
+  for (size_t i = 0; i < kNumSamples; ) {
+    size_t size = min(kNumSamples - i, size_t(7 + i % 17));
+    if (low_pass) {
+      resonator[0].template ProcessScalar<FILTER_MODE_LOW_PASS, true>(
+          f, q, gain, &in[i], &out[0][i], size);
+      resonator[1].template Process<FILTER_MODE_LOW_PASS, true>(
+          f, q, gain, &in[i], &out[1][i], size);
+    } else {
+      resonator[0].template ProcessScalar<FILTER_MODE_BAND_PASS, false>(
+          f, q, gain, &in[i], &out[0][i], size);
+      resonator[1].template Process<FILTER_MODE_BAND_PASS, false>(
+          f, q, gain, &in[i], &out[1][i], size);
+    }
+    i += size;
+  }
+  
+  float error = 0.0f;
+  for (size_t i = 0; i < kNumSamples; ++i) {
+    error = max(error, fabsf(out[1][i] - out[0][i]));
+  }
+  return error;
+}
+
+void TestResonatorSvfKernels() {
+  // With 4 modes, the SIMD kernel does the same operations in the same
+  // order. With more modes, the modes are not summed in the same order.
+  float error_4 = 0.0f;
+  float error_8 = 0.0f;
+  float error_24 = 0.0f;
+  for (int trial = 0; trial < 20; ++trial) {
+    error_4 = max(error_4, CompareResonatorSvfKernels<4>(trial & 1));
+    error_8 = max(error_8, CompareResonatorSvfKernels<8>(trial & 1));
+    error_24 = max(error_24, CompareResonatorSvfKernels<24>(trial & 1));
+  }
+  printf("ResonatorSvf<4>: max error %g %s\n",
+      error_4, error_4 == 0.0f ? "OK" : "FAIL");
+  printf("ResonatorSvf<8>: max error %g %s\n",
+      error_8, error_8 < 1e-5f ? "OK" : "FAIL");
+  printf("ResonatorSvf<24>: max error %g %s\n",
+      error_24, error_24 < 1e-5f ? "OK" : "FAIL");
+}
+
+void TestSwarmOscillatorBankKernels() {
+  const size_t kNumSamples = 48000;
+  static float out[2][2][kNumSamples];
+  SwarmOscillatorBank oscillators[2];
+  oscillators[0].Init();
+  oscillators[1].Init();
+  
+  float frequency[kNumSwarmVoices];
+  float amplitude[kNumSwarmVoices];
+  for (size_t i = 0; i < kNumSamples; ) {
+    size_t size = min(kNumSamples - i, size_t(1 + i % 23));
+    for (int j = 0; j < kNumSwarmVoices; ++j) {
+      // Up to 0.3, to cover the clipping of both oscillators.
+      frequency[j] = 0.3f * Random::GetFloat() * Random::GetFloat();
+      amplitude[j] = Random::GetFloat() / kNumSwarmVoices;
+    }
+    oscillators[0].RenderScalar(
+        frequency, amplitude, &out[0][0][i], &out[0][1][i], size);
+    oscillators[1].Render(
+        frequency, amplitude, &out[1][0][i], &out[1][1][i], size);
+    i += size;
+  }
+  
+  float error = 0.0f;
+  for (size_t i = 0; i < kNumSamples; ++i) {
+    error = max(error, fabsf(out[1][0][i] - out[0][0][i]));
+    error = max(error, fabsf(out[1][1][i] - out[0][1][i]));
+  }
+  printf("SwarmOscillatorBank: max error %g %s\n",
+      error, error < 1e-5f ? "OK" : "FAIL");
+}
+
 void TestSampleRateReducer() {
   WavWriter wav_writer(2, kSampleRate, 20);
   wav_writer.Open("plaits_sample_rate_reducer.wav");
@@ -870,6 +1221,264 @@ void TestVoice() {
   }
 }
 
+// Renders each engine through the voice at large block sizes, and compares
+// the level of the output, in windows of 100ms, to the one obtained with
+// kAudioBlockSize. The engines are only updated once per block, so the
+// waveforms themselves are not expected to line up.
+void RenderVoiceLevels(
+    int engine,
+    bool triggered,
+    size_t block_size,
+    float* levels,
+    size_t num_windows,
+    size_t window_size) {
+  static Voice v;
+  static Voice::Frame frames[kMaxBlockSize];
+  BufferAllocator allocator(ram_block, sizeof(ram_block));
+  v.Init(&allocator);
+  Random::Seed(1);
+  
+  Patch patch;
+  patch.engine = engine;
+  patch.note = 48.0f;
+  patch.harmonics = 0.3f;
+  patch.timbre = 0.6f;
+  patch.morph = 0.4f;
+  patch.frequency_modulation_amount = 0.0f;
+  patch.timbre_modulation_amount = 0.0f;
+  patch.morph_modulation_amount = 0.0f;
+  patch.decay = 0.5f;
+  patch.lpg_colour = 0.5f;
+
+  Modulations modulations;
+  memset(&modulations, 0, sizeof(modulations));
+  modulations.trigger_patched = triggered;
+  
+  // Triggers on a grid common to all block sizes.
+  const size_t trigger_period = window_size * 4;
+  const size_t num_samples = num_windows * window_size;
+  double energy = 0.0;
+  size_t window = 0;
+  size_t window_samples = 0;
+  for (size_t i = 0; i < num_samples; i += block_size) {
+    modulations.trigger = i % trigger_period < 768 ? 1.0f : 0.0f;
+    v.Render(patch, modulations, frames, block_size);
+    for (size_t j = 0; j < block_size; ++j) {
+      float s = frames[j].out / 32768.0f;
+      energy += s * s;
+      if (++window_samples == window_size) {
+        levels[window++] = 10.0f * log10f(energy / window_size + 1e-10f);
+        energy = 0.0;
+        window_samples = 0;
+      }
+    }
+  }
+}
+
+float AverageLevel(const float* levels, size_t size) {
+  float energy = 0.0f;
+  for (size_t i = 0; i < size; ++i) {
+    energy += powf(10.0f, levels[i] / 10.0f);
+  }
+  return 10.0f * log10f(energy / size + 1e-10f);
+}
+
+void TestVoiceBlockSizes() {
+  const size_t kWindowSize = 4800;
+  const size_t kNumWindows = 40;
+  const size_t kBlockSizes[] = { 64, 128, 256 };
+  // Difference in level tolerated, in dB. The relative phases of the partials
+  // of the chords or of the swarm depend on how the parameters settled, which
+  // is worth about 2dB. Levels are clipped to a floor, so that the tails of
+  // decaying notes do not dominate.
+  const float kTolerance = 3.0f;
+  const float kFloor = -50.0f;
+  // Engines driven by random processes (swarm, noise, particles, strings)
+  // are only compared on their average level.
+  const uint32_t kStochasticEngines = 0x0f00;
+  // Some engines smooth their parameters once per block, so they take longer
+  // to settle with large blocks.
+  const size_t kSettlingWindows = 8;
+  
+  float reference[kNumWindows];
+  float levels[kNumWindows];
+  int num_failures = 0;
+  for (int engine = 0; engine < 16; ++engine) {
+    bool stochastic = kStochasticEngines & (1 << engine);
+    for (int triggered = 0; triggered < 2; ++triggered) {
+      RenderVoiceLevels(
+          engine, triggered, kAudioBlockSize, reference,
+          kNumWindows, kWindowSize);
+      for (size_t b = 0; b < sizeof(kBlockSizes) / sizeof(size_t); ++b) {
+        size_t block_size = kBlockSizes[b];
+        if (block_size > kMaxBlockSize) {
+          continue;
+        }
+        RenderVoiceLevels(
+            engine, triggered, block_size, levels,
+            kNumWindows, kWindowSize);
+        float error = 0.0f;
+        if (stochastic) {
+          error = fabsf(
+              AverageLevel(&levels[kSettlingWindows],
+                  kNumWindows - kSettlingWindows) - 
+              AverageLevel(&reference[kSettlingWindows],
+                  kNumWindows - kSettlingWindows));
+        } else {
+          for (size_t w = kSettlingWindows; w < kNumWindows; ++w) {
+            error = max(error, fabsf(
+                max(levels[w], kFloor) - max(reference[w], kFloor)));
+          }
+        }
+        bool pass = error < kTolerance;
+        num_failures += !pass;
+        printf("Engine %2d %s block %3d: %.2f dB %s\n",
+            engine,
+            triggered ? "triggered" : "free     ",
+            static_cast<int>(block_size),
+            error,
+            pass ? "OK" : "FAIL");
+      }
+    }
+  }
+  printf("%d failures\n", num_failures);
+}
+
+// Largest step between two consecutive samples, right after the engine
+// switches, relative to the largest step elsewhere.
+float RenderEngineSwitches(bool dedicated_ram) {
+  const size_t kSwitchPeriod = 4800;
+  const size_t kNumSamples = kSwitchPeriod * 20;
+  static Voice v;
+  static Voice::Frame frames[kBlockSize];
+  static char ram[kDedicatedRamSize];
+  BufferAllocator allocator(ram, kDedicatedRamSize);
+  if (dedicated_ram) {
+    v.InitWithDedicatedRam(&allocator);
+  } else {
+    v.Init(&allocator);
+  }
+  
+  Patch patch;
+  patch.note = 36.0f;
+  patch.harmonics = 0.0f;
+  patch.timbre = 0.0f;
+  patch.morph = 0.0f;
+  patch.frequency_modulation_amount = 0.0f;
+  patch.timbre_modulation_amount = 0.0f;
+  patch.morph_modulation_amount = 0.0f;
+  patch.decay = 0.5f;
+  patch.lpg_colour = 0.5f;
+
+  Modulations modulations;
+  memset(&modulations, 0, sizeof(modulations));
+  
+  float switch_step = 0.0f;
+  float step = 0.0f;
+  short previous = 0;
+  for (size_t i = 0; i < kNumSamples; i += kBlockSize) {
+    // Sine-like settings of the FM and additive engines.
+    patch.engine = (i / kSwitchPeriod) & 1 ? 2 : 4;
+    v.Render(patch, modulations, frames, kBlockSize);
+    for (size_t j = 0; j < kBlockSize; ++j) {
+      float s = fabsf(frames[j].out - previous) / 32768.0f;
+      previous = frames[j].out;
+      if (i + j < kSwitchPeriod) {
+        continue;
+      }
+      if ((i + j) % kSwitchPeriod < 48) {
+        switch_step = max(switch_step, s);
+      } else {
+        step = max(step, s);
+      }
+    }
+  }
+  return switch_step / step;
+}
+
+void TestVoiceEngineCrossfade() {
+  float shared = RenderEngineSwitches(false);
+  float dedicated = RenderEngineSwitches(true);
+  printf("Engine switch step, shared RAM: %.2f\n", shared);
+  printf("Engine switch step, dedicated RAM: %.2f %s\n",
+      dedicated, dedicated < 1.5f ? "OK" : "FAIL");
+}
+
+void RenderVoicePool(
+    int engine,
+    int num_workers,
+    short* out,
+    size_t num_samples) {
+  // 24 notes for 8 voices, some of them stolen while being held.
+  static VoicePool pool;
+  pool.Init(8, num_workers);
+  Patch patch;
+  memset(&patch, 0, sizeof(patch));
+  patch.engine = engine;
+  patch.harmonics = 0.3f;
+  patch.timbre = 0.6f;
+  patch.morph = 0.4f;
+  patch.decay = 0.5f;
+  patch.lpg_colour = 0.5f;
+  pool.set_patch(patch);
+  
+  Voice::Frame frames[kBlockSize];
+  for (size_t i = 0; i < num_samples; i += kBlockSize) {
+    size_t step = i / 2400;
+    if (i % 2400 == 0 && step < 24) {
+      pool.NoteOn(48 + step * 7 % 24, 0.5f + 0.02f * step);
+    }
+    if (i % 2400 == 1200 && step % 3 == 0) {
+      pool.NoteOff(48 + step * 7 % 24);
+    }
+    pool.Render(0.25f, frames, kBlockSize);
+    for (size_t j = 0; j < kBlockSize; ++j) {
+      out[i + j] = frames[j].out;
+    }
+  }
+  pool.Shutdown();
+}
+
+void TestVoicePool() {
+  // The output must not depend on the number of workers, including with an
+  // engine using stmlib::Random (strings).
+  const size_t kNumSamples = kSampleRate * 2;
+  static short out[2][kNumSamples];
+  const int engines[] = { 0, 11 };
+  for (int i = 0; i < 2; ++i) {
+    RenderVoicePool(engines[i], 1, out[0], kNumSamples);
+    RenderVoicePool(engines[i], 4, out[1], kNumSamples);
+    bool match = !memcmp(out[0], out[1], sizeof(out[0]));
+    printf("Voice pool, engine %d, 1 vs 4 workers: %s\n",
+        engines[i], match ? "OK" : "FAIL");
+  }
+  
+  // Voice allocation.
+  static VoicePool pool;
+  pool.Init(4, 1);
+  Patch patch;
+  memset(&patch, 0, sizeof(patch));
+  patch.decay = 0.5f;
+  pool.set_patch(patch);
+  Voice::Frame frames[kBlockSize];
+  const int notes[] = { 60, 62, 64, 65 };
+  for (int i = 0; i < 4; ++i) {
+    pool.NoteOn(notes[i], 0.8f);
+    pool.Render(0.25f, frames, kBlockSize);
+  }
+  bool pass = true;
+  // Same note: same voice.
+  pass = pass && pool.NoteOn(62, 0.8f) == 1;
+  // The released voice is reused before any held voice.
+  pool.NoteOff(64);
+  pool.Render(0.25f, frames, kBlockSize);
+  pass = pass && pool.NoteOn(67, 0.8f) == 2;
+  // Then the oldest held voice is stolen.
+  pass = pass && pool.NoteOn(69, 0.8f) == 0;
+  pool.Shutdown();
+  printf("Voice pool, allocation: %s\n", pass ? "OK" : "FAIL");
+}
+
 void TestFMGlitch() {
   WavWriter wav_writer(2, kSampleRate, 200);
   wav_writer.Open("plaits_fm_glitch.wav");
@@ -1026,6 +1635,7 @@ int main(void) {
   // TestVosimOscillator();
   // TestZOscillator();
   // TestHarmonicOscillator();
+  // TestHarmonicOscillatorKernels();
 
   // TestAdditiveEngine();
   // TestChordEngine();
@@ -1036,6 +1646,7 @@ int main(void) {
   // TestNoiseEngine();
   // TestParticleEngine();
   // TestSpeechEngine();
+  // TestLPCSpeechSynthWordBank();
   // TestSwarmEngine();
   // TestVirtualAnalogEngine();
   // TestWaveshapingEngine();
@@ -1047,10 +1658,17 @@ int main(void) {
   // TestVariableSawOscillator();
   
   // TestSampleRateReducer();
+  // TestResonatorSvfKernels();
+  // TestSwarmOscillatorBankKernels();
   // TestVoice();
+  // TestVoiceBlockSizes();
+  // TestVoiceEngineCrossfade();
+  // TestVoicePool();
   // TestFMGlitch();
   // TestLimiterGlitch();
   // EnumerateWavetables();
+  // TestWavetableSliceCaching();
+  // TestWavetableEngineSwitch();
   
   // TestLPGAttackDecay();
 }
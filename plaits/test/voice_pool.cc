@@ -0,0 +1,361 @@
+// Copyright 2021 Chris Rogers.
+//
+// Author: Chris Rogers
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -----------------------------------------------------------------------------
+//
+// Polyphonic host-side Plaits: independent voices, each with its own RAM,
+// rendered by a pool of worker processes.
+
+#include "plaits/test/voice_pool.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <xmmintrin.h>
+
+#include "stmlib/utils/random.h"
+
+#include "plaits/test/worker_processes.h"
+
+namespace plaits {
+
+using namespace std;
+using namespace stmlib;
+
+const float kTriggerDuration = 0.005f;
+
+// A released voice is not rendered any more once its output has stayed below
+// this level for this time.
+const int kSilenceThreshold = 2;
+const size_t kSilenceDuration = kSampleRate * 0.1f;
+
+bool VoicePool::Init(int num_voices, int num_workers) {
+  num_voices_ = num_voices;
+  num_workers_ = num_workers;
+  CONSTRAIN(num_voices_, 1, kMaxPoolVoices);
+  CONSTRAIN(num_workers_, 1, kMaxPoolWorkers);
+  num_active_voices_ = 0;
+  age_ = 0;
+
+  // Mapped before forking, so at the same address in all the workers.
+  voices_ = static_cast<PoolVoice*>(
+      MapShared(num_voices_ * sizeof(PoolVoice)));
+  ram_ = static_cast<char*>(MapShared(num_voices_ * kSharedRamSize));
+  shared_ = static_cast<SharedState*>(MapShared(sizeof(SharedState)));
+  if (!voices_ || !ram_ || !shared_) {
+    Unmap();
+    return false;
+  }
+
+  memset(&patch_, 0, sizeof(patch_));
+  for (int i = 0; i < num_voices_; ++i) {
+    PoolVoice* v = new(&voices_[i]) PoolVoice;
+    v->ram = &ram_[i * kSharedRamSize];
+    v->allocator.Init(v->ram, kSharedRamSize);
+    v->voice.Init(&v->allocator);
+    memset(&v->modulations, 0, sizeof(v->modulations));
+    v->modulations.trigger_patched = true;
+    v->modulations.level_patched = true;
+    v->random_state = (i + 1) * 2654435761u;
+    v->note = -1;
+    v->velocity = 0.0f;
+    v->gate = false;
+    v->retrigger = false;
+    v->trigger_samples = 0;
+    v->age = 0;
+    v->level = 0;
+    v->silent_samples = 0;
+    v->idle = true;
+  }
+
+  pthread_mutexattr_t mutex_attr;
+  pthread_mutexattr_init(&mutex_attr);
+  pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutex_init(&shared_->mutex, &mutex_attr);
+  pthread_mutexattr_destroy(&mutex_attr);
+  pthread_condattr_t cond_attr;
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+  pthread_cond_init(&shared_->start, &cond_attr);
+  pthread_cond_init(&shared_->done, &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
+
+  const int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+  for (int i = 1; i < num_workers_; ++i) {
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+      PinToCore(i % num_cores);
+      RunWorker(i);
+      _exit(0);
+    } else if (pid < 0) {
+      num_workers_ = i;
+      Shutdown();
+      return false;
+    }
+    workers_[i] = pid;
+  }
+  return true;
+}
+
+void VoicePool::Shutdown() {
+  pthread_mutex_lock(&shared_->mutex);
+  shared_->quit = true;
+  pthread_cond_broadcast(&shared_->start);
+  pthread_mutex_unlock(&shared_->mutex);
+  for (int i = 1; i < num_workers_; ++i) {
+    waitpid(workers_[i], NULL, 0);
+  }
+  pthread_cond_destroy(&shared_->done);
+  pthread_cond_destroy(&shared_->start);
+  pthread_mutex_destroy(&shared_->mutex);
+  Unmap();
+}
+
+void VoicePool::Unmap() {
+  if (shared_) {
+    UnmapShared(shared_, sizeof(SharedState));
+    shared_ = NULL;
+  }
+  if (voices_) {
+    UnmapShared(voices_, num_voices_ * sizeof(PoolVoice));
+    voices_ = NULL;
+  }
+  if (ram_) {
+    UnmapShared(ram_, num_voices_ * kSharedRamSize);
+    ram_ = NULL;
+  }
+}
+
+int VoicePool::FindVoice(int note) const {
+  int found = -1;
+  for (int i = 0; i < num_voices_; ++i) {
+    const PoolVoice& v = voices_[i];
+    if (v.idle || v.note != note) {
+      continue;
+    }
+    if (found == -1 || (v.gate && !voices_[found].gate)) {
+      found = i;
+    }
+  }
+  return found;
+}
+
+int VoicePool::NoteOn(int note, float velocity) {
+  // A note played again retriggers its voice. Otherwise, the new note goes
+  // to the voice that has been idle for the longest time, then to the
+  // quietest released voice, and as a last resort to the oldest voice.
+  int index = FindVoice(note);
+  if (index == -1) {
+    int best_rank = 3;
+    for (int i = 0; i < num_voices_; ++i) {
+      const PoolVoice& v = voices_[i];
+      int rank = v.idle ? 0 : (v.gate ? 2 : 1);
+      if (rank > best_rank) {
+        continue;
+      }
+      if (rank < best_rank) {
+        best_rank = rank;
+        index = i;
+        continue;
+      }
+      const PoolVoice& best = voices_[index];
+      bool better = rank == 1 ? v.level < best.level : v.age < best.age;
+      if (better) {
+        index = i;
+      }
+    }
+  }
+
+  PoolVoice* v = &voices_[index];
+  // The trigger input must go low before a new rising edge.
+  v->retrigger = v->trigger_samples > 0;
+  v->trigger_samples = kTriggerDuration * kSampleRate;
+  v->note = note;
+  v->velocity = velocity;
+  v->gate = true;
+  v->age = ++age_;
+  v->silent_samples = 0;
+  v->idle = false;
+  return index;
+}
+
+void VoicePool::NoteOff(int note) {
+  for (int i = 0; i < num_voices_; ++i) {
+    PoolVoice* v = &voices_[i];
+    if (v->gate && v->note == note) {
+      v->gate = false;
+    }
+  }
+}
+
+void VoicePool::RenderVoice(PoolVoice* v) {
+  Random::Seed(v->random_state);
+  v->voice.Render(v->patch, v->modulations, v->frames, shared_->block_size);
+  v->random_state = Random::state();
+}
+
+bool VoicePool::PopTask(int queue, int* task) {
+  TaskQueue* q = &shared_->queues[queue];
+  while (true) {
+    uint64_t range = q->range;
+    uint32_t front = range;
+    uint32_t back = range >> 32;
+    if (front >= back) {
+      return false;
+    }
+    if (__sync_bool_compare_and_swap(&q->range, range, range + 1)) {
+      *task = q->tasks[front];
+      return true;
+    }
+  }
+}
+
+bool VoicePool::StealTask(int queue, int* task) {
+  for (int i = 1; i < num_workers_; ++i) {
+    TaskQueue* q = &shared_->queues[(queue + i) % num_workers_];
+    while (true) {
+      uint64_t range = q->range;
+      uint32_t front = range;
+      uint32_t back = range >> 32;
+      if (front >= back) {
+        break;
+      }
+      uint64_t stolen = (static_cast<uint64_t>(back - 1) << 32) | front;
+      if (__sync_bool_compare_and_swap(&q->range, range, stolen)) {
+        *task = q->tasks[back - 1];
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void VoicePool::RenderTasks(int queue) {
+  int task;
+  while (PopTask(queue, &task) || StealTask(queue, &task)) {
+    RenderVoice(&voices_[task]);
+    if (__sync_sub_and_fetch(&shared_->remaining_tasks, 1) == 0) {
+      pthread_mutex_lock(&shared_->mutex);
+      pthread_cond_signal(&shared_->done);
+      pthread_mutex_unlock(&shared_->mutex);
+    }
+  }
+}
+
+void VoicePool::RunWorker(int index) {
+  _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+  uint32_t generation = 0;
+  while (true) {
+    pthread_mutex_lock(&shared_->mutex);
+    while (shared_->generation == generation && !shared_->quit) {
+      pthread_cond_wait(&shared_->start, &shared_->mutex);
+    }
+    generation = shared_->generation;
+    bool quit = shared_->quit;
+    pthread_mutex_unlock(&shared_->mutex);
+    if (quit) {
+      break;
+    }
+    RenderTasks(index);
+  }
+}
+
+void VoicePool::Render(float gain, Voice::Frame* frames, size_t size) {
+  shared_->block_size = size;
+
+  // Control-rate updates, and distribution of the voices to the queues.
+  int num_tasks[kMaxPoolWorkers];
+  fill(&num_tasks[0], &num_tasks[num_workers_], 0);
+  num_active_voices_ = 0;
+  for (int i = 0; i < num_voices_; ++i) {
+    PoolVoice* v = &voices_[i];
+    if (v->idle) {
+      continue;
+    }
+    Modulations* m = &v->modulations;
+    if (v->retrigger) {
+      m->trigger = 0.0f;
+      v->retrigger = false;
+    } else {
+      m->trigger = v->trigger_samples ? 1.0f : 0.0f;
+      v->trigger_samples -= min(size, v->trigger_samples);
+    }
+    m->level = v->gate ? v->velocity : 0.0f;
+    v->patch = patch_;
+    v->patch.note = v->note;
+
+    int queue = num_active_voices_ % num_workers_;
+    shared_->queues[queue].tasks[num_tasks[queue]++] = i;
+    ++num_active_voices_;
+  }
+
+  if (num_active_voices_) {
+    shared_->remaining_tasks = num_active_voices_;
+    __sync_synchronize();
+    for (int i = 0; i < num_workers_; ++i) {
+      shared_->queues[i].range = static_cast<uint64_t>(num_tasks[i]) << 32;
+    }
+    __sync_synchronize();
+    if (num_workers_ > 1) {
+      pthread_mutex_lock(&shared_->mutex);
+      ++shared_->generation;
+      pthread_cond_broadcast(&shared_->start);
+      pthread_mutex_unlock(&shared_->mutex);
+    }
+    RenderTasks(0);
+    pthread_mutex_lock(&shared_->mutex);
+    while (shared_->remaining_tasks) {
+      pthread_cond_wait(&shared_->done, &shared_->mutex);
+    }
+    pthread_mutex_unlock(&shared_->mutex);
+  }
+
+  // Mix, always in the same order.
+  float out[kMaxBlockSize];
+  float aux[kMaxBlockSize];
+  fill(&out[0], &out[size], 0.0f);
+  fill(&aux[0], &aux[size], 0.0f);
+  for (int i = 0; i < num_voices_; ++i) {
+    PoolVoice* v = &voices_[i];
+    if (v->idle) {
+      continue;
+    }
+    int level = 0;
+    for (size_t j = 0; j < size; ++j) {
+      out[j] += v->frames[j].out;
+      aux[j] += v->frames[j].aux;
+      level = max(level, max(abs(v->frames[j].out), abs(v->frames[j].aux)));
+    }
+    v->level = level;
+    if (!v->gate && level < kSilenceThreshold) {
+      v->silent_samples += size;
+      v->idle = v->silent_samples >= kSilenceDuration;
+    } else {
+      v->silent_samples = 0;
+    }
+  }
+  for (size_t j = 0; j < size; ++j) {
+    frames[j].out = Clip16(static_cast<int32_t>(out[j] * gain));
+    frames[j].aux = Clip16(static_cast<int32_t>(aux[j] * gain));
+  }
+}
+
+}  // namespace plaits
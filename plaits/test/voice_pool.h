@@ -0,0 +1,139 @@
+// Copyright 2021 Chris Rogers.
+//
+// Author: Chris Rogers
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -----------------------------------------------------------------------------
+//
+// Polyphonic host-side Plaits: independent voices, each with its own RAM,
+// rendered by a pool of worker processes (see worker_processes.h). The
+// voices, their RAM and the task queues are in memory shared by the workers.
+//
+// Each block, the voices to render are dealt to the workers, one queue per
+// worker. A worker renders the voices from the front of its own queue, then
+// steals from the back of the other queues. The voices are mixed in the same
+// order whatever the worker that rendered them. Each voice also keeps its own
+// stmlib::Random state, loaded into the state of the rendering process for
+// the duration of its block, so the output does not depend on the scheduling,
+// even with the engines using noise.
+
+#ifndef PLAITS_TEST_VOICE_POOL_H_
+#define PLAITS_TEST_VOICE_POOL_H_
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "stmlib/stmlib.h"
+
+#include "plaits/dsp/voice.h"
+
+namespace plaits {
+
+const int kMaxPoolVoices = 64;
+const int kMaxPoolWorkers = 32;
+
+class VoicePool {
+ public:
+  VoicePool() { }
+  ~VoicePool() { }
+
+  // The process calling Render is one of the num_workers workers. Returns
+  // false if the shared memory or the processes could not be created.
+  bool Init(int num_voices, int num_workers);
+  void Shutdown();
+
+  // Applies to all voices, except for the note.
+  void set_patch(const Patch& patch) { patch_ = patch; }
+
+  // Returns the index of the voice playing the note.
+  int NoteOn(int note, float velocity);
+  void NoteOff(int note);
+
+  // Mix of all voices, multiplied by gain.
+  void Render(float gain, Voice::Frame* frames, size_t size);
+
+  inline int num_voices() const { return num_voices_; }
+  inline int num_active_voices() const { return num_active_voices_; }
+  inline int note(int voice) const { return voices_[voice].note; }
+  inline bool gate(int voice) const { return voices_[voice].gate; }
+
+ private:
+  struct PoolVoice {
+    Voice voice;
+    stmlib::BufferAllocator allocator;
+    char* ram;
+    Patch patch;
+    Modulations modulations;
+    Voice::Frame frames[kMaxBlockSize];
+    uint32_t random_state;
+
+    int note;
+    float velocity;
+    bool gate;
+    bool retrigger;
+    size_t trigger_samples;
+
+    // For voice allocation.
+    uint32_t age;
+    int level;
+    size_t silent_samples;
+    bool idle;
+  };
+
+  // Packs the indices of the first and past-the-last voices left in the
+  // queue, so that both ends can be claimed by a single compare-and-swap.
+  struct TaskQueue {
+    volatile uint64_t range;
+    int tasks[kMaxPoolVoices];
+    char padding[64];
+  };
+
+  // The mutex and the conditions are shared between processes.
+  struct SharedState {
+    TaskQueue queues[kMaxPoolWorkers];
+    volatile int remaining_tasks;
+    size_t block_size;
+    uint32_t generation;
+    bool quit;
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+  };
+
+  void RunWorker(int index);
+  void Unmap();
+
+  void RenderTasks(int queue);
+  bool PopTask(int queue, int* task);
+  bool StealTask(int queue, int* task);
+
+  void RenderVoice(PoolVoice* v);
+  int FindVoice(int note) const;
+
+  int num_voices_;
+  int num_workers_;
+  int num_active_voices_;
+  PoolVoice* voices_;
+  char* ram_;
+  Patch patch_;
+  uint32_t age_;
+
+  SharedState* shared_;
+  pid_t workers_[kMaxPoolWorkers];
+
+  DISALLOW_COPY_AND_ASSIGN(VoicePool);
+};
+
+}  // namespace plaits
+
+#endif  // PLAITS_TEST_VOICE_POOL_H_
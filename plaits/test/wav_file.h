@@ -0,0 +1,112 @@
+// Copyright 2021 Chris Rogers.
+//
+// Author: Chris Rogers
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -----------------------------------------------------------------------------
+//
+// 16-bit WAV file, written as it is rendered.
+
+#ifndef PLAITS_TEST_WAV_FILE_H_
+#define PLAITS_TEST_WAV_FILE_H_
+
+#include <cstdio>
+
+#include "stmlib/stmlib.h"
+
+#include "plaits/dsp/dsp.h"
+
+namespace plaits {
+
+class WavFile {
+ public:
+  WavFile() : fp_(NULL) { }
+  ~WavFile() { Close(); }
+
+  bool Open(const char* file_name, int num_channels) {
+    fp_ = fopen(file_name, "wb");
+    if (!fp_) {
+      return false;
+    }
+    num_channels_ = num_channels;
+    num_frames_ = 0;
+    ok_ = true;
+    // The sizes are filled in when the file is closed.
+    WriteHeader();
+    return ok_;
+  }
+
+  // Returns false, and keeps doing so, once a write has failed (disk full...).
+  bool Write(const short* samples, size_t num_frames) {
+    size_t size = num_frames * num_channels_;
+    ok_ = ok_ && fwrite(samples, sizeof(short), size, fp_) == size;
+    num_frames_ += num_frames;
+    return ok_;
+  }
+
+  // Returns false if any part of the file could not be written: the file is
+  // then incomplete.
+  bool Close() {
+    if (!fp_) {
+      return false;
+    }
+    ok_ = ok_ && fseek(fp_, 0, SEEK_SET) == 0;
+    if (ok_) {
+      WriteHeader();
+    }
+    ok_ = (fclose(fp_) == 0) && ok_;
+    fp_ = NULL;
+    return ok_;
+  }
+
+ private:
+  void WriteBytes(const void* data, size_t size) {
+    ok_ = ok_ && fwrite(data, size, 1, fp_) == 1;
+  }
+
+  void WriteUInt32(uint32_t value) {
+    WriteBytes(&value, sizeof(value));
+  }
+
+  void WriteUInt16(uint16_t value) {
+    WriteBytes(&value, sizeof(value));
+  }
+
+  void WriteHeader() {
+    const uint32_t data_size = num_frames_ * num_channels_ * sizeof(short);
+    const uint32_t sample_rate = kSampleRate;
+    WriteBytes("RIFF", 4);
+    WriteUInt32(36 + data_size);
+    WriteBytes("WAVEfmt ", 8);
+    WriteUInt32(16);
+    WriteUInt16(1);
+    WriteUInt16(num_channels_);
+    WriteUInt32(sample_rate);
+    WriteUInt32(sample_rate * num_channels_ * sizeof(short));
+    WriteUInt16(num_channels_ * sizeof(short));
+    WriteUInt16(16);
+    WriteBytes("data", 4);
+    WriteUInt32(data_size);
+  }
+
+  FILE* fp_;
+  int num_channels_;
+  uint32_t num_frames_;
+  bool ok_;
+
+  DISALLOW_COPY_AND_ASSIGN(WavFile);
+};
+
+}  // namespace plaits
+
+#endif  // PLAITS_TEST_WAV_FILE_H_
@@ -0,0 +1,56 @@
+// Copyright 2021 Chris Rogers.
+//
+// Author: Chris Rogers
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -----------------------------------------------------------------------------
+//
+// Helpers for the worker processes of plaits_render and VoicePool. The
+// engines draw their noise from stmlib::Random, whose state is global: the
+// workers are processes rather than threads so that each has its own.
+
+#ifndef PLAITS_TEST_WORKER_PROCESSES_H_
+#define PLAITS_TEST_WORKER_PROCESSES_H_
+
+#include <sched.h>
+#include <sys/mman.h>
+
+#include <cstddef>
+
+namespace plaits {
+
+// Pins the calling process to a core, on Linux.
+inline void PinToCore(int core) {
+#ifdef __linux__
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(core, &cpu_set);
+  sched_setaffinity(0, sizeof(cpu_set), &cpu_set);
+#endif  // __linux__
+}
+
+// Zeroed memory, shared with the processes forked afterwards. Returns NULL on
+// failure.
+inline void* MapShared(size_t size) {
+  void* memory = mmap(
+      NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  return memory == MAP_FAILED ? NULL : memory;
+}
+
+inline void UnmapShared(void* memory, size_t size) {
+  munmap(memory, size);
+}
+
+}  // namespace plaits
+
+#endif  // PLAITS_TEST_WORKER_PROCESSES_H_
@@ -0,0 +1,107 @@
+// Copyright 2021 Chris Rogers.
+//
+// Author: Chris Rogers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Deferred clock events.
+
+#include "yarns/clock_event_queue.h"
+
+namespace yarns {
+
+void ClockEventQueue::Init() {
+  size_ = 0;
+  now_ = 0;
+  request_write_ptr_ = 0;
+  request_read_ptr_ = 0;
+  overflows_ = 0;
+}
+
+bool ClockEventQueue::Post(uint8_t type, uint16_t data, uint16_t delay) {
+  uint8_t next = (request_write_ptr_ + 1) % kNumRequests;
+  if (next == request_read_ptr_) {
+    ++overflows_;
+    return false;
+  }
+  Request& r = requests_[request_write_ptr_];
+  r.type = type;
+  r.data = data;
+  r.delay = delay;
+  request_write_ptr_ = next;
+  return true;
+}
+
+bool ClockEventQueue::PostCancel(uint8_t type) {
+  return Post(kCancel, type, 0);
+}
+
+void ClockEventQueue::ApplyRequests() {
+  while (request_read_ptr_ != request_write_ptr_) {
+    const Request& r = requests_[request_read_ptr_];
+    if (r.type == kCancel) {
+      Cancel(r.data);
+    } else {
+      Schedule(r.type, r.data, r.delay);
+    }
+    request_read_ptr_ = (request_read_ptr_ + 1) % kNumRequests;
+  }
+}
+
+void ClockEventQueue::Schedule(uint8_t type, uint16_t data, uint16_t delay) {
+  if (size_ == kCapacity) {
+    ++overflows_;
+    return;
+  }
+  // Events due at the same time fire in the order they were scheduled.
+  uint8_t i = size_;
+  while (i && static_cast<uint16_t>(events_[i - 1].deadline - now_) > delay) {
+    events_[i] = events_[i - 1];
+    --i;
+  }
+  ClockEvent& e = events_[i];
+  e.deadline = now_ + delay;
+  e.type = type;
+  e.data = data;
+  ++size_;
+}
+
+void ClockEventQueue::Cancel(uint8_t type) {
+  uint8_t i = 0;
+  while (i < size_) {
+    if (events_[i].type == type) {
+      Remove(i);
+    } else {
+      ++i;
+    }
+  }
+}
+
+void ClockEventQueue::Remove(uint8_t index) {
+  --size_;
+  for (uint8_t i = index; i < size_; ++i) {
+    events_[i] = events_[i + 1];
+  }
+}
+
+}  // namespace yarns
@@ -0,0 +1,117 @@
+// Copyright 2021 Chris Rogers.
+//
+// Author: Chris Rogers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Deferred clock events (swung ticks, end of clock and reset pulses), kept in
+// deadline order so that SysTick only has to look at the earliest one.
+//
+// Events are posted from the main loop through a small FIFO, and moved into
+// the queue by SysTick, which is the only context that reads or modifies it.
+// Delays are counted in SysTicks, and events with no delay fire on the next
+// SysTick.
+
+#ifndef YARNS_CLOCK_EVENT_QUEUE_H_
+#define YARNS_CLOCK_EVENT_QUEUE_H_
+
+#include "stmlib/stmlib.h"
+
+namespace yarns {
+
+struct ClockEvent {
+  uint16_t deadline;
+  uint8_t type;
+  uint16_t data;
+};
+
+class ClockEventQueue {
+ public:
+  ClockEventQueue() { }
+  ~ClockEventQueue() { }
+
+  void Init();
+
+  // From the main loop. Returns false if the event was dropped.
+  bool Post(uint8_t type, uint16_t data, uint16_t delay);
+  // From the main loop: drops the pending events of a type, including those
+  // posted before.
+  bool PostCancel(uint8_t type);
+
+  // From SysTick.
+  void Schedule(uint8_t type, uint16_t data, uint16_t delay);
+  void Cancel(uint8_t type);
+
+  // From SysTick, once per tick, before polling.
+  inline void Tick() {
+    ++now_;
+    if (request_read_ptr_ != request_write_ptr_) {
+      ApplyRequests();
+    }
+  }
+
+  // From SysTick: pops the next event due on this tick, if any.
+  inline bool Poll(ClockEvent* event) {
+    if (!size_ || events_[0].deadline != now_) {
+      return false;
+    }
+    *event = events_[0];
+    Remove(0);
+    return true;
+  }
+
+  inline uint8_t size() const { return size_; }
+  inline uint16_t overflows() const { return overflows_; }
+
+ private:
+  static const uint8_t kCapacity = 8;
+  static const uint8_t kNumRequests = 8;
+  static const uint8_t kCancel = 0xff;
+
+  struct Request {
+    uint8_t type;
+    uint16_t data;
+    uint16_t delay;
+  };
+
+  void ApplyRequests();
+  void Remove(uint8_t index);
+
+  // Sorted by distance to now_.
+  ClockEvent events_[kCapacity];
+  uint8_t size_;
+  uint16_t now_;
+
+  // Written by the main loop, read by SysTick.
+  Request requests_[kNumRequests];
+  volatile uint8_t request_write_ptr_;
+  volatile uint8_t request_read_ptr_;
+
+  uint16_t overflows_;
+
+  DISALLOW_COPY_AND_ASSIGN(ClockEventQueue);
+};
+
+}  // namespace yarns
+
+#endif  // YARNS_CLOCK_EVENT_QUEUE_H_
@@ -0,0 +1,120 @@
+// Copyright 2021 Chris Rogers.
+//
+// Author: Chris Rogers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Interleaved DAC frames.
+
+#include "yarns/dac_frame_producer.h"
+
+#include <algorithm>
+
+namespace yarns {
+
+using namespace std;
+
+void DacFrameProducer::Init() {
+  for (uint8_t i = 0; i < kDacLatency; ++i) {
+    fill(&delayed_cv_[i][0], &delayed_cv_[i][kNumDacChannels], 0);
+    fill(&delayed_gate_[i][0], &delayed_gate_[i][kNumDacChannels], false);
+  }
+  delay_ptr_ = 0;
+  pending_write_ptr_ = 0;
+  pending_read_ptr_ = 0;
+  dropped_ = 0;
+  num_rendered_ = 0;
+  num_played_ = 0;
+  write_segment_ = 0;
+  for (uint8_t i = 0; i < kNumDacChannels; ++i) {
+    interpolator_[i].Init(kFramesPerRefresh);
+  }
+  playing_ = false;
+  read_segment_ = 0;
+  read_frame_ = 0;
+  underruns_ = 0;
+}
+
+void DacFrameProducer::Capture(const CVOutput* outputs) {
+  uint8_t next = (pending_write_ptr_ + 1) % kNumPending;
+  if (next == pending_read_ptr_) {
+    // The main loop has stalled (flash erase...): envelopes resume from where
+    // they stopped.
+    ++dropped_;
+    return;
+  }
+  Snapshot& s = pending_[pending_write_ptr_];
+  for (uint8_t i = 0; i < kNumDacChannels; ++i) {
+    const CVOutput& output = outputs[i];
+    if (output.is_audio()) {
+      s.mode[i] = DAC_CHANNEL_AUDIO;
+    } else if (output.is_envelope()) {
+      s.mode[i] = DAC_CHANNEL_ENVELOPE;
+    } else {
+      s.mode[i] = DAC_CHANNEL_DC;
+    }
+    s.target[i] = output.dc_dac_code();
+  }
+  pending_write_ptr_ = next;
+}
+
+void DacFrameProducer::Delay(uint16_t* cv, bool* gate) {
+  for (uint8_t i = 0; i < kNumDacChannels; ++i) {
+    swap(cv[i], delayed_cv_[delay_ptr_][i]);
+    swap(gate[i], delayed_gate_[delay_ptr_][i]);
+  }
+  delay_ptr_ = (delay_ptr_ + 1) % kDacLatency;
+}
+
+void DacFrameProducer::Render(CVOutput* outputs) {
+  if (pending_read_ptr_ != pending_write_ptr_ &&
+      num_ready() < kNumDacSegments) {
+    const Snapshot& s = pending_[pending_read_ptr_];
+    Segment& segment = segment_[write_segment_];
+    for (uint8_t i = 0; i < kNumDacChannels; ++i) {
+      segment.mode[i] = s.mode[i];
+      if (s.mode[i] == DAC_CHANNEL_AUDIO) {
+        CVOutput* output = &outputs[i];
+        for (uint8_t f = 0; f < kFramesPerRefresh; ++f) {
+          segment.frame[f][i] = output->GetAudioSample();
+        }
+      } else if (s.mode[i] == DAC_CHANNEL_ENVELOPE) {
+        Interpolator* interpolator = &interpolator_[i];
+        interpolator->SetTarget(s.target[i] >> 1);
+        interpolator->ComputeSlope();
+        for (uint8_t f = 0; f < kFramesPerRefresh; ++f) {
+          interpolator->Tick();
+          segment.frame[f][i] = interpolator->value() << 1;
+        }
+      }
+    }
+    pending_read_ptr_ = (pending_read_ptr_ + 1) % kNumPending;
+    write_segment_ = (write_segment_ + 1) % kNumDacSegments;
+    ++num_rendered_;
+  }
+}
+
+/* extern */
+DacFrameProducer dac_frame_producer;
+
+}  // namespace yarns
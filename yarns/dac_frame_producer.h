@@ -0,0 +1,175 @@
+// Copyright 2021 Chris Rogers.
+//
+// Author: Chris Rogers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Interleaved DAC frames, rendered in the main loop one CV refresh period at a
+// time, and read one word at a time by the DAC interrupt.
+//
+// At each CV refresh, the mode of every output (audio, envelope or DC) and its
+// DC target are captured. The main loop then renders the 24 frames up to the
+// next refresh: audio outputs read their voices' buffers, and envelope outputs
+// ramp towards the target, exactly as the interrupt used to do sample by
+// sample. DC outputs are not rendered: the interrupt keeps writing the value
+// latched by SysTick.
+//
+// Playback starts once kNumDacSegments periods are ready, so rendered outputs
+// lag the refresh by five periods (2.5ms), and the main loop may stall that
+// long (MIDI burst, display, SysEx, flash writes) without an underrun. This is
+// about the lookahead of the former per-voice audio buffers. SysTick delays
+// the DC values and the gates by as much, so that every output, and so the
+// whole MIDI to CV path, has 2.5ms of added latency. The segments take about
+// 1.2KB of RAM.
+
+#ifndef YARNS_DAC_FRAME_PRODUCER_H_
+#define YARNS_DAC_FRAME_PRODUCER_H_
+
+#include "stmlib/stmlib.h"
+
+#include "yarns/interpolator.h"
+#include "yarns/voice.h"
+
+namespace yarns {
+
+const uint8_t kNumDacChannels = 4;
+const uint8_t kFramesPerRefresh = 24;  // 48kHz / 2kHz
+const uint8_t kNumDacSegments = 6;
+// In refresh periods.
+const uint8_t kDacLatency = kNumDacSegments - 1;
+
+enum DacChannelMode {
+  DAC_CHANNEL_DC,
+  DAC_CHANNEL_ENVELOPE,
+  DAC_CHANNEL_AUDIO,
+};
+
+class DacFrameProducer {
+ public:
+  DacFrameProducer() { }
+  ~DacFrameProducer() { }
+
+  void Init();
+
+  // From SysTick, once the CV outputs have been refreshed.
+  void Capture(const CVOutput* outputs);
+
+  // From SysTick, once the CV outputs have been read: swaps the DC values and
+  // gates for those of kDacLatency periods ago.
+  void Delay(uint16_t* cv, bool* gate);
+
+  // From the main loop, once the voices have rendered their blocks. Renders
+  // one captured period if a segment is free: the voices render a block
+  // between two calls, so their buffers always hold the samples needed.
+  void Render(CVOutput* outputs);
+
+  // From the DAC interrupt, for each channel in turn. Returns false if the
+  // channel holds DC, or if nothing is playing yet.
+  inline bool Read(uint8_t channel, uint16_t* sample) {
+    if (!playing_) {
+      if (channel != 0 || num_ready() < kNumDacSegments) {
+        return false;
+      }
+      playing_ = true;
+      read_frame_ = 0;
+    }
+    const Segment& s = segment_[read_segment_];
+    bool rendered = s.mode[channel] != DAC_CHANNEL_DC;
+    if (rendered) {
+      *sample = s.frame[read_frame_][channel];
+    }
+    if (channel == kNumDacChannels - 1) {
+      Advance();
+    }
+    return rendered;
+  }
+
+  inline uint8_t num_ready() const {
+    return static_cast<uint8_t>(num_rendered_ - num_played_);
+  }
+  inline uint16_t underruns() const { return underruns_; }
+  inline uint16_t dropped() const { return dropped_; }
+
+ private:
+  // Holds the periods captured during a stall.
+  static const uint8_t kNumPending = kNumDacSegments + 2;
+
+  struct Snapshot {
+    uint8_t mode[kNumDacChannels];
+    uint16_t target[kNumDacChannels];
+  };
+
+  struct Segment {
+    uint8_t mode[kNumDacChannels];
+    uint16_t frame[kFramesPerRefresh][kNumDacChannels];
+  };
+
+  inline void Advance() {
+    if (++read_frame_ < kFramesPerRefresh) {
+      return;
+    }
+    if (num_ready() > 1) {
+      ++num_played_;
+      read_segment_ = (read_segment_ + 1) % kNumDacSegments;
+      read_frame_ = 0;
+    } else {
+      // Hold the last frame until the main loop catches up.
+      read_frame_ = kFramesPerRefresh - 1;
+      ++underruns_;
+    }
+  }
+
+  // SysTick state.
+  uint16_t delayed_cv_[kDacLatency][kNumDacChannels];
+  bool delayed_gate_[kDacLatency][kNumDacChannels];
+  uint8_t delay_ptr_;
+
+  // Written by SysTick, read by the main loop.
+  Snapshot pending_[kNumPending];
+  volatile uint8_t pending_write_ptr_;
+  volatile uint8_t pending_read_ptr_;
+  uint16_t dropped_;
+
+  // Written by the main loop, read by the DAC interrupt. Each side only
+  // increments its own counter. The counters wrap around, so the segments are
+  // indexed separately.
+  Segment segment_[kNumDacSegments];
+  volatile uint8_t num_rendered_;
+  volatile uint8_t num_played_;
+  uint8_t write_segment_;
+  Interpolator interpolator_[kNumDacChannels];
+
+  // DAC interrupt state.
+  bool playing_;
+  uint8_t read_segment_;
+  uint8_t read_frame_;
+  uint16_t underruns_;
+
+  DISALLOW_COPY_AND_ASSIGN(DacFrameProducer);
+};
+
+extern DacFrameProducer dac_frame_producer;
+
+}  // namespace yarns
+
+#endif  // YARNS_DAC_FRAME_PRODUCER_H_
@@ -80,16 +80,47 @@ class Envelope {
     return static_cast<EnvelopeSegment>(segment_);
   }
 
-  // All params 7-bit
-  inline void SetADSR(uint16_t peak, uint8_t a, uint8_t d, uint8_t s, uint8_t r) {
+  // All params 16-bit
+  inline void SetADSR(
+      uint16_t peak, uint16_t a, uint16_t d, uint16_t s, uint16_t r) {
     target_[ENV_SEGMENT_ATTACK] = peak;
-    // TODO could interpolate these from 16-bit parameters
-    increment_[ENV_SEGMENT_ATTACK] = lut_portamento_increments[a];
-    increment_[ENV_SEGMENT_DECAY] = lut_portamento_increments[d];
-    target_[ENV_SEGMENT_DECAY] = target_[ENV_SEGMENT_SUSTAIN] = s << 9;
-    increment_[ENV_SEGMENT_RELEASE] = lut_portamento_increments[r];
+    increment_[ENV_SEGMENT_ATTACK] = SegmentIncrement(a);
+    increment_[ENV_SEGMENT_DECAY] = SegmentIncrement(d);
+    target_[ENV_SEGMENT_DECAY] = target_[ENV_SEGMENT_SUSTAIN] = s;
+    increment_[ENV_SEGMENT_RELEASE] = SegmentIncrement(r);
   }
-  
+
+  // Interpolates between the 128 entries of the portamento time table.
+  static inline uint32_t SegmentIncrement(uint16_t time) {
+    uint16_t index = time >> 9;
+    if (index >= 127) {
+      return lut_portamento_increments[127];
+    }
+    int64_t a = lut_portamento_increments[index];
+    int64_t b = lut_portamento_increments[index + 1];
+    return a + ((b - a) * (time & 0x1ff) >> 9);
+  }
+
+  // exp(-4 * increment / 2^32) as a 0.32 fraction, ie the ratio by which the
+  // distance to the asymptote shrinks at each sample. Computed on the
+  // 1 - x + x^2/2 - x^3/6 series after halving the exponent until x < 2^-8,
+  // then squaring the result back.
+  static inline uint32_t DecayCoefficient(uint32_t increment) {
+    uint64_t x = static_cast<uint64_t>(increment) << 2;
+    uint8_t num_squarings = 0;
+    while (x >= (1UL << 24)) {
+      x >>= 1;
+      ++num_squarings;
+    }
+    uint64_t x2 = x * x >> 32;
+    uint64_t x3 = x2 * x >> 32;
+    uint64_t r = (1ULL << 32) - x + (x2 >> 1) - x3 / 6;
+    while (num_squarings--) {
+      r = r * r >> 32;
+    }
+    return r > 0xffffffff ? 0xffffffff : r;
+  }
+
   inline void Trigger(EnvelopeSegment segment) {
     if (segment == ENV_SEGMENT_DEAD) {
       value_ = 0;
@@ -105,6 +136,13 @@ class Envelope {
     phase_increment_ = increment_[segment];
     segment_ = segment;
     phase_ = 0;
+
+    // The segment follows a + (b - a) * (1 - exp(-4t)) / (1 - exp(-4)), that
+    // is an exponential approach to an asymptote slightly beyond b, which is
+    // crossed at t = 1. distance_ starts at a - asymptote.
+    int64_t delta = static_cast<int32_t>(b_) - static_cast<int32_t>(a_);
+    distance_ = start_distance_ = -((delta * kAsymptoteScale) >> 2);
+    decay_ = phase_increment_ ? DecayCoefficient(phase_increment_) : 0;
   }
 
   inline void RenderSamples(size_t size = kEnvBlockSize) {
@@ -115,9 +153,13 @@ class Envelope {
       if (phase_ < phase_increment_) {
         value_ = b_;
         Trigger(static_cast<EnvelopeSegment>(segment_ + 1));
-      }
-      if (phase_increment_) {
-        value_ = Mix(a_, b_, Interpolate824(lut_env_expo, phase_));
+      } else if (phase_increment_) {
+        // One multiply per sample. The segment ends on b_ exactly, whatever
+        // the rounding errors accumulated by the recursion.
+        distance_ = static_cast<int64_t>(distance_) * decay_ >> 32;
+        int32_t value = a_ + ((distance_ - start_distance_) >> 14);
+        CONSTRAIN(value, 0, UINT16_MAX);
+        value_ = value;
       }
       samples_.Overwrite(value_);
     }
@@ -149,6 +191,14 @@ class Envelope {
   uint32_t phase_;
   uint32_t phase_increment_;
 
+  // 1 / (1 - exp(-4)), 16.16.
+  static const int32_t kAsymptoteScale = 66759;
+
+  // Distance to the asymptote of the current segment, 17.14.
+  int32_t distance_;
+  int32_t start_distance_;
+  uint32_t decay_;
+
   stmlib::RingBuffer<uint16_t, kEnvBlockSize * 2> samples_;
 
   DISALLOW_COPY_AND_ASSIGN(Envelope);
@@ -25,6 +25,18 @@
 // -----------------------------------------------------------------------------
 //
 // Internal clock.
+//
+// The clock phase advances at 48kHz, but rather than being incremented and
+// compared at every sample, it is advanced by whole SysTick periods: each time
+// a tick is due, the number of samples until the next one (including swing)
+// is computed in advance. Ticks fall on the same samples as with a per-sample
+// accumulator.
+//
+// Between ticks, the clock also keeps track of the fraction of the current
+// tick that has elapsed, for consumers that interpolate between ticks.
+//
+// The clock is advanced from SysTick, while tempo and swing are changed from
+// the main loop: changes are posted, and applied by the next Advance.
 
 #ifndef YARNS_INTERNAL_CLOCK_H_
 #define YARNS_INTERNAL_CLOCK_H_
@@ -33,58 +45,132 @@
 
 namespace yarns {
 
+const uint8_t kClockSamplesPerSysTick = 6;  // 48kHz / 8kHz
+const uint8_t kClockSamplesPerRefresh = 24;  // 48kHz / 2kHz
+
+// Position of a clock relative to its most recent tick, as fractions of a
+// tick (0.32). An increment of 0 means that the clock is external, and that
+// its rate has to be estimated from the ticks.
+struct TickPhase {
+  uint32_t phase;  // Elapsed since the tick.
+  uint32_t increment;  // Per CV refresh.
+};
+
 class InternalClock {
  public:
 
   InternalClock() {
     phase_ = 0;
     phase_increment_ = 0;
+    swing_amount_ = 0;
+    requested_phase_increment_ = 0;
+    requested_swing_amount_ = 0;
+    swing_step_ = 0;
+    samples_to_tick_ = UINT32_MAX;
+    tick_phase_ = 0;
+    tick_phase_increment_ = 0;
   }
 
   ~InternalClock() { }
   
+  // Only called while the clock is not being advanced.
   inline void Start(uint32_t tempo, uint8_t swing) {
     phase_ = 0;
     swing_step_ = 11;
+    tick_phase_ = 0;
     set_tempo(tempo);
     set_swing(swing);
+    ApplySettings();
   }
   
   inline void set_tempo(uint32_t tempo) {
-    phase_increment_ = 178957UL * tempo / 10;  // For 48kHz
-    // phase_increment_ = 128849UL * tempo / 6;  // For 40kHz
+    requested_phase_increment_ = 178957UL * tempo / 10;  // For 48kHz
+    // requested_phase_increment_ = 128849UL * tempo / 6;  // For 40kHz
   }
   
   inline void set_swing(uint32_t swing) {
-    swing_amount_ = swing * (0x80000000 / 3 / 100);
+    requested_swing_amount_ = swing * (0x80000000 / 3 / 100);
   }
-  
-  inline bool Process() {
-    uint32_t half_cycle = 0x80000000;
-    if (swing_step_ < 6) {
-      half_cycle += swing_amount_;
-    } else {
-      half_cycle -= swing_amount_;
+
+  // Advances the clock by a number of samples, and returns the number of
+  // ticks that occurred.
+  inline uint8_t Advance(uint32_t num_samples) {
+    if (requested_phase_increment_ != phase_increment_ ||
+        requested_swing_amount_ != swing_amount_) {
+      ApplySettings();
     }
-    
-    bool tick = false;
-    if (phase_ >= half_cycle) {
-      tick = true;
-      phase_ -= half_cycle;
+    uint8_t num_ticks = 0;
+    while (num_samples > samples_to_tick_) {
+      // The sample on which the phase reaches the half cycle.
+      phase_ += samples_to_tick_ * phase_increment_;
+      phase_ -= half_cycle();
+      phase_ += phase_increment_;
+      num_samples -= samples_to_tick_ + 1;
       ++swing_step_;
       if (swing_step_ >= 12) {
         swing_step_ = 0;
       }
+      ++num_ticks;
+      tick_phase_ = 0;
+      Schedule();
     }
-    phase_ += phase_increment_;
-    return tick;
+    phase_ += num_samples * phase_increment_;
+    samples_to_tick_ -= num_samples;
+    tick_phase_ += num_samples * tick_phase_increment_;
+    return num_ticks;
+  }
+
+  inline TickPhase tick_phase() const {
+    TickPhase t;
+    t.phase = tick_phase_;
+    t.increment = tick_phase_increment_ * kClockSamplesPerRefresh;
+    return t;
   }
   
  private:
+  inline uint32_t half_cycle() const {
+    uint32_t half_cycle = 0x80000000;
+    if (swing_step_ < 6) {
+      half_cycle += swing_amount_;
+    } else {
+      half_cycle -= swing_amount_;
+    }
+    return half_cycle;
+  }
+
+  inline void ApplySettings() {
+    phase_increment_ = requested_phase_increment_;
+    swing_amount_ = requested_swing_amount_;
+    Schedule();
+  }
+
+  // Counts the samples until the phase reaches the half cycle, and spreads
+  // what remains of the current tick over them.
+  inline void Schedule() {
+    uint32_t target = half_cycle();
+    if (!phase_increment_) {
+      samples_to_tick_ = UINT32_MAX;
+      tick_phase_increment_ = 0;
+      return;
+    }
+    samples_to_tick_ = phase_ >= target
+        ? 0
+        : (target - phase_ + phase_increment_ - 1) / phase_increment_;
+    tick_phase_increment_ = (UINT32_MAX - tick_phase_) / (samples_to_tick_ + 1);
+  }
+
   uint32_t phase_;
   uint32_t phase_increment_;
   uint32_t swing_amount_;
   uint8_t swing_step_;
+
+  // Written by the main loop, read by Advance.
+  volatile uint32_t requested_phase_increment_;
+  volatile uint32_t requested_swing_amount_;
+
+  uint32_t samples_to_tick_;
+  uint32_t tick_phase_;
+  uint32_t tick_phase_increment_;
    
   DISALLOW_COPY_AND_ASSIGN(InternalClock);
 };
@@ -45,19 +45,71 @@ void JustIntonationProcessor::Init() {
   e.note = 0;
   e.pitch = 0;
   e.weight = 0;
+  e.bin = 0;
   std::fill(&history_[0], &history_[kHistorySize], e);
+
+  ConsonanceBin b;
+  b.pitch_class = 0;
+  b.weight = 0;
+  std::fill(&bins_[0], &bins_[kHistorySize], b);
+}
+
+uint8_t JustIntonationProcessor::FindBin(int16_t pitch) {
+  int16_t pitch_class = (pitch + kOctave * 12) % kOctave;
+  // The bin of the replaced note is empty, at least.
+  uint8_t free_bin = 0;
+  for (uint8_t i = 0; i < kHistorySize; ++i) {
+    if (!bins_[i].weight) {
+      free_bin = i;
+    } else if (bins_[i].pitch_class == pitch_class) {
+      return i;
+    }
+  }
+  bins_[free_bin].pitch_class = pitch_class;
+  return free_bin;
 }
 
-int JustIntonationProcessor::Tune(int note, int min, int max, int step) {
+int16_t JustIntonationProcessor::Tune(int note) {
+  // Interval from each bin in use to the uncorrected note.
+  uint16_t interval[kHistorySize];
+  uint16_t weight[kHistorySize];
+  uint8_t num_bins = 0;
+  int note_class = note % kOctave;
+  for (uint8_t b = 0; b < kHistorySize; ++b) {
+    if (!bins_[b].weight) {
+      continue;
+    }
+    int i = note_class - bins_[b].pitch_class;
+    interval[num_bins] = i < 0 ? i + kOctave : i;
+    weight[num_bins] = bins_[b].weight;
+    ++num_bins;
+  }
+  int coarse = Search(interval, weight, num_bins, -32, 32, 4);
+  return int16_t(note + Search(
+      interval, weight, num_bins, coarse - 6, coarse + 6, 1));
+}
+
+/* static */
+int JustIntonationProcessor::Search(
+    const uint16_t* interval,
+    const uint16_t* weight,
+    uint8_t num_bins,
+    int min,
+    int max,
+    int step) {
   int best_score = 0x7fffffff;
   int best_correction = 0;
   for (int correction = min; correction <= max; correction += step) {
     int score = lut_consonance[
         correction >= 0 ? correction : (kOctave + correction)];
-    int pitch = correction + note;
-    for (size_t i = 0; i < kHistorySize; ++i) {
-      int interval = (pitch - history_[i].pitch + kOctave * 12) % kOctave;
-      score += lut_consonance[interval] * history_[i].weight;
+    for (uint8_t b = 0; b < num_bins; ++b) {
+      int i = interval[b] + correction;
+      if (i < 0) {
+        i += kOctave;
+      } else if (i >= kOctave) {
+        i -= kOctave;
+      }
+      score += lut_consonance[i] * weight[b];
       if (score > best_score) {
         break;
       }
@@ -41,6 +41,12 @@
 // interval involves more convoluted ratios (say 32/27), and goes up according
 // to a square law as we move away from the just intervals.
 // The tuning giving the least badness score is selected.
+//
+// Notes of the history which share a pitch (modulo one octave) are grouped
+// into bins, whose weight is kept up to date as notes are played, released
+// and decayed. Each candidate tuning is then scored against the bins in use
+// rather than against every note of the history, and the interval to each
+// bin is computed once per note rather than once per candidate.
 
 #ifndef YARNS_JUST_INTONATION_PROCESSOR_H_
 #define YARNS_JUST_INTONATION_PROCESSOR_H_
@@ -53,6 +59,12 @@ struct HistoryEntry {
   uint8_t note;
   uint8_t weight;
   int16_t pitch;
+  uint8_t bin;
+};
+
+struct ConsonanceBin {
+  int16_t pitch_class;
+  uint16_t weight;
 };
 
 const size_t kHistorySize = 16;
@@ -67,7 +79,7 @@ class JustIntonationProcessor {
   inline void NoteOff(uint8_t note) {
     for (uint8_t i = 0; i < kHistorySize; ++i) {
       if (history_[i].note == note && history_[i].weight == 255) {
-        history_[i].weight = 192;
+        SetWeight(&history_[i], 192);
       }
     }
   }
@@ -82,12 +94,15 @@ class JustIntonationProcessor {
     // playing.
     for (size_t i = 0; i < kHistorySize; ++i) {
       if (history_[i].weight != 255) {
-        history_[i].weight = (history_[i].weight * 3) >> 2;
+        SetWeight(&history_[i], (history_[i].weight * 3) >> 2);
       }
     }
-    history_[write_ptr_].note = note;
-    history_[write_ptr_].weight = 255;
-    history_[write_ptr_].pitch = cached_pitch_;
+    HistoryEntry* e = &history_[write_ptr_];
+    SetWeight(e, 0);
+    e->note = note;
+    e->pitch = cached_pitch_;
+    e->bin = FindBin(cached_pitch_);
+    SetWeight(e, 255);
     ++write_ptr_;
     if (write_ptr_ >= kHistorySize) {
       write_ptr_ = 0;
@@ -96,17 +111,26 @@ class JustIntonationProcessor {
   }
   
  private:
-  int Tune(int note, int min, int max, int steps);
-  
-  int16_t Tune(int note) {
-    int coarse = Tune(note, -32, 32, 4);
-    return int16_t(note + Tune(note, coarse - 6, coarse + 6, 1));
-  }
+  int16_t Tune(int note);
+  static int Search(
+      const uint16_t* interval,
+      const uint16_t* weight,
+      uint8_t num_bins,
+      int min,
+      int max,
+      int step);
+  uint8_t FindBin(int16_t pitch);
 
+  inline void SetWeight(HistoryEntry* e, uint8_t weight) {
+    bins_[e->bin].weight += weight - e->weight;
+    e->weight = weight;
+  }
+  
   size_t write_ptr_;
   int16_t cached_pitch_;
   uint8_t cached_note_;
   HistoryEntry history_[kHistorySize];
+  ConsonanceBin bins_[kHistorySize];
   
   DISALLOW_COPY_AND_ASSIGN(JustIntonationProcessor);
 };
@@ -0,0 +1,231 @@
+// Copyright 2021 Chris Rogers.
+//
+// Author: Chris Rogers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Event-to-CV latency tracer.
+
+#include "yarns/latency_tracer.h"
+
+#ifndef TEST
+#include <stm32f10x_conf.h>
+#endif  // TEST
+
+#include <algorithm>
+
+namespace yarns {
+
+using namespace std;
+
+#if YARNS_LATENCY_TRACER
+
+const uint32_t kMicrosecondsPerTick = 125;  // SysTick at 8kHz
+
+void LatencyStats::Init() {
+  count_ = 0;
+  sum_ = 0;
+  min_ = 0xffff;
+  max_ = 0;
+  previous_ = 0;
+  jitter_ = 0;
+  fill(&histogram_[0], &histogram_[kNumLatencyBins], 0);
+}
+
+/* static */
+uint8_t LatencyStats::Bin(uint16_t latency) {
+  if (latency < (kNumLatencyLinearBins << 4)) {
+    return latency >> 4;
+  }
+  // 512us is in the first octave bin.
+  return kNumLatencyLinearBins + (31 - __builtin_clz(latency)) - 9;
+}
+
+/* static */
+uint16_t LatencyStats::BinUpperBound(uint8_t bin) {
+  if (bin < kNumLatencyLinearBins) {
+    return ((bin + 1) << 4) - 1;
+  }
+  return (1024UL << (bin - kNumLatencyLinearBins)) - 1;
+}
+
+void LatencyStats::Add(uint16_t latency) {
+  if (count_) {
+    int32_t delta = latency - previous_;
+    if (delta < 0) {
+      delta = -delta;
+    }
+    jitter_ += ((delta << 4) - jitter_) >> 4;
+  }
+  previous_ = latency;
+  ++count_;
+  sum_ += latency;
+  min_ = std::min(min_, latency);
+  max_ = std::max(max_, latency);
+
+  uint8_t bin = Bin(latency);
+  if (histogram_[bin] == 0xffff) {
+    // Keep the shape of the distribution rather than saturating.
+    for (uint8_t i = 0; i < kNumLatencyBins; ++i) {
+      histogram_[i] >>= 1;
+    }
+  }
+  ++histogram_[bin];
+}
+
+uint16_t LatencyStats::Percentile(uint8_t percent) const {
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < kNumLatencyBins; ++i) {
+    total += histogram_[i];
+  }
+  if (!total) {
+    return 0;
+  }
+  uint32_t threshold = (total * percent + 99) / 100;
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < kNumLatencyBins; ++i) {
+    seen += histogram_[i];
+    if (seen >= threshold) {
+      return std::min(BinUpperBound(i), max_);
+    }
+  }
+  return max_;
+}
+
+#endif  // YARNS_LATENCY_TRACER
+
+void LatencyTracer::Init() {
+  enabled_ = false;
+#if YARNS_LATENCY_TRACER
+  ticks_ = 0;
+#ifdef TEST
+  host_time_ = 0;
+#endif  // TEST
+#endif  // YARNS_LATENCY_TRACER
+  Reset();
+}
+
+void LatencyTracer::Reset() {
+#if YARNS_LATENCY_TRACER
+  fill(&arrival_[0], &arrival_[kArrivalBufferSize], 0);
+  write_ptr_ = 0;
+  current_arrival_ = 0;
+  pending_write_ptr_ = 0;
+  pending_read_ptr_ = 0;
+  dropped_ = 0;
+  for (uint8_t i = 0; i < LATENCY_STAGE_LAST; ++i) {
+    stats_[i].Init();
+  }
+#endif  // YARNS_LATENCY_TRACER
+}
+
+#if YARNS_LATENCY_TRACER
+
+uint16_t LatencyTracer::Now() const {
+#ifdef TEST
+  return host_time_;
+#else
+  uint32_t ticks;
+  uint32_t elapsed;
+  uint32_t counted;
+  do {
+    counted = ticks_;
+    ticks = counted;
+    elapsed = SysTick->LOAD - SysTick->VAL;
+    // The counter has wrapped, but SysTick_Handler has not counted the tick
+    // yet (called with SysTick pending, or from SysTick_Handler itself when
+    // it overruns its period).
+    if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) {
+      ++ticks;
+      elapsed = SysTick->LOAD - SysTick->VAL;
+    }
+    // If SysTick_Handler ran in the middle, ticks and elapsed may belong to
+    // different periods: read again.
+  } while (ticks_ != counted);
+  return ticks * kMicrosecondsPerTick + elapsed / (F_CPU / 1000000);
+#endif  // TEST
+}
+
+void LatencyTracer::OnNoteOn() {
+  if (!enabled_) {
+    return;
+  }
+  uint16_t now = Now();
+  stats_[LATENCY_STAGE_INPUT].Add(now - current_arrival_);
+
+  uint8_t next = (pending_write_ptr_ + 1) % kMaxPendingNotes;
+  if (next == pending_read_ptr_) {
+    ++dropped_;
+    return;
+  }
+  pending_[pending_write_ptr_].arrival = current_arrival_;
+  pending_[pending_write_ptr_].dispatch = now;
+  pending_write_ptr_ = next;
+}
+
+void LatencyTracer::OnCvGateUpdate() {
+  if (!enabled_) {
+    return;
+  }
+  uint16_t now = Now();
+  while (pending_read_ptr_ != pending_write_ptr_) {
+    const PendingNote& note = pending_[pending_read_ptr_];
+    stats_[LATENCY_STAGE_REFRESH].Add(now - note.dispatch);
+    stats_[LATENCY_STAGE_TOTAL].Add(now - note.arrival);
+    pending_read_ptr_ = (pending_read_ptr_ + 1) % kMaxPendingNotes;
+  }
+}
+
+#endif  // YARNS_LATENCY_TRACER
+
+size_t LatencyTracer::Serialize(uint8_t* buffer) const {
+#if !YARNS_LATENCY_TRACER
+  fill(&buffer[0], &buffer[kSerializedSize], 0);
+  return kSerializedSize;
+#else
+  uint8_t* p = buffer;
+  for (uint8_t i = 0; i < LATENCY_STAGE_LAST; ++i) {
+    const LatencyStats& s = stats_[i];
+    uint32_t count = s.count();
+    uint16_t values[] = {
+      s.min(), s.mean(), s.Percentile(99), s.max(), s.jitter()
+    };
+    *p++ = count >> 24;
+    *p++ = count >> 16;
+    *p++ = count >> 8;
+    *p++ = count;
+    for (uint8_t j = 0; j < sizeof(values) / sizeof(values[0]); ++j) {
+      *p++ = values[j] >> 8;
+      *p++ = values[j];
+    }
+  }
+  *p++ = dropped_ >> 8;
+  *p++ = dropped_;
+  return p - buffer;
+#endif  // YARNS_LATENCY_TRACER
+}
+
+/* extern */
+LatencyTracer latency_tracer;
+
+}  // namespace yarns
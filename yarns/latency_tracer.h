@@ -0,0 +1,201 @@
+// Copyright 2021 Chris Rogers.
+//
+// Author: Chris Rogers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Event-to-CV latency tracer. Disabled by default; enabled by SysEx.
+//
+// A note-on is timestamped three times:
+// - when SysTick pushes its last byte into the MIDI input buffer,
+// - when the main loop has parsed it and hands it to Multi::NoteOn,
+// - when the next GetCvGate copies the voices into cv[]/gate[].
+// The "input" stage covers buffering and parsing, the "refresh" stage covers
+// the 2kHz CV refresh decimation, and "total" is the sum of both.
+//
+// Timestamps are 16-bit microseconds, so a stage must complete within 65ms
+// to be measured correctly. The input buffer holds 41ms of bytes at most.
+//
+// The timestamps and statistics take about 600 bytes of RAM, so the firmware
+// only includes them when built with -DYARNS_LATENCY_TRACER=1. Otherwise the
+// hooks do nothing and the report is all zeros.
+
+#ifndef YARNS_LATENCY_TRACER_H_
+#define YARNS_LATENCY_TRACER_H_
+
+#include "stmlib/stmlib.h"
+
+#ifndef YARNS_LATENCY_TRACER
+#ifdef TEST
+#define YARNS_LATENCY_TRACER 1
+#else
+#define YARNS_LATENCY_TRACER 0
+#endif  // TEST
+#endif  // YARNS_LATENCY_TRACER
+
+namespace yarns {
+
+enum LatencyStage {
+  LATENCY_STAGE_INPUT,
+  LATENCY_STAGE_REFRESH,
+  LATENCY_STAGE_TOTAL,
+  LATENCY_STAGE_LAST
+};
+
+// 16us bins up to 512us, then one bin per octave up to 65ms.
+const uint8_t kNumLatencyLinearBins = 32;
+const uint8_t kNumLatencyBins = kNumLatencyLinearBins + 7;
+
+class LatencyStats {
+ public:
+  LatencyStats() { }
+  ~LatencyStats() { }
+
+  void Init();
+  void Add(uint16_t latency);
+  uint16_t Percentile(uint8_t percent) const;
+
+  inline uint32_t count() const { return count_; }
+  inline uint16_t min() const { return count_ ? min_ : 0; }
+  inline uint16_t max() const { return max_; }
+  inline uint16_t mean() const { return count_ ? sum_ / count_ : 0; }
+  // Smoothed absolute difference between consecutive latencies (RFC 3550).
+  inline uint16_t jitter() const { return jitter_ >> 4; }
+
+ private:
+  static uint8_t Bin(uint16_t latency);
+  static uint16_t BinUpperBound(uint8_t bin);
+
+  uint32_t count_;
+  uint32_t sum_;
+  uint16_t min_;
+  uint16_t max_;
+  uint16_t previous_;
+  int32_t jitter_;
+  uint16_t histogram_[kNumLatencyBins];
+
+  DISALLOW_COPY_AND_ASSIGN(LatencyStats);
+};
+
+class LatencyTracer {
+ public:
+  LatencyTracer() { }
+  ~LatencyTracer() { }
+
+  void Init();
+  void Reset();
+
+  inline void set_enabled(bool enabled) { enabled_ = enabled; }
+  inline bool enabled() const { return enabled_; }
+
+  // Packs count, min, mean, p99, max and jitter of each stage, and the number
+  // of dropped events, into big-endian bytes. Returns the size.
+  size_t Serialize(uint8_t* buffer) const;
+
+  static const size_t kSerializedSize = LATENCY_STAGE_LAST * 14 + 2;
+
+#if YARNS_LATENCY_TRACER
+
+  // Called at the top of SysTick_Handler.
+  inline void Tick() { ++ticks_; }
+
+#ifdef TEST
+  inline void set_host_time(uint32_t us) { host_time_ = us; }
+#endif  // TEST
+
+  // From SysTick, as a byte is written to the MIDI input buffer.
+  inline void OnByteReceived() {
+    if (enabled_) {
+      arrival_[write_ptr_++ & (kArrivalBufferSize - 1)] = Now();
+    }
+  }
+
+  // From the main loop, with the number of bytes still in the input buffer,
+  // just before its oldest byte is handed to the parser.
+  inline void OnByteParsed(uint8_t num_pending) {
+    if (enabled_) {
+      uint8_t index = (write_ptr_ - num_pending) & (kArrivalBufferSize - 1);
+      current_arrival_ = arrival_[index];
+    }
+  }
+
+  void OnNoteOn();
+  void OnCvGateUpdate();
+
+  inline const LatencyStats& stats(LatencyStage stage) const {
+    return stats_[stage];
+  }
+  inline uint16_t dropped() const { return dropped_; }
+
+#else
+
+  inline void Tick() { }
+  inline void OnByteReceived() { }
+  inline void OnByteParsed(uint8_t num_pending) { }
+  inline void OnNoteOn() { }
+  inline void OnCvGateUpdate() { }
+
+#endif  // YARNS_LATENCY_TRACER
+
+ private:
+  // Switched from the main loop, read from SysTick.
+  volatile bool enabled_;
+
+#if YARNS_LATENCY_TRACER
+  uint16_t Now() const;
+
+  static const uint8_t kArrivalBufferSize = 128;
+  static const uint8_t kMaxPendingNotes = 8;
+
+  struct PendingNote {
+    uint16_t arrival;
+    uint16_t dispatch;
+  };
+
+  volatile uint32_t ticks_;
+#ifdef TEST
+  uint32_t host_time_;
+#endif  // TEST
+
+  // Mirrors the MIDI input buffer, filled from SysTick.
+  uint16_t arrival_[kArrivalBufferSize];
+  volatile uint8_t write_ptr_;
+  uint16_t current_arrival_;
+
+  // Written by the main loop, read by the CV refresh.
+  PendingNote pending_[kMaxPendingNotes];
+  volatile uint8_t pending_write_ptr_;
+  volatile uint8_t pending_read_ptr_;
+  uint16_t dropped_;
+
+  LatencyStats stats_[LATENCY_STAGE_LAST];
+#endif  // YARNS_LATENCY_TRACER
+
+  DISALLOW_COPY_AND_ASSIGN(LatencyTracer);
+};
+
+extern LatencyTracer latency_tracer;
+
+}  // namespace yarns
+
+#endif  // YARNS_LATENCY_TRACER_H_
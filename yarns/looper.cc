@@ -69,48 +69,494 @@ void Deck::Rewind() {
   Advance(0, false);
 }
 
+// Saved recordings are variable-length. After the number of notes, the notes
+// are stored oldest first,
+// one field after the other (all on positions, then all lengths, pitches and
+// velocities), so that each field can use the previous ones:
+// - on position: delta from the previous note's, either as is, or relative
+//   to the previous delta, which is short for steady rhythms,
+// - length: either as is, or relative to the gap until the next note, which
+//   is short for legato playing,
+// - pitch: delta from the previous note's,
+// - velocity: index in a dictionary of the most frequent velocities, or
+//   escape followed by the literal value.
+// Positions, lengths and pitches are Rice-coded, with a parameter chosen for
+// each recording. Positions keep the 13-bit resolution. If a recording does
+// not fit, its oldest notes are left out.
+
+const uint16_t kPosMask = (1 << kBitsPos) - 1;
+const uint8_t kMaxRiceQuotient = 8;
+const uint8_t kMaxVelocities = 7;
+const uint8_t kBitsVelocityDictionarySize = 3;
+const uint8_t kDefaultPitch = 60;
+
+enum Field {
+  FIELD_ON,
+  FIELD_LENGTH,
+  FIELD_PITCH,
+  FIELD_LAST
+};
+
+// Bits of the escaped value, and of the Rice parameter in the header.
+const uint8_t kFieldRawBits[] = { kBitsPos + 1, kBitsPos + 1, kBitsMIDI + 1 };
+const uint8_t kFieldParameterBits[] = { 4, 4, 3 };
+
+inline uint16_t ZigZag(int16_t value) {
+  return value >= 0 ? value << 1 : ((-value) << 1) - 1;
+}
+
+inline int16_t UnZigZag(uint16_t value) {
+  return value & 1 ? -static_cast<int16_t>((value + 1) >> 1) : value >> 1;
+}
+
+inline uint8_t RiceSize(uint16_t value, uint8_t k, uint8_t raw_bits) {
+  uint16_t quotient = value >> k;
+  return quotient < kMaxRiceQuotient ?
+      quotient + 1 + k : kMaxRiceQuotient + raw_bits;
+}
+
+// MSB first, into a zeroed buffer.
+class BitWriter {
+ public:
+  BitWriter(uint8_t* data) : data_(data), size_(0) { }
+
+  void Write(uint16_t value, uint8_t num_bits) {
+    while (num_bits) {
+      uint8_t space = 8 - (size_ & 7);
+      uint8_t n = std::min(space, num_bits);
+      num_bits -= n;
+      if (size_ < kPackedSize * 8) {
+        uint8_t bits = (value >> num_bits) & ((1 << n) - 1);
+        data_[size_ >> 3] |= bits << (space - n);
+      }
+      size_ += n;
+    }
+  }
+
+  void WriteRice(uint16_t value, uint8_t k, uint8_t raw_bits) {
+    uint16_t quotient = value >> k;
+    if (quotient < kMaxRiceQuotient) {
+      Write((1 << (quotient + 1)) - 2, quotient + 1);
+      Write(value, k);
+    } else {
+      Write((1 << kMaxRiceQuotient) - 1, kMaxRiceQuotient);
+      Write(value, raw_bits);
+    }
+  }
+
+  inline uint16_t size() const { return size_; }
+
+ private:
+  uint8_t* data_;
+  uint16_t size_;
+};
+
+class BitReader {
+ public:
+  BitReader(const uint8_t* data) : data_(data), position_(0) { }
+
+  uint16_t Read(uint8_t num_bits) {
+    uint16_t value = 0;
+    while (num_bits--) {
+      uint8_t bit = position_ < kPackedSize * 8 ?
+          (data_[position_ >> 3] >> (7 - (position_ & 7))) & 1 : 0;
+      value = (value << 1) | bit;
+      ++position_;
+    }
+    return value;
+  }
+
+  uint16_t ReadRice(uint8_t k, uint8_t raw_bits) {
+    uint8_t quotient = 0;
+    while (quotient < kMaxRiceQuotient && Read(1)) {
+      ++quotient;
+    }
+    if (quotient == kMaxRiceQuotient) {
+      return Read(raw_bits);
+    }
+    return (quotient << k) | Read(k);
+  }
+
+ private:
+  const uint8_t* data_;
+  uint16_t position_;
+};
+
+// Choices made for a recording, stored in its header.
+struct CodecParameters {
+  uint8_t k[FIELD_LAST];
+  bool relative[FIELD_LAST];
+  uint8_t dictionary[kMaxVelocities];
+  uint8_t dictionary_size;
+  uint8_t code_bits;
+};
+
+// Notes in age order, with 13-bit positions.
+class NoteCodec {
+ public:
+  NoteCodec() { }
+  ~NoteCodec() { }
+
+  uint16_t on[kMaxNotes];
+  uint16_t off[kMaxNotes];
+  uint8_t pitch[kMaxNotes];
+  uint8_t velocity[kMaxNotes];
+  uint8_t size;
+
+  // Encodes as many of the newest notes as fit, and returns the size in bits.
+  uint16_t Pack(uint8_t* data) const;
+  void Decode(const uint8_t* data);
+
+ private:
+  void ChooseParameters(uint8_t first, CodecParameters* parameters) const;
+
+  // Returns the oldest note from which the recording fits, walking back from
+  // the newest one: the size of a note only depends on the oldest note kept
+  // for the first two notes and for the last one.
+  uint8_t Fit(const CodecParameters& parameters) const;
+
+  // Encodes the notes from first onwards, and returns the size in bits.
+  uint16_t Encode(
+      uint8_t first, const CodecParameters& parameters, uint8_t* data) const;
+
+  uint16_t HeaderSize(const CodecParameters& parameters) const {
+    return kBitsNoteIndex + kFieldParameterBits[FIELD_ON] + \
+        kFieldParameterBits[FIELD_LENGTH] + kFieldParameterBits[FIELD_PITCH] + \
+        2 + kBitsVelocityDictionarySize + \
+        parameters.dictionary_size * kBitsMIDI;
+  }
+
+  uint16_t NoteSize(
+      const CodecParameters& parameters, uint8_t first, uint8_t i) const {
+    uint16_t total = parameters.code_bits;
+    if (std::find(
+            parameters.dictionary,
+            parameters.dictionary + parameters.dictionary_size,
+            velocity[i]) ==
+        parameters.dictionary + parameters.dictionary_size) {
+      total += kBitsMIDI;
+    }
+    for (uint8_t field = 0; field < FIELD_LAST; ++field) {
+      total += RiceSize(
+          value(static_cast<Field>(field), first, i,
+                parameters.relative[field]),
+          parameters.k[field],
+          kFieldRawBits[field]);
+    }
+    return total;
+  }
+
+  inline uint16_t gap_after(uint8_t first, uint8_t i) const {
+    uint8_t next = i + 1 < size ? i + 1 : first;
+    return (on[next] - on[i]) & kPosMask;
+  }
+
+  inline uint16_t on_delta(uint8_t first, uint8_t i) const {
+    return i > first ? (on[i] - on[i - 1]) & kPosMask : 0;
+  }
+
+  uint16_t value(Field field, uint8_t first, uint8_t i, bool relative) const {
+    switch (field) {
+      case FIELD_ON:
+        if (i == first) {
+          return on[i];
+        }
+        return relative ?
+            ZigZag(on_delta(first, i) - on_delta(first, i - 1)) :
+            on_delta(first, i);
+      case FIELD_LENGTH:
+        {
+          uint16_t length = (off[i] - on[i]) & kPosMask;
+          return relative ? ZigZag(gap_after(first, i) - length) : length;
+        }
+      default:
+        return ZigZag(pitch[i] - (i == first ? kDefaultPitch : pitch[i - 1]));
+    }
+  }
+
+  // Returns the best Rice parameter for the values of a field, and its cost
+  // in size. The size shrinks as the parameter grows, until it is too large
+  // for most values: the search stops there.
+  uint8_t BestParameter(
+      Field field, uint8_t first, bool relative, uint16_t* size) const {
+    uint16_t values[kMaxNotes];
+    uint8_t num_values = this->size - first;
+    for (uint8_t i = 0; i < num_values; ++i) {
+      values[i] = value(field, first, first + i, relative);
+    }
+    uint8_t best_k = 0;
+    *size = UINT16_MAX;
+    for (uint8_t k = 0; k < (1 << kFieldParameterBits[field]); ++k) {
+      uint16_t field_size = 0;
+      for (uint8_t i = 0; i < num_values; ++i) {
+        field_size += RiceSize(values[i], k, kFieldRawBits[field]);
+      }
+      if (field_size > *size) {
+        break;
+      } else if (field_size < *size) {
+        *size = field_size;
+        best_k = k;
+      }
+    }
+    return best_k;
+  }
+
+  // Sorts the dictionary by decreasing frequency, and returns the number of
+  // entries worth using.
+  uint8_t BuildVelocityDictionary(uint8_t first, uint8_t* dictionary) const;
+};
+
+uint8_t NoteCodec::BuildVelocityDictionary(
+    uint8_t first, uint8_t* dictionary) const {
+  uint8_t count[1 << kBitsMIDI];
+  std::fill(&count[0], &count[1 << kBitsMIDI], 0);
+  for (uint8_t i = first; i < size; ++i) {
+    ++count[velocity[i]];
+  }
+  uint8_t num_candidates = 0;
+  uint8_t candidate_count[kMaxVelocities];
+  for (; num_candidates < kMaxVelocities; ++num_candidates) {
+    uint8_t best = 0;
+    for (uint8_t v = 1; v < (1 << kBitsMIDI); ++v) {
+      if (count[v] > count[best]) {
+        best = v;
+      }
+    }
+    if (!count[best]) {
+      break;
+    }
+    dictionary[num_candidates] = best;
+    candidate_count[num_candidates] = count[best];
+    count[best] = 0;
+  }
+
+  // A larger dictionary makes every code longer, and saves 7 bits for each
+  // note it covers.
+  uint8_t num_notes = size - first;
+  uint8_t num_uncovered = num_notes;
+  uint8_t best_size = 0;
+  uint16_t best_cost = UINT16_MAX;
+  for (uint8_t dictionary_size = 0;
+       dictionary_size <= num_candidates;
+       ++dictionary_size) {
+    if (dictionary_size) {
+      num_uncovered -= candidate_count[dictionary_size - 1];
+    }
+    uint8_t code_bits = dictionary_size ?
+        32 - __builtin_clz(dictionary_size) : 0;
+    uint16_t cost = (dictionary_size + num_uncovered) * kBitsMIDI + \
+        num_notes * code_bits;
+    if (cost < best_cost) {
+      best_cost = cost;
+      best_size = dictionary_size;
+    }
+  }
+  return best_size;
+}
+
+void NoteCodec::ChooseParameters(
+    uint8_t first, CodecParameters* parameters) const {
+  for (uint8_t field = 0; field < FIELD_LAST; ++field) {
+    uint16_t absolute_size;
+    uint16_t relative_size = UINT16_MAX;
+    uint8_t k_absolute = BestParameter(
+        static_cast<Field>(field), first, false, &absolute_size);
+    uint8_t k_relative = field == FIELD_PITCH ? 0 : BestParameter(
+        static_cast<Field>(field), first, true, &relative_size);
+    parameters->relative[field] = relative_size < absolute_size;
+    parameters->k[field] = parameters->relative[field] ?
+        k_relative : k_absolute;
+  }
+  parameters->dictionary_size = BuildVelocityDictionary(
+      first, parameters->dictionary);
+  parameters->code_bits = parameters->dictionary_size ?
+      32 - __builtin_clz(parameters->dictionary_size) : 0;
+}
+
+uint8_t NoteCodec::Fit(const CodecParameters& parameters) const {
+  uint16_t budget = kPackedSize * 8 - HeaderSize(parameters);
+  uint16_t middle_size = 0;
+  uint8_t fit = size;
+  for (int16_t first = size - 1; first >= 0; --first) {
+    // Notes first + 2 to size - 2 have the same size whatever the first.
+    if (first + 4 <= size) {
+      middle_size += NoteSize(parameters, first, first + 2);
+    }
+    uint16_t total = middle_size + NoteSize(parameters, first, first);
+    if (first + 1 < size) {
+      total += NoteSize(parameters, first, first + 1);
+    }
+    if (first + 2 < size) {
+      total += NoteSize(parameters, first, size - 1);
+    }
+    if (total > budget) {
+      break;
+    }
+    fit = first;
+  }
+  return fit;
+}
+
+uint16_t NoteCodec::Pack(uint8_t* data) const {
+  CodecParameters parameters;
+  ChooseParameters(0, &parameters);
+  // The parameters suit the whole recording rather than the notes that fit.
+  // Choosing them again for those makes no measurable difference.
+  return Encode(Fit(parameters), parameters, data);
+}
+
+uint16_t NoteCodec::Encode(
+    uint8_t first, const CodecParameters& parameters, uint8_t* data) const {
+  const uint8_t* dictionary = parameters.dictionary;
+  uint8_t dictionary_size = parameters.dictionary_size;
+
+  BitWriter writer(data);
+  writer.Write(size - first, kBitsNoteIndex);
+  for (uint8_t field = 0; field < FIELD_LAST; ++field) {
+    writer.Write(parameters.k[field], kFieldParameterBits[field]);
+  }
+  writer.Write(parameters.relative[FIELD_ON], 1);
+  writer.Write(parameters.relative[FIELD_LENGTH], 1);
+  writer.Write(dictionary_size, kBitsVelocityDictionarySize);
+  for (uint8_t j = 0; j < dictionary_size; ++j) {
+    writer.Write(dictionary[j], kBitsMIDI);
+  }
+  for (uint8_t field = 0; field < FIELD_LAST; ++field) {
+    for (uint8_t i = first; i < size; ++i) {
+      writer.WriteRice(
+          value(static_cast<Field>(field), first, i,
+                parameters.relative[field]),
+          parameters.k[field],
+          kFieldRawBits[field]);
+    }
+  }
+  for (uint8_t i = first; i < size; ++i) {
+    uint8_t code = std::find(
+        dictionary, dictionary + dictionary_size, velocity[i]) - dictionary;
+    writer.Write(code, parameters.code_bits);
+    if (code == dictionary_size) {
+      writer.Write(velocity[i], kBitsMIDI);
+    }
+  }
+  return writer.size();
+}
+
+void NoteCodec::Decode(const uint8_t* data) {
+  BitReader reader(data);
+  size = std::min(
+      static_cast<uint8_t>(reader.Read(kBitsNoteIndex)), kMaxNotes);
+  uint8_t k[FIELD_LAST];
+  for (uint8_t field = 0; field < FIELD_LAST; ++field) {
+    k[field] = reader.Read(kFieldParameterBits[field]);
+  }
+  bool on_relative = reader.Read(1);
+  bool length_relative = reader.Read(1);
+  uint8_t dictionary_size = reader.Read(kBitsVelocityDictionarySize);
+  uint8_t dictionary[kMaxVelocities];
+  for (uint8_t j = 0; j < dictionary_size; ++j) {
+    dictionary[j] = reader.Read(kBitsMIDI);
+  }
+  uint8_t code_bits = dictionary_size ? 32 - __builtin_clz(dictionary_size) : 0;
+
+  uint16_t delta = 0;
+  for (uint8_t i = 0; i < size; ++i) {
+    uint16_t code = reader.ReadRice(k[FIELD_ON], kFieldRawBits[FIELD_ON]);
+    if (!i) {
+      on[i] = code;
+      continue;
+    }
+    delta = on_relative ? (delta + UnZigZag(code)) & kPosMask : code;
+    on[i] = (on[i - 1] + delta) & kPosMask;
+  }
+  for (uint8_t i = 0; i < size; ++i) {
+    uint16_t length = reader.ReadRice(
+        k[FIELD_LENGTH], kFieldRawBits[FIELD_LENGTH]);
+    if (length_relative) {
+      length = gap_after(0, i) - UnZigZag(length);
+    }
+    off[i] = (on[i] + length) & kPosMask;
+  }
+  for (uint8_t i = 0; i < size; ++i) {
+    int16_t delta = UnZigZag(
+        reader.ReadRice(k[FIELD_PITCH], kFieldRawBits[FIELD_PITCH]));
+    pitch[i] = ((i ? pitch[i - 1] : kDefaultPitch) + delta) & 0x7f;
+  }
+  for (uint8_t i = 0; i < size; ++i) {
+    uint8_t code = reader.Read(code_bits);
+    velocity[i] = code < dictionary_size ?
+        dictionary[code] : reader.Read(kBitsMIDI);
+  }
+}
+
 void Deck::Unpack(PackedPart& storage) {
   RemoveAll();
-  oldest_index_ = storage.looper_oldest_index;
-  size_ = storage.looper_size;
-  for (uint8_t ordinal = 0; ordinal < kMaxNotes; ++ordinal) {
-    uint8_t index = index_mod(oldest_index_ + ordinal);
-    PackedNote& packed_note = storage.looper_notes[index];
+  NoteCodec codec;
+  codec.Decode(storage.looper_data);
+  oldest_index_ = 0;
+  size_ = codec.size;
+  for (uint8_t index = 0; index < size_; ++index) {
     Note& note = notes_[index];
 
-    note.on_pos   = packed_note.on_pos  << (16 - kBitsPos);
-    note.off_pos  = packed_note.off_pos << (16 - kBitsPos);
-    note.pitch    = packed_note.pitch;
-    note.velocity = packed_note.velocity;
+    note.on_pos   = codec.on[index]  << (16 - kBitsPos);
+    note.off_pos  = codec.off[index] << (16 - kBitsPos);
+    note.pitch    = codec.pitch[index];
+    note.velocity = codec.velocity[index];
 
-    if (ordinal < size_) {
-      Advance(note.on_pos, false);
-      LinkOn(index);
-      Advance(note.off_pos, false);
-      LinkOff(index);
-    }
+    Advance(note.on_pos, false);
+    LinkOn(index);
+    Advance(note.off_pos, false);
+    LinkOff(index);
   }
 }
 
-void Deck::Pack(PackedPart& storage) const {
-  storage.looper_oldest_index = oldest_index_;
-  storage.looper_size = size_;
-  for (uint8_t ordinal = 0; ordinal < kMaxNotes; ++ordinal) {
-    uint8_t index = index_mod(oldest_index_ + ordinal);
-    PackedNote& packed_note = storage.looper_notes[index];
-    const Note& note = notes_[index];
+uint8_t Deck::Pack(PackedPart& storage) const {
+  NoteCodec codec;
+  codec.size = size_;
+  for (uint8_t ordinal = 0; ordinal < size_; ++ordinal) {
+    const Note& note = notes_[index_mod(oldest_index_ + ordinal)];
+    codec.on[ordinal]       = (note.on_pos  - pos_offset) >> (16 - kBitsPos);
+    codec.off[ordinal]      = (note.off_pos - pos_offset) >> (16 - kBitsPos);
+    codec.pitch[ordinal]    = note.pitch;
+    codec.velocity[ordinal] = note.velocity;
+  }
+
+  std::fill(&storage.looper_data[0], &storage.looper_data[kPackedSize], 0);
+  uint16_t num_bits = codec.Pack(storage.looper_data);
+  storage.looper_legacy_oldest_index = 0;
+  storage.looper_legacy_size = 0;
+  return (num_bits + 7) >> 3;
+}
 
-    packed_note.on_pos    = (note.on_pos  - pos_offset) >> (16 - kBitsPos);
-    packed_note.off_pos   = (note.off_pos - pos_offset) >> (16 - kBitsPos);
-    packed_note.pitch     = note.pitch;
-    packed_note.velocity  = note.velocity;
+void ConvertLegacy(PackedPart& storage) {
+  NoteCodec codec;
+  uint8_t oldest_index = storage.looper_legacy_oldest_index;
+  codec.size = storage.looper_legacy_size;
+  if (oldest_index >= kLegacyMaxNotes || codec.size > kLegacyMaxNotes) {
+    codec.size = 0;
   }
+  for (uint8_t ordinal = 0; ordinal < codec.size; ++ordinal) {
+    uint8_t index = (oldest_index + ordinal) % kLegacyMaxNotes;
+    PackedNote packed_note;
+    std::copy(
+        &storage.looper_data[index * sizeof(PackedNote)],
+        &storage.looper_data[(index + 1) * sizeof(PackedNote)],
+        reinterpret_cast<uint8_t*>(&packed_note));
+    codec.on[ordinal]       = packed_note.on_pos;
+    codec.off[ordinal]      = packed_note.off_pos;
+    codec.pitch[ordinal]    = packed_note.pitch;
+    codec.velocity[ordinal] = packed_note.velocity;
+  }
+
+  std::fill(&storage.looper_data[0], &storage.looper_data[kPackedSize], 0);
+  codec.Pack(storage.looper_data);
+  storage.looper_legacy_oldest_index = 0;
+  storage.looper_legacy_size = 0;
 }
 
-void Deck::Clock() {
+void Deck::Clock(const TickPhase& tick) {
   SequencerSettings seq = part_->sequencer_settings();
   uint16_t num_ticks = lut_clock_ratio_ticks[seq.clock_division];
-  lfo_.Tap(num_ticks * (1 << seq.loop_length), pos_offset << 16);
+  lfo_.Tap(num_ticks * (1 << seq.loop_length), tick, pos_offset << 16);
 }
 
 void Deck::RemoveOldestNote() {
@@ -41,13 +41,24 @@ struct PackedPart;
 
 namespace looper {
 
-const uint8_t kBitsNoteIndex = 5;
+const uint8_t kBitsNoteIndex = 6;
 STATIC_ASSERT(kBitsNoteIndex <= 7, bits); // Leave room for kNullIndex
 const uint8_t kNullIndex = UINT8_MAX;
 
-const uint8_t kMaxNotes = 30;
+// Steady playing packs more notes than this (about 1.9 bytes per note), but
+// each note costs 9 bytes of RAM per part. Random playing fits 42 to 44.
+const uint8_t kMaxNotes = 48;
 STATIC_ASSERT(kMaxNotes < (1 << kBitsNoteIndex), bits);
 
+// Bytes available to a saved recording, in the place of the 30 x 40-bit notes
+// of the former fixed-size format. See Deck::Pack.
+const uint8_t kPackedSize = 150;
+
+// Former fixed-size format, still found in multis saved by earlier versions.
+// See ConvertLegacy.
+const uint8_t kLegacyBitsNoteIndex = 5;
+const uint8_t kLegacyMaxNotes = 30;
+
 struct Link {
   Link() {
     on = off = kNullIndex;
@@ -69,13 +80,16 @@ const uint8_t kBitsPos = 13;
 const uint8_t kBitsMIDI = 7;
 
 struct PackedNote {
-  PackedNote() { }
   unsigned int
     on_pos    : kBitsPos,
     off_pos   : kBitsPos,
     pitch     : kBitsMIDI,
     velocity  : kBitsMIDI;
 }__attribute__((packed));
+STATIC_ASSERT(sizeof(PackedNote) * kLegacyMaxNotes == kPackedSize, legacy);
+
+// Re-encodes a recording saved in the former fixed-size format.
+void ConvertLegacy(PackedPart& storage);
 
 class Deck {
  public:
@@ -88,12 +102,13 @@ class Deck {
   void RemoveAll();
   void Rewind();
   void Unpack(PackedPart& storage);
-  void Pack(PackedPart& storage) const;
+  // Returns the number of bytes used.
+  uint8_t Pack(PackedPart& storage) const;
 
   inline uint16_t phase() const {
     return pos_;
   }
-  void Clock();
+  void Clock(const TickPhase& tick);
   inline void Refresh() {
     uint16_t new_phase = lfo_.Refresh() >> 16;
     if (
@@ -129,6 +144,7 @@ class Deck {
   uint8_t NotePitch(uint8_t index) const;
   uint8_t NoteAgeOrdinal(uint8_t index) const;
 
+  inline uint8_t size() const { return size_; }
   inline const Note& note_at(uint8_t index) const {
     return notes_[index];
   }
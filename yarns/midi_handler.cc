@@ -43,11 +43,14 @@ using namespace std;
 MidiHandler::MidiBuffer MidiHandler::input_buffer_; 
 
 /* static */
-MidiHandler::MidiBuffer MidiHandler::output_buffer_;
+MidiOutputEncoder MidiHandler::output_encoder_;
 
 /* static */
 MidiHandler::SmallMidiBuffer MidiHandler::high_priority_output_buffer_;
 
+/* static */
+uint32_t MidiHandler::high_priority_overflows_;
+
 /* static */
 stmlib_midi::MidiStreamParser<MidiHandler> MidiHandler::parser_;
 
@@ -86,13 +89,15 @@ bool MidiHandler::factory_testing_requested_;
 /* static */
 void MidiHandler::Init() {
   input_buffer_.Init();
-  output_buffer_.Init();
+  output_encoder_.Init();
   high_priority_output_buffer_.Init();
+  high_priority_overflows_ = 0;
   sysex_rx_write_ptr_ = 0;
   previous_packet_index_ = 0;
   calibration_voice_ = 0xff;
   calibration_note_ = 0xff;
   factory_testing_requested_ = false;
+  latency_tracer.Init();
 }
 
 /* static */
@@ -153,12 +158,24 @@ enum SysExCommand {
   SYSEX_COMMAND_REQUEST_PACKETS = 17,
   SYSEX_COMMAND_FACTORY_TESTING_MODE = 32,
   SYSEX_COMMAND_CALIBRATE = 33,
+  SYSEX_COMMAND_LATENCY_TRACE = 34,
+  SYSEX_COMMAND_LATENCY_REPORT = 35,
+};
+
+enum LatencyTraceAction {
+  LATENCY_TRACE_ACTION_QUERY,
+  LATENCY_TRACE_ACTION_START,
+  LATENCY_TRACE_ACTION_STOP,
 };
 
 /* static */
 void MidiHandler::HandleYarnsSpecificMessage() {
-#ifndef TEST
   uint8_t command = sysex_rx_buffer_[6];
+  if (command == SYSEX_COMMAND_LATENCY_TRACE) {
+    HandleLatencyTraceMessage();
+    return;
+  }
+#ifndef TEST
   if (command == SYSEX_COMMAND_DUMP_PACKET) {
     uint8_t packet_index = sysex_rx_buffer_[7];
     
@@ -222,6 +239,43 @@ void MidiHandler::HandleYarnsSpecificMessage() {
 #endif  // TEST
 }
 
+/* static */
+void MidiHandler::HandleLatencyTraceMessage() {
+  if (sysex_rx_buffer_[8] != 0xf7) {
+    return;
+  }
+  switch (sysex_rx_buffer_[7]) {
+    case LATENCY_TRACE_ACTION_QUERY:
+      SysExSendLatencyReport();
+      break;
+
+    case LATENCY_TRACE_ACTION_START:
+      latency_tracer.Reset();
+      latency_tracer.set_enabled(true);
+      break;
+
+    case LATENCY_TRACE_ACTION_STOP:
+      latency_tracer.set_enabled(false);
+      break;
+  }
+}
+
+/* static */
+void MidiHandler::SysExSendLatencyReport() {
+  uint8_t data[LatencyTracer::kSerializedSize];
+  size_t size = latency_tracer.Serialize(data);
+
+  for (uint8_t i = 0; i < 6; ++i) {
+    SendBlocking(accepted_sysex_[0].prefix[i]);
+  }
+  SendBlocking(SYSEX_COMMAND_LATENCY_REPORT);
+  for (uint8_t i = 0; i < size; ++i) {
+    SendBlocking(data[i] >> 4);
+    SendBlocking(data[i] & 0x0f);
+  }
+  SendBlocking(0xf7);
+}
+
 /* static */
 void MidiHandler::SysExSendPacket(
     uint8_t packet_index,
@@ -34,6 +34,8 @@
 #include "stmlib/utils/ring_buffer.h"
 #include "stmlib/midi/midi.h"
 
+#include "yarns/latency_tracer.h"
+#include "yarns/midi_output_encoder.h"
 #include "yarns/multi.h"
 
 namespace yarns {
@@ -52,6 +54,7 @@ class MidiHandler {
   static void Init();
   
   static void NoteOn(uint8_t channel, uint8_t note, uint8_t velocity) {
+    latency_tracer.OnNoteOn();
     if (multi.NoteOn(channel, note, velocity) && !multi.direct_thru()) {
       Send3(0x90 | channel, note, velocity);
     }
@@ -145,7 +148,7 @@ class MidiHandler {
   static void RawByte(uint8_t byte) {
     if (multi.direct_thru()) {
       if (byte != 0xfa && byte != 0xf8 && byte != 0xfc) {
-        output_buffer_.Overwrite(byte);
+        output_encoder_.WriteRaw(byte);
       }
     }
   }
@@ -182,41 +185,47 @@ class MidiHandler {
   }
   
   static void PushByte(uint8_t byte) {
+    latency_tracer.OnByteReceived();
     input_buffer_.Overwrite(byte);
   }
   
   static void ProcessInput() {
     while (input_buffer_.readable()) {
+      latency_tracer.OnByteParsed(input_buffer_.readable());
       parser_.PushByte(input_buffer_.ImmediateRead());
     }
   }
   
-  static inline MidiBuffer* mutable_output_buffer() { return &output_buffer_; }
+  static inline MidiOutputEncoder* mutable_output_encoder() {
+    return &output_encoder_;
+  }
   static inline SmallMidiBuffer* mutable_high_priority_output_buffer() {
     return &high_priority_output_buffer_;
   }
 
   static inline void Send3(uint8_t byte_1, uint8_t byte_2, uint8_t byte_3) {
-    output_buffer_.Overwrite(byte_1);
-    output_buffer_.Overwrite(byte_2);
-    output_buffer_.Overwrite(byte_3);
+    output_encoder_.Write(byte_1, byte_2, byte_3);
   }
 
   static inline void Send2(uint8_t byte_1, uint8_t byte_2) {
-    output_buffer_.Overwrite(byte_1);
-    output_buffer_.Overwrite(byte_2);
+    output_encoder_.Write(byte_1, byte_2, 0);
   }
 
   static inline void Send1(uint8_t byte) {
-    output_buffer_.Overwrite(byte);
+    output_encoder_.WriteRaw(byte);
   }
   
   static inline void SendBlocking(uint8_t byte) {
-    output_buffer_.Write(byte);
+    while (!output_encoder_.writable());
+    output_encoder_.WriteRaw(byte);
   }
 
   static inline void SendNow(uint8_t byte) {
-    high_priority_output_buffer_.Overwrite(byte);
+    if (high_priority_output_buffer_.writable()) {
+      high_priority_output_buffer_.Overwrite(byte);
+    } else {
+      ++high_priority_overflows_;
+    }
   }
   
   typedef void (*SysExHandlerFn)();
@@ -228,7 +237,7 @@ class MidiHandler {
   };
 
   static void Flush() {
-    while (output_buffer_.readable());
+    while (output_encoder_.readable());
   }
   
   static void SysExSendPackets(const uint8_t* data, size_t size);
@@ -238,6 +247,9 @@ class MidiHandler {
   }
   static inline uint8_t calibration_voice() { return calibration_voice_; }
   static inline uint8_t calibration_note() { return calibration_note_; }
+  static inline uint32_t output_overflows() {
+    return output_encoder_.overflows() + high_priority_overflows_;
+  }
   static inline bool factory_testing_requested() {
     return factory_testing_requested_;
   }
@@ -263,10 +275,13 @@ class MidiHandler {
   static void HandleScaleOctaveTuning1ByteForm();
   static void HandleScaleOctaveTuning2ByteForm();
   static void HandleYarnsSpecificMessage();
+  static void HandleLatencyTraceMessage();
+  static void SysExSendLatencyReport();
   
   static MidiBuffer input_buffer_; 
-  static MidiBuffer output_buffer_; 
+  static MidiOutputEncoder output_encoder_;
   static SmallMidiBuffer high_priority_output_buffer_;
+  static uint32_t high_priority_overflows_;
   static stmlib_midi::MidiStreamParser<MidiHandler> parser_;
   
   static uint8_t sysex_rx_buffer_[kSysexRxBufferSize];
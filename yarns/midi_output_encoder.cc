@@ -0,0 +1,154 @@
+// Copyright 2021 Chris Rogers.
+//
+// Author: Chris Rogers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// MIDI output queue.
+
+#include "yarns/midi_output_encoder.h"
+
+#ifndef TEST
+#include <stm32f10x_conf.h>
+#endif  // TEST
+
+namespace yarns {
+
+// Relative data entry: every message counts, so they are never merged.
+const uint8_t kCCDataIncrement = 0x60;
+const uint8_t kCCDataDecrement = 0x61;
+
+// Messages are written from the main loop and from SysTick (MIDI thru). With
+// interrupts masked, SysTick can neither dequeue a message while it is being
+// checked and modified, nor write to the queue while the main loop is
+// appending to it.
+inline void MaskInterrupts() {
+#ifndef TEST
+  __disable_irq();
+#endif  // TEST
+}
+
+inline void UnmaskInterrupts() {
+#ifndef TEST
+  __enable_irq();
+#endif  // TEST
+}
+
+void MidiOutputEncoder::Init() {
+  read_ptr_ = write_ptr_ = 0;
+  pending_size_ = 0;
+  pending_ptr_ = 0;
+  running_status_ = 0;
+  bytes_sent_ = 0;
+  bytes_saved_ = 0;
+  coalesced_ = 0;
+  overflows_ = 0;
+}
+
+bool MidiOutputEncoder::Coalesce(
+    uint8_t status,
+    uint8_t data_1,
+    uint8_t data_2) {
+  uint8_t channel = status & 0x0f;
+  bool match_controller = (status & 0xf0) == 0xb0;
+  bool coalesced = false;
+  // The head of the queue is left alone: SysTick picks it up as soon as
+  // interrupts are unmasked.
+  uint8_t head = read_ptr_;
+  uint8_t i = write_ptr_;
+  while (i != head) {
+    i = (i - 1) & (kQueueSize - 1);
+    if (i == head) {
+      break;
+    }
+    Message& m = queue_[i];
+    if (is_raw(m)) {
+      break;
+    }
+    if ((m.status & 0x0f) != channel) {
+      continue;
+    }
+    // Any other message on this channel in between (a note, or another
+    // controller that could be part of an RPN sequence) keeps the order.
+    if (m.status != status || (match_controller && m.data[0] != data_1)) {
+      break;
+    }
+    m.data[0] = data_1;
+    m.data[1] = data_2;
+    coalesced = true;
+    break;
+  }
+  if (coalesced) {
+    ++coalesced_;
+    bytes_saved_ += size(status);
+  }
+  return coalesced;
+}
+
+bool MidiOutputEncoder::Write(uint8_t status, uint8_t data_1, uint8_t data_2) {
+  uint8_t type = status & 0xf0;
+  bool absolute_cc = type == 0xb0 && \
+      data_1 != kCCDataIncrement && data_1 != kCCDataDecrement;
+  bool written = true;
+  MaskInterrupts();
+  if ((absolute_cc || type == 0xe0) && Coalesce(status, data_1, data_2)) {
+    // Merged into a queued message.
+  } else if (!writable()) {
+    ++overflows_;
+    written = false;
+  } else {
+    Message& m = queue_[write_ptr_];
+    m.status = status;
+    m.data[0] = data_1;
+    m.data[1] = data_2;
+    write_ptr_ = (write_ptr_ + 1) & (kQueueSize - 1);
+  }
+  UnmaskInterrupts();
+  return written;
+}
+
+bool MidiOutputEncoder::WriteRaw(uint8_t byte) {
+  bool written = true;
+  MaskInterrupts();
+  // Fill the second slot of the last entry, unless it is the head of the
+  // queue and could be picked up at any time.
+  uint8_t last = (write_ptr_ - 1) & (kQueueSize - 1);
+  if (write_ptr_ != read_ptr_ && last != read_ptr_ && \
+      queue_[last].status == 1) {
+    Message& m = queue_[last];
+    m.data[1] = byte;
+    m.status = 2;
+  } else if (!writable()) {
+    ++overflows_;
+    written = false;
+  } else {
+    Message& m = queue_[write_ptr_];
+    m.status = 1;
+    m.data[0] = byte;
+    write_ptr_ = (write_ptr_ + 1) & (kQueueSize - 1);
+  }
+  UnmaskInterrupts();
+  return written;
+}
+
+}  // namespace yarns
@@ -0,0 +1,158 @@
+// Copyright 2021 Chris Rogers.
+//
+// Author: Chris Rogers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// MIDI output queue. Channel messages are queued whole and only turned into
+// bytes as the UART consumes them, which allows:
+// - running status, with note-offs sent as zero-velocity note-ons,
+// - replacing a queued CC or pitch bend by a newer value for the same
+//   controller, rather than sending both,
+// - dropping (and counting) messages when the queue is full, instead of
+//   overwriting bytes of messages already queued.
+// Raw bytes (thru, SysEx) are passed as-is, packed two per queue entry.
+
+#ifndef YARNS_MIDI_OUTPUT_ENCODER_H_
+#define YARNS_MIDI_OUTPUT_ENCODER_H_
+
+#include "stmlib/stmlib.h"
+
+namespace yarns {
+
+class MidiOutputEncoder {
+ public:
+  MidiOutputEncoder() { }
+  ~MidiOutputEncoder() { }
+
+  void Init();
+
+  // Queues a channel message. The second data byte is ignored for program
+  // change and channel pressure. Returns false if the message was dropped.
+  bool Write(uint8_t status, uint8_t data_1, uint8_t data_2);
+  bool WriteRaw(uint8_t byte);
+
+  inline bool writable() const {
+    return ((read_ptr_ - write_ptr_ - 1) & (kQueueSize - 1)) != 0;
+  }
+
+  inline bool readable() const {
+    return pending_size_ != 0 || read_ptr_ != write_ptr_;
+  }
+
+  // Next byte of the encoded stream. Called from SysTick.
+  inline uint8_t ImmediateRead() {
+    if (!pending_size_) {
+      Message m = queue_[read_ptr_];
+      read_ptr_ = (read_ptr_ + 1) & (kQueueSize - 1);
+      Encode(m);
+    }
+    ++bytes_sent_;
+    --pending_size_;
+    return pending_[pending_ptr_++];
+  }
+
+  inline uint32_t bytes_sent() const { return bytes_sent_; }
+  inline uint32_t bytes_saved() const { return bytes_saved_; }
+  inline uint32_t coalesced() const { return coalesced_; }
+  inline uint32_t overflows() const { return overflows_; }
+
+ private:
+  static const uint8_t kQueueSize = 64;
+
+  // For raw bytes, status holds the number of bytes in data.
+  struct Message {
+    uint8_t status;
+    uint8_t data[2];
+  };
+
+  static inline bool is_raw(const Message& m) {
+    return !(m.status & 0x80);
+  }
+
+  static inline uint8_t size(uint8_t status) {
+    uint8_t type = status & 0xf0;
+    return (type == 0xc0 || type == 0xd0) ? 2 : 3;
+  }
+
+  inline void ObserveRawByte(uint8_t byte) {
+    if (byte >= 0xf8) {
+      // Real-time messages leave running status untouched.
+    } else if (byte >= 0xf0) {
+      running_status_ = 0;
+    } else if (byte & 0x80) {
+      running_status_ = byte;
+    }
+  }
+
+  inline void Encode(const Message& m) {
+    pending_ptr_ = 0;
+    pending_size_ = 0;
+    if (is_raw(m)) {
+      for (uint8_t i = 0; i < m.status; ++i) {
+        ObserveRawByte(m.data[i]);
+        pending_[pending_size_++] = m.data[i];
+      }
+      return;
+    }
+    uint8_t status = m.status;
+    uint8_t message_size = size(status);
+    if ((status & 0xf0) == 0x80 && m.data[1] == 0) {
+      status |= 0x10;
+    }
+    if (status != running_status_) {
+      pending_[pending_size_++] = status;
+      running_status_ = status;
+    } else {
+      ++bytes_saved_;
+    }
+    pending_[pending_size_++] = m.data[0];
+    if (message_size == 3) {
+      pending_[pending_size_++] = m.data[1];
+    }
+  }
+
+  // Called with interrupts masked.
+  bool Coalesce(uint8_t status, uint8_t data_1, uint8_t data_2);
+
+  Message queue_[kQueueSize];
+  volatile uint8_t read_ptr_;
+  volatile uint8_t write_ptr_;
+
+  // Bytes of the message currently being sent.
+  uint8_t pending_[3];
+  volatile uint8_t pending_size_;
+  uint8_t pending_ptr_;
+  uint8_t running_status_;
+
+  uint32_t bytes_sent_;
+  uint32_t bytes_saved_;
+  uint32_t coalesced_;
+  uint32_t overflows_;
+
+  DISALLOW_COPY_AND_ASSIGN(MidiOutputEncoder);
+};
+
+}  // namespace yarns
+
+#endif  // YARNS_MIDI_OUTPUT_ENCODER_H_
@@ -0,0 +1,88 @@
+// Copyright 2021 Chris Rogers.
+//
+// Author: Chris Rogers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Per-voice modulation matrix.
+
+#include "yarns/modulation_matrix.h"
+
+#include <algorithm>
+
+namespace yarns {
+
+void ModulationMatrix::Init() {
+  for (uint8_t s = 0; s < kNumRefreshedModSources; ++s) {
+    std::fill(&amount_[s][0], &amount_[s][MOD_DESTINATION_LAST], 0);
+  }
+  for (uint8_t d = 0; d < MOD_DESTINATION_LAST; ++d) {
+    std::fill(&event_amount_[d][0], &event_amount_[d][kNumEventModSources], 0);
+  }
+  used_sources_ = 0;
+  std::fill(&source_[0], &source_[MOD_SOURCE_LAST], 0);
+  SumEventSources();
+  Process(0, 0, 0);
+  ProcessTimbre();
+}
+
+void ModulationMatrix::SumEventSources() {
+  for (uint8_t d = 0; d < MOD_DESTINATION_LAST; ++d) {
+    int32_t sum = 0;
+    for (uint8_t s = 0; s < kNumEventModSources; ++s) {
+      sum += source_[MOD_SOURCE_VELOCITY + s] * event_amount_[d][s] >> 15;
+    }
+    event_sum_[d] = sum;
+  }
+}
+
+void ModulationMatrix::set_amount(
+    ModSource source,
+    ModDestination destination,
+    int16_t amount) {
+  if (source >= MOD_SOURCE_VELOCITY) {
+    event_amount_[destination][source - MOD_SOURCE_VELOCITY] = amount;
+    SumEventSources();
+    return;
+  }
+  amount_[source][destination] = amount;
+  bool used = false;
+  for (uint8_t d = 0; d < MOD_DESTINATION_LAST; ++d) {
+    used = used || amount_[source][d];
+  }
+  if (used) {
+    used_sources_ |= 1 << source;
+  } else {
+    used_sources_ &= ~(1 << source);
+  }
+}
+
+int16_t ModulationMatrix::amount(
+    ModSource source,
+    ModDestination destination) const {
+  return source >= MOD_SOURCE_VELOCITY
+      ? event_amount_[destination][source - MOD_SOURCE_VELOCITY]
+      : amount_[source][destination];
+}
+
+}  // namespace yarns
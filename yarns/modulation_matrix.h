@@ -0,0 +1,147 @@
+// Copyright 2021 Chris Rogers.
+//
+// Author: Chris Rogers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Per-voice modulation matrix.
+//
+// Sources and destinations are Q15; each route adds source * amount >> 15 to
+// its destination. The envelope and LFO sources are written at every refresh,
+// and Process() skips those without routes. The other sources only change
+// with MIDI events: their contributions are summed when they or their amounts
+// change.
+
+#ifndef YARNS_MODULATION_MATRIX_H_
+#define YARNS_MODULATION_MATRIX_H_
+
+#include "stmlib/stmlib.h"
+
+namespace yarns {
+
+enum ModSource {
+  MOD_SOURCE_ENVELOPE,  // Unipolar.
+  MOD_SOURCE_LFO,  // Triangle, bipolar.
+  MOD_SOURCE_LFO_UNIPOLAR,  // Tremolo shape, 0 at the top of the wave.
+
+  // Event-rate sources.
+  MOD_SOURCE_VELOCITY,
+  MOD_SOURCE_AFTERTOUCH,
+  MOD_SOURCE_BEND,  // Bipolar.
+  MOD_SOURCE_BREATH,
+
+  MOD_SOURCE_LAST
+};
+
+enum ModDestination {
+  MOD_DESTINATION_PITCH,  // 1/128th of a semitone.
+  MOD_DESTINATION_TIMBRE,  // Added to the initial timbre.
+  MOD_DESTINATION_GAIN,  // Attenuation.
+  MOD_DESTINATION_AUX_CV,  // Bipolar.
+
+  MOD_DESTINATION_LAST
+};
+
+const uint8_t kNumRefreshedModSources = MOD_SOURCE_VELOCITY;
+const uint8_t kNumEventModSources = MOD_SOURCE_LAST - MOD_SOURCE_VELOCITY;
+
+class ModulationMatrix {
+ public:
+  ModulationMatrix() { }
+  ~ModulationMatrix() { }
+
+  void Init();
+
+  // An amount of 0 removes the route.
+  void set_amount(ModSource source, ModDestination destination, int16_t amount);
+  int16_t amount(ModSource source, ModDestination destination) const;
+
+  inline void set_source(ModSource source, int16_t value) {
+    source_[source] = value;
+    if (source >= MOD_SOURCE_VELOCITY) {
+      SumEventSources();
+    }
+  }
+  inline int16_t source(ModSource source) const { return source_[source]; }
+  // Sources that are costly to compute can be skipped when unused.
+  inline bool used(ModSource source) const {
+    return used_sources_ & (1 << source);
+  }
+
+  inline int32_t destination(ModDestination destination) const {
+    return destination_[destination];
+  }
+
+  // Sets the refreshed sources and evaluates the destinations read at every
+  // refresh. Timbre is only needed when the oscillator starts a block, and is
+  // evaluated then.
+  inline void Process(int16_t envelope, int16_t lfo, int16_t lfo_unipolar) {
+    source_[MOD_SOURCE_ENVELOPE] = envelope;
+    source_[MOD_SOURCE_LFO] = lfo;
+    source_[MOD_SOURCE_LFO_UNIPOLAR] = lfo_unipolar;
+    int32_t value[] = { envelope, lfo, lfo_unipolar };
+    int32_t pitch = event_sum_[MOD_DESTINATION_PITCH];
+    int32_t gain = event_sum_[MOD_DESTINATION_GAIN];
+    int32_t aux_cv = event_sum_[MOD_DESTINATION_AUX_CV];
+    for (uint8_t s = 0; s < kNumRefreshedModSources; ++s) {
+      if (!used(static_cast<ModSource>(s))) {
+        continue;
+      }
+      const int32_t* amount = amount_[s];
+      pitch += value[s] * amount[MOD_DESTINATION_PITCH] >> 15;
+      gain += value[s] * amount[MOD_DESTINATION_GAIN] >> 15;
+      aux_cv += value[s] * amount[MOD_DESTINATION_AUX_CV] >> 15;
+    }
+    destination_[MOD_DESTINATION_PITCH] = pitch;
+    destination_[MOD_DESTINATION_GAIN] = gain;
+    destination_[MOD_DESTINATION_AUX_CV] = aux_cv;
+  }
+
+  inline void ProcessTimbre() {
+    int32_t timbre = event_sum_[MOD_DESTINATION_TIMBRE];
+    for (uint8_t s = 0; s < kNumRefreshedModSources; ++s) {
+      if (used(static_cast<ModSource>(s))) {
+        timbre += source_[s] * amount_[s][MOD_DESTINATION_TIMBRE] >> 15;
+      }
+    }
+    destination_[MOD_DESTINATION_TIMBRE] = timbre;
+  }
+
+ private:
+  void SumEventSources();
+
+  int32_t amount_[kNumRefreshedModSources][MOD_DESTINATION_LAST];
+  uint8_t used_sources_;
+
+  int16_t event_amount_[MOD_DESTINATION_LAST][kNumEventModSources];
+  int32_t event_sum_[MOD_DESTINATION_LAST];
+
+  int16_t source_[MOD_SOURCE_LAST];
+  int32_t destination_[MOD_DESTINATION_LAST];
+
+  DISALLOW_COPY_AND_ASSIGN(ModulationMatrix);
+};
+
+}  // namespace yarns
+
+#endif  // YARNS_MODULATION_MATRIX_H_
@@ -34,6 +34,7 @@
 #include "stmlib/algorithms/voice_allocator.h"
 
 #include "yarns/just_intonation_processor.h"
+#include "yarns/latency_tracer.h"
 #include "yarns/midi_handler.h"
 #include "yarns/settings.h"
 #include "yarns/ui.h"
@@ -65,6 +66,9 @@ void Multi::Init(bool reset_calibration) {
   recording_ = false;
   recording_part_ = 0;
   started_by_keyboard_ = true;
+  clock_events_.Init();
+  clock_pulse_ = false;
+  reset_pulse_ = false;
   
   // Put the multi in a usable state. Even if these settings will later be
   // overriden with some data retrieved from Flash (presets).
@@ -110,25 +114,29 @@ void Multi::Clock() {
   previous_output_division_ = output_division;
   
   // Logic equation for computing a clock output with a 50% duty cycle.
+  int32_t clock_pulse_length = -1;
   if (output_division > 1) {
     if (clock_output_prescaler_ == 0 && clock_input_prescaler_ == 0) {
-      clock_pulse_counter_ = 0xffff;
+      clock_pulse_length = 0xffff;
     }
     if (clock_output_prescaler_ >= (output_division >> 1) &&
         clock_input_prescaler_ >= (input_division >> 1)) {
-      clock_pulse_counter_ = 0;
+      clock_pulse_length = 0;
     }
   } else {
     if (input_division > 1) {
-      clock_pulse_counter_ = \
+      clock_pulse_length = \
           clock_input_prescaler_ <= (input_division - 1) >> 1 ? 0xffff : 0;
     } else {
       // Because no division is used, neither on the output nor on the input,
       // we don't have a sufficient fast time base to derive a 50% duty cycle
       // output. Instead, we output 5ms pulses.
-      clock_pulse_counter_ = 40;
+      clock_pulse_length = 40;
     }
   }
+  if (clock_pulse_length >= 0) {
+    clock_events_.Post(CLOCK_EVENT_CLOCK_PULSE, clock_pulse_length, 0);
+  }
   
   if (!clock_input_prescaler_) {
     midi_handler.OnClock();
@@ -141,17 +149,17 @@ void Multi::Clock() {
     if (song_pointer_) {
       ClockSong();
     } else {
-      if (internal_clock()) {
-        swing_predelay_[swing_counter_] = 0;
-      } else {
+      uint16_t predelay = 0;
+      if (!internal_clock()) {
         uint32_t interval = midi_clock_tick_duration_;
         midi_clock_tick_duration_ = 0;
 
         uint32_t modulation = swing_counter_ < 6
             ? swing_counter_ : 12 - swing_counter_;
-        swing_predelay_[swing_counter_] = \
+        predelay = \
             27 * modulation * interval * uint32_t(settings_.clock_swing) >> 13;
       }
+      clock_events_.Post(CLOCK_EVENT_PART_TICK, kAllParts, predelay);
     }
     
     ++bar_position_;
@@ -159,7 +167,8 @@ void Multi::Clock() {
       bar_position_ = 0;
     }
     if (bar_position_ == 0) {
-      reset_pulse_counter_ = settings_.nudge_first_tick ? 9 : 81;
+      clock_events_.Post(
+          CLOCK_EVENT_RESET_PULSE, settings_.nudge_first_tick ? 9 : 81, 0);
       if (needs_resync_) {
         clock_output_prescaler_ = 0;
         needs_resync_ = false;
@@ -208,7 +217,7 @@ void Multi::Start(bool started_by_keyboard) {
   previous_output_division_ = 0;
   needs_resync_ = false;
   
-  fill(&swing_predelay_[0], &swing_predelay_[12], -1);
+  clock_events_.PostCancel(CLOCK_EVENT_PART_TICK);
   
   for (uint8_t i = 0; i < num_active_parts_; ++i) {
     part_[i].Start();
@@ -225,8 +234,8 @@ void Multi::Stop() {
     part_[i].Stop();
   }
   midi_handler.OnStop();
-  clock_pulse_counter_ = 0;
-  reset_pulse_counter_ = 0;
+  clock_events_.Post(CLOCK_EVENT_CLOCK_PULSE, 0, 0);
+  clock_events_.Post(CLOCK_EVENT_RESET_PULSE, 0, 0);
   stop_count_down_ = 0;
   running_ = false;
   started_by_keyboard_ = true;
@@ -234,22 +243,55 @@ void Multi::Stop() {
 }
 
 void Multi::ClockFast() {
-  if (clock_pulse_counter_) {
-    --clock_pulse_counter_;
-  }
-  if (reset_pulse_counter_) {
-    --reset_pulse_counter_;
-  }
-
   ++midi_clock_tick_duration_;
-  for (int i = 0; i < 12; ++i) {
-    if (swing_predelay_[i] == 0) {
-      for (uint8_t j = 0; j < num_active_parts_; ++j) {
-        part_[j].Clock();
-      }
-    }
-    if (swing_predelay_[i] >= 0) {
-      --swing_predelay_[i];
+  clock_events_.Tick();
+  ClockEvent event;
+  while (clock_events_.Poll(&event)) {
+    switch (event.type) {
+      case CLOCK_EVENT_PART_TICK:
+        {
+          TickPhase tick = { 0, 0 };
+          if (internal_clock()) {
+            tick = internal_clock_.tick_phase();
+            if (internal_clock_ticks_) {
+              // The clock has already ticked again.
+              tick.phase = UINT32_MAX;
+            }
+          }
+          for (uint8_t j = 0; j < num_active_parts_; ++j) {
+            if (event.data & (1 << j)) {
+              part_[j].Clock(tick);
+            }
+          }
+        }
+        break;
+
+      case CLOCK_EVENT_CLOCK_PULSE:
+        // Pulses last until the end of the SysTick before their end event.
+        clock_pulse_ = event.data != 0;
+        clock_events_.Cancel(CLOCK_EVENT_CLOCK_PULSE_END);
+        if (event.data) {
+          clock_events_.Schedule(
+              CLOCK_EVENT_CLOCK_PULSE_END, 0, event.data - 1);
+        }
+        break;
+
+      case CLOCK_EVENT_CLOCK_PULSE_END:
+        clock_pulse_ = false;
+        break;
+
+      case CLOCK_EVENT_RESET_PULSE:
+        reset_pulse_ = event.data != 0;
+        clock_events_.Cancel(CLOCK_EVENT_RESET_PULSE_END);
+        if (event.data) {
+          clock_events_.Schedule(
+              CLOCK_EVENT_RESET_PULSE_END, 0, event.data - 1);
+        }
+        break;
+
+      case CLOCK_EVENT_RESET_PULSE_END:
+        reset_pulse_ = false;
+        break;
     }
   }
 }
@@ -266,6 +308,7 @@ void Multi::Refresh() {
   for (uint8_t i = 0; i < kNumCVOutputs; ++i) {
     cv_outputs_[i].Refresh();
   }
+  dac_frame_producer.Capture(cv_outputs_);
 }
 
 bool Multi::Set(uint8_t address, uint8_t value) {
@@ -438,6 +481,7 @@ void Multi::GetCvGate(uint16_t* cv, bool* gate) {
       }
       break;
   }
+  latency_tracer.OnCvGateUpdate();
 }
 
 void Multi::GetLedsBrightness(uint8_t* brightness) {
@@ -618,6 +662,7 @@ void Multi::ChangeLayout(Layout old_layout, Layout new_layout) {
                 part_[destination].mutable_sequencer_settings(),
                 part_[source].mutable_sequencer_settings(),
                 sizeof(SequencerSettings));
+            part_[destination].InvalidateLookahead();
           }
         }
       }
@@ -644,6 +689,7 @@ void Multi::ChangeLayout(Layout old_layout, Layout new_layout) {
                 part_[destination].mutable_sequencer_settings(),
                 part_[source].mutable_sequencer_settings(),
                 sizeof(SequencerSettings));
+            part_[destination].InvalidateLookahead();
           }
         }
       }
@@ -32,6 +32,8 @@
 
 #include "stmlib/stmlib.h"
 
+#include "yarns/clock_event_queue.h"
+#include "yarns/dac_frame_producer.h"
 #include "yarns/internal_clock.h"
 #include "yarns/layout_configurator.h"
 #include "yarns/part.h"
@@ -43,10 +45,32 @@ namespace yarns {
 
 const uint8_t kNumParts = 4;
 const uint8_t kNumCVOutputs = 4;
+STATIC_ASSERT(kNumCVOutputs == kNumDacChannels, dac_channels);
 // One paraphonic part, one voice per remaining output
 const uint8_t kNumSystemVoices = kNumParaphonicVoices + (kNumCVOutputs - 1);
 const uint8_t kMaxBarDuration = 32;
 
+enum ClockEventType {
+  CLOCK_EVENT_PART_TICK,  // data: mask of the parts to clock.
+  CLOCK_EVENT_CLOCK_PULSE,  // data: length in SysTicks, 0 to end it.
+  CLOCK_EVENT_CLOCK_PULSE_END,
+  CLOCK_EVENT_RESET_PULSE,  // data: length in SysTicks, 0 to end it.
+  CLOCK_EVENT_RESET_PULSE_END,
+};
+
+const uint8_t kAllParts = (1 << kNumParts) - 1;
+
+// Layouts of PackedMulti. The format is stored along with a multi (in the
+// header of its flash page, or after it in SysEx dumps) rather than in it:
+// earlier versions left the padding bytes uninitialized.
+enum MultiFormat {
+  MULTI_FORMAT_LEGACY,  // Looper notes with a fixed size.
+  MULTI_FORMAT_PACKED_LOOPER,  // Delta-encoded looper recordings.
+  MULTI_FORMAT_LAST
+};
+
+const uint8_t kMultiFormat = MULTI_FORMAT_PACKED_LOOPER;
+
 struct PackedMulti {
   PackedPart parts[kNumParts];
 
@@ -375,8 +399,8 @@ class Multi {
   void ClockFast();
   void Refresh();
   void RefreshInternalClock() {
-    if (running() && internal_clock() && internal_clock_.Process()) {
-      ++internal_clock_ticks_;
+    if (running() && internal_clock()) {
+      internal_clock_ticks_ += internal_clock_.Advance(kClockSamplesPerSysTick);
     }
   }
 
@@ -390,10 +414,16 @@ class Multi {
       if (running() && part_[p].looper_in_use()) {
         part_[p].mutable_looper().AdvanceToPresent();
       }
+      part_[p].FillLookahead();
       for (uint8_t v = 0; v < part_[p].num_voices(); ++v) {
         part_[p].voice(v)->RenderSamples();
       }
     }
+    for (uint8_t i = 0; i < kNumCVOutputs; ++i) {
+      cv_outputs_[i].RenderSamples();
+    }
+    dac_frame_producer.Render(cv_outputs_);
+    storage_manager.Poll();
   }
   
   bool Set(uint8_t address, uint8_t value);
@@ -410,13 +440,13 @@ class Multi {
   inline bool recording() const { return recording_; }
   inline uint8_t recording_part() const { return recording_part_; }
   inline bool clock() const {
-    return clock_pulse_counter_ > 0 && \
+    return clock_pulse_ && \
         (!settings_.nudge_first_tick || \
           settings_.clock_bar_duration == 0 || \
           !reset());
   }
   inline bool reset() const {
-    return reset_pulse_counter_ > 0;
+    return reset_pulse_;
   }
   inline bool reset_or_playing_flag() const {
     return reset() || ((settings_.clock_bar_duration == 0) && running_);
@@ -460,13 +490,24 @@ class Multi {
   void GetCvGate(uint16_t* cv, bool* gate);
   void GetLedsBrightness(uint8_t* brightness);
 
+  // Packs one part (which includes fitting its looper recording), or the
+  // multi settings when part is kNumParts. The storage manager saves a multi
+  // one call per poll step.
+  void Pack(uint8_t part, PackedMulti* packed) {
+    if (part < kNumParts) {
+      part_[part].Pack(packed->parts[part]);
+    } else {
+      settings_.Pack(*packed);
+    }
+  }
+
   template<typename T>
   void Serialize(T* stream_buffer) {
-    PackedMulti packed;
-    for (uint8_t i = 0; i < kNumParts; i++) {
-      part_[i].Pack(packed.parts[i]);
+    // Zeroed, so that unused bits do not make identical multis differ.
+    PackedMulti packed = PackedMulti();
+    for (uint8_t i = 0; i <= kNumParts; i++) {
+      Pack(i, &packed);
     }
-    settings_.Pack(packed);
     const uint16_t size = sizeof(packed);
     // char (*__debug)[size] = 1;
     STATIC_ASSERT(size == 1012, expected);
@@ -476,12 +517,15 @@ class Multi {
   };
   
   template<typename T>
-  void Deserialize(T* stream_buffer) {
+  void Deserialize(T* stream_buffer, uint8_t format) {
     StopRecording(recording_part_);
     Stop();
     PackedMulti packed;
     stream_buffer->Read(&packed);
     for (uint8_t i = 0; i < kNumParts; i++) {
+      if (format == MULTI_FORMAT_LEGACY) {
+        looper::ConvertLegacy(packed.parts[i]);
+      }
       part_[i].Unpack(packed.parts[i]);
     }
     settings_.Unpack(packed);
@@ -539,7 +583,7 @@ class Multi {
   uint8_t internal_clock_ticks_;
   uint16_t midi_clock_tick_duration_;
 
-  int16_t swing_predelay_[12];
+  ClockEventQueue clock_events_;
   uint8_t swing_counter_;
   
   uint8_t clock_input_prescaler_;
@@ -547,8 +591,8 @@ class Multi {
   uint16_t bar_position_;
   uint8_t stop_count_down_;
   
-  uint16_t clock_pulse_counter_;
-  uint16_t reset_pulse_counter_;
+  bool clock_pulse_;
+  bool reset_pulse_;
   
   uint16_t previous_output_division_;
   bool needs_resync_;
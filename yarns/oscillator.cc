@@ -40,7 +40,6 @@ using namespace stmlib;
 
 static const size_t kNumZones = 15;
 
-static const uint16_t kHighestNote = 128 * 128;
 static const uint16_t kPitchTableStart = 116 * 128;
 static const uint16_t kOctave = 12 * 128;
 
@@ -72,6 +71,7 @@ Oscillator::RenderFn Oscillator::fn_table_[] = {
   &Oscillator::RenderTanhSine,
   &Oscillator::RenderBuzz,
   &Oscillator::RenderFM,
+  &Oscillator::RenderWavetable,
   // &Oscillator::RenderAudioRatePWM,
 };
 
@@ -106,7 +106,8 @@ void Oscillator::Refresh(int16_t pitch, int16_t timbre, uint16_t gain) {
     gain_.SetTarget((scale_ * gain) >> 17);
 
     int32_t strength = 32767;
-    if (shape_ == OSC_SHAPE_FOLD_SINE || shape_ >= OSC_SHAPE_FM) {
+    bool fm = shape_ >= OSC_SHAPE_FM && shape_ < OSC_SHAPE_WAVETABLE;
+    if (shape_ == OSC_SHAPE_FOLD_SINE || fm) {
       strength -= 6 * (pitch_ - (92 << 7));
       CONSTRAIN(strength, 0, 32767);
       timbre = timbre * strength >> 15;
@@ -115,6 +116,9 @@ void Oscillator::Refresh(int16_t pitch, int16_t timbre, uint16_t gain) {
         case OSC_SHAPE_VARIABLE_PULSE:
           CONSTRAIN(timbre, 0, 31767);
           break;
+        case OSC_SHAPE_WAVETABLE:
+          CONSTRAIN(timbre, 0, 32767);
+          break;
         case OSC_SHAPE_FOLD_TRIANGLE:
           strength -= 7 * (pitch_ - (80 << 7));
           CONSTRAIN(strength, 0, 32767);
@@ -127,7 +131,8 @@ void Oscillator::Refresh(int16_t pitch, int16_t timbre, uint16_t gain) {
     timbre_.SetTarget(timbre);
   }
 
-uint32_t Oscillator::ComputePhaseIncrement(int16_t midi_pitch) const {
+/* static */
+uint32_t Oscillator::ComputePhaseIncrement(int16_t midi_pitch) {
   int16_t num_shifts = 0;
   while (midi_pitch >= kHighestNote) {
     midi_pitch -= kOctave;
@@ -154,6 +159,32 @@ uint32_t Oscillator::ComputePhaseIncrement(int16_t midi_pitch) const {
   return phase_increment;
 }
 
+void PhaseIncrementCache::Update(int16_t pitch) {
+  pitch_ = pitch;
+  uint32_t ref_pitch = static_cast<int32_t>(pitch) - octave_start_;
+  if (ref_pitch >= kOctave) {
+    if (pitch >= kHighestNote) {
+      // Shifted left, with a clamp that depends on the interpolated value.
+      octave_start_ = kNoOctave;
+      phase_increment_ = Oscillator::ComputePhaseIncrement(pitch);
+      return;
+    }
+    num_shifts_ = 0;
+    int32_t start = kPitchTableStart;
+    while (pitch < start) {
+      start -= kOctave;
+      ++num_shifts_;
+    }
+    octave_start_ = start;
+    ref_pitch = pitch - start;
+  }
+  uint32_t a = lut_oscillator_increments[ref_pitch >> 4];
+  uint32_t b = lut_oscillator_increments[(ref_pitch >> 4) + 1];
+  uint32_t phase_increment = a + \
+      (static_cast<int32_t>(b - a) * static_cast<int32_t>(ref_pitch & 0xf) >> 4);
+  phase_increment_ = phase_increment >> num_shifts_;
+}
+
 void Oscillator::Render() {
   if (audio_buffer_.writable() < kAudioBlockSize) return;
   
@@ -162,10 +193,17 @@ void Oscillator::Render() {
   } else if (pitch_ < 0) {
     pitch_ = 0;
   }
-  phase_increment_ = ComputePhaseIncrement(pitch_);
+  uint32_t phase_increment = phase_increment_cache_.Compute(pitch_);
+  phase_increment_slope_ = static_cast<int32_t>(
+      phase_increment - phase_increment_) / \
+      static_cast<int32_t>(kAudioBlockSize);
   
   uint8_t fn_index = shape_;
-  CONSTRAIN(fn_index, 0, OSC_SHAPE_FM);
+  if (fn_index >= OSC_SHAPE_WAVETABLE) {
+    fn_index = OSC_SHAPE_FM + 1;
+  } else {
+    CONSTRAIN(fn_index, 0, OSC_SHAPE_FM);
+  }
   RenderFn fn = fn_table_[fn_index];
   (this->*fn)();
 }
@@ -175,12 +213,14 @@ void Oscillator::Render() {
   int32_t next_sample = next_sample_; \
   uint32_t phase = phase_; \
   uint32_t phase_increment = phase_increment_; \
+  int32_t phase_increment_slope = phase_increment_slope_; \
   uint32_t modulator_phase = modulator_phase_; \
   uint32_t modulator_phase_increment = modulator_phase_increment_; \
   size_t size = kAudioBlockSize; \
   while (size--) { \
     int32_t this_sample = next_sample; \
     next_sample = 0; \
+    phase_increment += phase_increment_slope; \
     phase += phase_increment; \
     timbre_.Tick(); gain_.Tick(); \
     body \
@@ -188,7 +228,7 @@ void Oscillator::Render() {
   } \
   next_sample_ = next_sample; \
   phase_ = phase; \
-  phase_increment_ = phase_increment; \
+  phase_increment_ = phase_increment_cache_.phase_increment(); \
   modulator_phase_ = modulator_phase; \
   modulator_phase_increment_ = modulator_phase_increment;
 
@@ -300,7 +340,7 @@ void Oscillator::RenderSaw() {
 }
 
 #define SET_SYNC_INCREMENT \
-  modulator_phase_increment_ = ComputePhaseIncrement( \
+  modulator_phase_increment_ = modulator_phase_increment_cache_.Compute( \
     pitch_ + (timbre_.target() >> 4) \
   );
 
@@ -374,7 +414,8 @@ void Oscillator::RenderTanhSine() {
 
 void Oscillator::RenderFM() {
   int16_t interval = lut_fm_modulator_intervals[shape_ - OSC_SHAPE_FM];
-  modulator_phase_increment_ = ComputePhaseIncrement(pitch_ + interval);
+  modulator_phase_increment_ = modulator_phase_increment_cache_.Compute(
+      pitch_ + interval);
   RENDER_LOOP(
     int16_t modulator = Interpolate824(wav_sine, modulator_phase);
     uint32_t phase_mod = modulator * timbre_.value();
@@ -387,7 +428,7 @@ void Oscillator::RenderFM() {
   int16_t timbre_offset = timbre_.target() - 2048; \
   int32_t shifted_pitch = pitch_ + (timbre_offset >> 2) + (timbre_offset >> 4) + (timbre_offset >> 8); \
   if (shifted_pitch >= kHighestNote) shifted_pitch = kHighestNote - 1; \
-  modulator_phase_increment_ = ComputePhaseIncrement(shifted_pitch);
+  modulator_phase_increment_ = modulator_phase_increment_cache_.Compute(shifted_pitch);
 
 const uint32_t kPhaseResetSaw[] = {
   0, // Low-pass: -cos
@@ -467,6 +508,34 @@ void Oscillator::RenderBuzz() {
   )
 }
 
+/* static */
+void Oscillator::SelectWavetables(int16_t pitch, Wavetables* wavetables) {
+  // Peak of the difference of saws, measured on the tables of each zone.
+  // Above the last zone, the saw is the sine, and so is the square.
+  static const int16_t square_gain[kNumWavetableZones + 1] = {
+    16302, 16192, 15970, 15515, 14768, 13290, 8192
+  };
+  // Each zone is band-limited for the top of an octave, the first one
+  // ending at note 54. Higher up, only the sine fits.
+  int16_t zone = (pitch - (54 << 7) + kOctave - 1) / kOctave;
+  CONSTRAIN(zone, 0, kNumWavetableZones);
+  wavetables->wave[0] = wav_sine;
+  for (uint8_t i = 1; i < kNumWavetableWaves - 1; ++i) {
+    wavetables->wave[i] = zone == kNumWavetableZones ? wav_sine :
+        waveform_table[WAV_BANDLIMITED_TRIANGLE_0 + \
+            zone * (kNumWavetableWaves - 2) + i - 1];
+  }
+  wavetables->square_gain = square_gain[zone];
+}
+
+void Oscillator::RenderWavetable() {
+  Wavetables wavetables;
+  SelectWavetables(pitch_, &wavetables);
+  RENDER_LOOP_WITHOUT_MOD_PHASE_INCREMENT(
+    this_sample = WavetableSample(wavetables, timbre_.value(), phase);
+  )
+}
+
 void Oscillator::RenderFilteredNoise() {
   int32_t cutoff = 0x1000 + (timbre_.target() >> 1); // 1/4...1/2
   svf_.RenderInit(cutoff, pitch_ << 1);
@@ -31,9 +31,11 @@
 #define YARNS_ANALOG_OSCILLATOR_H_
 
 #include "stmlib/stmlib.h"
+#include "stmlib/utils/dsp.h"
 #include "stmlib/utils/ring_buffer.h"
 
 #include "yarns/interpolator.h"
+#include "yarns/resources.h"
 
 #include <cstring>
 #include <cstdio>
@@ -41,6 +43,17 @@
 namespace yarns {
 
 const size_t kAudioBlockSize = 64;
+const uint16_t kHighestNote = 128 * 128;
+
+// Sine, then band-limited triangle, saw and square. The square is not stored:
+// it is the saw minus the same saw half a period later.
+const uint8_t kNumWavetableWaves = 4;
+const uint8_t kNumWavetableZones = 6;
+
+struct Wavetables {
+  const int16_t* wave[kNumWavetableWaves - 1];
+  int16_t square_gain;  // Q14, brings the difference of saws to full scale.
+};
 
 class StateVariableFilter {
  public:
@@ -82,6 +95,46 @@ enum OscillatorShape {
   OSC_SHAPE_TANH_SINE,
   OSC_SHAPE_BUZZ,
   OSC_SHAPE_FM,
+  // Followed by the other FM ratios. The wavetable comes after them, so that
+  // saved shapes keep their values.
+  OSC_SHAPE_WAVETABLE = OSC_SHAPE_FM + LUT_FM_RATIO_NAMES_SIZE,
+};
+
+// Remembers the last pitch converted to a phase increment, and the octave of
+// the table it fell in. Pitch changes within that octave (portamento,
+// vibrato) only need the table interpolation and a shift. Results are the
+// same as Oscillator::ComputePhaseIncrement.
+class PhaseIncrementCache {
+ public:
+  PhaseIncrementCache() { }
+  ~PhaseIncrementCache() { }
+
+  inline void Init() {
+    octave_start_ = kNoOctave;
+    Update(60 << 7);
+  }
+
+  inline uint32_t Compute(int16_t pitch) {
+    if (pitch != pitch_) {
+      Update(pitch);
+    }
+    return phase_increment_;
+  }
+
+  inline uint32_t phase_increment() const { return phase_increment_; }
+
+ private:
+  // Far enough below any pitch to never be within an octave of it.
+  static const int32_t kNoOctave = -65536;
+
+  void Update(int16_t pitch);
+
+  int16_t pitch_;
+  uint32_t phase_increment_;
+  int32_t octave_start_;
+  uint8_t num_shifts_;
+
+  DISALLOW_COPY_AND_ASSIGN(PhaseIncrementCache);
 };
 
 class Oscillator {
@@ -101,6 +154,9 @@ class Oscillator {
     pitch_ = 60 << 7;
     phase_ = 0;
     phase_increment_ = 1;
+    phase_increment_slope_ = 0;
+    phase_increment_cache_.Init();
+    modulator_phase_increment_cache_.Init();
     high_ = false;
     next_sample_ = 0;
   }
@@ -109,13 +165,48 @@ class Oscillator {
     return audio_buffer_.ImmediateRead();
   }
 
+  // Drops the samples rendered but not read yet.
+  inline void Flush() {
+    audio_buffer_.Flush();
+  }
+
   void Refresh(int16_t pitch, int16_t timbre, uint16_t gain);
   
   inline void set_shape(OscillatorShape shape) {
     shape_ = shape;
   }
-  
+
+  inline OscillatorShape shape() const { return shape_; }
+  inline int16_t pitch() const { return pitch_; }
+  inline int16_t timbre_target() const { return timbre_.target(); }
+  inline int16_t gain_target() const { return gain_.target(); }
+  inline size_t readable() const { return audio_buffer_.readable(); }
+  inline size_t writable() const { return audio_buffer_.writable(); }
+
   void Render();
+
+  static uint32_t ComputePhaseIncrement(int16_t midi_pitch);
+
+  // Tables band-limited for the pitch, from sine to saw.
+  static void SelectWavetables(int16_t pitch, Wavetables* wavetables);
+
+  // Timbre sweeps across the waves, crossfading adjacent ones.
+  static inline int16_t WavetableSample(
+      const Wavetables& wavetables, int16_t timbre, uint32_t phase) {
+    uint32_t position = static_cast<uint32_t>(timbre) * \
+        (kNumWavetableWaves - 1);
+    uint8_t index = position >> 15;
+    uint16_t balance = (position & 0x7fff) << 1;
+    const int16_t* wave = wavetables.wave[index];
+    if (index < kNumWavetableWaves - 2) {
+      return stmlib::Crossfade(
+          wave, wavetables.wave[index + 1], phase, balance);
+    }
+    int32_t saw = stmlib::Interpolate824(wave, phase);
+    int32_t shifted = stmlib::Interpolate824(wave, phase + (1UL << 31));
+    int32_t square = (saw - shifted) * wavetables.square_gain >> 14;
+    return saw + ((square - saw) * static_cast<int32_t>(balance) >> 16);
+  }
   
  private:
   void RenderPulse();
@@ -131,8 +222,7 @@ class Oscillator {
   void RenderPhaseDistortionSaw();
   void RenderBuzz();
   void RenderFilteredNoise();
-  
-  uint32_t ComputePhaseIncrement(int16_t midi_pitch) const;
+  void RenderWavetable();
   
   inline int32_t ThisBlepSample(uint32_t t) const {
     if (t > 65535) {
@@ -155,8 +245,12 @@ class Oscillator {
 
   uint32_t phase_;
   uint32_t phase_increment_;
+  // The increment glides to the new pitch across each block.
+  int32_t phase_increment_slope_;
   uint32_t modulator_phase_;
   uint32_t modulator_phase_increment_;
+  PhaseIncrementCache phase_increment_cache_;
+  PhaseIncrementCache modulator_phase_increment_cache_;
   bool high_;
 
   StateVariableFilter svf_;
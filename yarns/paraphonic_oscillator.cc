@@ -0,0 +1,254 @@
+// Copyright 2021 Chris Rogers.
+//
+// Author: Chris Rogers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Paraphonic oscillator.
+
+#include "yarns/paraphonic_oscillator.h"
+
+#include <algorithm>
+
+#include "stmlib/utils/dsp.h"
+
+#include "yarns/resources.h"
+
+namespace yarns {
+
+using namespace stmlib;
+
+static const size_t kNumZones = 15;
+
+/* static */
+ParaphonicOscillator::RenderFn ParaphonicOscillator::fn_table_[] = {
+  // Filtered noise, phase distortion, BLEP pulse/saw and sync shapes keep
+  // per-voice state, and are rendered by each voice's Oscillator.
+  NULL, NULL, NULL, NULL,
+  NULL, NULL, NULL, NULL,
+  NULL, NULL, NULL, NULL,
+  NULL, NULL,
+  NULL, NULL,
+  NULL, NULL, NULL,
+  &ParaphonicOscillator::RenderFoldSine,
+  &ParaphonicOscillator::RenderFoldTriangle,
+  &ParaphonicOscillator::RenderTanhSine,
+  &ParaphonicOscillator::RenderBuzz,
+  &ParaphonicOscillator::RenderFM,
+  &ParaphonicOscillator::RenderWavetable,
+};
+
+void ParaphonicOscillator::Init(uint8_t num_voices, int32_t offset) {
+  audio_buffer_.Init();
+  num_voices_ = num_voices;
+  mix_offset_ = offset * num_voices;
+  // The voices' Oscillators are initialized along with this one: nothing
+  // stale in their buffers.
+  mixing_ = true;
+  for (uint8_t v = 0; v < kMaxParaphonicVoices; ++v) {
+    oscillator_[v] = NULL;
+    pitch_[v] = 60 << 7;
+    phase_[v] = 0;
+    // Same as Oscillator::Init, which the first block glides from.
+    phase_increment_[v] = 1;
+    phase_increment_slope_[v] = 0;
+    phase_increment_cache_[v].Init();
+    modulator_phase_increment_cache_[v].Init();
+    modulator_phase_[v] = 0;
+    modulator_phase_increment_[v] = 0;
+    timbre_[v] = timbre_slope_[v] = 0;
+    gain_[v] = gain_slope_[v] = 0;
+  }
+}
+
+void ParaphonicOscillator::Render() {
+  if (audio_buffer_.writable() < kAudioBlockSize) return;
+
+  // All voices belong to the same part, hence have the same shape.
+  uint8_t fn_index = oscillator_[0]->shape();
+  if (fn_index >= OSC_SHAPE_WAVETABLE) {
+    fn_index = OSC_SHAPE_FM + 1;
+  } else {
+    CONSTRAIN(fn_index, 0, OSC_SHAPE_FM);
+  }
+  RenderFn fn = fn_table_[fn_index];
+  if (!fn) {
+    if (!mixing_) {
+      // The voices' buffers have not been read since the shape changed, and
+      // hold samples of the previous shape: start again from a fresh block.
+      for (uint8_t v = 0; v < num_voices_; ++v) {
+        oscillator_[v]->Flush();
+        oscillator_[v]->Render();
+      }
+      mixing_ = true;
+    }
+    RenderMix();
+    return;
+  }
+  mixing_ = false;
+
+  for (uint8_t v = 0; v < num_voices_; ++v) {
+    const Oscillator& oscillator = *oscillator_[v];
+    int16_t pitch = oscillator.pitch();
+    CONSTRAIN(pitch, 0, kHighestNote - 1);
+    pitch_[v] = pitch;
+    phase_increment_slope_[v] = static_cast<int32_t>(
+        phase_increment_cache_[v].Compute(pitch) - phase_increment_[v]) / \
+        static_cast<int32_t>(kAudioBlockSize);
+    modulator_phase_increment_[v] = 0;
+    timbre_slope_[v] = static_cast<int32_t>(
+        (oscillator.timbre_target() - (timbre_[v] >> 16)) << 16) / \
+        static_cast<int32_t>(kAudioBlockSize);
+    gain_slope_[v] = static_cast<int32_t>(
+        (oscillator.gain_target() - (gain_[v] >> 16)) << 16) / \
+        static_cast<int32_t>(kAudioBlockSize);
+  }
+  (this->*fn)();
+}
+
+// Same as Oscillator's RENDER_LOOP, one voice at a time so that its state
+// stays in registers. Each voice is accumulated into the mix, which is scaled
+// and offset once per sample.
+#define PARAPHONIC_RENDER_LOOP(body) \
+  int32_t mix[kAudioBlockSize]; \
+  std::fill(&mix[0], &mix[kAudioBlockSize], 0); \
+  for (uint8_t v = 0; v < num_voices_; ++v) { \
+    uint32_t phase = phase_[v]; \
+    uint32_t phase_increment = phase_increment_[v]; \
+    int32_t phase_increment_slope = phase_increment_slope_[v]; \
+    uint32_t modulator_phase = modulator_phase_[v]; \
+    uint32_t modulator_phase_increment = modulator_phase_increment_[v]; \
+    int32_t timbre = timbre_[v]; \
+    int32_t timbre_slope = timbre_slope_[v]; \
+    int32_t gain = gain_[v]; \
+    int32_t gain_slope = gain_slope_[v]; \
+    int16_t pitch = pitch_[v]; \
+    for (size_t i = 0; i < kAudioBlockSize; ++i) { \
+      phase_increment += phase_increment_slope; \
+      phase += phase_increment; \
+      modulator_phase += modulator_phase_increment; \
+      timbre += timbre_slope; \
+      gain += gain_slope; \
+      int16_t timbre_16 = timbre >> 16; \
+      int32_t this_sample; \
+      body \
+      (void) pitch; (void) timbre_16; \
+      mix[i] += static_cast<int16_t>(gain >> 16) * \
+          static_cast<int16_t>(this_sample); \
+    } \
+    phase_[v] = phase; \
+    phase_increment_[v] = phase_increment_cache_[v].phase_increment(); \
+    modulator_phase_[v] = modulator_phase; \
+    timbre_[v] = timbre; \
+    gain_[v] = gain; \
+  } \
+  for (size_t i = 0; i < kAudioBlockSize; ++i) { \
+    audio_buffer_.Overwrite(mix_offset_ - (mix[i] >> 15)); \
+  }
+
+void ParaphonicOscillator::RenderFoldTriangle() {
+  PARAPHONIC_RENDER_LOOP(
+    uint16_t phase_16 = phase >> 16;
+    this_sample = (phase_16 << 1) ^ (phase_16 & 0x8000 ? 0xffff : 0x0000);
+    this_sample += 32768;
+    this_sample = this_sample * timbre_16 >> 15;
+    this_sample = Interpolate88(ws_tri_fold, this_sample + 32768);
+  )
+}
+
+void ParaphonicOscillator::RenderFoldSine() {
+  PARAPHONIC_RENDER_LOOP(
+    this_sample = Interpolate824(wav_sine, phase);
+    this_sample = this_sample * timbre_16 >> 15;
+    this_sample = Interpolate88(ws_sine_fold, this_sample + 32768);
+  )
+}
+
+void ParaphonicOscillator::RenderTanhSine() {
+  PARAPHONIC_RENDER_LOOP(
+    this_sample = Interpolate824(wav_sine, phase);
+    int16_t baseline = this_sample >> 6;
+    this_sample = baseline + \
+        ((this_sample - baseline) * timbre_16 >> 15);
+    this_sample = Interpolate88(ws_violent_overdrive, this_sample + 32768);
+  )
+}
+
+void ParaphonicOscillator::RenderFM() {
+  int16_t interval = lut_fm_modulator_intervals[
+      oscillator_[0]->shape() - OSC_SHAPE_FM];
+  for (uint8_t v = 0; v < num_voices_; ++v) {
+    modulator_phase_increment_[v] = \
+        modulator_phase_increment_cache_[v].Compute(pitch_[v] + interval);
+  }
+  PARAPHONIC_RENDER_LOOP(
+    int16_t modulator = Interpolate824(wav_sine, modulator_phase);
+    uint32_t phase_mod = modulator * timbre_16;
+    phase_mod = (phase_mod << 3) + (phase_mod << 2); // FM index 0-3
+    this_sample = Interpolate824(wav_sine, phase + phase_mod);
+  )
+}
+
+void ParaphonicOscillator::RenderBuzz() {
+  PARAPHONIC_RENDER_LOOP(
+    int32_t zone_14 = (pitch + ((32767 - timbre_16) >> 1));
+    uint16_t crossfade = zone_14 << 6; // Ignore highest 4 bits
+    size_t index = zone_14 >> 10; // Use highest 4 bits
+    CONSTRAIN(index, 0, kNumZones - 1);
+    const int16_t* wave_1 = waveform_table[WAV_BANDLIMITED_COMB_0 + index];
+    index += 1;
+    CONSTRAIN(index, 0, kNumZones - 1);
+    const int16_t* wave_2 = waveform_table[WAV_BANDLIMITED_COMB_0 + index];
+    this_sample = Crossfade(wave_1, wave_2, phase, crossfade);
+  )
+}
+
+void ParaphonicOscillator::RenderWavetable() {
+  Wavetables wavetables[kMaxParaphonicVoices];
+  for (uint8_t v = 0; v < num_voices_; ++v) {
+    Oscillator::SelectWavetables(pitch_[v], &wavetables[v]);
+  }
+  PARAPHONIC_RENDER_LOOP(
+    this_sample = Oscillator::WavetableSample(
+        wavetables[v], timbre_16, phase);
+  )
+}
+
+void ParaphonicOscillator::RenderMix() {
+  for (uint8_t v = 0; v < num_voices_; ++v) {
+    if (oscillator_[v]->readable() < kAudioBlockSize) return;
+  }
+  size_t size = kAudioBlockSize;
+  while (size--) {
+    uint16_t mix = 0;
+    for (uint8_t v = 0; v < num_voices_; ++v) {
+      mix += oscillator_[v]->ReadSample();
+    }
+    audio_buffer_.Overwrite(mix);
+  }
+}
+
+/* extern */
+ParaphonicOscillator paraphonic_oscillator;
+
+}  // namespace yarns
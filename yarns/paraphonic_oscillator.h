@@ -0,0 +1,111 @@
+// Copyright 2021 Chris Rogers.
+//
+// Author: Chris Rogers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Paraphonic oscillator: renders and mixes the voices of a paraphonic part in
+// a single pass, with the state of all voices in struct-of-arrays form.
+//
+// Shapes without per-voice filter or BLEP state are rendered here directly.
+// For the others, each voice's Oscillator still renders its own block, and
+// the blocks are summed into the output buffer here, so that the DAC
+// interrupt reads one buffer in either case.
+
+#ifndef YARNS_PARAPHONIC_OSCILLATOR_H_
+#define YARNS_PARAPHONIC_OSCILLATOR_H_
+
+#include "stmlib/stmlib.h"
+#include "stmlib/utils/ring_buffer.h"
+
+#include "yarns/oscillator.h"
+
+namespace yarns {
+
+const uint8_t kMaxParaphonicVoices = 4;
+
+class ParaphonicOscillator {
+ public:
+  typedef void (ParaphonicOscillator::*RenderFn)();
+
+  ParaphonicOscillator() { }
+  ~ParaphonicOscillator() { }
+
+  void Init(uint8_t num_voices, int32_t offset);
+
+  // The oscillators keep receiving pitch, timbre and gain from their voices
+  // before each block, and render the shapes not supported here.
+  inline void set_oscillator(uint8_t index, Oscillator* oscillator) {
+    oscillator_[index] = oscillator;
+  }
+
+  inline uint16_t ReadSample() {
+    return audio_buffer_.ImmediateRead();
+  }
+  inline size_t writable() const { return audio_buffer_.writable(); }
+
+  void Render();
+
+ private:
+  void RenderFoldTriangle();
+  void RenderFoldSine();
+  void RenderTanhSine();
+  void RenderBuzz();
+  void RenderFM();
+  void RenderWavetable();
+  void RenderMix();
+
+  Oscillator* oscillator_[kMaxParaphonicVoices];
+  uint8_t num_voices_;
+  // Each oscillator adds its own offset to the mix.
+  uint16_t mix_offset_;
+  // The last block was summed from the voices' Oscillators.
+  bool mixing_;
+
+  int16_t pitch_[kMaxParaphonicVoices];
+  uint32_t phase_[kMaxParaphonicVoices];
+  uint32_t phase_increment_[kMaxParaphonicVoices];
+  int32_t phase_increment_slope_[kMaxParaphonicVoices];
+  uint32_t modulator_phase_[kMaxParaphonicVoices];
+  uint32_t modulator_phase_increment_[kMaxParaphonicVoices];
+  PhaseIncrementCache phase_increment_cache_[kMaxParaphonicVoices];
+  PhaseIncrementCache modulator_phase_increment_cache_[kMaxParaphonicVoices];
+
+  // Same ramps as Interpolator: 16.16 values, slope computed once per block.
+  int32_t timbre_[kMaxParaphonicVoices];
+  int32_t timbre_slope_[kMaxParaphonicVoices];
+  int32_t gain_[kMaxParaphonicVoices];
+  int32_t gain_slope_[kMaxParaphonicVoices];
+
+  stmlib::RingBuffer<uint16_t, kAudioBlockSize * 2> audio_buffer_;
+
+  static RenderFn fn_table_[];
+
+  DISALLOW_COPY_AND_ASSIGN(ParaphonicOscillator);
+};
+
+extern ParaphonicOscillator paraphonic_oscillator;
+
+}  // namespace yarns
+
+#endif  // YARNS_PARAPHONIC_OSCILLATOR_H_
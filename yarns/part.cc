@@ -47,9 +47,18 @@ using namespace stmlib;
 using namespace stmlib_midi;
 using namespace std;
 
+// Same as modulate_7bit, but keeps the fractional part of the velocity
+// modulation.
+inline uint16_t modulate_16bit(uint8_t init, int8_t mod, uint8_t scale) {
+  int32_t value = (init << 9) + mod * scale * 4;
+  CONSTRAIN(value, 0, UINT16_MAX);
+  return value;
+}
+
 void Part::Init() {
   manual_keys_.Init();
   arp_keys_.Init();
+  hold_pedal_engaged_ = false;
   mono_allocator_.Init();
   poly_allocator_.Init();
   generated_notes_.Init();
@@ -117,6 +126,16 @@ void Part::Init() {
   seq_.clock_quantization = 0;
   seq_.loop_length = 2; // 1 bar
 
+  lookahead_read_ptr_ = lookahead_write_ptr_ = 0;
+  lookahead_generation_ = 0;
+  // Forces the main loop to start from the current state.
+  lookahead_cursor_generation_ = lookahead_generation_ - 1;
+  step_counter_ = 0;
+#ifdef TEST
+  lookahead_enabled_ = true;
+  lookahead_hits_ = lookahead_misses_ = 0;
+#endif  // TEST
+
   StopRecording();
   DeleteSequence();
 }
@@ -146,6 +165,7 @@ uint8_t Part::PressedKeysNoteOn(PressedKeys &keys, uint8_t pitch, uint8_t veloci
     keys.release_latched_keys_on_next_note_on = still_latched;
     keys.ignore_note_off_messages = still_latched;
   }
+  InvalidateLookahead();
   bool sustained = keys.IsSustained(pitch); // Capture existing sustain status
   uint8_t index = keys.stack.NoteOn(pitch, velocity);
   if (sustained) { keys.SetSustain(pitch); }
@@ -181,6 +201,7 @@ bool Part::NoteOn(uint8_t channel, uint8_t note, uint8_t velocity) {
 
 bool Part::NoteOff(uint8_t channel, uint8_t note) {
   bool sent_from_step_editor = channel & 0x80;
+  InvalidateLookahead();
 
   uint8_t recording_pitch = ArpUndoTransposeInputPitch(note);
   uint8_t pressed_key_index = manual_keys_.stack.Find(recording_pitch);
@@ -204,6 +225,7 @@ bool Part::NoteOff(uint8_t channel, uint8_t note) {
 }
 
 void Part::PressedKeysSustainOn(PressedKeys &keys) {
+  InvalidateLookahead();
   switch (midi_.sustain_mode) {
     case SUSTAIN_MODE_NORMAL:
       keys.ignore_note_off_messages = true;
@@ -227,6 +249,7 @@ void Part::PressedKeysSustainOn(PressedKeys &keys) {
 }
 
 void Part::PressedKeysSustainOff(PressedKeys &keys) {
+  InvalidateLookahead();
   switch (midi_.sustain_mode) {
     case SUSTAIN_MODE_NORMAL:
       keys.ignore_note_off_messages = false;
@@ -372,21 +395,30 @@ void Part::Reset() {
   }
 }
 
-void Part::Clock() {
+void Part::Clock(const TickPhase& tick) {
   SequencerStep step;
 
   bool clock = !arp_seq_prescaler_;
-  bool play = midi_.play_mode != PLAY_MODE_MANUAL && (
-    !looped() || (
-      midi_.play_mode == PLAY_MODE_ARPEGGIATOR && !seq_driven_arp()
-    )
-  );
+  bool play = plays_steps();
+  const LookaheadStep* ahead = PeekLookahead();
 
   if (clock && play) {
-    step = BuildSeqStep();
+    ArpeggiatorState next;
+    if (ahead) {
+      next = ahead->arp;
+      lookahead_read_ptr_ = (lookahead_read_ptr_ + 1) & (kStepLookaheadSize - 1);
+#ifdef TEST
+      ++lookahead_hits_;
+#endif  // TEST
+    } else {
+      next = ResolveStep(arp_, seq_step_);
+#ifdef TEST
+      ++lookahead_misses_;
+#endif  // TEST
+    }
+    step = next.step;
     if (midi_.play_mode == PLAY_MODE_ARPEGGIATOR) {
-      arp_ = BuildArpState(step);
-      step = arp_.step;
+      arp_ = next;
     }
     if (step.has_note()) {
       if (step.is_slid()) {
@@ -406,6 +438,7 @@ void Part::Clock() {
     if (seq_step_ >= seq_.num_steps) {
       seq_step_ = 0;
     }
+    ++step_counter_;
   }
 
   if (play) {
@@ -418,10 +451,8 @@ void Part::Clock() {
       --gate_length_counter_;
     } else if (generated_notes_.most_recent_note_index()) {
       // Peek at next step to see if it's a continuation
-      step = BuildSeqStep();
-      if (midi_.play_mode == PLAY_MODE_ARPEGGIATOR) {
-        step = BuildArpState(step).step;
-      }
+      ahead = PeekLookahead();
+      step = ahead ? ahead->arp.step : ResolveStep(arp_, seq_step_).step;
       if (step.is_continuation()) {
         // The next step contains a "sustain" message; or a slid note. Extends
         // the duration of the current note.
@@ -438,13 +469,14 @@ void Part::Clock() {
   }
   
   for (uint8_t i = 0; i < num_voices_; ++i) {
-    voice_[i]->Clock();
+    voice_[i]->Clock(tick);
   }
 
-  looper_.Clock();
+  looper_.Clock(tick);
 }
 
 void Part::Start() {
+  InvalidateLookahead();
   arp_seq_prescaler_ = 0;
 
   seq_step_ = 0;
@@ -480,6 +512,7 @@ void Part::Stop() {
 void Part::StopRecording() {
   if (!seq_recording_) { return; }
   seq_recording_ = false;
+  InvalidateLookahead();
   if (looped()) {
     // Stop recording any held notes
     for (uint8_t i = 1; i <= manual_keys_.stack.max_size(); ++i) {
@@ -497,6 +530,7 @@ void Part::StartRecording() {
     return;
   }
   seq_recording_ = true;
+  InvalidateLookahead();
   if (looped() && manual_control()) {
     // Start recording any held notes
     for (uint8_t i = 1; i <= manual_keys_.stack.max_size(); ++i) {
@@ -520,6 +554,7 @@ void Part::DeleteRecording() {
 }
 
 void Part::DeleteSequence() {
+  InvalidateLookahead();
   std::fill(
     &seq_.step[0],
     &seq_.step[kNumSteps],
@@ -580,8 +615,8 @@ uint8_t Part::ApplySequencerInputResponse(int16_t pitch, int8_t root_pitch) cons
   return pitch;
 }
 
-const SequencerStep Part::BuildSeqStep() const {
-  const SequencerStep& step = seq_.step[seq_step_];
+const SequencerStep Part::BuildSeqStep(uint8_t index) const {
+  const SequencerStep& step = seq_.step[index];
   int16_t note = step.note();
   if (step.has_note()) {
     // When we play a monophonic sequence, we can make the guess that root
@@ -594,8 +629,10 @@ const SequencerStep Part::BuildSeqStep() const {
   return SequencerStep((0x80 & step.data[0]) | (0x7f & note), step.data[1]);
 }
 
-const ArpeggiatorState Part::BuildArpState(SequencerStep seq_step) const {
-  ArpeggiatorState next = arp_;
+const ArpeggiatorState Part::BuildArpState(
+    const ArpeggiatorState& arp,
+    SequencerStep seq_step) const {
+  ArpeggiatorState next = arp;
   // In case the pattern doesn't hit a note, the default output step is a REST
   next.step.data[0] = SEQUENCER_STEP_REST;
 
@@ -756,6 +793,73 @@ const ArpeggiatorState Part::BuildArpState(SequencerStep seq_step) const {
   return next;
 }
 
+const ArpeggiatorState Part::ResolveStep(
+    const ArpeggiatorState& arp,
+    uint8_t seq_step) const {
+  SequencerStep step = BuildSeqStep(seq_step);
+  if (midi_.play_mode == PLAY_MODE_ARPEGGIATOR) {
+    return BuildArpState(arp, step);
+  }
+  ArpeggiatorState next = arp;
+  next.step = step;
+  return next;
+}
+
+const LookaheadStep* Part::PeekLookahead() {
+  while (lookahead_read_ptr_ != lookahead_write_ptr_) {
+    const LookaheadStep& ahead = lookahead_[lookahead_read_ptr_];
+    if (ahead.generation == lookahead_generation_ &&
+        ahead.position == step_counter_) {
+      return &ahead;
+    }
+    lookahead_read_ptr_ = (lookahead_read_ptr_ + 1) & (kStepLookaheadSize - 1);
+  }
+  return NULL;
+}
+
+void Part::FillLookahead() {
+#ifdef TEST
+  if (!lookahead_enabled_) { return; }
+#endif  // TEST
+  if (!plays_steps()) { return; }
+
+  uint8_t generation = lookahead_generation_;
+  bool empty = lookahead_read_ptr_ == lookahead_write_ptr_;
+  if (generation != lookahead_cursor_generation_ ||
+      (empty && lookahead_position_ != step_counter_)) {
+    // Start over from the current state once Clock has dropped the steps
+    // already queued. Clock may play a step while the state is copied, in
+    // which case the copy is retried later.
+    if (!empty) { return; }
+    uint8_t position = step_counter_;
+    lookahead_arp_ = arp_;
+    lookahead_seq_step_ = seq_step_;
+    if (position != step_counter_ || generation != lookahead_generation_) {
+      return;
+    }
+    lookahead_position_ = position;
+    lookahead_cursor_generation_ = generation;
+  }
+
+  while (((lookahead_read_ptr_ - lookahead_write_ptr_ - 1) &
+          (kStepLookaheadSize - 1)) != 0) {
+    LookaheadStep& ahead = lookahead_[lookahead_write_ptr_];
+    ahead.arp = ResolveStep(lookahead_arp_, lookahead_seq_step_);
+    ahead.position = lookahead_position_;
+    ahead.generation = generation;
+    lookahead_write_ptr_ = (lookahead_write_ptr_ + 1) & (kStepLookaheadSize - 1);
+
+    if (midi_.play_mode == PLAY_MODE_ARPEGGIATOR) {
+      lookahead_arp_ = ahead.arp;
+    }
+    ++lookahead_seq_step_;
+    if (lookahead_seq_step_ >= seq_.num_steps) {
+      lookahead_seq_step_ = 0;
+    }
+    ++lookahead_position_;
+  }
+}
+
 void Part::ResetAllControllers() {
   ResetLatch();
   for (uint8_t i = 0; i < num_voices_; ++i) {
@@ -781,6 +885,7 @@ void Part::AllNotesOff() {
 }
 
 void Part::ReleaseLatchedNotes(PressedKeys &keys) {
+  InvalidateLookahead();
   for (uint8_t i = 1; i <= keys.stack.max_size(); ++i) {
     NoteEntry* e = keys.stack.mutable_note(i);
     if (!keys.IsSustained(*e)) { continue; }
@@ -865,10 +970,10 @@ void Part::VoiceNoteOn(Voice* voice, uint8_t pitch, uint8_t vel, bool legato) {
 
   voice->envelope()->SetADSR(
     UINT16_MAX - (damping_22 >> (22 - 16)),
-    modulate_7bit(voicing_.env_init_attack, voicing_.env_mod_attack, vel),
-    modulate_7bit(voicing_.env_init_decay, voicing_.env_mod_decay, vel),
-    modulate_7bit(voicing_.env_init_sustain, voicing_.env_mod_sustain, vel),
-    modulate_7bit(voicing_.env_init_release, voicing_.env_mod_release, vel)
+    modulate_16bit(voicing_.env_init_attack, voicing_.env_mod_attack, vel),
+    modulate_16bit(voicing_.env_init_decay, voicing_.env_mod_decay, vel),
+    modulate_16bit(voicing_.env_init_sustain, voicing_.env_mod_sustain, vel),
+    modulate_16bit(voicing_.env_init_release, voicing_.env_mod_release, vel)
   );
 
   voice->NoteOn(Tune(pitch), vel, portamento, trigger);
@@ -1051,6 +1156,7 @@ bool Part::Set(uint8_t address, uint8_t value) {
   uint8_t previous_value = bytes[address];
   bytes[address] = value;
   if (value == previous_value) { return false; }
+  InvalidateLookahead();
   switch (address) {
     case PART_MIDI_CHANNEL:
     case PART_MIDI_MIN_NOTE:
@@ -153,10 +153,12 @@ struct PackedPart {
   }__attribute__((packed));
   PackedSequencerStep sequencer_steps[kNumSteps];
 
-  looper::PackedNote looper_notes[looper::kMaxNotes];
+  // Delta-encoded recording, see looper::Deck::Pack. The fields after it keep
+  // the bit positions of the former fixed-size format.
+  uint8_t looper_data[looper::kPackedSize];
   unsigned int
-    looper_oldest_index : looper::kBitsNoteIndex,
-    looper_size         : looper::kBitsNoteIndex;
+    looper_legacy_oldest_index : looper::kLegacyBitsNoteIndex,
+    looper_legacy_size         : looper::kLegacyBitsNoteIndex;
 
   static const uint8_t kTimbreBits = 7;
 
@@ -579,6 +581,16 @@ struct ArpeggiatorState {
   }
 };
 
+// A step of the sequencer or arpeggiator, resolved by the main loop ahead of
+// the clock tick that plays it.
+struct LookaheadStep {
+  ArpeggiatorState arp;  // State after the step; arp.step is the output step.
+  uint8_t position;  // Value of the step counter when the step plays.
+  uint8_t generation;
+};
+
+const uint8_t kStepLookaheadSize = 4;
+
 struct PressedKeys {
 
   static const uint8_t VELOCITY_SUSTAIN_MASK = 0x80;
@@ -686,7 +698,20 @@ class Part {
   void AllNotesOff();
   void StopSequencerArpeggiatorNotes();
   void Reset();
-  void Clock();
+  void Clock(const TickPhase& tick);
+  // Called from the main loop. Resolves the next steps of the sequencer or
+  // arpeggiator, so that Clock only has to pick them up.
+  void FillLookahead();
+  // Steps resolved so far are discarded whenever something they depend on
+  // changes: held keys, settings, the sequence, or the arpeggiator state.
+  inline void InvalidateLookahead() { ++lookahead_generation_; }
+#ifdef TEST
+  inline void set_lookahead_enabled(bool enabled) {
+    lookahead_enabled_ = enabled;
+  }
+  inline uint32_t lookahead_hits() const { return lookahead_hits_; }
+  inline uint32_t lookahead_misses() const { return lookahead_misses_; }
+#endif  // TEST
   void Start();
   void Stop();
   void StopRecording();
@@ -762,6 +787,7 @@ class Part {
     if (midi_.play_mode == PLAY_MODE_ARPEGGIATOR) {
       // Advance arp
       arp_ = BuildArpState(SequencerStep(pitch, velocity));
+      InvalidateLookahead();
       pitch = arp_.step.note();
       if (arp_.step.has_note()) {
         InternalNoteOn(pitch, arp_.step.velocity());
@@ -836,6 +862,7 @@ class Part {
   inline void PressedKeysResetLatch(PressedKeys &keys) {
     ReleaseLatchedNotes(keys);
     keys.Init();
+    InvalidateLookahead();
   }
   void ResetLatch();
 
@@ -849,6 +876,7 @@ class Part {
 
   inline void RecordStep(const SequencerStep& step) {
     if (seq_recording_) {
+      InvalidateLookahead();
       SequencerStep* target = &seq_.step[seq_rec_step_];
       target->data[0] = step.data[0];
       target->data[1] |= step.data[1];
@@ -867,6 +895,7 @@ class Part {
 
   inline void ModifyNoteAtCurrentStep(uint8_t note) {
     if (seq_recording_) {
+      InvalidateLookahead();
       seq_.step[seq_rec_step_].data[0] = note;
     }
   }
@@ -980,10 +1009,12 @@ class Part {
     TouchVoices();
     TouchVoiceAllocation();
     ResetLatch();
+    InvalidateLookahead();
   }
 
   void set_siblings(bool has_siblings) {
     has_siblings_ = has_siblings;
+    InvalidateLookahead();
   }
   
  private:
@@ -998,8 +1029,31 @@ class Part {
   void KillAllInstancesOfNote(uint8_t note);
 
   uint8_t ApplySequencerInputResponse(int16_t pitch, int8_t root_pitch = 60) const;
-  const SequencerStep BuildSeqStep() const;
-  const ArpeggiatorState BuildArpState(SequencerStep seq_step) const;
+  const SequencerStep BuildSeqStep(uint8_t index) const;
+  const ArpeggiatorState BuildArpState(
+      const ArpeggiatorState& arp,
+      SequencerStep seq_step) const;
+  inline const SequencerStep BuildSeqStep() const {
+    return BuildSeqStep(seq_step_);
+  }
+  inline const ArpeggiatorState BuildArpState(SequencerStep seq_step) const {
+    return BuildArpState(arp_, seq_step);
+  }
+  // Output step (and next arpeggiator state) for the given sequencer step.
+  const ArpeggiatorState ResolveStep(
+      const ArpeggiatorState& arp,
+      uint8_t seq_step) const;
+  // Front of the lookahead queue, if it holds the step about to be played.
+  // Called from Clock; drops stale steps.
+  const LookaheadStep* PeekLookahead();
+
+  inline bool plays_steps() const {
+    return midi_.play_mode != PLAY_MODE_MANUAL && (
+      !looped() || (
+        midi_.play_mode == PLAY_MODE_ARPEGGIATOR && !seq_driven_arp()
+      )
+    );
+  }
 
   MidiSettings midi_;
   VoicingSettings voicing_;
@@ -1028,6 +1082,25 @@ class Part {
   bool seq_overdubbing_;
   uint8_t seq_step_;
   uint8_t seq_rec_step_;
+
+  // Written by the main loop, read by Clock.
+  LookaheadStep lookahead_[kStepLookaheadSize];
+  volatile uint8_t lookahead_read_ptr_;
+  volatile uint8_t lookahead_write_ptr_;
+  volatile uint8_t lookahead_generation_;
+  // Number of steps clocked so far, wrapping.
+  volatile uint8_t step_counter_;
+
+  // Where the main loop is resolving steps.
+  ArpeggiatorState lookahead_arp_;
+  uint8_t lookahead_seq_step_;
+  uint8_t lookahead_position_;
+  uint8_t lookahead_cursor_generation_;
+#ifdef TEST
+  bool lookahead_enabled_;
+  uint32_t lookahead_hits_;
+  uint32_t lookahead_misses_;
+#endif  // TEST
   
   looper::Deck looper_;
 
@@ -2276,6 +2276,810 @@ const int16_t wav_bandlimited_comb_14[] = {
    -3210,  -2411,  -1608,   -804,
        0,
 };
+const int16_t wav_bandlimited_triangle_0[] = {
+  -32512, -32116, -31589, -31082,
+  -30568, -30059, -29545, -29036,
+  -28521, -28012, -27500, -26988,
+  -26476, -25965, -25453, -24942,
+  -24429, -23920, -23405, -22897,
+  -22382, -21873, -21360, -20849,
+  -20337, -19826, -19313, -18803,
+  -18291, -17779, -17267, -16756,
+  -16245, -15732, -15222, -14709,
+  -14198, -13686, -13175, -12663,
+  -12151, -11641, -11128, -10616,
+  -10106,  -9593,  -9081,  -8572,
+   -8057,  -7548,  -7036,  -6523,
+   -6012,  -5501,  -4990,  -4476,
+   -3967,  -3453,  -2943,  -2432,
+   -1918,  -1409,   -896,   -384,
+     127,    638,   1150,   1663,
+    2173,   2684,   3198,   3707,
+    4221,   4730,   5244,   5755,
+    6266,   6777,   7291,   7800,
+    8313,   8824,   9336,   9847,
+   10360,  10870,  11383,  11893,
+   12406,  12917,  13429,  13940,
+   14452,  14963,  15476,  15986,
+   16499,  17010,  17521,  18033,
+   18545,  19057,  19567,  20080,
+   20591,  21103,  21614,  22127,
+   22637,  23149,  23660,  24174,
+   24683,  25196,  25707,  26219,
+   26730,  27242,  27754,  28266,
+   28775,  29290,  29799,  30313,
+   30822,  31336,  31843,  32370,
+   32766,  32370,  31843,  31336,
+   30822,  30313,  29799,  29290,
+   28775,  28266,  27754,  27242,
+   26730,  26219,  25707,  25196,
+   24683,  24174,  23660,  23149,
+   22637,  22127,  21614,  21103,
+   20591,  20080,  19567,  19057,
+   18545,  18033,  17521,  17010,
+   16499,  15986,  15476,  14963,
+   14452,  13940,  13429,  12917,
+   12406,  11893,  11383,  10870,
+   10360,   9847,   9336,   8824,
+    8313,   7800,   7291,   6777,
+    6266,   5755,   5244,   4730,
+    4221,   3707,   3198,   2684,
+    2173,   1663,   1150,    638,
+     127,   -384,   -896,  -1409,
+   -1918,  -2432,  -2943,  -3453,
+   -3967,  -4476,  -4990,  -5501,
+   -6012,  -6523,  -7036,  -7548,
+   -8057,  -8572,  -9081,  -9593,
+  -10106, -10616, -11128, -11641,
+  -12151, -12663, -13175, -13686,
+  -14198, -14709, -15222, -15732,
+  -16245, -16756, -17267, -17779,
+  -18291, -18803, -19313, -19826,
+  -20337, -20849, -21360, -21873,
+  -22382, -22897, -23405, -23920,
+  -24429, -24942, -25453, -25965,
+  -26476, -26988, -27500, -28012,
+  -28521, -29036, -29545, -30059,
+  -30568, -31082, -31589, -32116,
+  -32512,
+};
+const int16_t wav_bandlimited_saw_0[] = {
+  -13842, -13761, -13410, -13320,
+  -12977, -12881, -12543, -12442,
+  -12110, -12002, -11676, -11564,
+  -11241, -11125, -10808, -10686,
+  -10374, -10247,  -9939,  -9809,
+   -9506,  -9369,  -9072,  -8930,
+   -8638,  -8492,  -8204,  -8053,
+   -7769,  -7615,  -7334,  -7177,
+   -6900,  -6739,  -6465,  -6299,
+   -6032,  -5862,  -5596,  -5423,
+   -5163,  -4984,  -4727,  -4548,
+   -4292,  -4109,  -3857,  -3671,
+   -3424,  -3232,  -2988,  -2795,
+   -2553,  -2356,  -2120,  -1918,
+   -1684,  -1479,  -1251,  -1041,
+    -815,   -603,   -381,   -165,
+      54,    273,    489,    711,
+     924,   1149,   1359,   1586,
+    1794,   2026,   2227,   2464,
+    2663,   2901,   3097,   3341,
+    3531,   3779,   3966,   4217,
+    4400,   4655,   4836,   5093,
+    5271,   5530,   5705,   5970,
+    6140,   6407,   6574,   6846,
+    7008,   7286,   7442,   7723,
+    7877,   8162,   8311,   8601,
+    8745,   9039,   9180,   9478,
+    9613,   9917,  10047,  10356,
+   10482,  10794,  10916,  11233,
+   11350,  11672,  11783,  12112,
+   12216,  12552,  12650,  12990,
+   13083,  13431,  13516,  13870,
+   13950,  14310,  14382,  14750,
+   14815,  15190,  15248,  15630,
+   15681,  16070,  16114,  16510,
+   16545,  16953,  16976,  17393,
+   17408,  17837,  17837,  18278,
+   18269,  18721,  18698,  19164,
+   19128,  19608,  19556,  20053,
+   19984,  20499,  20409,  20947,
+   20834,  21395,  21259,  21844,
+   21681,  22295,  22103,  22748,
+   22520,  23206,  22933,  23667,
+   23344,  24131,  23749,  24603,
+   24145,  25086,  24529,  25581,
+   24899,  26095,  25241,  26647,
+   25536,  27262,  25739,  28016,
+   25716,  29178,  24836,  32765,
+      55, -32659, -24726, -29071,
+  -25607, -27908, -25632, -27152,
+  -25429, -26539, -25132, -25987,
+  -24792, -25472, -24421, -24978,
+  -24036, -24496, -23640, -24023,
+  -23237, -23557, -22826, -23098,
+  -22411, -22641, -21994, -22187,
+  -21573, -21736, -21151, -21286,
+  -20727, -20838, -20301, -20392,
+  -19874, -19946, -19447, -19501,
+  -19019, -19056, -18590, -18613,
+  -18160, -18171, -17729, -17728,
+  -17299, -17287, -16867, -16844,
+  -16438, -16402, -16005, -15962,
+  -15573, -15522, -15140, -15081,
+  -14708, -14640, -14276, -14201,
+  -13842,
+};
+const int16_t wav_bandlimited_triangle_1[] = {
+  -32512, -32272, -31718, -31143,
+  -30659, -30178, -29645, -29110,
+  -28610, -28117, -27588, -27063,
+  -26560, -26058, -25535, -25013,
+  -24508, -24003, -23482, -22961,
+  -22455, -21949, -21429, -20910,
+  -20401, -19896, -19375, -18858,
+  -18350, -17840, -17323, -16806,
+  -16296, -15787, -15271, -14752,
+  -14244, -13734, -13218, -12699,
+  -12190, -11682, -11165, -10646,
+  -10138,  -9628,  -9112,  -8593,
+   -8086,  -7574,  -7059,  -6542,
+   -6031,  -5522,  -5005,  -4490,
+   -3978,  -3469,  -2953,  -2435,
+   -1926,  -1417,   -898,   -384,
+     127,    637,   1154,   1670,
+    2179,   2691,   3206,   3723,
+    4232,   4744,   5259,   5775,
+    6287,   6795,   7313,   7828,
+    8339,   8849,   9365,   9882,
+   10391,  10902,  11418,  11935,
+   12445,  12954,  13471,  13988,
+   14498,  15006,  15525,  16041,
+   16550,  17060,  17576,  18096,
+   18603,  19112,  19629,  20150,
+   20655,  21164,  21683,  22203,
+   22709,  23215,  23736,  24257,
+   24762,  25266,  25790,  26313,
+   26813,  27316,  27844,  28369,
+   28866,  29363,  29899,  30432,
+   30913,  31397,  31972,  32526,
+   32766,  32526,  31972,  31397,
+   30913,  30432,  29899,  29363,
+   28866,  28369,  27844,  27316,
+   26813,  26313,  25790,  25266,
+   24762,  24257,  23736,  23215,
+   22709,  22203,  21683,  21164,
+   20655,  20150,  19629,  19112,
+   18603,  18096,  17576,  17060,
+   16550,  16041,  15525,  15006,
+   14498,  13988,  13471,  12954,
+   12445,  11935,  11418,  10902,
+   10391,   9882,   9365,   8849,
+    8339,   7828,   7313,   6795,
+    6287,   5775,   5259,   4744,
+    4232,   3723,   3206,   2691,
+    2179,   1670,   1154,    637,
+     127,   -384,   -898,  -1417,
+   -1926,  -2435,  -2953,  -3469,
+   -3978,  -4490,  -5005,  -5522,
+   -6031,  -6542,  -7059,  -7574,
+   -8086,  -8593,  -9112,  -9628,
+  -10138, -10646, -11165, -11682,
+  -12190, -12699, -13218, -13734,
+  -14244, -14752, -15271, -15787,
+  -16296, -16806, -17323, -17840,
+  -18350, -18858, -19375, -19896,
+  -20401, -20910, -21429, -21949,
+  -22455, -22961, -23482, -24003,
+  -24508, -25013, -25535, -26058,
+  -26560, -27063, -27588, -28117,
+  -28610, -29110, -29645, -30178,
+  -30659, -31143, -31718, -32272,
+  -32512,
+};
+const int16_t wav_bandlimited_saw_1[] = {
+  -13866, -13923, -13700, -13208,
+  -13001, -13045, -12808, -12329,
+  -12134, -12167, -11917, -11452,
+  -11265, -11288, -11028, -10573,
+  -10396, -10410, -10140,  -9694,
+   -9527,  -9531,  -9251,  -8815,
+   -8659,  -8652,  -8363,  -7937,
+   -7787,  -7774,  -7477,  -7057,
+   -6918,  -6894,  -6591,  -6177,
+   -6048,  -6016,  -5703,  -5300,
+   -5175,  -5138,  -4817,  -4421,
+   -4304,  -4259,  -3931,  -3542,
+   -3433,  -3380,  -3046,  -2662,
+   -2562,  -2501,  -2160,  -1784,
+   -1689,  -1623,  -1275,   -904,
+    -819,   -743,   -389,    -26,
+      53,    136,    497,    852,
+     925,   1015,   1382,   1731,
+    1797,   1894,   2267,   2610,
+    2670,   2771,   3153,   3489,
+    3542,   3649,   4040,   4368,
+    4411,   4530,   4926,   5245,
+    5284,   5408,   5813,   6123,
+    6156,   6286,   6698,   7004,
+    7026,   7164,   7587,   7881,
+    7896,   8045,   8472,   8760,
+    8767,   8923,   9360,   9639,
+    9636,   9802,  10248,  10518,
+   10505,  10681,  11137,  11395,
+   11375,  11559,  12027,  12274,
+   12241,  12439,  12917,  13153,
+   13108,  13317,  13808,  14032,
+   13974,  14196,  14700,  14911,
+   14838,  15075,  15594,  15789,
+   15701,  15955,  16489,  16667,
+   16562,  16833,  17388,  17546,
+   17419,  17713,  18289,  18424,
+   18273,  18593,  19194,  19301,
+   19125,  19471,  20104,  20179,
+   19970,  20351,  21020,  21057,
+   20806,  21232,  21945,  21933,
+   21633,  22113,  22884,  22810,
+   22441,  22995,  23845,  23683,
+   23224,  23879,  24841,  24554,
+   23957,  24772,  25900,  25415,
+   24600,  25677,  27102,  26248,
+   25013,  26639,  28713,  26947,
+   24564,  28048,  32766,  24513,
+      54, -24404, -32658, -27939,
+  -24457, -26839, -28604, -26530,
+  -24905, -26140, -26994, -25568,
+  -24492, -25306, -25793, -24662,
+  -23850, -24446, -24731, -23772,
+  -23115, -23575, -23737, -22887,
+  -22332, -22701, -22777, -22004,
+  -21524, -21825, -21837, -21124,
+  -20698, -20948, -20912, -20242,
+  -19862, -20071, -19995, -19363,
+  -19017, -19193, -19085, -18484,
+  -18166, -18315, -18181, -17604,
+  -17312, -17437, -17279, -16725,
+  -16454, -16558, -16382, -15846,
+  -15592, -15681, -15486, -14967,
+  -14729, -14803, -14592, -14087,
+  -13866,
+};
+const int16_t wav_bandlimited_triangle_2[] = {
+  -32512, -32385, -32029, -31511,
+  -30913, -30313, -29757, -29253,
+  -28781, -28311, -27815, -27288,
+  -26741, -26192, -25662, -25154,
+  -24662, -24169, -23662, -23139,
+  -22604, -22067, -21541, -21033,
+  -20531, -20033, -19522, -19000,
+  -18470, -17938, -17415, -16905,
+  -16400, -15898, -15386, -14864,
+  -14338, -13807, -13287, -12774,
+  -12269, -11764, -11251, -10731,
+  -10204,  -9677,  -9157,  -8642,
+   -8138,  -7631,  -7117,  -6598,
+   -6072,  -5545,  -5025,  -4512,
+   -4005,  -3498,  -2985,  -2466,
+   -1938,  -1414,   -893,   -380,
+     127,    634,   1147,   1668,
+    2192,   2720,   3239,   3752,
+    4259,   4766,   5279,   5799,
+    6326,   6852,   7371,   7886,
+    8390,   8898,   9409,   9932,
+   10458,  10985,  11505,  12018,
+   12523,  13028,  13541,  14061,
+   14592,  15118,  15640,  16152,
+   16654,  17159,  17669,  18192,
+   18724,  19254,  19776,  20287,
+   20785,  21287,  21795,  22321,
+   22858,  23393,  23916,  24423,
+   24916,  25408,  25916,  26446,
+   26995,  27542,  28069,  28565,
+   29035,  29507,  30011,  30567,
+   31167,  31765,  32283,  32639,
+   32766,  32639,  32283,  31765,
+   31167,  30567,  30011,  29507,
+   29035,  28565,  28069,  27542,
+   26995,  26446,  25916,  25408,
+   24916,  24423,  23916,  23393,
+   22858,  22321,  21795,  21287,
+   20785,  20287,  19776,  19254,
+   18724,  18192,  17669,  17159,
+   16654,  16152,  15640,  15118,
+   14592,  14061,  13541,  13028,
+   12523,  12018,  11505,  10985,
+   10458,   9932,   9409,   8898,
+    8390,   7886,   7371,   6852,
+    6326,   5799,   5279,   4766,
+    4259,   3752,   3239,   2720,
+    2192,   1668,   1147,    634,
+     127,   -380,   -893,  -1414,
+   -1938,  -2466,  -2985,  -3498,
+   -4005,  -4512,  -5025,  -5545,
+   -6072,  -6598,  -7117,  -7631,
+   -8138,  -8642,  -9157,  -9677,
+  -10204, -10731, -11251, -11764,
+  -12269, -12774, -13287, -13807,
+  -14338, -14864, -15386, -15898,
+  -16400, -16905, -17415, -17938,
+  -18470, -19000, -19522, -20033,
+  -20531, -21033, -21541, -22067,
+  -22604, -23139, -23662, -24169,
+  -24662, -25154, -25662, -26192,
+  -26741, -27288, -27815, -28311,
+  -28781, -29253, -29757, -30313,
+  -30913, -31511, -32029, -32385,
+  -32512,
+};
+const int16_t wav_bandlimited_saw_2[] = {
+  -13915, -13974, -14029, -13910,
+  -13565, -13066, -12587, -12276,
+  -12183, -12230, -12247, -12097,
+  -11736, -11252, -10804, -10525,
+  -10445, -10478, -10467, -10287,
+   -9914,  -9442,  -9021,  -8770,
+   -8701,  -8725,  -8685,  -8480,
+   -8097,  -7635,  -7240,  -7011,
+   -6954,  -6967,  -6905,  -6675,
+   -6282,  -5831,  -5457,  -5253,
+   -5204,  -5207,  -5123,  -4873,
+   -4470,  -4028,  -3675,  -3491,
+   -3453,  -3447,  -3341,  -3071,
+   -2660,  -2225,  -1893,  -1731,
+   -1700,  -1684,  -1560,  -1270,
+    -850,   -424,   -111,     30,
+      56,     76,    221,    533,
+     958,   1378,   1670,   1793,
+    1808,   1839,   2003,   2333,
+    2769,   3179,   3451,   3555,
+    3561,   3601,   3783,   4137,
+    4579,   4981,   5232,   5316,
+    5312,   5362,   5566,   5939,
+    6392,   6783,   7014,   7075,
+    7063,   7120,   7349,   7743,
+    8206,   8588,   8795,   8832,
+    8811,   8878,   9131,   9550,
+   10022,  10397,  10574,  10588,
+   10554,  10634,  10912,  11360,
+   11846,  12204,  12357,  12338,
+   12293,  12384,  12695,  13176,
+   13672,  14021,  14135,  14085,
+   14022,  14132,  14477,  14997,
+   15510,  15841,  15916,  15821,
+   15743,  15869,  16262,  16828,
+   17361,  17670,  17695,  17547,
+   17446,  17595,  18048,  18673,
+   19234,  19514,  19473,  19252,
+   19122,  19303,  19836,  20545,
+   21140,  21384,  21246,  20924,
+   20750,  20980,  21628,  22464,
+   23113,  23298,  23009,  22529,
+   22286,  22589,  23437,  24486,
+   25228,  25309,  24745,  23966,
+   23588,  24047,  25302,  26807,
+   27760,  27590,  26343,  24774,
+   24018,  24959,  27624,  30887,
+   32767,  31154,  24766,  13806,
+      54, -13697, -24657, -31046,
+  -32657, -30780, -27514, -24851,
+  -23909, -24665, -26235, -27481,
+  -27651, -26697, -25196, -23937,
+  -23479, -23858, -24636, -25199,
+  -25121, -24376, -23329, -22481,
+  -22176, -22421, -22900, -23190,
+  -23003, -22356, -21520, -20870,
+  -20642, -20816, -21136, -21275,
+  -21033, -20435, -19728, -19193,
+  -19015, -19143, -19363, -19406,
+  -19125, -18566, -17937, -17488,
+  -17336, -17439, -17586, -17561,
+  -17253, -16719, -16154, -15759,
+  -15635, -15712, -15808, -15731,
+  -15402, -14888, -14369, -14022,
+  -13915,
+};
+const int16_t wav_bandlimited_triangle_3[] = {
+  -32512, -32447, -32255, -31945,
+  -31533, -31040, -30481, -29886,
+  -29272, -28656, -28055, -27477,
+  -26928, -26406, -25908, -25426,
+  -24954, -24481, -24003, -23508,
+  -22999, -22472, -21929, -21378,
+  -20817, -20259, -19704, -19162,
+  -18628, -18110, -17601, -17102,
+  -16608, -16113, -15612, -15108,
+  -14589, -14064, -13526, -12982,
+  -12436, -11888, -11344, -10807,
+  -10278,  -9760,  -9246,  -8745,
+   -8240,  -7741,  -7236,  -6725,
+   -6205,  -5681,  -5143,  -4605,
+   -4059,  -3517,  -2976,  -2440,
+   -1913,  -1394,   -882,   -377,
+     128,    630,   1135,   1649,
+    2167,   2695,   3229,   3770,
+    4315,   4857,   5399,   5933,
+    6460,   6980,   7489,   7994,
+    8496,   8997,   9502,  10013,
+   10532,  11061,  11598,  12142,
+   12689,  13237,  13781,  14316,
+   14845,  15360,  15868,  16366,
+   16861,  17357,  17855,  18364,
+   18883,  19414,  19959,  20513,
+   21072,  21630,  22184,  22726,
+   23253,  23763,  24255,  24736,
+   25208,  25681,  26161,  26660,
+   27181,  27732,  28309,  28911,
+   29524,  30141,  30736,  31292,
+   31788,  32199,  32509,  32701,
+   32766,  32701,  32509,  32199,
+   31788,  31292,  30736,  30141,
+   29524,  28911,  28309,  27732,
+   27181,  26660,  26161,  25681,
+   25208,  24736,  24255,  23763,
+   23253,  22726,  22184,  21630,
+   21072,  20513,  19959,  19414,
+   18883,  18364,  17855,  17357,
+   16861,  16366,  15868,  15360,
+   14845,  14316,  13781,  13237,
+   12689,  12142,  11598,  11061,
+   10532,  10013,   9502,   8997,
+    8496,   7994,   7489,   6980,
+    6460,   5933,   5399,   4857,
+    4315,   3770,   3229,   2695,
+    2167,   1649,   1135,    630,
+     128,   -377,   -882,  -1394,
+   -1913,  -2440,  -2976,  -3517,
+   -4059,  -4605,  -5143,  -5681,
+   -6205,  -6725,  -7236,  -7741,
+   -8240,  -8745,  -9246,  -9760,
+  -10278, -10807, -11344, -11888,
+  -12436, -12982, -13526, -14064,
+  -14589, -15108, -15612, -16113,
+  -16608, -17102, -17601, -18110,
+  -18628, -19162, -19704, -20259,
+  -20817, -21378, -21929, -22472,
+  -22999, -23508, -24003, -24481,
+  -24954, -25426, -25908, -26406,
+  -26928, -27477, -28055, -28656,
+  -29272, -29886, -30481, -31040,
+  -31533, -31945, -32255, -32447,
+  -32512,
+};
+const int16_t wav_bandlimited_saw_3[] = {
+  -14022, -14060, -14142, -14217,
+  -14237, -14163, -13974, -13663,
+  -13248, -12760, -12242, -11740,
+  -11300, -10952, -10713, -10586,
+  -10551, -10572, -10615, -10631,
+  -10580, -10439, -10194,  -9845,
+   -9417,  -8942,  -8459,  -8011,
+   -7628,  -7341,  -7153,  -7057,
+   -7034,  -7045,  -7055,  -7024,
+   -6921,  -6725,  -6434,  -6058,
+   -5617,  -5154,  -4699,  -4293,
+   -3961,  -3724,  -3575,  -3510,
+   -3494,  -3496,  -3479,  -3409,
+   -3258,  -3017,  -2685,  -2282,
+   -1836,  -1377,   -951,   -583,
+    -295,   -103,      7,     48,
+      55,     61,    104,    211,
+     405,    693,   1059,   1488,
+    1945,   2392,   2794,   3127,
+    3368,   3517,   3589,   3607,
+    3602,   3620,   3685,   3833,
+    4071,   4402,   4809,   5263,
+    5728,   6166,   6543,   6836,
+    7030,   7134,   7164,   7155,
+    7143,   7167,   7262,   7451,
+    7738,   8120,   8569,   9050,
+    9528,   9955,  10302,  10549,
+   10691,  10739,  10724,  10683,
+   10660,  10695,  10824,  11061,
+   11409,  11850,  12351,  12870,
+   13357,  13773,  14083,  14273,
+   14347,  14327,  14250,  14171,
+   14130,  14184,  14353,  14658,
+   15085,  15609,  16179,  16748,
+   17251,  17650,  17907,  18018,
+   17993,  17873,  17711,  17569,
+   17509,  17583,  17821,  18225,
+   18778,  19429,  20113,  20758,
+   21290,  21660,  21828,  21804,
+   21611,  21316,  21000,  20750,
+   20652,  20765,  21130,  21731,
+   22529,  23437,  24354,  25162,
+   25757,  26057,  26030,  25682,
+   25088,  24358,  23641,  23104,
+   22896,  23134,  23880,  25116,
+   26747,  28590,  30405,  31898,
+   32765,  32726,  31548,  29084,
+   25299,  20264,  14172,   7316,
+      54,  -7205, -14063, -20155,
+  -25189, -28975, -31437, -32617,
+  -32657, -31787, -30295, -28482,
+  -26636, -25007, -23771, -23024,
+  -22787, -22993, -23533, -24248,
+  -24978, -25573, -25920, -25948,
+  -25647, -25052, -24245, -23328,
+  -22419, -21621, -21020, -20657,
+  -20542, -20640, -20890, -21207,
+  -21502, -21694, -21719, -21549,
+  -21181, -20649, -20004, -19318,
+  -18669, -18116, -17711, -17473,
+  -17400, -17460, -17600, -17765,
+  -17883, -17908, -17798, -17540,
+  -17142, -16637, -16071, -15498,
+  -14977, -14548, -14244, -14073,
+  -14022,
+};
+const int16_t wav_bandlimited_triangle_4[] = {
+  -32512, -32478, -32379, -32213,
+  -31983, -31695, -31348, -30950,
+  -30501, -30013, -29483, -28925,
+  -28339, -27733, -27111, -26480,
+  -25846, -25211, -24578, -23956,
+  -23340, -22742, -22153, -21582,
+  -21025, -20484, -19957, -19442,
+  -18939, -18447, -17958, -17479,
+  -16997, -16520, -16038, -15551,
+  -15059, -14561, -14052, -13533,
+  -13006, -12466, -11921, -11361,
+  -10799, -10225,  -9650,  -9069,
+   -8486,  -7905,  -7324,  -6748,
+   -6174,  -5610,  -5050,  -4500,
+   -3957,  -3424,  -2899,  -2379,
+   -1871,  -1364,   -866,   -368,
+     127,    623,   1118,   1620,
+    2123,   2635,   3152,   3678,
+    4211,   4753,   5306,   5862,
+    6430,   7000,   7579,   8159,
+    8741,   9322,   9903,  10481,
+   11051,  11617,  12173,  12721,
+   13260,  13788,  14305,  14814,
+   15314,  15806,  16291,  16773,
+   17253,  17731,  18214,  18700,
+   19193,  19696,  20211,  20738,
+   21279,  21835,  22409,  22994,
+   23596,  24208,  24834,  25464,
+   26099,  26735,  27366,  27986,
+   28593,  29178,  29739,  30265,
+   30757,  31203,  31602,  31948,
+   32239,  32466,  32632,  32733,
+   32766,  32733,  32632,  32466,
+   32239,  31948,  31602,  31203,
+   30757,  30265,  29739,  29178,
+   28593,  27986,  27366,  26735,
+   26099,  25464,  24834,  24208,
+   23596,  22994,  22409,  21835,
+   21279,  20738,  20211,  19696,
+   19193,  18700,  18214,  17731,
+   17253,  16773,  16291,  15806,
+   15314,  14814,  14305,  13788,
+   13260,  12721,  12173,  11617,
+   11051,  10481,   9903,   9322,
+    8741,   8159,   7579,   7000,
+    6430,   5862,   5306,   4753,
+    4211,   3678,   3152,   2635,
+    2123,   1620,   1118,    623,
+     127,   -368,   -866,  -1364,
+   -1871,  -2379,  -2899,  -3424,
+   -3957,  -4500,  -5050,  -5610,
+   -6174,  -6748,  -7324,  -7905,
+   -8486,  -9069,  -9650, -10225,
+  -10799, -11361, -11921, -12466,
+  -13006, -13533, -14052, -14561,
+  -15059, -15551, -16038, -16520,
+  -16997, -17479, -17958, -18447,
+  -18939, -19442, -19957, -20484,
+  -21025, -21582, -22153, -22742,
+  -23340, -23956, -24578, -25211,
+  -25846, -26480, -27111, -27733,
+  -28339, -28925, -29483, -30013,
+  -30501, -30950, -31348, -31695,
+  -31983, -32213, -32379, -32478,
+  -32512,
+};
+const int16_t wav_bandlimited_saw_4[] = {
+  -14090, -14113, -14167, -14247,
+  -14329, -14408, -14466, -14490,
+  -14472, -14401, -14274, -14084,
+  -13830, -13518, -13146, -12727,
+  -12264, -11771, -11257, -10735,
+  -10219,  -9717,  -9244,  -8805,
+   -8414,  -8072,  -7784,  -7553,
+   -7375,  -7250,  -7171,  -7129,
+   -7119,  -7125,  -7143,  -7156,
+   -7158,  -7134,  -7079,  -6981,
+   -6840,  -6648,  -6402,  -6108,
+   -5762,  -5376,  -4949,  -4498,
+   -4022,  -3542,  -3058,  -2590,
+   -2142,  -1722,  -1343,  -1007,
+    -719,   -480,   -292,   -150,
+     -52,      9,     41,     54,
+      54,     58,     68,    101,
+     162,    261,    402,    589,
+     830,   1117,   1452,   1834,
+    2251,   2699,   3170,   3651,
+    4133,   4606,   5061,   5486,
+    5872,   6217,   6514,   6756,
+    6951,   7091,   7190,   7243,
+    7268,   7266,   7253,   7237,
+    7227,   7240,   7280,   7361,
+    7485,   7664,   7893,   8182,
+    8524,   8916,   9353,   9828,
+   10328,  10846,  11367,  11881,
+   12374,  12836,  13258,  13626,
+   13942,  14194,  14383,  14511,
+   14583,  14600,  14576,  14517,
+   14441,  14355,  14279,  14222,
+   14200,  14226,  14309,  14457,
+   14679,  14972,  15342,  15781,
+   16283,  16842,  17440,  18068,
+   18705,  19337,  19947,  20515,
+   21029,  21470,  21831,  22100,
+   22277,  22355,  22338,  22240,
+   22061,  21827,  21548,  21249,
+   20953,  20680,  20459,  20312,
+   20255,  20318,  20503,  20833,
+   21302,  21919,  22672,  23551,
+   24536,  25604,  26719,  27856,
+   28966,  30013,  30953,  31739,
+   32330,  32685,  32766,  32541,
+   31979,  31068,  29787,  28137,
+   26121,  23753,  21053,  18053,
+   14788,  11304,   7652,   3883,
+      54,  -3772,  -7541, -11195,
+  -14678, -17942, -20944, -23642,
+  -26011, -28027, -29678, -30956,
+  -31871, -32429, -32657, -32575,
+  -32220, -31628, -30843, -29904,
+  -28856, -27744, -26611, -25493,
+  -24426, -23440, -22563, -21809,
+  -21192, -20722, -20395, -20205,
+  -20147, -20201, -20349, -20571,
+  -20842, -21138, -21439, -21717,
+  -21951, -22129, -22229, -22245,
+  -22165, -21992, -21720, -21361,
+  -20917, -20406, -19837, -19227,
+  -18595, -17957, -17331, -16731,
+  -16174, -15670, -15232, -14863,
+  -14568, -14347, -14198, -14117,
+  -14090,
+};
+const int16_t wav_bandlimited_triangle_5[] = {
+  -32512, -32494, -32442, -32353,
+  -32229, -32073, -31881, -31655,
+  -31398, -31107, -30787, -30434,
+  -30054, -29644, -29210, -28747,
+  -28261, -27751, -27222, -26669,
+  -26100, -25511, -24910, -24290,
+  -23661, -23019, -22369, -21707,
+  -21041, -20371, -19694, -19016,
+  -18336, -17657, -16979, -16302,
+  -15630, -14961, -14300, -13641,
+  -12991, -12350, -11715, -11089,
+  -10472,  -9864,  -9267,  -8678,
+   -8099,  -7529,  -6970,  -6418,
+   -5878,  -5344,  -4818,  -4302,
+   -3790,  -3286,  -2788,  -2294,
+   -1805,  -1318,   -836,   -354,
+     127,    608,   1089,   1573,
+    2059,   2548,   3042,   3540,
+    4045,   4554,   5074,   5597,
+    6131,   6673,   7224,   7783,
+    8353,   8933,   9519,  10119,
+   10726,  11344,  11968,  12603,
+   13246,  13896,  14552,  15216,
+   15884,  16556,  17233,  17911,
+   18590,  19270,  19949,  20623,
+   21296,  21962,  22622,  23272,
+   23916,  24545,  25162,  25766,
+   26354,  26924,  27474,  28006,
+   28515,  29002,  29462,  29899,
+   30308,  30689,  31040,  31361,
+   31652,  31909,  32135,  32326,
+   32484,  32608,  32694,  32749,
+   32766,  32749,  32694,  32608,
+   32484,  32326,  32135,  31909,
+   31652,  31361,  31040,  30689,
+   30308,  29899,  29462,  29002,
+   28515,  28006,  27474,  26924,
+   26354,  25766,  25162,  24545,
+   23916,  23272,  22622,  21962,
+   21296,  20623,  19949,  19270,
+   18590,  17911,  17233,  16556,
+   15884,  15216,  14552,  13896,
+   13246,  12603,  11968,  11344,
+   10726,  10119,   9519,   8933,
+    8353,   7783,   7224,   6673,
+    6131,   5597,   5074,   4554,
+    4045,   3540,   3042,   2548,
+    2059,   1573,   1089,    608,
+     127,   -354,   -836,  -1318,
+   -1805,  -2294,  -2788,  -3286,
+   -3790,  -4302,  -4818,  -5344,
+   -5878,  -6418,  -6970,  -7529,
+   -8099,  -8678,  -9267,  -9864,
+  -10472, -11089, -11715, -12350,
+  -12991, -13641, -14300, -14961,
+  -15630, -16302, -16979, -17657,
+  -18336, -19016, -19694, -20371,
+  -21041, -21707, -22369, -23019,
+  -23661, -24290, -24910, -25511,
+  -26100, -26669, -27222, -27751,
+  -28261, -28747, -29210, -29644,
+  -30054, -30434, -30787, -31107,
+  -31398, -31655, -31881, -32073,
+  -32229, -32353, -32442, -32494,
+  -32512,
+};
+const int16_t wav_bandlimited_saw_5[] = {
+  -14226, -14239, -14272, -14325,
+  -14390, -14466, -14546, -14627,
+  -14707, -14776, -14839, -14883,
+  -14912, -14918, -14901, -14858,
+  -14785, -14683, -14547, -14382,
+  -14178, -13945, -13677, -13374,
+  -13040, -12677, -12283, -11860,
+  -11415, -10945, -10457,  -9950,
+   -9431,  -8899,  -8363,  -7820,
+   -7277,  -6738,  -6204,  -5679,
+   -5167,  -4669,  -4191,  -3732,
+   -3295,  -2884,  -2498,  -2139,
+   -1811,  -1509,  -1239,   -996,
+    -785,   -599,   -444,   -311,
+    -205,   -121,    -56,     -9,
+      22,     41,     52,     54,
+      56,     57,     59,     70,
+      88,    122,    167,    231,
+     317,    422,    554,    712,
+     895,   1107,   1351,   1620,
+    1921,   2252,   2608,   2995,
+    3407,   3842,   4303,   4780,
+    5278,   5790,   6315,   6849,
+    7389,   7931,   8473,   9011,
+    9542,  10062,  10567,  11056,
+   11527,  11971,  12394,  12788,
+   13151,  13486,  13788,  14055,
+   14290,  14493,  14658,  14794,
+   14897,  14968,  15012,  15031,
+   15021,  14996,  14948,  14889,
+   14818,  14737,  14658,  14577,
+   14501,  14436,  14384,  14350,
+   14336,  14352,  14393,  14470,
+   14582,  14733,  14925,  15160,
+   15441,  15768,  16142,  16561,
+   17029,  17541,  18097,  18695,
+   19334,  20007,  20713,  21449,
+   22206,  22984,  23775,  24571,
+   25371,  26161,  26944,  27703,
+   28437,  29139,  29797,  30409,
+   30963,  31459,  31882,  32232,
+   32498,  32678,  32767,  32755,
+   32645,  32426,  32101,  31665,
+   31114,  30451,  29675,  28784,
+   27781,  26666,  25446,  24120,
+   22693,  21170,  19560,  17861,
+   16089,  14244,  12337,  10374,
+    8369,   6321,   4250,   2157,
+      56,  -2047,  -4137,  -6212,
+   -8256, -10264, -12226, -14133,
+  -15976, -17752, -19447, -21060,
+  -22583, -24007, -25335, -26556,
+  -27669, -28673, -29563, -30341,
+  -31003, -31553, -31991, -32314,
+  -32534, -32644, -32655, -32568,
+  -32387, -32120, -31771, -31347,
+  -30854, -30296, -29687, -29027,
+  -28327, -27591, -26833, -26050,
+  -25260, -24460, -23663, -22873,
+  -22095, -21338, -20602, -19896,
+  -19223, -18583, -17987, -17429,
+  -16918, -16450, -16030, -15658,
+  -15329, -15050, -14813, -14622,
+  -14471, -14358, -14283, -14240,
+  -14226,
+};
 
 
 const int16_t* waveform_table[] = {
@@ -2299,6 +3103,18 @@ const int16_t* waveform_table[] = {
   wav_bandlimited_comb_12,
   wav_bandlimited_comb_13,
   wav_bandlimited_comb_14,
+  wav_bandlimited_triangle_0,
+  wav_bandlimited_saw_0,
+  wav_bandlimited_triangle_1,
+  wav_bandlimited_saw_1,
+  wav_bandlimited_triangle_2,
+  wav_bandlimited_saw_2,
+  wav_bandlimited_triangle_3,
+  wav_bandlimited_saw_3,
+  wav_bandlimited_triangle_4,
+  wav_bandlimited_saw_4,
+  wav_bandlimited_triangle_5,
+  wav_bandlimited_saw_5,
 };
 
 const int16_t ws_violent_overdrive[] = {
@@ -118,6 +118,18 @@ extern const int16_t wav_bandlimited_comb_11[];
 extern const int16_t wav_bandlimited_comb_12[];
 extern const int16_t wav_bandlimited_comb_13[];
 extern const int16_t wav_bandlimited_comb_14[];
+extern const int16_t wav_bandlimited_triangle_0[];
+extern const int16_t wav_bandlimited_saw_0[];
+extern const int16_t wav_bandlimited_triangle_1[];
+extern const int16_t wav_bandlimited_saw_1[];
+extern const int16_t wav_bandlimited_triangle_2[];
+extern const int16_t wav_bandlimited_saw_2[];
+extern const int16_t wav_bandlimited_triangle_3[];
+extern const int16_t wav_bandlimited_saw_3[];
+extern const int16_t wav_bandlimited_triangle_4[];
+extern const int16_t wav_bandlimited_saw_4[];
+extern const int16_t wav_bandlimited_triangle_5[];
+extern const int16_t wav_bandlimited_saw_5[];
 extern const int16_t ws_violent_overdrive[];
 extern const int16_t ws_sine_fold[];
 extern const int16_t ws_tri_fold[];
@@ -249,6 +261,30 @@ extern const uint16_t chr_characters[];
 #define WAV_BANDLIMITED_COMB_13_SIZE 257
 #define WAV_BANDLIMITED_COMB_14 19
 #define WAV_BANDLIMITED_COMB_14_SIZE 257
+#define WAV_BANDLIMITED_TRIANGLE_0 20
+#define WAV_BANDLIMITED_TRIANGLE_0_SIZE 257
+#define WAV_BANDLIMITED_SAW_0 21
+#define WAV_BANDLIMITED_SAW_0_SIZE 257
+#define WAV_BANDLIMITED_TRIANGLE_1 22
+#define WAV_BANDLIMITED_TRIANGLE_1_SIZE 257
+#define WAV_BANDLIMITED_SAW_1 23
+#define WAV_BANDLIMITED_SAW_1_SIZE 257
+#define WAV_BANDLIMITED_TRIANGLE_2 24
+#define WAV_BANDLIMITED_TRIANGLE_2_SIZE 257
+#define WAV_BANDLIMITED_SAW_2 25
+#define WAV_BANDLIMITED_SAW_2_SIZE 257
+#define WAV_BANDLIMITED_TRIANGLE_3 26
+#define WAV_BANDLIMITED_TRIANGLE_3_SIZE 257
+#define WAV_BANDLIMITED_SAW_3 27
+#define WAV_BANDLIMITED_SAW_3_SIZE 257
+#define WAV_BANDLIMITED_TRIANGLE_4 28
+#define WAV_BANDLIMITED_TRIANGLE_4_SIZE 257
+#define WAV_BANDLIMITED_SAW_4 29
+#define WAV_BANDLIMITED_SAW_4_SIZE 257
+#define WAV_BANDLIMITED_TRIANGLE_5 30
+#define WAV_BANDLIMITED_TRIANGLE_5_SIZE 257
+#define WAV_BANDLIMITED_SAW_5 31
+#define WAV_BANDLIMITED_SAW_5_SIZE 257
 #define WS_VIOLENT_OVERDRIVE 0
 #define WS_VIOLENT_OVERDRIVE_SIZE 257
 #define WS_SINE_FOLD 1
@@ -123,4 +123,29 @@ for zone in range(num_zones):
   bl_pulse_tables.append(('bandlimited_comb_%d' % zone,
                           scale(pulse[quadrature])))
 
-waveforms.extend(bl_pulse_tables)
\ No newline at end of file
+waveforms.extend(bl_pulse_tables)
+# Band-limited triangle and saw for the wavetable oscillator, one pair per
+# octave, with as many harmonics as fit below Nyquist at the top of it. The
+# oscillator derives the square from the saw, and above the last octave, only
+# plays the sine.
+num_wavetable_zones = 6
+bl_wavetables = []
+
+x = (numpy.arange(WAVETABLE_SIZE + 1) / float(WAVETABLE_SIZE) + 0.25) * \
+    2 * numpy.pi
+
+for zone in range(num_wavetable_zones):
+  f_top = 440.0 * 2.0 ** ((54 + 12 * zone - 69) / 12.0)
+  num_harmonics = min(int(SAMPLE_RATE / 2.0 / f_top), WAVETABLE_SIZE / 2 - 1)
+  triangle = numpy.zeros(WAVETABLE_SIZE + 1)
+  saw = numpy.zeros(WAVETABLE_SIZE + 1)
+  for k in xrange(1, num_harmonics + 1):
+    harmonic = numpy.sin(k * x)
+    saw += harmonic / k
+    if k % 2:
+      triangle += (-1) ** ((k - 1) / 2) * harmonic / k ** 2
+  # Same phase as the sine: both start with -cos.
+  bl_wavetables.append(('bandlimited_triangle_%d' % zone, scale(-triangle)))
+  bl_wavetables.append(('bandlimited_saw_%d' % zone, scale(-saw)))
+
+waveforms.extend(bl_wavetables)
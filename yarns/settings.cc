@@ -456,7 +456,7 @@ const Setting Settings::settings_[] = {
   {
     "OS", "OSC SHAPE",
     SETTING_DOMAIN_PART, { PART_VOICING_OSCILLATOR_SHAPE, 0 },
-    SETTING_UNIT_OSCILLATOR_SHAPE, 0, OSC_SHAPE_FM + LUT_FM_RATIO_NAMES_SIZE - 1, NULL,
+    SETTING_UNIT_OSCILLATOR_SHAPE, 0, OSC_SHAPE_WAVETABLE, NULL,
     71, 23,
   },
   {
@@ -749,7 +749,9 @@ void Settings::Print(const Setting& setting, uint8_t value, char* buffer) const
       break;
 
     case SETTING_UNIT_OSCILLATOR_SHAPE:
-      if (value >= OSC_SHAPE_FM) {
+      if (value == OSC_SHAPE_WAVETABLE) {
+        strcpy(buffer, "WT SINE TO SQUARE WAVETABLE");
+      } else if (value >= OSC_SHAPE_FM) {
         strcpy(buffer, lut_fm_ratio_names[value - OSC_SHAPE_FM]);
       } else {
         strcpy(buffer, voicing_oscillator_shape_values[value]);
@@ -28,18 +28,243 @@
 
 #include "yarns/storage_manager.h"
 
+#ifndef TEST
+#include <stm32f10x_conf.h>
+#endif  // TEST
+
+#include <cstring>
+
 #include "yarns/midi_handler.h"
 #include "yarns/multi.h"
 
 namespace yarns {
 
+using namespace std;
+
+#ifdef TEST
+
+uint8_t host_flash[kNumMultiPages][PAGE_SIZE];
+
+inline const uint8_t* PageAddress(uint8_t page) {
+  return &host_flash[page][0];
+}
+
+inline void ErasePage(uint8_t page) {
+  fill(&host_flash[page][0], &host_flash[page][PAGE_SIZE], 0xff);
+}
+
+inline void ProgramHalfWord(uint8_t page, uint16_t offset, uint16_t value) {
+  // Programming can only clear bits.
+  host_flash[page][offset] &= value;
+  host_flash[page][offset + 1] &= value >> 8;
+}
+
+void StorageManager::EraseHostFlash() {
+  for (uint8_t page = 0; page < kNumMultiPages; ++page) {
+    ErasePage(page);
+  }
+}
+
+#else
+
+inline const uint8_t* PageAddress(uint8_t page) {
+  return reinterpret_cast<const uint8_t*>(
+      kMultiPagesAddress + page * PAGE_SIZE);
+}
+
+inline void ErasePage(uint8_t page) {
+  FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPRTERR);
+  FLASH_ErasePage(kMultiPagesAddress + page * PAGE_SIZE);
+}
+
+inline void ProgramHalfWord(uint8_t page, uint16_t offset, uint16_t value) {
+  FLASH_ProgramHalfWord(kMultiPagesAddress + page * PAGE_SIZE + offset, value);
+}
+
+#endif  // TEST
+
+/* static */
+const MultiPageHeader& StorageManager::header(uint8_t page) {
+  return *static_cast<const MultiPageHeader*>(
+      static_cast<const void*>(PageAddress(page)));
+}
+
+/* static */
+const uint8_t* StorageManager::data(uint8_t page) {
+  return PageAddress(page) + sizeof(MultiPageHeader);
+}
+
+/* static */
+uint16_t StorageManager::Checksum(const uint8_t* data, uint16_t size) {
+  // Fletcher-16
+  uint16_t a = 0;
+  uint16_t b = 0;
+  while (size--) {
+    a = (a + *data++) % 255;
+    b = (b + a) % 255;
+  }
+  return (b << 8) | a;
+}
+
+bool StorageManager::valid(uint8_t page) const {
+  const MultiPageHeader& h = header(page);
+  return h.slot < kNumMultiSlots && \
+      h.format == kMultiFormat && \
+      h.size == sizeof(PackedMulti) && \
+      h.checksum == Checksum(data(page), h.size);
+}
+
+void StorageManager::Init() {
+  fill(&slot_page_[0], &slot_page_[kNumMultiSlots], kNoPage);
+  generation_ = 0;
+  bool first = true;
+  for (uint8_t page = 0; page < kNumMultiPages; ++page) {
+    if (!valid(page)) {
+      continue;
+    }
+    const MultiPageHeader& h = header(page);
+    uint8_t& latest = slot_page_[h.slot];
+    if (latest == kNoPage || Newer(h.generation, header(latest).generation)) {
+      latest = page;
+    }
+    if (first || Newer(h.generation, generation_)) {
+      generation_ = h.generation;
+      first = false;
+    }
+  }
+  save_state_ = SAVE_STATE_IDLE;
+  bytes_programmed_ = 0;
+}
+
 void StorageManager::SaveMulti(uint8_t slot) {
+  Flush();
   stream_buffer_.Rewind();
-  multi.Serialize(&stream_buffer_);
-  storage_.Save(stream_buffer_.bytes(), stream_buffer_.position(), 1 + slot);
+  STATIC_ASSERT(sizeof(PackedMulti) <= kMaxMultiSize, capacity);
+  // Zeroed, so that unused bits do not make identical multis differ.
+  PackedMulti* packed = reinterpret_cast<PackedMulti*>(
+      stream_buffer_.mutable_bytes());
+  *packed = PackedMulti();
+  save_slot_ = slot;
+  save_size_ = sizeof(PackedMulti);
+  save_part_ = 0;
+  save_state_ = SAVE_STATE_PACK;
+}
+
+void StorageManager::Pack() {
+  multi.Pack(save_part_, reinterpret_cast<PackedMulti*>(
+      stream_buffer_.mutable_bytes()));
+  if (save_part_++ < kNumParts) {
+    return;
+  }
+
+  uint8_t current = slot_page_[save_slot_];
+  if (current != kNoPage && \
+      !memcmp(data(current), stream_buffer_.bytes(), save_size_)) {
+    // Unchanged: no need to wear the flash.
+    save_state_ = SAVE_STATE_IDLE;
+    return;
+  }
+
+  // Any page not holding the latest copy of a program.
+  bool used[kNumMultiPages];
+  fill(&used[0], &used[kNumMultiPages], false);
+  for (uint8_t i = 0; i < kNumMultiSlots; ++i) {
+    if (slot_page_[i] != kNoPage) {
+      used[slot_page_[i]] = true;
+    }
+  }
+  save_page_ = find(&used[0], &used[kNumMultiPages], false) - &used[0];
+  save_ptr_ = 0;
+  save_state_ = SAVE_STATE_ERASE;
+}
+
+void StorageManager::Poll() {
+  switch (save_state_) {
+    case SAVE_STATE_IDLE:
+      break;
+
+    case SAVE_STATE_PACK:
+      Pack();
+      break;
+
+    case SAVE_STATE_ERASE:
+#ifndef TEST
+      FLASH_Unlock();
+#endif  // TEST
+      ErasePage(save_page_);
+      save_state_ = SAVE_STATE_PROGRAM;
+      break;
+
+    case SAVE_STATE_PROGRAM:
+      {
+        const uint8_t* bytes = stream_buffer_.bytes();
+        for (uint8_t i = 0; i < kHalfWordsPerPoll; ++i) {
+          if (save_ptr_ >= save_size_) {
+            save_state_ = SAVE_STATE_COMMIT;
+            break;
+          }
+          uint16_t value = bytes[save_ptr_] | (bytes[save_ptr_ + 1] << 8);
+          // Erased flash reads as 0xff: nothing to program.
+          if (value != 0xffff) {
+            ProgramHalfWord(
+                save_page_, sizeof(MultiPageHeader) + save_ptr_, value);
+            bytes_programmed_ += 2;
+          }
+          save_ptr_ += 2;
+        }
+      }
+      break;
+
+    case SAVE_STATE_COMMIT:
+      Commit();
+      break;
+  }
+}
+
+void StorageManager::Commit() {
+  MultiPageHeader h;
+  h.slot = save_slot_;
+  h.format = kMultiFormat;
+  h.size = save_size_;
+  h.generation = generation_ + 1;
+  h.checksum = Checksum(stream_buffer_.bytes(), save_size_);
+  // The checksum goes last: until then, the page is not valid.
+  uint16_t words[sizeof(h) / 2];
+  memcpy(words, &h, sizeof(h));
+  for (uint8_t i = 0; i < sizeof(h) / 2; ++i) {
+    ProgramHalfWord(save_page_, i * 2, words[i]);
+  }
+#ifndef TEST
+  FLASH_Lock();
+#endif  // TEST
+  bytes_programmed_ += sizeof(h);
+  ++generation_;
+  slot_page_[save_slot_] = save_page_;
+  save_state_ = SAVE_STATE_IDLE;
+}
+
+void StorageManager::Flush() {
+  while (saving()) {
+    Poll();
+  }
 }
 
 bool StorageManager::LoadMulti(uint8_t slot) {
+  Flush();
+  uint8_t page = slot_page_[slot];
+  if (page != kNoPage) {
+    stream_buffer_.Rewind();
+    stream_buffer_.Write(data(page), header(page).size);
+    stream_buffer_.Rewind();
+    multi.Deserialize(&stream_buffer_, header(page).format);
+    return true;
+  }
+
+#ifdef TEST
+  return false;
+#else
+  // Not saved since the update: the copy saved by an earlier version, whose
+  // looper data Multi::Deserialize converts.
   // Dummy serialization of the multi to know its size.
   stream_buffer_.Rewind();
   multi.Serialize(&stream_buffer_);
@@ -48,18 +273,27 @@ bool StorageManager::LoadMulti(uint8_t slot) {
   if (!storage_.Load(stream_buffer_.mutable_bytes(), expected_size, 1 + slot)) {
     return false;
   } else {
-    DeserializeMulti();
+    stream_buffer_.Rewind();
+    multi.Deserialize(&stream_buffer_, MULTI_FORMAT_LEGACY);
     return true;
   }
+#endif  // TEST
 }
 
 void StorageManager::SaveCalibration() {
+  Flush();
+#ifndef TEST
   stream_buffer_.Rewind();
   multi.SerializeCalibration(&stream_buffer_);
   storage_.Save(stream_buffer_.bytes(), stream_buffer_.position(), 0);
+#endif  // TEST
 }
 
 bool StorageManager::LoadCalibration() {
+#ifdef TEST
+  return false;
+#else
+  Flush();
   stream_buffer_.Rewind();
   multi.SerializeCalibration(&stream_buffer_);
   uint32_t expected_size = stream_buffer_.position();
@@ -71,19 +305,29 @@ bool StorageManager::LoadCalibration() {
     multi.DeserializeCalibration(&stream_buffer_);
     return true;
   }
+#endif  // TEST
 }
 
 void StorageManager::SysExSendMulti() {
+  Flush();
   stream_buffer_.Rewind();
   multi.Serialize(&stream_buffer_);
+  stream_buffer_.Write(kMultiFormat);
   midi_handler.SysExSendPackets(
       stream_buffer_.bytes(),
       stream_buffer_.position());
 }
 
 void StorageManager::DeserializeMulti() {
+  uint8_t format = MULTI_FORMAT_LEGACY;
+  if (stream_buffer_.position() > sizeof(PackedMulti)) {
+    format = stream_buffer_.bytes()[sizeof(PackedMulti)];
+  }
+  if (format >= MULTI_FORMAT_LAST) {
+    return;
+  }
   stream_buffer_.Rewind();
-  multi.Deserialize(&stream_buffer_);
+  multi.Deserialize(&stream_buffer_, format);
 }
 
 /* extern */
@@ -25,6 +25,12 @@
 // -----------------------------------------------------------------------------
 //
 // Responsible for flash memory storage.
+//
+// Multis are saved in the background, from Multi::LowPriority: one part
+// packed, one page erase or a few halfwords of programming per call. Each multi page starts with a
+// header that is programmed last, so a save that is interrupted leaves the
+// previous copy of the program valid. There is one more page than programs,
+// and each save goes to a page not holding the latest copy of any program.
 
 #ifndef YARNS_STORAGE_MANAGER_H_
 #define YARNS_STORAGE_MANAGER_H_
@@ -34,17 +40,57 @@
 #include "stmlib/stmlib.h"
 
 #include "stmlib/utils/stream_buffer.h"
+#ifndef TEST
 #include "stmlib/system/storage.h"
+#else
+#define PAGE_SIZE 0x400
+#endif  // TEST
 
 namespace yarns {
 
 const uint16_t kMaxSize = PAGE_SIZE - 2; // 2 bytes for checksum
 
+const uint8_t kNumMultiSlots = 8;
+const uint8_t kNumMultiPages = kNumMultiSlots + 1;
+const uint8_t kNoPage = 0xff;
+// Below the calibration and the multis saved by earlier versions, which are
+// still loaded if a program has not been saved since. The link fails if the
+// application reaches these pages: see flash_layout.ld.
+const uint32_t kMultiPagesAddress = 0x8020000 - \
+    (9 + kNumMultiPages) * PAGE_SIZE;
+
+struct MultiPageHeader {
+  uint8_t slot;
+  uint8_t format;
+  uint16_t size;
+  uint16_t generation;
+  uint16_t checksum;
+};
+
+const uint16_t kMaxMultiSize = PAGE_SIZE - sizeof(MultiPageHeader);
+
+// Programming a halfword stalls the CPU for about 52us: a poll step takes
+// about 0.2ms, well within the lookahead of the DAC frame producer.
+const uint8_t kHalfWordsPerPoll = 4;
+
+enum SaveState {
+  SAVE_STATE_IDLE,
+  SAVE_STATE_PACK,
+  SAVE_STATE_ERASE,
+  SAVE_STATE_PROGRAM,
+  SAVE_STATE_COMMIT
+};
+
 class StorageManager {
  public:
   StorageManager() { }
   ~StorageManager() { }
-  
+
+  // Finds the latest copy of each program.
+  void Init();
+
+  // Leaves packing the multi and the flash writes to Poll. Parts edited
+  // before Poll has packed them are saved with the edit.
   void SaveMulti(uint8_t slot);
   bool LoadMulti(uint8_t slot);
   void SaveCalibration();
@@ -53,16 +99,56 @@ class StorageManager {
   
   void AppendData(const uint8_t* data, size_t size, bool rewind) {
     if (rewind) {
+      Flush();
       stream_buffer_.Rewind();
     }
     stream_buffer_.Write(data, size);
   }
   
+  // Loads a multi received by SysEx: from earlier versions, the packed multi
+  // alone, otherwise followed by its format.
   void DeserializeMulti();
 
+  // Advances the pending save by one step.
+  void Poll();
+  // Completes the pending save, as the stream buffer is needed.
+  void Flush();
+
+  inline bool saving() const { return save_state_ != SAVE_STATE_IDLE; }
+  inline uint16_t bytes_programmed() const { return bytes_programmed_; }
+
+#ifdef TEST
+  // Simulated flash, initially erased.
+  void EraseHostFlash();
+#endif  // TEST
+
  private:
+  static const MultiPageHeader& header(uint8_t page);
+  static const uint8_t* data(uint8_t page);
+  static uint16_t Checksum(const uint8_t* data, uint16_t size);
+  static bool Newer(uint16_t generation, uint16_t reference) {
+    return static_cast<int16_t>(generation - reference) > 0;
+  }
+
+  bool valid(uint8_t page) const;
+  void Pack();
+  void Commit();
+
   stmlib::StreamBuffer<kMaxSize> stream_buffer_;
+#ifndef TEST
   stmlib::Storage<0x8020000, 9> storage_;
+#endif  // TEST
+
+  uint8_t slot_page_[kNumMultiSlots];
+  uint16_t generation_;
+
+  SaveState save_state_;
+  uint8_t save_slot_;
+  uint8_t save_part_;
+  uint8_t save_page_;
+  uint16_t save_size_;
+  uint16_t save_ptr_;
+  uint16_t bytes_programmed_;
   
   DISALLOW_COPY_AND_ASSIGN(StorageManager);
 };
@@ -30,6 +30,8 @@
 #ifndef YARNS_SYNCED_LFO_H_
 #define YARNS_SYNCED_LFO_H_
 
+#include "yarns/internal_clock.h"
+
 namespace yarns {
 
 enum LFOShape {
@@ -89,7 +91,10 @@ class SyncedLFO {
     } 
   }
 
-  void Tap(uint16_t num_ticks, uint32_t phase_offset = 0) {
+  void Tap(
+      uint16_t num_ticks,
+      const TickPhase& tick,
+      uint32_t phase_offset = 0) {
     if (num_ticks != period_ticks_) {
       if (period_ticks_) {
         counter_ = (counter_ * num_ticks + period_ticks_ - 1) / period_ticks_;
@@ -100,20 +105,38 @@ class SyncedLFO {
 
     uint32_t target_phase = (counter_ * 65536 / period_ticks_) << 16;
     target_phase += phase_offset;
-    uint32_t target_increment = target_phase - previous_target_phase_;
-
-    int32_t d_error = target_increment - (phase_ - previous_phase_);
-    int32_t p_error = target_phase - phase_;
-    int32_t error = (d_error + (p_error >> 1)) >> 11;
-
-    if (error < 0 && abs(error) > phase_increment_) {
-      // underflow
-      phase_increment_ = 0;
-    } else if (error > 0 && (UINT32_MAX - error) < phase_increment_) {
-      // overflow
-      phase_increment_ = UINT32_MAX;
+
+    if (tick.increment) {
+      // The clock position is known: steer the phase so that it reaches the
+      // target of the next tick exactly when it is due, without ever moving
+      // backwards.
+      uint16_t next_counter = (counter_ + 1) % period_ticks_;
+      uint32_t next_target_phase = \
+          ((next_counter * 65536 / period_ticks_) << 16) + phase_offset;
+      int32_t distance = next_target_phase - phase_;
+      uint32_t remaining = UINT32_MAX - tick.phase;
+      if (remaining < tick.increment) {
+        remaining = tick.increment;
+      }
+      phase_increment_ = distance <= 0
+          ? 0
+          : static_cast<uint64_t>(distance) * tick.increment / remaining;
     } else {
-      phase_increment_ += error;
+      uint32_t target_increment = target_phase - previous_target_phase_;
+
+      int32_t d_error = target_increment - (phase_ - previous_phase_);
+      int32_t p_error = target_phase - phase_;
+      int32_t error = (d_error + (p_error >> 1)) >> 11;
+
+      if (error < 0 && abs(error) > phase_increment_) {
+        // underflow
+        phase_increment_ = 0;
+      } else if (error > 0 && (UINT32_MAX - error) < phase_increment_) {
+        // overflow
+        phase_increment_ = UINT32_MAX;
+      } else {
+        phase_increment_ += error;
+      }
     }
 
     previous_phase_ = phase_;
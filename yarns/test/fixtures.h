@@ -0,0 +1,967 @@
+// Copyright 2021 Chris Rogers.
+//
+// Author: Chris Rogers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Host-side fixtures: SMF reader, baud-limited MIDI input, call timers,
+// reference implementations.
+
+#ifndef YARNS_TEST_FIXTURES_H_
+#define YARNS_TEST_FIXTURES_H_
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "stmlib/stmlib.h"
+#include "stmlib/utils/dsp.h"
+#include "stmlib/utils/ring_buffer.h"
+
+#include "yarns/dac_frame_producer.h"
+#include "yarns/envelope.h"
+#include "yarns/internal_clock.h"
+#include "yarns/just_intonation_processor.h"
+#include "yarns/resources.h"
+#include "yarns/voice.h"
+
+namespace yarns {
+
+using namespace std;
+
+const uint32_t kSysTickRate = 8000;
+const uint32_t kDacTicksPerSysTick = 24;  // 4 channels x 48kHz / 8kHz
+const uint32_t kTargetClockRate = 72000000;
+const uint32_t kSysTickBudgetCycles = kTargetClockRate / kSysTickRate;
+// 31250 baud, 10 bits per byte.
+const uint32_t kMidiByteDurationNs = 320000;
+
+struct TimedMidiByte {
+  uint64_t time_ns;
+  uint8_t data;
+};
+
+// Reads a Standard MIDI File, merges all tracks and converts delta times
+// (including tempo changes) into absolute timestamps. Running status is
+// expanded and meta events are dropped, so the result is exactly the byte
+// stream a DIN cable would carry.
+class MidiFileReader {
+ public:
+  MidiFileReader() { }
+  ~MidiFileReader() { }
+
+  bool Load(const char* file_name) {
+    FILE* fp = fopen(file_name, "rb");
+    if (!fp) {
+      return false;
+    }
+    vector<uint8_t> data;
+    uint8_t buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+      data.insert(data.end(), buffer, buffer + n);
+    }
+    fclose(fp);
+    return Parse(data);
+  }
+
+  bool Parse(const vector<uint8_t>& data) {
+    bytes_.clear();
+    if (data.size() < 14 || memcmp(&data[0], "MThd", 4)) {
+      return false;
+    }
+    uint16_t num_tracks = Read16(&data[10]);
+    uint16_t division = Read16(&data[12]);
+    size_t p = 8 + Read32(&data[4]);
+
+    vector<Event> events;
+    for (uint16_t t = 0; t < num_tracks && p + 8 <= data.size(); ++t) {
+      if (memcmp(&data[p], "MTrk", 4)) {
+        return false;
+      }
+      size_t end = std::min(data.size(), p + 8 + Read32(&data[p + 4]));
+      ParseTrack(data, p + 8, end, t, &events);
+      p = end;
+    }
+    std::stable_sort(events.begin(), events.end());
+
+    // Ticks to nanoseconds, honoring tempo changes.
+    double ns_per_tick;
+    bool smpte = division & 0x8000;
+    if (smpte) {
+      int8_t fps = -static_cast<int8_t>(division >> 8);
+      ns_per_tick = 1e9 / (fps * (division & 0xff));
+    } else {
+      ns_per_tick = 500000.0 * 1000.0 / division;
+    }
+    double time_ns = 0.0;
+    uint32_t last_tick = 0;
+    for (size_t i = 0; i < events.size(); ++i) {
+      const Event& e = events[i];
+      time_ns += (e.tick - last_tick) * ns_per_tick;
+      last_tick = e.tick;
+      if (e.tempo) {
+        if (!smpte) {
+          ns_per_tick = e.tempo * 1000.0 / division;
+        }
+        continue;
+      }
+      for (size_t j = 0; j < e.data.size(); ++j) {
+        TimedMidiByte b;
+        b.time_ns = static_cast<uint64_t>(time_ns);
+        b.data = e.data[j];
+        bytes_.push_back(b);
+      }
+    }
+    return true;
+  }
+
+  inline const vector<TimedMidiByte>& bytes() const { return bytes_; }
+
+ private:
+  struct Event {
+    uint32_t tick;
+    uint16_t track;
+    uint32_t order;
+    uint32_t tempo;
+    vector<uint8_t> data;
+
+    bool operator<(const Event& other) const {
+      if (tick != other.tick) {
+        return tick < other.tick;
+      }
+      if (track != other.track) {
+        return track < other.track;
+      }
+      return order < other.order;
+    }
+  };
+
+  static uint16_t Read16(const uint8_t* p) {
+    return (p[0] << 8) | p[1];
+  }
+
+  static uint32_t Read32(const uint8_t* p) {
+    return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+  }
+
+  static uint32_t ReadVarLen(const vector<uint8_t>& data, size_t* p, size_t end) {
+    uint32_t value = 0;
+    while (*p < end) {
+      uint8_t byte = data[(*p)++];
+      value = (value << 7) | (byte & 0x7f);
+      if (!(byte & 0x80)) {
+        break;
+      }
+    }
+    return value;
+  }
+
+  void ParseTrack(
+      const vector<uint8_t>& data,
+      size_t p,
+      size_t end,
+      uint16_t track,
+      vector<Event>* events) {
+    uint32_t tick = 0;
+    uint8_t running_status = 0;
+    uint32_t order = 0;
+    while (p < end) {
+      tick += ReadVarLen(data, &p, end);
+      if (p >= end) {
+        break;
+      }
+      Event e;
+      e.tick = tick;
+      e.track = track;
+      e.order = order++;
+      e.tempo = 0;
+      uint8_t status = data[p];
+      if (status == 0xff) {
+        uint8_t type = p + 1 < end ? data[p + 1] : 0x2f;
+        p += 2;
+        uint32_t length = ReadVarLen(data, &p, end);
+        if (type == 0x51 && length == 3 && p + 3 <= end) {
+          e.tempo = (data[p] << 16) | (data[p + 1] << 8) | data[p + 2];
+          events->push_back(e);
+        } else if (type == 0x2f) {
+          break;
+        }
+        p += length;
+        continue;
+      } else if (status == 0xf0 || status == 0xf7) {
+        ++p;
+        uint32_t length = ReadVarLen(data, &p, end);
+        // The leading 0xf0 is not part of the SMF payload.
+        if (status == 0xf0) {
+          e.data.push_back(0xf0);
+        }
+        while (length-- && p < end) {
+          e.data.push_back(data[p++]);
+        }
+        running_status = 0;
+        events->push_back(e);
+        continue;
+      }
+
+      if (status & 0x80) {
+        running_status = status;
+        ++p;
+      } else if (running_status) {
+        status = running_status;
+      } else {
+        ++p;  // Stray data byte.
+        continue;
+      }
+      uint8_t length = ((status & 0xe0) == 0xc0) ? 1 : 2;
+      e.data.push_back(status);
+      for (uint8_t i = 0; i < length && p < end; ++i) {
+        e.data.push_back(data[p++]);
+      }
+      events->push_back(e);
+    }
+  }
+
+  vector<TimedMidiByte> bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(MidiFileReader);
+};
+
+// Stands in for the UART: bytes become readable no earlier than their
+// timestamp, and no faster than the DIN baud rate allows.
+class HostMidiIn {
+ public:
+  HostMidiIn() { }
+  ~HostMidiIn() { }
+
+  void Init(const vector<TimedMidiByte>& bytes) {
+    bytes_ = bytes;
+    position_ = 0;
+    next_byte_ns_ = 0;
+  }
+
+  inline bool done() const { return position_ >= bytes_.size(); }
+
+  inline bool readable(uint64_t now_ns) const {
+    return !done() && \
+        now_ns >= bytes_[position_].time_ns && \
+        now_ns >= next_byte_ns_;
+  }
+
+  inline uint8_t ImmediateRead(uint64_t now_ns) {
+    next_byte_ns_ = now_ns + kMidiByteDurationNs;
+    return bytes_[position_++].data;
+  }
+
+  inline uint64_t duration_ns() const {
+    return bytes_.empty() ? 0 : bytes_.back().time_ns;
+  }
+
+ private:
+  vector<TimedMidiByte> bytes_;
+  size_t position_;
+  uint64_t next_byte_ns_;
+
+  DISALLOW_COPY_AND_ASSIGN(HostMidiIn);
+};
+
+// Stands in for the UART transmitter: one byte in the shift register, one
+// waiting in the data register.
+class HostMidiOut {
+ public:
+  HostMidiOut() { }
+  ~HostMidiOut() { }
+
+  void Init() {
+    busy_until_ns_ = 0;
+    bytes_.clear();
+  }
+
+  inline bool writable(uint64_t now_ns) const {
+    return busy_until_ns_ <= now_ns + kMidiByteDurationNs;
+  }
+
+  inline void Overwrite(uint64_t now_ns, uint8_t byte) {
+    busy_until_ns_ = std::max(busy_until_ns_, now_ns) + kMidiByteDurationNs;
+    bytes_.push_back(byte);
+  }
+
+  inline const vector<uint8_t>& bytes() const { return bytes_; }
+
+ private:
+  uint64_t busy_until_ns_;
+  vector<uint8_t> bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(HostMidiOut);
+};
+
+inline uint64_t ReadCycleCounter() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return static_cast<uint64_t>(t.tv_sec) * 1000000000 + t.tv_nsec;
+#endif
+}
+
+// Host cycle counter frequency, measured once against the monotonic clock.
+inline double CycleCounterGHz() {
+  static double ghz = 0.0;
+  if (ghz == 0.0) {
+#if defined(__x86_64__) || defined(__i386__)
+    timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t start_cycles = ReadCycleCounter();
+    double elapsed_ns;
+    do {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      elapsed_ns = (now.tv_sec - start.tv_sec) * 1e9 + \
+          (now.tv_nsec - start.tv_nsec);
+    } while (elapsed_ns < 20e6);
+    ghz = (ReadCycleCounter() - start_cycles) / elapsed_ns;
+#else
+    ghz = 1.0;
+#endif
+  }
+  return ghz;
+}
+
+// Cycle histogram with 1-cycle bins up to kLinearBins, then log2 bins.
+class Histogram {
+ public:
+  static const uint32_t kLinearBins = 8192;
+  static const uint32_t kLogBins = 32;
+
+  Histogram() { Init(); }
+  ~Histogram() { }
+
+  void Init() {
+    fill(&linear_[0], &linear_[kLinearBins], 0);
+    fill(&log_[0], &log_[kLogBins], 0);
+    count_ = 0;
+    sum_ = 0;
+    sum_squares_ = 0.0;
+    min_ = ~0ULL;
+    max_ = 0;
+  }
+
+  inline void Add(uint64_t value) {
+    if (value < kLinearBins) {
+      ++linear_[value];
+    } else {
+      ++log_[std::min<int>(63 - __builtin_clzll(value), kLogBins - 1)];
+    }
+    ++count_;
+    sum_ += value;
+    sum_squares_ += static_cast<double>(value) * value;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+  }
+
+  uint64_t Percentile(double p) const {
+    if (!count_) {
+      return 0;
+    }
+    uint64_t target = static_cast<uint64_t>(p * (count_ - 1));
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < kLinearBins; ++i) {
+      seen += linear_[i];
+      if (seen > target) {
+        return i;
+      }
+    }
+    for (uint32_t i = 0; i < kLogBins; ++i) {
+      seen += log_[i];
+      if (seen > target) {
+        return std::min<uint64_t>(max_, (2ULL << i) - 1);
+      }
+    }
+    return max_;
+  }
+
+  inline uint64_t count() const { return count_; }
+  inline uint64_t min() const { return count_ ? min_ : 0; }
+  inline uint64_t max() const { return max_; }
+  inline double mean() const { return count_ ? double(sum_) / count_ : 0.0; }
+  inline double stddev() const {
+    if (!count_) {
+      return 0.0;
+    }
+    double m = mean();
+    double variance = sum_squares_ / count_ - m * m;
+    return variance > 0.0 ? __builtin_sqrt(variance) : 0.0;
+  }
+  inline uint64_t sum() const { return sum_; }
+
+  // Prints a summary line, then a coarse log2 histogram.
+  void Print(const char* name, double units_per_ns, const char* units) const {
+    printf("%-20s n=%-9llu min=%-7.0f mean=%-9.1f p99=%-7.0f max=%-7.0f %s\n",
+        name,
+        static_cast<unsigned long long>(count_),
+        min() / units_per_ns,
+        mean() / units_per_ns,
+        Percentile(0.99) / units_per_ns,
+        max() / units_per_ns,
+        units);
+  }
+
+  void PrintBins(double units_per_ns, const char* units) const {
+    uint64_t bins[kLogBins];
+    fill(&bins[0], &bins[kLogBins], 0);
+    for (uint32_t i = 1; i < kLinearBins; ++i) {
+      bins[31 - __builtin_clz(i)] += linear_[i];
+    }
+    bins[0] += linear_[0];
+    for (uint32_t i = 0; i < kLogBins; ++i) {
+      bins[i] += log_[i];
+    }
+    for (uint32_t i = 0; i < kLogBins; ++i) {
+      if (!bins[i]) {
+        continue;
+      }
+      printf("  < %9.0f %s: %10llu %5.1f%%\n",
+          (2ULL << i) / units_per_ns,
+          units,
+          static_cast<unsigned long long>(bins[i]),
+          100.0 * bins[i] / count_);
+    }
+  }
+
+ private:
+  uint64_t linear_[kLinearBins];
+  uint64_t log_[kLogBins];
+  uint64_t count_;
+  uint64_t sum_;
+  double sum_squares_;
+  uint64_t min_;
+  uint64_t max_;
+
+  DISALLOW_COPY_AND_ASSIGN(Histogram);
+};
+
+// Times every call made through it into a histogram of host cycles.
+class CallTimer {
+ public:
+  CallTimer(const char* name) : name_(name) { }
+  ~CallTimer() { }
+
+  inline void Start() { start_ = ReadCycleCounter(); }
+  inline void Stop() { histogram_.Add(ReadCycleCounter() - start_); }
+
+  void Report(bool bins) const {
+    double ghz = CycleCounterGHz();
+    histogram_.Print(name_, ghz, "ns");
+    if (bins) {
+      histogram_.PrintBins(ghz, "ns");
+    }
+  }
+
+  inline const Histogram& histogram() const { return histogram_; }
+  inline const char* name() const { return name_; }
+
+ private:
+  const char* name_;
+  uint64_t start_;
+  Histogram histogram_;
+
+  DISALLOW_COPY_AND_ASSIGN(CallTimer);
+};
+
+// The envelope as it was before the recursive implementation: each sample
+// interpolates the 1 - exp(-4x) table at the segment phase.
+class LutEnvelope {
+ public:
+  LutEnvelope() { }
+  ~LutEnvelope() { }
+
+  void Init() {
+    gate_ = false;
+    target_[ENV_SEGMENT_RELEASE] = 0;
+    target_[ENV_SEGMENT_DEAD] = 0;
+    increment_[ENV_SEGMENT_SUSTAIN] = 0;
+    increment_[ENV_SEGMENT_DEAD] = 0;
+  }
+
+  inline void GateOn() {
+    if (!gate_) {
+      gate_ = true;
+      Trigger(ENV_SEGMENT_ATTACK);
+      samples_.Flush();
+    }
+  }
+
+  inline void GateOff() {
+    gate_ = false;
+    switch (segment_) {
+      case ENV_SEGMENT_ATTACK:
+        Trigger(ENV_SEGMENT_DECAY);
+        break;
+      case ENV_SEGMENT_SUSTAIN:
+        Trigger(ENV_SEGMENT_RELEASE);
+        samples_.Flush();
+        break;
+      default:
+        break;
+    }
+  }
+
+  inline void SetADSR(
+      uint16_t peak, uint16_t a, uint16_t d, uint16_t s, uint16_t r) {
+    target_[ENV_SEGMENT_ATTACK] = peak;
+    increment_[ENV_SEGMENT_ATTACK] = Envelope::SegmentIncrement(a);
+    increment_[ENV_SEGMENT_DECAY] = Envelope::SegmentIncrement(d);
+    target_[ENV_SEGMENT_DECAY] = target_[ENV_SEGMENT_SUSTAIN] = s;
+    increment_[ENV_SEGMENT_RELEASE] = Envelope::SegmentIncrement(r);
+  }
+
+  inline void Trigger(EnvelopeSegment segment) {
+    if (segment == ENV_SEGMENT_DEAD) {
+      value_ = 0;
+    }
+    if (!gate_) {
+      CONSTRAIN(target_[segment], 0, value_);
+      if (segment == ENV_SEGMENT_SUSTAIN) {
+        segment = ENV_SEGMENT_RELEASE;
+      }
+    }
+    a_ = value_;
+    b_ = target_[segment];
+    phase_increment_ = increment_[segment];
+    segment_ = segment;
+    phase_ = 0;
+  }
+
+  inline void RenderSamples(size_t size = kEnvBlockSize) {
+    if (samples_.writable() < size) return;
+
+    while (size--) {
+      phase_ += phase_increment_;
+      if (phase_ < phase_increment_) {
+        value_ = b_;
+        Trigger(static_cast<EnvelopeSegment>(segment_ + 1));
+      }
+      if (phase_increment_) {
+        value_ = stmlib::Mix(
+            a_, b_, stmlib::Interpolate824(lut_env_expo, phase_));
+      }
+      samples_.Overwrite(value_);
+    }
+  }
+
+  inline void ReadSample() {
+    value_read_ = samples_.ImmediateRead();
+  }
+
+  inline uint16_t value() const { return value_read_; }
+  inline EnvelopeSegment segment() const {
+    return static_cast<EnvelopeSegment>(segment_);
+  }
+
+ private:
+  bool gate_;
+  uint32_t increment_[ENV_NUM_SEGMENTS];
+  uint16_t target_[ENV_NUM_SEGMENTS];
+  size_t segment_;
+  uint16_t a_;
+  uint16_t b_;
+  uint16_t value_;
+  uint16_t value_read_;
+  uint32_t phase_;
+  uint32_t phase_increment_;
+
+  stmlib::RingBuffer<uint16_t, kEnvBlockSize * 2> samples_;
+
+  DISALLOW_COPY_AND_ASSIGN(LutEnvelope);
+};
+
+// The just intonation processor as it was before the consonance bins: every
+// candidate tuning is scored against every note of the history.
+class BruteForceJustIntonation {
+ public:
+  BruteForceJustIntonation() { }
+  ~BruteForceJustIntonation() { }
+
+  void Init() {
+    write_ptr_ = 0;
+    cached_note_ = 0xff;
+    cached_pitch_ = 0;
+    HistoryEntry e;
+    e.note = 0;
+    e.pitch = 0;
+    e.weight = 0;
+    e.bin = 0;
+    std::fill(&history_[0], &history_[kHistorySize], e);
+  }
+
+  void NoteOff(uint8_t note) {
+    for (uint8_t i = 0; i < kHistorySize; ++i) {
+      if (history_[i].note == note && history_[i].weight == 255) {
+        history_[i].weight = 192;
+      }
+    }
+  }
+
+  int16_t NoteOn(uint8_t note) {
+    if (note != cached_note_) {
+      cached_note_ = note;
+      cached_pitch_ = Tune(static_cast<int>(note) << 7);
+    }
+    for (size_t i = 0; i < kHistorySize; ++i) {
+      if (history_[i].weight != 255) {
+        history_[i].weight = (history_[i].weight * 3) >> 2;
+      }
+    }
+    history_[write_ptr_].note = note;
+    history_[write_ptr_].weight = 255;
+    history_[write_ptr_].pitch = cached_pitch_;
+    ++write_ptr_;
+    if (write_ptr_ >= kHistorySize) {
+      write_ptr_ = 0;
+    }
+    return cached_pitch_;
+  }
+
+ private:
+  static const int kOctave = 12 << 7;
+
+  int Tune(int note, int min, int max, int step) {
+    int best_score = 0x7fffffff;
+    int best_correction = 0;
+    for (int correction = min; correction <= max; correction += step) {
+      int score = lut_consonance[
+          correction >= 0 ? correction : (kOctave + correction)];
+      int pitch = correction + note;
+      for (size_t i = 0; i < kHistorySize; ++i) {
+        int interval = (pitch - history_[i].pitch + kOctave * 12) % kOctave;
+        score += lut_consonance[interval] * history_[i].weight;
+        if (score > best_score) {
+          break;
+        }
+      }
+      if (score < best_score) {
+        best_correction = correction;
+        best_score = score;
+      }
+    }
+    return best_correction;
+  }
+
+  int16_t Tune(int note) {
+    int coarse = Tune(note, -32, 32, 4);
+    return int16_t(note + Tune(note, coarse - 6, coarse + 6, 1));
+  }
+
+  size_t write_ptr_;
+  int16_t cached_pitch_;
+  uint8_t cached_note_;
+  HistoryEntry history_[kHistorySize];
+
+  DISALLOW_COPY_AND_ASSIGN(BruteForceJustIntonation);
+};
+
+// The DAC interrupt as it was before the frame producer: audio samples were
+// read and envelopes interpolated one sample at a time, and each CV output
+// kept its own interpolator, retargeted at every refresh.
+class PerSampleDac {
+ public:
+  PerSampleDac() { }
+  ~PerSampleDac() { }
+
+  void Init() {
+    for (uint8_t i = 0; i < kNumDacChannels; ++i) {
+      interpolator_[i].Init(kFramesPerRefresh);
+    }
+  }
+
+  void Refresh(const CVOutput* outputs) {
+    for (uint8_t i = 0; i < kNumDacChannels; ++i) {
+      if (!outputs[i].is_audio()) {
+        interpolator_[i].SetTarget(outputs[i].dc_dac_code() >> 1);
+        interpolator_[i].ComputeSlope();
+      }
+    }
+  }
+
+  uint16_t Sample(CVOutput* outputs, uint8_t channel) {
+    CVOutput* output = &outputs[channel];
+    if (output->is_audio()) {
+      return output->GetAudioSample();
+    } else if (output->is_envelope()) {
+      interpolator_[channel].Tick();
+      return interpolator_[channel].value() << 1;
+    } else {
+      return output->dc_dac_code();
+    }
+  }
+
+ private:
+  Interpolator interpolator_[kNumDacChannels];
+
+  DISALLOW_COPY_AND_ASSIGN(PerSampleDac);
+};
+
+// The internal clock as it was before ticks were scheduled: the phase is
+// incremented and compared to the swung half cycle at every sample.
+class PerSampleInternalClock {
+ public:
+  PerSampleInternalClock() { }
+  ~PerSampleInternalClock() { }
+
+  void Start(uint32_t tempo, uint8_t swing) {
+    phase_ = 0;
+    swing_step_ = 11;
+    set_tempo(tempo);
+    set_swing(swing);
+  }
+
+  void set_tempo(uint32_t tempo) {
+    phase_increment_ = 178957UL * tempo / 10;
+  }
+
+  void set_swing(uint32_t swing) {
+    swing_amount_ = swing * (0x80000000 / 3 / 100);
+  }
+
+  bool Process() {
+    uint32_t half_cycle = 0x80000000;
+    if (swing_step_ < 6) {
+      half_cycle += swing_amount_;
+    } else {
+      half_cycle -= swing_amount_;
+    }
+    bool tick = false;
+    if (phase_ >= half_cycle) {
+      tick = true;
+      phase_ -= half_cycle;
+      ++swing_step_;
+      if (swing_step_ >= 12) {
+        swing_step_ = 0;
+      }
+    }
+    phase_ += phase_increment_;
+    return tick;
+  }
+
+ private:
+  uint32_t phase_;
+  uint32_t phase_increment_;
+  uint32_t swing_amount_;
+  uint8_t swing_step_;
+
+  DISALLOW_COPY_AND_ASSIGN(PerSampleInternalClock);
+};
+
+// The voice modulation as it was before the modulation matrix: vibrato,
+// tremolo and timbre modulation were hard-wired, their amounts slewed at every
+// refresh, and the oscillator targets updated even without an audio listener.
+class HardWiredVoice {
+ public:
+  HardWiredVoice() { }
+  ~HardWiredVoice() { }
+
+  void Init(int32_t scale, int32_t offset) {
+    synced_lfo_.Init();
+    envelope_.Init();
+    oscillator_.Init(scale, offset);
+    note_source_ = note_target_ = 60 << 7;
+    portamento_phase_ = 0;
+    portamento_phase_increment_ = 0;
+    portamento_exponential_shape_ = false;
+    tuning_ = 0;
+    mod_pitch_bend_ = 8192;
+    mod_velocity_ = 0x7f;
+    pitch_bend_range_ = 2;
+    vibrato_range_ = 0;
+    vibrato_mod_ = 0;
+    modulation_increment_ = lut_lfo_increments[50];
+    oscillator_mode_ = OSCILLATOR_MODE_DRONE;
+    tremolo_shape_ = LFO_SHAPE_TRIANGLE;
+    tremolo_mod_target_ = tremolo_mod_current_ = 0;
+    timbre_mod_lfo_target_ = timbre_mod_lfo_current_ = 0;
+    timbre_init_target_ = timbre_init_current_ = 0;
+    timbre_mod_envelope_target_ = timbre_mod_envelope_current_ = 0;
+    note_ = -1;
+    retrigger_delay_ = 0;
+    trigger_pulse_ = 0;
+    trigger_phase_ = 0;
+    trigger_phase_increment_ = 0;
+  }
+
+  // Out of line, like Voice::Refresh.
+  __attribute__((noinline)) void Refresh(uint8_t voice_index) {
+    tremolo_mod_current_ = stmlib::slew(
+      tremolo_mod_current_, tremolo_mod_target_);
+    timbre_init_current_ = stmlib::slew(
+      timbre_init_current_, timbre_init_target_);
+    timbre_mod_lfo_current_ = stmlib::slew(
+      timbre_mod_lfo_current_, timbre_mod_lfo_target_);
+    timbre_mod_envelope_current_ = stmlib::slew(
+      timbre_mod_envelope_current_, timbre_mod_envelope_target_);
+
+    portamento_phase_ += portamento_phase_increment_;
+    if (portamento_phase_ < portamento_phase_increment_) {
+      portamento_phase_ = 0;
+      portamento_phase_increment_ = 0;
+      note_source_ = note_target_;
+    }
+    uint16_t portamento_level = portamento_exponential_shape_
+        ? stmlib::Interpolate824(lut_env_expo, portamento_phase_)
+        : portamento_phase_ >> 16;
+    int32_t note = note_source_ + \
+        ((note_target_ - note_source_) * portamento_level >> 16);
+    note += static_cast<int32_t>(mod_pitch_bend_ - 8192) * \
+        pitch_bend_range_ >> 6;
+    note += tuning_;
+
+    envelope_.ReadSample();
+    if (modulation_increment_) {
+      synced_lfo_.Increment(modulation_increment_);
+    } else {
+      synced_lfo_.Refresh();
+    }
+    uint32_t lfo_phase = synced_lfo_.GetPhase();
+
+    int32_t vibrato_lfo = synced_lfo_.shape(LFO_SHAPE_TRIANGLE, lfo_phase);
+    int32_t scaled_vibrato_lfo = vibrato_lfo * vibrato_mod_;
+    note += scaled_vibrato_lfo * vibrato_range_ >> 15;
+
+    int32_t timbre_lfo = synced_lfo_.shape(LFO_SHAPE_TRIANGLE, lfo_phase);
+    int32_t timbre_envelope_31 = \
+        envelope_.value() * timbre_mod_envelope_current_;
+    int32_t timbre_15 =
+      (timbre_init_current_ >> (16 - 15)) +
+      (timbre_envelope_31 >> (31 - 15)) +
+      (timbre_lfo * timbre_mod_lfo_current_ >> (31 - 15));
+    CONSTRAIN(timbre_15, 0, (1 << 15) - 1);
+
+    uint16_t tremolo_lfo = 32767 - synced_lfo_.shape(tremolo_shape_, lfo_phase);
+    uint16_t scaled_tremolo_lfo = tremolo_lfo * tremolo_mod_current_ >> 16;
+    uint16_t tremolo_drone = UINT16_MAX - scaled_tremolo_lfo;
+    uint16_t tremolo_envelope = envelope_.value() * tremolo_drone >> 16;
+    uint16_t gain = oscillator_mode_ == OSCILLATOR_MODE_ENVELOPED ?
+      tremolo_envelope : tremolo_drone;
+
+    oscillator_.Refresh(note, timbre_15, gain);
+
+    mod_aux_[MOD_AUX_VELOCITY] = mod_velocity_ << 9;
+    mod_aux_[MOD_AUX_MODULATION] = vibrato_mod_ << 9;
+    mod_aux_[MOD_AUX_BEND] = static_cast<uint16_t>(mod_pitch_bend_) << 2;
+    mod_aux_[MOD_AUX_VIBRATO_LFO] = (scaled_vibrato_lfo >> 7) + 32768;
+    mod_aux_[MOD_AUX_FULL_LFO] = vibrato_lfo + 32768;
+    mod_aux_[MOD_AUX_ENVELOPE] = tremolo_envelope;
+
+    if (retrigger_delay_) {
+      --retrigger_delay_;
+    }
+    if (trigger_pulse_) {
+      --trigger_pulse_;
+    }
+    if (trigger_phase_increment_) {
+      trigger_phase_ += trigger_phase_increment_;
+      if (trigger_phase_ < trigger_phase_increment_) {
+        trigger_phase_ = 0;
+        trigger_phase_increment_ = 0;
+      }
+    }
+    note_ = note;
+  }
+
+  // The targets were handed over at every refresh.
+  inline void RefreshOscillator() { }
+
+  void NoteOn(int16_t note, uint8_t velocity) {
+    note_source_ = note_target_ = note;
+    mod_velocity_ = velocity;
+    envelope_.GateOn();
+  }
+
+  inline void PitchBend(uint16_t pitch_bend) { mod_pitch_bend_ = pitch_bend; }
+  inline void set_pitch_bend_range(uint8_t n) { pitch_bend_range_ = n; }
+  inline void set_vibrato_range(uint8_t n) { vibrato_range_ = n; }
+  inline void set_vibrato_mod(uint8_t n) { vibrato_mod_ = n; }
+  inline void set_tremolo_mod(uint8_t n) { tremolo_mod_target_ = n << 9; }
+  inline void set_tremolo_shape(uint8_t n) {
+    tremolo_shape_ = static_cast<LFOShape>(n);
+  }
+  inline void set_oscillator_mode(uint8_t m) { oscillator_mode_ = m; }
+  inline void set_timbre_init(uint8_t n) { timbre_init_target_ = n << 9; }
+  inline void set_timbre_mod_lfo(uint8_t n) { timbre_mod_lfo_target_ = n << 9; }
+  inline void set_timbre_mod_envelope(int16_t n) {
+    timbre_mod_envelope_target_ = n;
+  }
+
+  inline int32_t note() const { return note_; }
+  inline uint16_t mod_aux(ModAux s) const { return mod_aux_[s]; }
+  inline Envelope* envelope() { return &envelope_; }
+  inline Oscillator* oscillator() { return &oscillator_; }
+
+ private:
+  SyncedLFO synced_lfo_;
+  Envelope envelope_;
+  Oscillator oscillator_;
+
+  int32_t note_source_;
+  int32_t note_target_;
+  int32_t note_;
+  int32_t tuning_;
+  uint32_t portamento_phase_;
+  uint32_t portamento_phase_increment_;
+  bool portamento_exponential_shape_;
+
+  int16_t mod_pitch_bend_;
+  uint16_t mod_aux_[MOD_AUX_LAST];
+  uint8_t mod_velocity_;
+  uint8_t pitch_bend_range_;
+  uint32_t modulation_increment_;
+  uint8_t vibrato_range_;
+  uint8_t vibrato_mod_;
+  uint8_t oscillator_mode_;
+  LFOShape tremolo_shape_;
+
+  uint16_t retrigger_delay_;
+  uint16_t trigger_pulse_;
+  uint32_t trigger_phase_increment_;
+  uint32_t trigger_phase_;
+
+  uint16_t tremolo_mod_target_;
+  uint16_t tremolo_mod_current_;
+  uint16_t timbre_mod_lfo_target_;
+  uint16_t timbre_mod_lfo_current_;
+  uint16_t timbre_init_target_;
+  uint16_t timbre_init_current_;
+  int16_t timbre_mod_envelope_target_;
+  int16_t timbre_mod_envelope_current_;
+
+  DISALLOW_COPY_AND_ASSIGN(HardWiredVoice);
+};
+
+}  // namespace yarns
+
+#endif  // YARNS_TEST_FIXTURES_H_
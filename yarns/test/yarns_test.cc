@@ -0,0 +1,1929 @@
+// Copyright 2021 Chris Rogers.
+//
+// Author: Chris Rogers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Headless host build: replays MIDI through the firmware's interrupt schedule.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "stmlib/test/wav_writer.h"
+
+#include "yarns/clock_event_queue.h"
+#include "yarns/latency_tracer.h"
+#include "yarns/midi_handler.h"
+#include "yarns/multi.h"
+#include "yarns/paraphonic_oscillator.h"
+#include "yarns/settings.h"
+#include "yarns/storage_manager.h"
+#include "yarns/ui.h"
+#include "yarns/test/fixtures.h"
+
+using namespace yarns;
+using namespace stmlib;
+using namespace std;
+
+// The makefile points this to the build directory, so that the replay's
+// recordings stay out of the source tree.
+#ifndef YARNS_TEST_OUTPUT_DIR
+#define YARNS_TEST_OUTPUT_DIR "/tmp/"
+#endif  // YARNS_TEST_OUTPUT_DIR
+
+namespace yarns {
+
+// The UI is not part of the host build; Multi and Part only reach it to
+// request splash screens.
+Ui ui;
+
+void Ui::SplashOn(Splash s) { }
+
+}  // namespace yarns
+
+// Mirrors the DAC driver: CV codes are latched at SysTick rate, and only
+// written out when the channel comes up in the 4x48kHz rotation.
+class HostDac {
+ public:
+  HostDac() { }
+  ~HostDac() { }
+
+  void Init() {
+    fill(&value_[0], &value_[kNumCVOutputs], 0);
+    fill(&update_[0], &update_[kNumCVOutputs], false);
+    fill(&output_[0], &output_[kNumCVOutputs], 0);
+    active_channel_ = 0;
+  }
+
+  inline void Write(const uint16_t* values) {
+    for (uint8_t i = 0; i < kNumCVOutputs; ++i) {
+      if (value_[i] != values[i]) {
+        value_[i] = values[i];
+        update_[i] = true;
+      }
+    }
+  }
+
+  inline void Cycle() {
+    active_channel_ = (active_channel_ + 1) % kNumCVOutputs;
+  }
+
+  inline void Write() {
+    if (update_[active_channel_]) {
+      Write(value_[active_channel_]);
+      update_[active_channel_] = false;
+    }
+  }
+
+  inline void Write(uint16_t value) {
+    output_[active_channel_] = value;
+  }
+
+  inline uint8_t channel() const { return active_channel_; }
+  inline uint16_t output(uint8_t channel) const { return output_[channel]; }
+
+ private:
+  bool update_[kNumCVOutputs];
+  uint16_t value_[kNumCVOutputs];
+  uint16_t output_[kNumCVOutputs];
+  uint8_t active_channel_;
+
+  DISALLOW_COPY_AND_ASSIGN(HostDac);
+};
+
+HostDac dac;
+HostMidiIn midi_in;
+HostMidiOut midi_out;
+uint64_t now_ns;
+
+uint16_t cv[kNumCVOutputs];
+bool gate[kNumCVOutputs];
+uint8_t refresh_counter;
+
+CallTimer push_byte_timer("PushByte");
+CallTimer clock_fast_timer("ClockFast");
+CallTimer refresh_timer("Refresh");
+CallTimer get_cv_gate_timer("GetCvGate");
+CallTimer dac_read_timer("DacFrameProducer::Read");
+CallTimer internal_clock_timer("RefreshInternalClock");
+CallTimer process_input_timer("ProcessInput");
+CallTimer low_priority_timer("LowPriority");
+CallTimer systick_timer("SysTick (+24 DAC)");
+
+// Same sequence of calls as SysTick_Handler in yarns.cc, minus the UI.
+void SysTick() {
+  latency_tracer.Tick();
+  latency_tracer.set_host_time(now_ns / 1000);
+  if (midi_in.readable(now_ns)) {
+    uint8_t byte = midi_in.ImmediateRead(now_ns);
+    push_byte_timer.Start();
+    midi_handler.PushByte(byte);
+    push_byte_timer.Stop();
+  }
+
+  if (midi_handler.mutable_high_priority_output_buffer()->readable()) {
+    if (midi_out.writable(now_ns)) {
+      midi_out.Overwrite(
+          now_ns,
+          midi_handler.mutable_high_priority_output_buffer()->ImmediateRead());
+    }
+  }
+  if (midi_handler.mutable_output_encoder()->readable()) {
+    if (midi_out.writable(now_ns)) {
+      midi_out.Overwrite(
+          now_ns,
+          midi_handler.mutable_output_encoder()->ImmediateRead());
+    }
+  }
+
+  refresh_counter = (refresh_counter + 1) % 4;
+  bool refresh = refresh_counter == 0;
+  internal_clock_timer.Start();
+  multi.RefreshInternalClock();
+  internal_clock_timer.Stop();
+  clock_fast_timer.Start();
+  multi.ClockFast();
+  clock_fast_timer.Stop();
+  if (refresh) {
+    refresh_timer.Start();
+    multi.Refresh();
+    refresh_timer.Stop();
+    get_cv_gate_timer.Start();
+    multi.GetCvGate(cv, gate);
+    dac_frame_producer.Delay(cv, gate);
+    get_cv_gate_timer.Stop();
+  }
+  dac.Write(cv);
+}
+
+// Same sequence of calls as TIM1_UP_IRQHandler in yarns.cc.
+void DacTick() {
+  dac.Cycle();
+  uint8_t channel = dac.channel();
+  uint16_t sample;
+  dac_read_timer.Start();
+  bool rendered = dac_frame_producer.Read(channel, &sample);
+  dac_read_timer.Stop();
+  if (rendered) {
+    dac.Write(sample);
+  } else {
+    dac.Write();
+  }
+}
+
+void MainLoop() {
+  // The first main loop pass after an interrupt is assumed to run halfway
+  // through the SysTick period.
+  latency_tracer.set_host_time((now_ns + 62500) / 1000);
+  process_input_timer.Start();
+  midi_handler.ProcessInput();
+  process_input_timer.Stop();
+  low_priority_timer.Start();
+  multi.LowPriority();
+  low_priority_timer.Stop();
+}
+
+void Init() {
+  setting_defs.Init();
+  multi.Init(true);
+  dac_frame_producer.Init();
+  storage_manager.EraseHostFlash();
+  storage_manager.Init();
+  midi_handler.Init();
+  dac.Init();
+  refresh_counter = 0;
+  now_ns = 0;
+  midi_out.Init();
+  fill(&cv[0], &cv[kNumCVOutputs], 0);
+  fill(&gate[0], &gate[kNumCVOutputs], false);
+}
+
+void AppendMessage(
+    vector<TimedMidiByte>* bytes,
+    uint64_t time_ns,
+    uint8_t status,
+    uint8_t data_1,
+    uint8_t data_2) {
+  TimedMidiByte b;
+  b.time_ns = time_ns;
+  b.data = status; bytes->push_back(b);
+  b.data = data_1; bytes->push_back(b);
+  b.data = data_2; bytes->push_back(b);
+}
+
+void AppendLatencyTraceMessage(
+    vector<TimedMidiByte>* bytes,
+    uint64_t time_ns,
+    uint8_t action) {
+  const uint8_t message[] = {
+    0xf0, 0x00, 0x21, 0x02, 0x00, 0x0b, 0x22, action, 0xf7
+  };
+  TimedMidiByte b;
+  b.time_ns = time_ns;
+  for (size_t i = 0; i < sizeof(message); ++i) {
+    b.data = message[i];
+    bytes->push_back(b);
+  }
+}
+
+// Finds the last latency report in the MIDI output and checks it against the
+// tracer's own counters.
+bool CheckLatencyReport(const vector<uint8_t>& output) {
+  // Real-time messages may be interleaved with the SysEx data.
+  vector<uint8_t> midi_out;
+  for (size_t i = 0; i < output.size(); ++i) {
+    if (output[i] < 0xf8) {
+      midi_out.push_back(output[i]);
+    }
+  }
+  const uint8_t header[] = { 0xf0, 0x00, 0x21, 0x02, 0x00, 0x0b, 0x23 };
+  const size_t header_size = sizeof(header);
+  size_t start = midi_out.size();
+  for (size_t i = 0; i + header_size <= midi_out.size(); ++i) {
+    if (equal(header, header + header_size, midi_out.begin() + i)) {
+      start = i + header_size;
+    }
+  }
+  uint8_t expected[LatencyTracer::kSerializedSize];
+  size_t size = latency_tracer.Serialize(expected);
+  if (start + 2 * size + 1 > midi_out.size() ||
+      midi_out[start + 2 * size] != 0xf7) {
+    return false;
+  }
+  for (size_t i = 0; i < size; ++i) {
+    uint8_t byte = (midi_out[start + 2 * i] << 4) | midi_out[start + 2 * i + 1];
+    if (byte != expected[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void PrintLatencyReport() {
+  const char* names[] = { "input", "refresh", "total" };
+  printf("\nNote-on latency (us)   count      min     mean      p99      max"
+         "   jitter\n");
+  for (uint8_t i = 0; i < LATENCY_STAGE_LAST; ++i) {
+    const LatencyStats& s = latency_tracer.stats(LatencyStage(i));
+    printf("  %-20s %7u %8u %8u %8u %8u %8u\n",
+        names[i],
+        static_cast<unsigned int>(s.count()),
+        s.min(), s.mean(), s.Percentile(99), s.max(), s.jitter());
+  }
+  printf("  dropped: %u\n", latency_tracer.dropped());
+}
+
+// Dense stream used when no SMF is given: 3-note chords on channel 1 and a
+// bass line on channel 2, with a mod wheel sweep and pitch bend in between.
+void BuildTestPattern(vector<TimedMidiByte>* bytes, uint32_t duration_ms) {
+  const uint8_t chords[4][4] = {
+    { 48, 55, 60, 64 },
+    { 45, 52, 57, 60 },
+    { 41, 48, 53, 57 },
+    { 43, 50, 55, 59 },
+  };
+  const uint64_t kStepNs = 125000000;
+  uint32_t num_steps = duration_ms * 1000000ULL / kStepNs;
+  for (uint32_t step = 0; step < num_steps; ++step) {
+    uint64_t t = step * kStepNs;
+    const uint8_t* chord = chords[(step / 4) % 4];
+    for (uint8_t i = 0; i < 4; ++i) {
+      uint8_t note = chord[i] + 12 * (step % 2);
+      uint8_t status = i == 0 ? 0x91 : 0x90;
+      AppendMessage(bytes, t, status, note, 64 + ((step * 7 + i * 13) & 63));
+    }
+    AppendMessage(bytes, t + kStepNs / 4, 0xb0, 1, (step * 5) & 0x7f);
+    uint16_t bend = 8192 + ((step & 15) - 8) * 256;
+    AppendMessage(bytes, t + kStepNs / 2, 0xe0, bend & 0x7f, bend >> 7);
+    for (uint8_t i = 0; i < 4; ++i) {
+      uint8_t note = chord[i] + 12 * (step % 2);
+      uint8_t status = i == 0 ? 0x81 : 0x80;
+      AppendMessage(bytes, t + kStepNs * 3 / 4, status, note, 0);
+    }
+  }
+}
+
+void TestMidiReplay(const char* file_name) {
+  vector<TimedMidiByte> bytes;
+  if (file_name) {
+    MidiFileReader reader;
+    if (!reader.Load(file_name)) {
+      printf("Could not read %s\n", file_name);
+      return;
+    }
+    bytes = reader.bytes();
+  } else {
+    BuildTestPattern(&bytes, 20000);
+  }
+
+  // Tracing is switched on and queried through SysEx, like on the module.
+  const uint64_t kTailNs = 2000000000ULL;
+  vector<TimedMidiByte> start;
+  AppendLatencyTraceMessage(&start, 0, 0x01);
+  bytes.insert(bytes.begin(), start.begin(), start.end());
+  AppendLatencyTraceMessage(&bytes, bytes.back().time_ns + kTailNs / 2, 0x00);
+
+  Init();
+  // Three CV voices on channel 1, and one audio voice on channel 2 so that
+  // the oscillator path is measured too.
+  multi.Set(MULTI_LAYOUT, LAYOUT_THREE_ONE);
+  multi.mutable_part(1)->Set(PART_MIDI_CHANNEL, 1);
+  multi.mutable_part(1)->Set(
+      PART_VOICING_OSCILLATOR_MODE, OSCILLATOR_MODE_ENVELOPED);
+  midi_in.Init(bytes);
+
+  const uint64_t kSysTickNs = 1000000000ULL / kSysTickRate;
+  uint64_t duration_ns = midi_in.duration_ns() + kTailNs;
+  uint32_t duration_sec = (duration_ns + 999999999ULL) / 1000000000ULL;
+
+  WavWriter wav_writer(kNumCVOutputs, 48000, duration_sec);
+  wav_writer.Open(YARNS_TEST_OUTPUT_DIR "yarns_replay.wav");
+  FILE* csv = fopen(YARNS_TEST_OUTPUT_DIR "yarns_replay.csv", "w");
+  if (csv) {
+    fprintf(csv, "time_ms,cv_1,cv_2,cv_3,cv_4,gate_1,gate_2,gate_3,gate_4\n");
+  }
+
+  const uint32_t kFramesPerSysTick = kDacTicksPerSysTick / kNumCVOutputs;
+  short frames[kFramesPerSysTick * kNumCVOutputs];
+  uint64_t num_systicks = 0;
+  uint64_t isr_overruns = 0;
+  uint64_t period_overruns = 0;
+  while (now_ns < duration_ns) {
+    uint64_t start = ReadCycleCounter();
+    systick_timer.Start();
+    SysTick();
+    short* frame = frames;
+    for (uint32_t i = 0; i < kDacTicksPerSysTick; ++i) {
+      DacTick();
+      if (dac.channel() == kNumCVOutputs - 1) {
+        for (uint8_t c = 0; c < kNumCVOutputs; ++c) {
+          *frame++ = static_cast<int32_t>(dac.output(c)) - 32768;
+        }
+      }
+    }
+    systick_timer.Stop();
+    uint64_t isr_elapsed = ReadCycleCounter() - start;
+    MainLoop();
+    uint64_t elapsed = ReadCycleCounter() - start;
+    // The interrupts alone taking longer than the period is an overrun on
+    // the module; interrupts and one main loop pass only delay the main loop.
+    if (isr_elapsed > kSysTickNs * CycleCounterGHz()) {
+      ++isr_overruns;
+    }
+    if (elapsed > kSysTickNs * CycleCounterGHz()) {
+      ++period_overruns;
+    }
+
+    wav_writer.WriteFrames(frames, kFramesPerSysTick);
+    if (csv && refresh_counter == 0) {
+      fprintf(csv, "%.3f,%d,%d,%d,%d,%d,%d,%d,%d\n",
+          now_ns / 1e6,
+          cv[0], cv[1], cv[2], cv[3],
+          gate[0], gate[1], gate[2], gate[3]);
+    }
+    now_ns += kSysTickNs;
+    ++num_systicks;
+  }
+  if (csv) {
+    fclose(csv);
+  }
+
+  printf("Replayed %llu bytes over %.2f s (%llu SysTicks, %llu bytes out)\n",
+      static_cast<unsigned long long>(bytes.size()),
+      duration_ns / 1e9,
+      static_cast<unsigned long long>(num_systicks),
+      static_cast<unsigned long long>(midi_out.bytes().size()));
+  printf("Host cycle counter: %.3f GHz\n", CycleCounterGHz());
+  const CallTimer* timers[] = {
+    &push_byte_timer, &process_input_timer, &clock_fast_timer,
+    &refresh_timer, &get_cv_gate_timer, &dac_read_timer,
+    &internal_clock_timer, &low_priority_timer,
+    &systick_timer
+  };
+  for (size_t i = 0; i < sizeof(timers) / sizeof(timers[0]); ++i) {
+    timers[i]->Report(false);
+  }
+  printf("\nSysTick period distribution:\n");
+  systick_timer.Report(true);
+
+  // The firmware has 125us (9000 cycles at 72MHz) between SysTicks; report
+  // the host-side share of that budget as a rough load figure.
+  double mean_ns = systick_timer.histogram().mean() / CycleCounterGHz();
+  printf("\nMean ISR load: %.2f%% of the %u-cycle target budget (host time)\n",
+      100.0 * mean_ns / kSysTickNs, kSysTickBudgetCycles);
+  printf("SysTicks overrunning 125us on host: %llu\n",
+      static_cast<unsigned long long>(isr_overruns));
+  printf("SysTick + main loop passes over 125us on host: %llu\n",
+      static_cast<unsigned long long>(period_overruns));
+
+  PrintLatencyReport();
+  printf("  SysEx report: %s\n",
+      CheckLatencyReport(midi_out.bytes()) ? "matches" : "MISMATCH");
+
+  const MidiOutputEncoder& encoder = *midi_handler.mutable_output_encoder();
+  printf("\nMIDI out: %u bytes sent, %u saved (%u coalesced), %u dropped\n",
+      static_cast<unsigned int>(encoder.bytes_sent()),
+      static_cast<unsigned int>(encoder.bytes_saved()),
+      static_cast<unsigned int>(encoder.coalesced()),
+      static_cast<unsigned int>(midi_handler.output_overflows()));
+}
+
+const uint32_t kEnvelopeTestSamples = 24000;  // 12s at 2kHz
+
+bool ExpectBytes(
+    MidiOutputEncoder* encoder,
+    const uint8_t* expected,
+    size_t size) {
+  bool ok = true;
+  for (size_t i = 0; i < size; ++i) {
+    if (!encoder->readable() || encoder->ImmediateRead() != expected[i]) {
+      ok = false;
+    }
+  }
+  return ok && !encoder->readable();
+}
+
+void TestMidiOutputEncoder() {
+  MidiOutputEncoder encoder;
+
+  // Running status, including for note-offs sent as zero-velocity note-ons.
+  encoder.Init();
+  encoder.Write(0x90, 60, 100);
+  encoder.Write(0x90, 64, 100);
+  encoder.Write(0x80, 60, 0);
+  encoder.Write(0x80, 64, 64);
+  const uint8_t running_status[] = {
+    0x90, 60, 100, 64, 100, 60, 0, 0x80, 64, 64
+  };
+  printf("Running status: %s\n", ExpectBytes(
+      &encoder, running_status, sizeof(running_status)) ? "OK" : "FAIL");
+
+  // CC and pitch bend updates merge into queued messages; the head of the
+  // queue and messages separated by another event on the channel do not.
+  encoder.Init();
+  encoder.Write(0xb0, 1, 10);
+  encoder.Write(0xb0, 1, 20);
+  encoder.Write(0xb0, 1, 30);
+  encoder.Write(0xb1, 1, 40);
+  encoder.Write(0xb0, 1, 50);
+  encoder.Write(0xe0, 0, 64);
+  encoder.Write(0xe0, 0, 65);
+  encoder.Write(0x90, 60, 100);
+  encoder.Write(0xb0, 1, 60);
+  const uint8_t coalesced[] = {
+    0xb0, 1, 10, 1, 50, 0xb1, 1, 40, 0xe0, 0, 65, 0x90, 60, 100, 0xb0, 1, 60
+  };
+  printf("Coalescing: %s\n", ExpectBytes(
+      &encoder, coalesced, sizeof(coalesced)) ? "OK" : "FAIL");
+
+  // Raw bytes pass through and reset running status.
+  encoder.Init();
+  encoder.Write(0x90, 60, 100);
+  encoder.WriteRaw(0xf0);
+  encoder.WriteRaw(0x7d);
+  encoder.WriteRaw(0xf7);
+  encoder.Write(0x90, 62, 100);
+  const uint8_t raw[] = { 0x90, 60, 100, 0xf0, 0x7d, 0xf7, 0x90, 62, 100 };
+  printf("Raw bytes: %s\n", ExpectBytes(
+      &encoder, raw, sizeof(raw)) ? "OK" : "FAIL");
+
+  // A full queue drops and counts messages instead of corrupting them.
+  encoder.Init();
+  uint32_t accepted = 0;
+  for (uint8_t i = 0; i < 100; ++i) {
+    accepted += encoder.Write(0x90, i, 100);
+  }
+  printf("Overflow: %u accepted, %u dropped\n",
+      static_cast<unsigned int>(accepted),
+      static_cast<unsigned int>(encoder.overflows()));
+}
+
+template<typename T>
+uint64_t RenderEnvelope(T* envelope, uint32_t gate_samples, uint16_t* out) {
+  uint64_t start = ReadCycleCounter();
+  for (uint32_t i = 0; i < kEnvelopeTestSamples; i += kEnvBlockSize) {
+    if (i == 0) {
+      envelope->GateOn();
+    } else if (i == gate_samples) {
+      envelope->GateOff();
+    }
+    envelope->RenderSamples();
+    for (size_t j = 0; j < kEnvBlockSize; ++j) {
+      envelope->ReadSample();
+      out[i + j] = envelope->value();
+    }
+  }
+  return ReadCycleCounter() - start;
+}
+
+// Largest deviation of the attack segment from
+// 65535 * (1 - exp(-4t)) / (1 - exp(-4)).
+template<typename T>
+int32_t AttackError(T* envelope, uint16_t time) {
+  envelope->Init();
+  envelope->SetADSR(0xffff, time, 0, 0xffff, 0);
+  // Start from 0.
+  envelope->GateOff();
+  while (envelope->segment() != ENV_SEGMENT_DEAD) {
+    envelope->RenderSamples(1);
+    envelope->ReadSample();
+  }
+  envelope->GateOn();
+  double increment = Envelope::SegmentIncrement(time) / 4294967296.0;
+  int32_t max_error = 0;
+  for (uint32_t n = 1; envelope->segment() == ENV_SEGMENT_ATTACK; ++n) {
+    envelope->RenderSamples(1);
+    envelope->ReadSample();
+    double t = std::min(n * increment, 1.0);
+    double expected = 65535.0 * (1.0 - exp(-4.0 * t)) / (1.0 - exp(-4.0));
+    int32_t error = fabs(envelope->value() - expected) + 0.5;
+    max_error = std::max(max_error, error);
+  }
+  return max_error;
+}
+
+void TestEnvelope() {
+  static Envelope envelope;
+  static LutEnvelope lut_envelope;
+  static uint16_t expected[kEnvelopeTestSamples];
+  static uint16_t actual[kEnvelopeTestSamples];
+  const uint32_t gate_samples[] = { 200, 4000, 12000 };
+  const uint16_t sustain_levels[] = { 0, 0x4000, 0xc000, 0xffff };
+
+  uint64_t lut_cycles = 0;
+  uint64_t recursive_cycles = 0;
+  uint64_t num_samples = 0;
+  int32_t max_error = 0;
+  uint32_t num_notes = 0;
+  for (uint16_t a = 0; a < 128; a += 21) {
+    for (uint16_t d = 0; d < 128; d += 21) {
+      for (uint16_t r = 0; r < 128; r += 21) {
+        for (uint8_t s = 0; s < 4; ++s) {
+          for (uint8_t g = 0; g < 3; ++g) {
+            // 7-bit times, so that both implementations share the table
+            // entries exactly.
+            envelope.Init();
+            envelope.SetADSR(0xffff, a << 9, d << 9, sustain_levels[s], r << 9);
+            lut_envelope.Init();
+            lut_envelope.SetADSR(
+                0xffff, a << 9, d << 9, sustain_levels[s], r << 9);
+            lut_cycles += RenderEnvelope(
+                &lut_envelope, gate_samples[g], expected);
+            recursive_cycles += RenderEnvelope(
+                &envelope, gate_samples[g], actual);
+            for (uint32_t i = 0; i < kEnvelopeTestSamples; ++i) {
+              int32_t error = abs(actual[i] - expected[i]);
+              max_error = std::max(max_error, error);
+            }
+            num_samples += kEnvelopeTestSamples;
+            ++num_notes;
+          }
+        }
+      }
+    }
+  }
+
+  // 16-bit times, including between table entries.
+  int32_t lut_attack_error = 0;
+  int32_t recursive_attack_error = 0;
+  uint32_t previous = Envelope::SegmentIncrement(0);
+  bool monotonic = true;
+  for (uint32_t time = 0; time <= 0xffff; time += 97) {
+    uint32_t increment = Envelope::SegmentIncrement(time);
+    monotonic = monotonic && increment <= previous;
+    previous = increment;
+    lut_attack_error = std::max(
+        lut_attack_error, AttackError(&lut_envelope, time));
+    recursive_attack_error = std::max(
+        recursive_attack_error, AttackError(&envelope, time));
+  }
+
+  double ghz = CycleCounterGHz();
+  printf("Envelope: %u notes, %lu samples\n",
+      static_cast<unsigned int>(num_notes),
+      static_cast<unsigned long>(num_samples));
+  printf("  LUT:       %.1f cycles/sample (%.2f ns)\n",
+      static_cast<double>(lut_cycles) / num_samples,
+      lut_cycles / ghz / num_samples);
+  printf("  Recursive: %.1f cycles/sample (%.2f ns)\n",
+      static_cast<double>(recursive_cycles) / num_samples,
+      recursive_cycles / ghz / num_samples);
+  printf("  Max difference: %d LSB\n", static_cast<int>(max_error));
+  printf("  Max attack error vs. exact curve: LUT %d LSB, recursive %d LSB\n",
+      static_cast<int>(lut_attack_error),
+      static_cast<int>(recursive_attack_error));
+  printf("  16-bit times: %s\n", monotonic ? "OK" : "FAIL");
+}
+
+enum PitchSweep {
+  PITCH_SWEEP_UP,
+  PITCH_SWEEP_DOWN,
+  PITCH_SWEEP_VIBRATO,
+  PITCH_SWEEP_RANDOM,
+  PITCH_SWEEP_LAST
+};
+
+// One pitch per block, over 0..kHighestNote. The vibrato and random sweeps
+// also go out of range, as the sync and FM modulator pitches can.
+int16_t SweepPitch(PitchSweep sweep, uint32_t block) {
+  switch (sweep) {
+    case PITCH_SWEEP_UP:
+      return block % kHighestNote;
+    case PITCH_SWEEP_DOWN:
+      return kHighestNote - 1 - block % kHighestNote;
+    case PITCH_SWEEP_VIBRATO:
+      {
+        // A semitone deep triangle, about every note.
+        int16_t center = (block >> 6) % 128 << 7;
+        int16_t triangle = block & 0x20 ? 0x3f - (block & 0x3f) : block & 0x3f;
+        return center + (triangle << 2) - 64;
+      }
+    default:
+      return rand() & 0xffff;
+  }
+}
+
+void TestPhaseIncrementCache() {
+  const char* sweep_names[] = { "up", "down", "vibrato", "random" };
+  const uint32_t kNumBlocks = kHighestNote * 4;
+
+  printf("Phase increment cache: %d blocks per sweep\n",
+      static_cast<int>(kNumBlocks));
+  for (uint8_t s = 0; s < PITCH_SWEEP_LAST; ++s) {
+    PitchSweep sweep = static_cast<PitchSweep>(s);
+    static int16_t pitches[kNumBlocks];
+    for (uint32_t i = 0; i < kNumBlocks; ++i) {
+      pitches[i] = SweepPitch(sweep, i);
+    }
+
+    PhaseIncrementCache cache;
+    cache.Init();
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < kNumBlocks; ++i) {
+      mismatches += cache.Compute(pitches[i]) != \
+          Oscillator::ComputePhaseIncrement(pitches[i]);
+    }
+
+    // Each block also renders, so a few increments at a time are timed.
+    uint32_t sum = 0;
+    uint64_t direct_cycles = 0;
+    uint64_t cached_cycles = 0;
+    cache.Init();
+    for (uint32_t i = 0; i < kNumBlocks; i += kAudioBlockSize) {
+      uint64_t start = ReadCycleCounter();
+      for (uint32_t j = i; j < i + kAudioBlockSize; ++j) {
+        sum += Oscillator::ComputePhaseIncrement(pitches[j]);
+      }
+      direct_cycles += ReadCycleCounter() - start;
+      start = ReadCycleCounter();
+      for (uint32_t j = i; j < i + kAudioBlockSize; ++j) {
+        sum -= cache.Compute(pitches[j]);
+      }
+      cached_cycles += ReadCycleCounter() - start;
+    }
+    printf("  %-8s direct %.1f, cached %.1f cycles/block, "
+        "%lu mismatches %s\n",
+        sweep_names[s],
+        static_cast<double>(direct_cycles) / kNumBlocks,
+        static_cast<double>(cached_cycles) / kNumBlocks,
+        static_cast<unsigned long>(mismatches),
+        !mismatches && !sum ? "OK" : "FAIL");
+  }
+}
+
+// Windowed energy left once the harmonics of the note are fitted and
+// removed, relative to the energy of the note: aliasing, and the noise of
+// the table interpolation and of the output quantization.
+double MeasureAliasing(Oscillator* oscillator, int16_t pitch, int16_t timbre) {
+  const size_t kNumSamples = 32768;
+  const size_t kNumSettleBlocks = 4;
+  static double x[kNumSamples];
+  static double window[kNumSamples];
+
+  for (size_t block = 0; block < kNumSettleBlocks + kNumSamples / kAudioBlockSize;
+      ++block) {
+    oscillator->Refresh(pitch, timbre, 0xffff);
+    oscillator->Render();
+    for (size_t i = 0; i < kAudioBlockSize; ++i) {
+      int32_t sample = oscillator->ReadSample();
+      if (block >= kNumSettleBlocks) {
+        x[(block - kNumSettleBlocks) * kAudioBlockSize + i] = sample;
+      }
+    }
+  }
+
+  // Blackman-Harris, so that closely spaced harmonics do not leak into each
+  // other's estimates.
+  double mean = 0.0;
+  double window_sum = 0.0;
+  for (size_t i = 0; i < kNumSamples; ++i) {
+    double t = 2 * M_PI * i / kNumSamples;
+    window[i] = 0.35875 - 0.48829 * cos(t) + 0.14128 * cos(2 * t) - \
+        0.01168 * cos(3 * t);
+    window_sum += window[i];
+    mean += window[i] * x[i];
+  }
+  mean /= window_sum;
+  double total = 0.0;
+  for (size_t i = 0; i < kNumSamples; ++i) {
+    x[i] -= mean;
+    total += window[i] * x[i] * x[i];
+  }
+
+  double frequency = Oscillator::ComputePhaseIncrement(pitch) / 4294967296.0;
+  double harmonics = 0.0;
+  for (uint16_t k = 1; k * frequency < 0.5; ++k) {
+    double step_re = cos(2 * M_PI * k * frequency);
+    double step_im = sin(2 * M_PI * k * frequency);
+    double rotor_re = 1.0;
+    double rotor_im = 0.0;
+    double re = 0.0;
+    double im = 0.0;
+    for (size_t i = 0; i < kNumSamples; ++i) {
+      re += window[i] * x[i] * rotor_re;
+      im += window[i] * x[i] * rotor_im;
+      double next_re = rotor_re * step_re - rotor_im * step_im;
+      rotor_im = rotor_re * step_im + rotor_im * step_re;
+      rotor_re = next_re;
+    }
+    // A windowed sinusoid of amplitude 2|X|/W has an energy of A^2 W / 2.
+    harmonics += 2 * (re * re + im * im) / window_sum;
+  }
+  double residual = std::max(total - harmonics, total * 1e-12);
+  return 10 * log10(residual / total);
+}
+
+void TestWavetableOscillator() {
+  // Default calibration, as in TestParaphonicOscillator.
+  const int32_t offset = 54586 - 5133 * 3;
+  const int32_t scale = (offset - (54586 - 5133 * 7)) / kNumParaphonicVoices;
+  const uint16_t kNumBlocks = 1000;
+  // Just past the triangle, as close to a saw as the sweep gets.
+  const int16_t kSawTimbre = 32768 * 2 / 3 + 1;
+  const uint8_t notes[] = { 36, 60, 84, 96, 108, 120 };
+
+  static Oscillator blep;
+  static Oscillator wavetable;
+  blep.Init(scale, offset);
+  blep.set_shape(OSC_SHAPE_VARIABLE_SAW);
+  wavetable.Init(scale, offset);
+  wavetable.set_shape(OSC_SHAPE_WAVETABLE);
+
+  printf("Wavetable oscillator:\n");
+  uint64_t blep_cycles = 0;
+  uint64_t wavetable_cycles = 0;
+  for (uint16_t block = 0; block < kNumBlocks; ++block) {
+    int16_t pitch = (36 << 7) + block * 8;
+    blep.Refresh(pitch, 0, 0xffff);
+    wavetable.Refresh(pitch, (block * 97) & 0x7fff, 0xffff);
+    uint64_t start = ReadCycleCounter();
+    blep.Render();
+    for (size_t i = 0; i < kAudioBlockSize; ++i) {
+      blep.ReadSample();
+    }
+    blep_cycles += ReadCycleCounter() - start;
+    start = ReadCycleCounter();
+    wavetable.Render();
+    for (size_t i = 0; i < kAudioBlockSize; ++i) {
+      wavetable.ReadSample();
+    }
+    wavetable_cycles += ReadCycleCounter() - start;
+  }
+  printf("  BLEP saw %.1f, wavetable %.1f cycles/sample\n",
+      static_cast<double>(blep_cycles) / kNumBlocks / kAudioBlockSize,
+      static_cast<double>(wavetable_cycles) / kNumBlocks / kAudioBlockSize);
+
+  for (uint8_t n = 0; n < sizeof(notes); ++n) {
+    int16_t pitch = notes[n] << 7;
+    printf("  note %3d: aliasing BLEP saw %.1f dB, wavetable saw %.1f dB, "
+        "square %.1f dB\n",
+        notes[n],
+        MeasureAliasing(&blep, pitch, 0),
+        MeasureAliasing(&wavetable, pitch, kSawTimbre),
+        MeasureAliasing(&wavetable, pitch, 32767));
+  }
+}
+
+void TestParaphonicOscillator() {
+  // Default calibration, 3 voices sharing 4Vpp.
+  const int32_t offset = 54586 - 5133 * 3;
+  const int32_t scale = (offset - (54586 - 5133 * 7)) / kNumParaphonicVoices;
+  const OscillatorShape shapes[] = {
+    OSC_SHAPE_FOLD_SINE,
+    OSC_SHAPE_FOLD_TRIANGLE,
+    OSC_SHAPE_TANH_SINE,
+    OSC_SHAPE_BUZZ,
+    OSC_SHAPE_FM,
+    OSC_SHAPE_WAVETABLE,
+    OSC_SHAPE_CZ_SAW_LP,
+  };
+  const uint8_t kNumShapes = sizeof(shapes) / sizeof(shapes[0]);
+  const uint16_t kNumBlocks = 1000;
+
+  // Oscillator::Init does not reset all the state, so every shape starts
+  // from fresh oscillators.
+  static Oscillator references[kNumShapes][kNumParaphonicVoices];
+  static Oscillator oscillators[kNumShapes][kNumParaphonicVoices];
+  static ParaphonicOscillator paraphonic;
+
+  printf("Paraphonic oscillator, %d voices:\n", kNumParaphonicVoices);
+  for (uint8_t s = 0; s < kNumShapes; ++s) {
+    Oscillator* reference = references[s];
+    Oscillator* oscillator = oscillators[s];
+    paraphonic.Init(kNumParaphonicVoices, offset);
+    for (uint8_t v = 0; v < kNumParaphonicVoices; ++v) {
+      reference[v].Init(scale, offset);
+      reference[v].set_shape(shapes[s]);
+      oscillator[v].Init(scale, offset);
+      oscillator[v].set_shape(shapes[s]);
+      paraphonic.set_oscillator(v, &oscillator[v]);
+    }
+
+    uint64_t reference_cycles = 0;
+    uint64_t paraphonic_cycles = 0;
+    int32_t max_error = 0;
+    for (uint16_t block = 0; block < kNumBlocks; ++block) {
+      for (uint8_t v = 0; v < kNumParaphonicVoices; ++v) {
+        int16_t pitch = ((36 + 7 * v) << 7) + block * 4;
+        int16_t timbre = (block * 97 + v * 5000) & 0x7fff;
+        uint16_t gain = 0xffff - ((block + v * 300) % kNumBlocks) * 48;
+        reference[v].Refresh(pitch, timbre, gain);
+        oscillator[v].Refresh(pitch, timbre, gain);
+      }
+
+      uint16_t expected[kAudioBlockSize];
+      uint64_t start = ReadCycleCounter();
+      for (uint8_t v = 0; v < kNumParaphonicVoices; ++v) {
+        reference[v].Render();
+      }
+      for (size_t i = 0; i < kAudioBlockSize; ++i) {
+        uint16_t mix = 0;
+        for (uint8_t v = 0; v < kNumParaphonicVoices; ++v) {
+          mix += reference[v].ReadSample();
+        }
+        expected[i] = mix;
+      }
+      reference_cycles += ReadCycleCounter() - start;
+
+      uint16_t actual[kAudioBlockSize];
+      start = ReadCycleCounter();
+      // As in Multi::LowPriority: voices first, then the paraphonic output.
+      for (uint8_t v = 0; v < kNumParaphonicVoices; ++v) {
+        oscillator[v].Render();
+      }
+      paraphonic.Render();
+      for (size_t i = 0; i < kAudioBlockSize; ++i) {
+        actual[i] = paraphonic.ReadSample();
+      }
+      paraphonic_cycles += ReadCycleCounter() - start;
+
+      for (size_t i = 0; i < kAudioBlockSize; ++i) {
+        int32_t error = abs(static_cast<int16_t>(actual[i] - expected[i]));
+        max_error = std::max(max_error, error);
+      }
+    }
+    printf("  shape %2d: per voice %.1f, paraphonic %.1f cycles/sample, "
+        "max error %d LSB\n",
+        shapes[s],
+        static_cast<double>(reference_cycles) / kNumBlocks / kAudioBlockSize,
+        static_cast<double>(paraphonic_cycles) / kNumBlocks / kAudioBlockSize,
+        static_cast<int>(max_error));
+  }
+
+  // From a shape rendered here to one summed from the voices. While silent,
+  // the voices' buffers filled up with silence and were never read: none of
+  // it must be played once the voices are heard.
+  Oscillator* oscillator = oscillators[0];
+  paraphonic.Init(kNumParaphonicVoices, offset);
+  for (uint8_t v = 0; v < kNumParaphonicVoices; ++v) {
+    oscillator[v].Init(scale, offset);
+    oscillator[v].set_shape(OSC_SHAPE_FOLD_SINE);
+    paraphonic.set_oscillator(v, &oscillator[v]);
+  }
+  uint16_t silence = static_cast<uint16_t>(offset * kNumParaphonicVoices);
+  bool stale = true;
+  for (uint8_t block = 0; block < 4; ++block) {
+    bool audible = block == 3;
+    OscillatorShape shape = audible ? OSC_SHAPE_CZ_SAW_LP : OSC_SHAPE_FOLD_SINE;
+    for (uint8_t v = 0; v < kNumParaphonicVoices; ++v) {
+      oscillator[v].set_shape(shape);
+      oscillator[v].Refresh((48 + 7 * v) << 7, 0x4000, audible ? 0xffff : 0);
+      oscillator[v].Render();
+    }
+    paraphonic.Render();
+    stale = true;
+    for (size_t i = 0; i < kAudioBlockSize; ++i) {
+      stale = stale && paraphonic.ReadSample() == silence;
+    }
+  }
+  printf("  shape change to a voice mix: %s\n", stale ? "FAIL" : "OK");
+}
+
+enum LooperTestStyle {
+  LOOPER_TEST_STYLE_STEADY,
+  LOOPER_TEST_STYLE_ACCENTS,
+  LOOPER_TEST_STYLE_RANDOM,
+  LOOPER_TEST_STYLE_LAST
+};
+
+// Notes played into part 0 while it records, on top of the internal clock.
+void BuildLooperRecording(
+    vector<TimedMidiByte>* bytes,
+    LooperTestStyle style,
+    uint16_t num_notes) {
+  const uint8_t accents[] = { 64, 100, 127 };
+  AppendMessage(bytes, 0, 0xb0, kCCRecordOffOn, 127);
+  uint64_t t = 50000000;
+  int16_t pitch = 60;
+  for (uint16_t i = 0; i < num_notes; ++i) {
+    pitch += (rand() % 9) - 4;
+    CONSTRAIN(pitch, 36, 96);
+    uint8_t velocity = 100;
+    uint64_t step_ns = 125000000;
+    uint64_t length_ns = 100000000;
+    if (style == LOOPER_TEST_STYLE_ACCENTS) {
+      velocity = accents[i % 4 ? rand() % 2 : 2];
+    } else if (style == LOOPER_TEST_STYLE_RANDOM) {
+      velocity = 1 + rand() % 127;
+      step_ns = 20000000 + (rand() % 200) * 1000000ULL;
+      length_ns = step_ns * (1 + rand() % 9) / 10;
+    }
+    AppendMessage(bytes, t, 0x90, pitch, velocity);
+    AppendMessage(bytes, t + length_ns, 0x80, pitch, 0);
+    t += step_ns;
+  }
+  AppendMessage(bytes, t + 50000000, 0xb0, kCCRecordOffOn, 0);
+}
+
+bool CheckLegacyLooperNotes() {
+  const Part& part = multi.part(0);
+  const looper::Deck& deck = multi.mutable_part(0)->mutable_looper();
+  bool ok = deck.size() == 10 && \
+      part.midi_settings().channel == 9 && \
+      part.midi_settings().transpose_octaves == -1;
+  for (uint8_t index = 0; ok && index < deck.size(); ++index) {
+    const looper::Note& note = deck.note_at(index);
+    ok = \
+        note.on_pos == (index * 800) << (16 - looper::kBitsPos) && \
+        note.off_pos == (index * 800 + 400) << (16 - looper::kBitsPos) && \
+        note.pitch == 48 + index && note.velocity == 100 - index;
+  }
+  return ok;
+}
+
+void TestLooper() {
+  const char* style_names[] = { "steady", "accents", "random" };
+  const uint16_t kNumNotes = 100;
+  const uint8_t kNumSeeds = 20;
+  const uint64_t kSysTickNs = 1000000000ULL / kSysTickRate;
+
+  // Unpacked away from the part, so that nothing is played from it.
+  static looper::Deck restored;
+
+  printf("Looper, %d notes recorded, %d bytes of storage:\n",
+      kNumNotes, looper::kPackedSize);
+  for (uint8_t style = 0; style < LOOPER_TEST_STYLE_LAST; ++style) {
+    uint32_t num_kept = 0;
+    uint32_t min_kept = looper::kMaxNotes;
+    uint32_t num_bytes = 0;
+    uint32_t num_errors = 0;
+    uint64_t max_pack_cycles = 0;
+    for (uint8_t seed = 0; seed < kNumSeeds; ++seed) {
+      srand(seed + 1);
+      vector<TimedMidiByte> bytes;
+      BuildLooperRecording(
+          &bytes, static_cast<LooperTestStyle>(style), kNumNotes);
+
+      Init();
+      Part* part = multi.mutable_part(0);
+      part->Set(PART_MIDI_PLAY_MODE, PLAY_MODE_SEQUENCER);
+      part->Set(PART_SEQUENCER_CLOCK_QUANTIZATION, 0);
+      part->Set(PART_SEQUENCER_LOOP_LENGTH, 4);
+      midi_in.Init(bytes);
+      while (now_ns < midi_in.duration_ns() + kSysTickNs) {
+        SysTick();
+        for (uint32_t i = 0; i < kDacTicksPerSysTick; ++i) {
+          DacTick();
+        }
+        MainLoop();
+        now_ns += kSysTickNs;
+      }
+
+      looper::Deck& deck = part->mutable_looper();
+      deck.pos_offset = rand();
+      PackedPart packed;
+      // Best of a few runs, to leave out cold caches and preemption.
+      uint64_t pack_cycles = UINT64_MAX;
+      for (uint8_t run = 0; run < 8; ++run) {
+        uint64_t start = ReadCycleCounter();
+        deck.Pack(packed);
+        pack_cycles = std::min(pack_cycles, ReadCycleCounter() - start);
+      }
+      max_pack_cycles = std::max(max_pack_cycles, pack_cycles);
+      num_bytes += deck.Pack(packed);
+      restored.Init(part);
+      restored.Unpack(packed);
+
+      // Positions keep the resolution of the former fixed-size format, so
+      // notes play at the same time as before.
+      uint8_t dropped = deck.size() - restored.size();
+      for (uint8_t index = 0; index < restored.size(); ++index) {
+        uint8_t ordinal = restored.NoteAgeOrdinal(index) + dropped;
+        uint8_t original = 0;
+        while (deck.NoteAgeOrdinal(original) != ordinal) {
+          ++original;
+        }
+        const looper::Note& a = deck.note_at(original);
+        const looper::Note& b = restored.note_at(index);
+        uint16_t mask = ~((1 << (16 - looper::kBitsPos)) - 1);
+        uint16_t on_pos = (a.on_pos - deck.pos_offset) & mask;
+        uint16_t off_pos = (a.off_pos - deck.pos_offset) & mask;
+        if (b.on_pos != on_pos || b.off_pos != off_pos ||
+            b.pitch != a.pitch || b.velocity != a.velocity) {
+          ++num_errors;
+        }
+      }
+      num_kept += restored.size();
+      min_kept = std::min(min_kept, static_cast<uint32_t>(restored.size()));
+    }
+    printf("  %-8s: %.1f notes kept (min %d), %.1f bytes/note, "
+        "%d mismatches, packed in %.1f us at most (host)\n",
+        style_names[style],
+        static_cast<double>(num_kept) / kNumSeeds,
+        static_cast<int>(min_kept),
+        static_cast<double>(num_bytes) / num_kept,
+        static_cast<int>(num_errors),
+        max_pack_cycles / CycleCounterGHz() / 1000.0);
+  }
+
+  // A multi dumped by an earlier version: the part settings are at the same
+  // bit positions, and the fixed-size notes are re-encoded.
+  Init();
+  PackedMulti packed = PackedMulti();
+  uint8_t* part_bytes = reinterpret_cast<uint8_t*>(&packed.parts[0]);
+  packed.parts[0].transpose_octaves = -1;
+  bool same_layout = \
+      part_bytes[sizeof(packed.parts[0].sequencer_steps) + \
+          looper::kPackedSize + 1] == 0x1c;
+  packed.parts[0].channel = 9;
+  packed.parts[0].looper_legacy_oldest_index = 25;
+  packed.parts[0].looper_legacy_size = 10;
+  for (uint8_t ordinal = 0; ordinal < 10; ++ordinal) {
+    looper::PackedNote note;
+    note.on_pos = ordinal * 800;
+    note.off_pos = ordinal * 800 + 400;
+    note.pitch = 48 + ordinal;
+    note.velocity = 100 - ordinal;
+    uint8_t index = (25 + ordinal) % looper::kLegacyMaxNotes;
+    memcpy(
+        &packed.parts[0].looper_data[index * sizeof(note)],
+        &note, sizeof(note));
+  }
+  // Left uninitialized by earlier versions.
+  packed.flash_padding[0] = 0x02;
+  packed.flash_padding[1] = 0x59;
+  storage_manager.AppendData(
+      reinterpret_cast<const uint8_t*>(&packed), sizeof(packed), true);
+  storage_manager.DeserializeMulti();
+  bool converted = CheckLegacyLooperNotes();
+
+  // The same multi dumped by this version, followed by its format. Saving
+  // applies the looper's phase offset, left over by the recordings above.
+  multi.mutable_part(0)->mutable_looper().pos_offset = 0;
+  stmlib::StreamBuffer<kMaxSize> stream_buffer;
+  multi.Serialize(&stream_buffer);
+  stream_buffer.Write(kMultiFormat);
+  Init();
+  storage_manager.AppendData(
+      stream_buffer.bytes(), stream_buffer.position(), true);
+  storage_manager.DeserializeMulti();
+  bool reloaded = CheckLegacyLooperNotes();
+
+  printf("  legacy  : settings layout %s, notes %s, dumped again %s\n",
+      same_layout ? "unchanged" : "CHANGED",
+      converted ? "converted" : "LOST",
+      reloaded ? "OK" : "FAIL");
+}
+
+// Serialized multi, to compare what was saved and what was loaded.
+struct MultiSnapshot {
+  MultiSnapshot() {
+    stmlib::StreamBuffer<kMaxSize> stream_buffer;
+    multi.Serialize(&stream_buffer);
+    memcpy(bytes, stream_buffer.bytes(), sizeof(bytes));
+  }
+  bool operator==(const MultiSnapshot& other) const {
+    return !memcmp(bytes, other.bytes, sizeof(bytes));
+  }
+  uint8_t bytes[sizeof(PackedMulti)];
+};
+
+void TestStorageManager() {
+  // STM32F103 datasheet, typical.
+  const double kPageEraseMs = 20.0;
+  const double kHalfWordProgramMs = 0.0525;
+
+  // Every program is saved once and program 0 twice, so that the next save
+  // of program 0 reuses a page holding an older copy. Each save is completed
+  // before the next edit, which it would otherwise include.
+  Init();
+  for (uint8_t slot = 0; slot < kNumMultiSlots; ++slot) {
+    multi.Set(MULTI_CLOCK_TEMPO, 60 + slot);
+    storage_manager.SaveMulti(slot);
+    storage_manager.Flush();
+  }
+  multi.Set(MULTI_CLOCK_TEMPO, 100);
+  storage_manager.SaveMulti(0);
+  storage_manager.Flush();
+  MultiSnapshot before;
+
+  multi.Set(MULTI_CLOCK_TEMPO, 140);
+  multi.mutable_part(0)->Set(PART_MIDI_PLAY_MODE, PLAY_MODE_SEQUENCER);
+  MultiSnapshot after;
+
+  uint16_t bytes_programmed = storage_manager.bytes_programmed();
+  storage_manager.SaveMulti(0);
+  uint16_t num_polls = 0;
+  // One part per poll, then the multi settings.
+  uint64_t max_pack_cycles = 0;
+  while (storage_manager.saving()) {
+    uint64_t start = ReadCycleCounter();
+    storage_manager.Poll();
+    if (num_polls <= kNumParts) {
+      max_pack_cycles = max(max_pack_cycles, ReadCycleCounter() - start);
+    }
+    ++num_polls;
+  }
+  bytes_programmed = storage_manager.bytes_programmed() - bytes_programmed;
+
+  uint16_t unchanged_bytes = storage_manager.bytes_programmed();
+  storage_manager.SaveMulti(0);
+  storage_manager.Flush();
+  bool skipped_unchanged = storage_manager.bytes_programmed() == \
+      unchanged_bytes;
+
+  // Power loss after each step of the save.
+  uint16_t num_failures = 0;
+  for (uint16_t steps = 0; steps <= num_polls; ++steps) {
+    Init();
+    for (uint8_t slot = 0; slot < kNumMultiSlots; ++slot) {
+      multi.Set(MULTI_CLOCK_TEMPO, 60 + slot);
+      storage_manager.SaveMulti(slot);
+      storage_manager.Flush();
+    }
+    multi.Set(MULTI_CLOCK_TEMPO, 100);
+    storage_manager.SaveMulti(0);
+    storage_manager.Flush();
+
+    multi.Set(MULTI_CLOCK_TEMPO, 140);
+    multi.mutable_part(0)->Set(PART_MIDI_PLAY_MODE, PLAY_MODE_SEQUENCER);
+    storage_manager.SaveMulti(0);
+    for (uint16_t i = 0; i < steps; ++i) {
+      storage_manager.Poll();
+    }
+
+    multi.Init(true);
+    storage_manager.Init();
+    bool loaded = storage_manager.LoadMulti(0);
+    MultiSnapshot loaded_multi;
+    const MultiSnapshot& expected = steps == num_polls ? after : before;
+    if (!loaded || !(loaded_multi == expected)) {
+      ++num_failures;
+    }
+    storage_manager.LoadMulti(1);
+    if (multi.tempo() != 61) {
+      ++num_failures;
+    }
+  }
+
+  double blocking_ms = kPageEraseMs + \
+      sizeof(PackedMulti) / 2 * kHalfWordProgramMs;
+  double chunk_ms = kHalfWordProgramMs * kHalfWordsPerPoll;
+  double dac_lookahead_ms = kDacLatency * 0.5;
+  printf("Multi save: %d polls, %d bytes programmed, unchanged save %s\n",
+      num_polls, bytes_programmed, skipped_unchanged ? "skipped" : "written");
+  printf("  packed over %d polls, longest %.1f us (host)\n",
+      kNumParts + 1, max_pack_cycles / CycleCounterGHz() / 1000.0);
+  printf("  longest main loop stall: %.1f ms (erase), then %.2f ms per poll "
+      "(was %.1f ms)\n", kPageEraseMs, chunk_ms, blocking_ms);
+  printf("  poll step within the %.1f ms DAC lookahead: %s\n",
+      dac_lookahead_ms, chunk_ms < dac_lookahead_ms ? "OK" : "FAIL");
+  printf("  power loss at each step: %d failures\n", num_failures);
+}
+
+void TestJustIntonation() {
+  static JustIntonationProcessor processor;
+  static BruteForceJustIntonation reference;
+  const uint32_t kNumEvents = 200000;
+
+  // Random playing, compared note by note.
+  processor.Init();
+  reference.Init();
+  srand(1);
+  uint32_t num_mismatches = 0;
+  uint8_t held[8] = { 0 };
+  for (uint32_t i = 0; i < kNumEvents; ++i) {
+    uint8_t& key = held[rand() % 8];
+    if (key) {
+      processor.NoteOff(key);
+      reference.NoteOff(key);
+      key = 0;
+    } else {
+      key = 36 + rand() % 48;
+      if (processor.NoteOn(key) != reference.NoteOn(key)) {
+        ++num_mismatches;
+      }
+    }
+  }
+
+  // Worst case: the history is full of held notes with distinct pitches.
+  const uint32_t kNumChords = 20000;
+  uint64_t brute_force_cycles = 0;
+  uint64_t binned_cycles = 0;
+  for (uint32_t chord = 0; chord < kNumChords; ++chord) {
+    processor.Init();
+    reference.Init();
+    for (uint8_t i = 0; i < kHistorySize; ++i) {
+      uint8_t note = 36 + (chord + i * 5) % 60;
+      processor.NoteOn(note);
+      reference.NoteOn(note);
+    }
+    uint8_t note = 36 + (chord * 7) % 60;
+    uint64_t start = ReadCycleCounter();
+    int16_t expected = reference.NoteOn(note);
+    brute_force_cycles += ReadCycleCounter() - start;
+    start = ReadCycleCounter();
+    int16_t actual = processor.NoteOn(note);
+    binned_cycles += ReadCycleCounter() - start;
+    if (actual != expected) {
+      ++num_mismatches;
+    }
+  }
+  printf("Just intonation: %d mismatches\n", static_cast<int>(num_mismatches));
+  printf("  brute force: %.0f cycles/note-on with a full history\n",
+      static_cast<double>(brute_force_cycles) / kNumChords);
+  printf("  binned:      %.0f cycles/note-on with a full history\n",
+      static_cast<double>(binned_cycles) / kNumChords);
+}
+
+// Audio on output 0, envelope on output 1, pitch on output 2, and output 3
+// switching between velocity and envelope.
+void SetUpDacTestOutputs(Voice* voices, CVOutput* outputs) {
+  const DCRole roles[] = { DC_PITCH, DC_AUX_1, DC_PITCH, DC_AUX_2 };
+  for (uint8_t i = 0; i < kNumDacChannels; ++i) {
+    voices[i].Init();
+    outputs[i].Init(true);
+    outputs[i].assign(&voices[i], roles[i], 1);
+    voices[i].envelope()->SetADSR(0xffff, 0x2000, 0x4000, 0x8000, 0x3000);
+  }
+  voices[0].set_oscillator_mode(OSCILLATOR_MODE_DRONE);
+  voices[0].set_oscillator_shape(OSC_SHAPE_CZ_SAW_LP);
+  voices[1].set_aux_cv(MOD_AUX_ENVELOPE);
+}
+
+// Every 100 refresh periods, the main loop stalls for the given number of
+// periods, then catches up over several iterations.
+uint16_t DacUnderrunsWithStalls(uint8_t stall_periods) {
+  static Voice voices[kNumDacChannels];
+  static CVOutput outputs[kNumDacChannels];
+  static DacFrameProducer producer;
+  SetUpDacTestOutputs(voices, outputs);
+  voices[0].NoteOn(60 << 7, 100, 0, true);
+  producer.Init();
+  for (uint32_t r = 0; r < 2000; ++r) {
+    for (uint8_t i = 0; i < kNumDacChannels; ++i) {
+      voices[i].Refresh(i);
+      outputs[i].Refresh();
+    }
+    producer.Capture(outputs);
+    if (r % 100 >= stall_periods) {
+      for (uint8_t n = 0; n < kNumDacSegments; ++n) {
+        for (uint8_t i = 0; i < kNumDacChannels; ++i) {
+          voices[i].RenderSamples();
+        }
+        producer.Render(outputs);
+      }
+    }
+    uint16_t sample;
+    for (uint8_t f = 0; f < kFramesPerRefresh; ++f) {
+      for (uint8_t i = 0; i < kNumDacChannels; ++i) {
+        producer.Read(i, &sample);
+      }
+    }
+  }
+  return producer.underruns();
+}
+
+void TestDacFrameProducer() {
+  const uint32_t kNumRefreshes = 20000;  // 10s at 2kHz
+  static Voice reference_voices[kNumDacChannels];
+  static CVOutput reference_outputs[kNumDacChannels];
+  static Voice voices[kNumDacChannels];
+  static CVOutput outputs[kNumDacChannels];
+  static PerSampleDac reference;
+  static DacFrameProducer producer;
+
+  SetUpDacTestOutputs(reference_voices, reference_outputs);
+  SetUpDacTestOutputs(voices, outputs);
+  reference.Init();
+  producer.Init();
+
+  // The producer plays kDacLatency refresh periods late, and SysTick delays
+  // the DC outputs by as much.
+  const uint8_t kLag = kDacLatency;
+  static uint16_t expected[kNumDacSegments][kFramesPerRefresh][kNumDacChannels];
+  static bool expected_dc[kNumDacSegments][kNumDacChannels];
+  static uint16_t expected_dc_code[kNumDacSegments][kNumDacChannels];
+  uint32_t num_compared = 0;
+  uint32_t num_mismatches = 0;
+  uint64_t reference_cycles = 0;
+  uint64_t producer_cycles = 0;
+  srand(2);
+  for (uint32_t r = 0; r < kNumRefreshes; ++r) {
+    if (r % 50 == 0) {
+      uint8_t v = rand() % kNumDacChannels;
+      int16_t note = (36 + rand() % 48) << 7;
+      uint8_t velocity = 1 + rand() % 127;
+      bool on = rand() % 3;
+      for (uint8_t set = 0; set < 2; ++set) {
+        Voice* voice = set ? &voices[v] : &reference_voices[v];
+        if (on) {
+          voice->NoteOn(note, velocity, 0, true);
+        } else {
+          voice->NoteOff();
+        }
+      }
+    }
+    if (r % 700 == 0) {
+      uint8_t source = (r / 700) & 1 ? MOD_AUX_ENVELOPE : MOD_AUX_VELOCITY;
+      reference_voices[3].set_aux_cv_2(source);
+      voices[3].set_aux_cv_2(source);
+    }
+
+    // SysTick.
+    for (uint8_t i = 0; i < kNumDacChannels; ++i) {
+      reference_voices[i].Refresh(i);
+      reference_outputs[i].Refresh();
+      voices[i].Refresh(i);
+      outputs[i].Refresh();
+    }
+    reference.Refresh(reference_outputs);
+    producer.Capture(outputs);
+    uint16_t cv[kNumDacChannels];
+    bool gate[kNumDacChannels] = { false };
+    for (uint8_t i = 0; i < kNumDacChannels; ++i) {
+      cv[i] = outputs[i].dc_dac_code();
+    }
+    producer.Delay(cv, gate);
+
+    // Main loop, then the DAC interrupt until the next refresh.
+    for (uint8_t i = 0; i < kNumDacChannels; ++i) {
+      reference_voices[i].RenderSamples();
+      voices[i].RenderSamples();
+    }
+    uint16_t (*frames)[kNumDacChannels] = expected[r % kNumDacSegments];
+    uint64_t start = ReadCycleCounter();
+    for (uint8_t f = 0; f < kFramesPerRefresh; ++f) {
+      for (uint8_t i = 0; i < kNumDacChannels; ++i) {
+        frames[f][i] = reference.Sample(reference_outputs, i);
+      }
+    }
+    reference_cycles += ReadCycleCounter() - start;
+    for (uint8_t i = 0; i < kNumDacChannels; ++i) {
+      expected_dc[r % kNumDacSegments][i] = \
+          !reference_outputs[i].is_audio() && \
+          !reference_outputs[i].is_envelope();
+      expected_dc_code[r % kNumDacSegments][i] = \
+          reference_outputs[i].dc_dac_code();
+    }
+
+    start = ReadCycleCounter();
+    producer.Render(outputs);
+    uint16_t actual[kFramesPerRefresh][kNumDacChannels];
+    bool rendered[kNumDacChannels];
+    for (uint8_t f = 0; f < kFramesPerRefresh; ++f) {
+      for (uint8_t i = 0; i < kNumDacChannels; ++i) {
+        rendered[i] = producer.Read(i, &actual[f][i]);
+      }
+    }
+    producer_cycles += ReadCycleCounter() - start;
+    if (r < kLag) {
+      continue;
+    }
+
+    uint8_t played = (r - kLag) % kNumDacSegments;
+    const uint16_t (*previous)[kNumDacChannels] = expected[played];
+    for (uint8_t i = 0; i < kNumDacChannels; ++i) {
+      if (rendered[i] == expected_dc[played][i]) {
+        ++num_mismatches;
+        continue;
+      }
+      for (uint8_t f = 0; f < kFramesPerRefresh; ++f) {
+        // DC outputs hold the value latched by SysTick.
+        uint16_t sample = rendered[i] ? actual[f][i] : cv[i];
+        uint16_t reference_sample = rendered[i]
+            ? previous[f][i] : expected_dc_code[played][i];
+        num_mismatches += sample != reference_sample;
+        ++num_compared;
+      }
+    }
+  }
+  printf("DAC frame producer: %d mismatches over %d samples, %d underruns\n",
+      static_cast<int>(num_mismatches),
+      static_cast<int>(num_compared),
+      static_cast<int>(producer.underruns()));
+  double num_frames = kNumRefreshes * kFramesPerRefresh;
+  printf("  per sample: %.1f cycles/frame\n", reference_cycles / num_frames);
+  printf("  per block:  %.1f cycles/frame (render + read)\n",
+      producer_cycles / num_frames);
+  printf("  main loop stalls of 2.0ms: %d underruns, 3.0ms: %d underruns\n",
+      static_cast<int>(DacUnderrunsWithStalls(4)),
+      static_cast<int>(DacUnderrunsWithStalls(6)));
+}
+
+void TestInternalClock() {
+  const uint32_t kNumSysTicks = 8000 * 600;  // 10 minutes
+  const uint32_t kSysTicksPerChange = 8000 * 10;
+  static PerSampleInternalClock reference;
+  static InternalClock clock;
+  static SyncedLFO estimated_lfo;
+  static SyncedLFO locked_lfo;
+  const TickPhase kExternal = { 0, 0 };
+  const uint16_t kLFOPeriodTicks = 24;
+
+  srand(3);
+  uint32_t tempo = 120;
+  uint8_t swing = 0;
+  reference.Start(tempo, swing);
+  clock.Start(tempo, swing);
+  estimated_lfo.Init();
+  locked_lfo.Init();
+
+  uint32_t num_ticks = 0;
+  uint32_t num_mismatches = 0;
+  // Phase errors of the LFOs at each CV refresh, in 1/65536 of a cycle, once
+  // they have had a bar to settle after a tempo change.
+  uint32_t max_error[2] = { 0, 0 };
+  uint64_t sum_error[2] = { 0, 0 };
+  uint32_t num_errors = 0;
+  uint32_t ticks_since_change = 0;
+  for (uint32_t t = 0; t < kNumSysTicks; ++t) {
+    if (t && t % kSysTicksPerChange == 0) {
+      tempo = 40 + rand() % 200;
+      swing = rand() % 2 ? rand() % 100 : 0;
+      reference.set_tempo(tempo);
+      reference.set_swing(swing);
+      clock.set_tempo(tempo);
+      clock.set_swing(swing);
+      ticks_since_change = 0;
+    }
+
+    uint8_t expected = 0;
+    for (uint8_t i = 0; i < kClockSamplesPerSysTick; ++i) {
+      expected += reference.Process();
+    }
+    uint8_t actual = clock.Advance(kClockSamplesPerSysTick);
+    num_mismatches += actual != expected;
+
+    for (uint8_t i = 0; i < actual; ++i) {
+      estimated_lfo.Tap(kLFOPeriodTicks, kExternal);
+      locked_lfo.Tap(kLFOPeriodTicks, clock.tick_phase());
+      ++num_ticks;
+      ++ticks_since_change;
+    }
+    if (t % 4 == 0) {
+      estimated_lfo.Refresh();
+      locked_lfo.Refresh();
+      if (num_ticks && !swing && ticks_since_change > 96) {
+        uint32_t counter = (num_ticks - 1) % kLFOPeriodTicks;
+        uint32_t target = ((counter << 16) + (clock.tick_phase().phase >> 16)) \
+            / kLFOPeriodTicks;
+        const SyncedLFO* lfos[] = { &estimated_lfo, &locked_lfo };
+        for (uint8_t i = 0; i < 2; ++i) {
+          int16_t error = (lfos[i]->GetPhase() >> 16) - target;
+          uint32_t e = abs(error);
+          max_error[i] = max(max_error[i], e);
+          sum_error[i] += e;
+        }
+        ++num_errors;
+      }
+    }
+  }
+  printf("Internal clock: %d ticks, %d mismatches\n",
+      static_cast<int>(num_ticks), static_cast<int>(num_mismatches));
+
+  // Cost of one second of clock.
+  uint32_t sink = 0;
+  uint64_t start = ReadCycleCounter();
+  for (uint32_t t = 0; t < 48000; ++t) {
+    sink += reference.Process();
+  }
+  uint64_t reference_cycles = ReadCycleCounter() - start;
+  start = ReadCycleCounter();
+  for (uint32_t t = 0; t < 8000; ++t) {
+    sink += clock.Advance(kClockSamplesPerSysTick);
+  }
+  uint64_t scheduled_cycles = ReadCycleCounter() - start;
+  printf("  per sample: %.0f, scheduled: %.0f cycles/s (%d ticks)\n",
+      static_cast<double>(reference_cycles),
+      static_cast<double>(scheduled_cycles),
+      static_cast<int>(sink / 2));
+  const char* names[] = { "estimated", "locked" };
+  for (uint8_t i = 0; i < 2; ++i) {
+    printf("  %-9s LFO: phase error mean %.2f%%, max %.2f%% of a cycle\n",
+        names[i],
+        100.0 * sum_error[i] / num_errors / 65536,
+        100.0 * max_error[i] / 65536);
+  }
+}
+
+void TestClockEventQueue() {
+  const uint32_t kNumTicks = 8000 * 600;
+  static ClockEventQueue queue;
+  // Reference: one countdown per pending event, decremented at every tick.
+  struct Countdown {
+    int32_t remaining;
+    uint8_t type;
+    uint16_t data;
+  };
+  vector<Countdown> countdowns;
+
+  queue.Init();
+  srand(4);
+  uint32_t num_fired = 0;
+  uint32_t num_mismatches = 0;
+  for (uint32_t t = 0; t < kNumTicks; ++t) {
+    if (rand() % 50 == 0 && countdowns.size() < 6) {
+      Countdown c;
+      c.type = rand() % 4;
+      c.data = rand() & 0xffff;
+      c.remaining = rand() % 4 ? rand() % 40 : rand() % 2000;
+      queue.Post(c.type, c.data, c.remaining);
+      countdowns.push_back(c);
+    } else if (rand() % 5000 == 0) {
+      uint8_t type = rand() % 4;
+      queue.PostCancel(type);
+      for (size_t i = 0; i < countdowns.size(); ) {
+        if (countdowns[i].type == type) {
+          countdowns.erase(countdowns.begin() + i);
+        } else {
+          ++i;
+        }
+      }
+    }
+
+    queue.Tick();
+    vector<Countdown> expected;
+    for (size_t i = 0; i < countdowns.size(); ) {
+      if (countdowns[i].remaining == 0) {
+        expected.push_back(countdowns[i]);
+        countdowns.erase(countdowns.begin() + i);
+      } else {
+        --countdowns[i].remaining;
+        ++i;
+      }
+    }
+    ClockEvent event;
+    size_t num_events = 0;
+    while (queue.Poll(&event)) {
+      if (num_events >= expected.size() ||
+          event.type != expected[num_events].type ||
+          event.data != expected[num_events].data) {
+        ++num_mismatches;
+      }
+      ++num_events;
+    }
+    num_mismatches += num_events != expected.size();
+    num_fired += num_events;
+  }
+  printf("Clock event queue: %d events, %d mismatches, %d overflows\n",
+      static_cast<int>(num_fired),
+      static_cast<int>(num_mismatches),
+      static_cast<int>(queue.overflows()));
+}
+
+const uint8_t kNumModulationVoices = 4;
+
+void InitModulationVoices(
+    Voice* voices,
+    HardWiredVoice* references,
+    bool audio,
+    bool modulated) {
+  uint8_t vibrato_mod = modulated ? 64 : 0;
+  uint8_t tremolo_mod = modulated ? 80 : 0;
+  uint8_t timbre_mod_lfo = modulated ? 50 : 0;
+  int16_t timbre_mod_envelope = modulated ? -12000 : 0;
+  uint16_t pitch_bend = modulated ? 11000 : 8192;
+  for (uint8_t v = 0; v < kNumModulationVoices; ++v) {
+    Voice* voice = &voices[v];
+    voice->Init();
+    voice->set_tuning(0, 0);
+    voice->oscillator()->Init(-8192, 32768);
+    voice->set_has_audio_listener(audio);
+    voice->set_oscillator_mode(OSCILLATOR_MODE_ENVELOPED);
+    voice->envelope()->SetADSR(0xffff, 0x1000, 0x4000, 0x8000, 0x4000);
+    voice->set_vibrato_range(2);
+    voice->set_vibrato_mod(vibrato_mod);
+    voice->set_tremolo_mod(tremolo_mod);
+    voice->set_tremolo_shape(LFO_SHAPE_SAW_DOWN);
+    voice->set_timbre_init(40);
+    voice->set_timbre_mod_lfo(timbre_mod_lfo);
+    voice->set_timbre_mod_envelope(timbre_mod_envelope);
+    voice->PitchBend(pitch_bend);
+    voice->NoteOn((48 + 7 * v) << 7, 100, 0, false);
+
+    HardWiredVoice* reference = &references[v];
+    reference->Init(-8192, 32768);
+    reference->set_oscillator_mode(OSCILLATOR_MODE_ENVELOPED);
+    reference->envelope()->SetADSR(0xffff, 0x1000, 0x4000, 0x8000, 0x4000);
+    reference->set_vibrato_range(2);
+    reference->set_vibrato_mod(vibrato_mod);
+    reference->set_tremolo_mod(tremolo_mod);
+    reference->set_tremolo_shape(LFO_SHAPE_SAW_DOWN);
+    reference->set_timbre_init(40);
+    reference->set_timbre_mod_lfo(timbre_mod_lfo);
+    reference->set_timbre_mod_envelope(timbre_mod_envelope);
+    reference->PitchBend(pitch_bend);
+    reference->NoteOn((48 + 7 * v) << 7, 100);
+  }
+}
+
+template<typename T>
+uint64_t RefreshModulationVoices(T* voices, uint32_t num_refreshes) {
+  uint64_t start = ReadCycleCounter();
+  for (uint32_t i = 0; i < num_refreshes; ++i) {
+    for (uint8_t v = 0; v < kNumModulationVoices; ++v) {
+      voices[v].envelope()->RenderSamples();
+      voices[v].Refresh(v);
+    }
+  }
+  return ReadCycleCounter() - start;
+}
+
+uint64_t RefreshModulationOscillators(Voice* voices, uint32_t num_blocks) {
+  uint64_t start = ReadCycleCounter();
+  for (uint32_t i = 0; i < num_blocks; ++i) {
+    for (uint8_t v = 0; v < kNumModulationVoices; ++v) {
+      voices[v].RefreshOscillator();
+    }
+  }
+  return ReadCycleCounter() - start;
+}
+
+void TestModulationMatrix() {
+  const uint32_t kNumRefreshes = 2000 * 20;
+  // The hard-wired amounts were slewed; compare once they have settled.
+  const uint32_t kSettleRefreshes = 2000;
+  const uint32_t kNumTimedRefreshes = 500;
+  const uint16_t kNumTrials = 400;
+  static Voice voices[kNumModulationVoices];
+  static HardWiredVoice references[kNumModulationVoices];
+
+  printf("Modulation matrix: %d voices, %d refreshes\n",
+      kNumModulationVoices, static_cast<int>(kNumRefreshes));
+  bool pass = true;
+  for (uint8_t scenario = 0; scenario < 4; ++scenario) {
+    bool audio = scenario & 1;
+    bool modulated = scenario & 2;
+
+    int32_t pitch_error = 0;
+    int32_t timbre_error = 0;
+    int32_t gain_error = 0;
+    int32_t aux_error = 0;
+    InitModulationVoices(voices, references, audio, modulated);
+    for (uint32_t i = 0; i < kNumRefreshes; ++i) {
+      RefreshModulationVoices(voices, 1);
+      RefreshModulationVoices(references, 1);
+      if (i < kSettleRefreshes) {
+        continue;
+      }
+      for (uint8_t v = 0; v < kNumModulationVoices; ++v) {
+        Voice* voice = &voices[v];
+        HardWiredVoice* reference = &references[v];
+        pitch_error = std::max(pitch_error,
+            abs(voice->note() - reference->note()));
+        aux_error = std::max(aux_error,
+            abs(voice->mod_aux(MOD_AUX_VIBRATO_LFO) -
+                reference->mod_aux(MOD_AUX_VIBRATO_LFO)));
+        aux_error = std::max(aux_error,
+            abs(voice->mod_aux(MOD_AUX_ENVELOPE) -
+                reference->mod_aux(MOD_AUX_ENVELOPE)));
+        if (audio) {
+          voice->RefreshOscillator();
+          timbre_error = std::max(timbre_error,
+              abs(voice->oscillator()->timbre_target() -
+                  reference->oscillator()->timbre_target()));
+          gain_error = std::max(gain_error,
+              abs(voice->oscillator()->gain_target() -
+                  reference->oscillator()->gain_target()));
+        }
+      }
+    }
+
+    // Short interleaved batches, keeping the fastest of each, so that both
+    // see the same host clock and interruptions.
+    uint64_t matrix_cycles = ~0ULL;
+    uint64_t hard_wired_cycles = ~0ULL;
+    uint64_t hand_off_cycles = ~0ULL;
+    InitModulationVoices(voices, references, audio, modulated);
+    for (uint16_t trial = 0; trial < kNumTrials; ++trial) {
+      if (trial & 1) {
+        matrix_cycles = std::min(matrix_cycles,
+            RefreshModulationVoices(voices, kNumTimedRefreshes));
+      }
+      hard_wired_cycles = std::min(hard_wired_cycles,
+          RefreshModulationVoices(references, kNumTimedRefreshes));
+      if (!(trial & 1)) {
+        matrix_cycles = std::min(matrix_cycles,
+            RefreshModulationVoices(voices, kNumTimedRefreshes));
+      }
+      if (audio) {
+        hand_off_cycles = std::min(hand_off_cycles,
+            RefreshModulationOscillators(voices, kNumTimedRefreshes));
+      }
+    }
+
+    // The hard-wired voice handed its targets over to the oscillator at every
+    // refresh, in the ISR. The matrix does it from the main loop, once per
+    // block.
+    bool ok = matrix_cycles <= hard_wired_cycles;
+    pass = pass && ok;
+    printf("  %-9s %-5s hard-wired %.1f, matrix %.1f cycles/refresh %s\n",
+        modulated ? "modulated" : "static",
+        audio ? "audio" : "CV",
+        static_cast<double>(hard_wired_cycles) / kNumTimedRefreshes,
+        static_cast<double>(matrix_cycles) / kNumTimedRefreshes,
+        ok ? "OK" : "FAIL");
+    if (audio) {
+      printf("    + %.1f cycles/block for the oscillator hand-off\n",
+          static_cast<double>(hand_off_cycles) / kNumTimedRefreshes);
+    }
+    printf("    max error: pitch %d, timbre %d, gain %d, aux %d LSB\n",
+        static_cast<int>(pitch_error),
+        static_cast<int>(timbre_error),
+        static_cast<int>(gain_error),
+        static_cast<int>(aux_error));
+  }
+  printf("  Refresh cost at %d voices: %s\n", kNumModulationVoices,
+      pass ? "OK" : "FAIL");
+}
+
+// Held chords change at random while part 0 arpeggiates, or transposes a
+// random sequence, at a fast clock.
+void BuildLookaheadSession(
+    vector<TimedMidiByte>* bytes,
+    uint32_t duration_ms) {
+  vector<uint8_t> held;
+  bool sustain = false;
+  for (uint32_t t = 0; t < duration_ms; t += 40 + rand() % 400) {
+    uint64_t time_ns = t * 1000000ULL;
+    if (rand() % 8 == 0) {
+      sustain = !sustain;
+      AppendMessage(bytes, time_ns, 0xb0, 64, sustain ? 127 : 0);
+    }
+    if (!held.empty() && (held.size() >= 4 || rand() % 2)) {
+      size_t i = rand() % held.size();
+      AppendMessage(bytes, time_ns, 0x80, held[i], 0);
+      held.erase(held.begin() + i);
+    } else {
+      uint8_t note = 48 + rand() % 24;
+      AppendMessage(bytes, time_ns, 0x90, note, 1 + rand() % 127);
+      held.push_back(note);
+    }
+  }
+}
+
+void TestStepLookahead() {
+  const uint8_t kNumSessions = 6;
+  const uint32_t kDurationMs = 10000;
+  const uint64_t kSysTickNs = 1000000000ULL / kSysTickRate;
+
+  printf("Step lookahead, %d sessions:\n", kNumSessions);
+  uint32_t num_mismatches = 0;
+  uint32_t num_steps = 0;
+  uint32_t num_hits = 0;
+  // Cost of the SysTicks that play a step.
+  static Histogram step_cycles[2];
+  step_cycles[0].Init();
+  step_cycles[1].Init();
+  for (uint8_t session = 0; session < kNumSessions; ++session) {
+    srand(session + 1);
+    vector<TimedMidiByte> bytes;
+    BuildLookaheadSession(&bytes, kDurationMs);
+    bool sequencer = session & 1;
+    uint8_t clock_division = 29 + rand() % 3;
+    uint8_t arp_direction = rand() % 2 ? \
+        ARPEGGIATOR_DIRECTION_UP_DOWN : ARPEGGIATOR_DIRECTION_LINEAR;
+    uint8_t arp_range = rand() % 4;
+    uint8_t arp_pattern = 1 + rand() % 8;
+    SequencerStep steps[kNumSteps];
+    uint8_t sequence_length = 1 + rand() % kNumSteps;
+    for (uint8_t i = 0; i < sequence_length; ++i) {
+      uint8_t type = rand() % 8;
+      steps[i] = SequencerStep(
+          type == 0 ? SEQUENCER_STEP_REST :
+              type == 1 ? SEQUENCER_STEP_TIE : 48 + rand() % 24,
+          (rand() % 4 == 0 ? 0x80 : 0) | (1 + rand() % 127));
+    }
+
+    // The same session, played with and without the lookahead.
+    vector<uint32_t> trace[2];
+    for (uint8_t enabled = 0; enabled < 2; ++enabled) {
+      Init();
+      multi.Set(MULTI_CLOCK_TEMPO, 240);
+      Part* part = multi.mutable_part(0);
+      part->set_lookahead_enabled(enabled);
+      part->Set(PART_MIDI_PLAY_MODE,
+          sequencer ? PLAY_MODE_SEQUENCER : PLAY_MODE_ARPEGGIATOR);
+      part->Set(PART_SEQUENCER_CLOCK_QUANTIZATION, 1);
+      part->Set(PART_SEQUENCER_CLOCK_DIVISION, clock_division);
+      part->Set(PART_SEQUENCER_ARP_DIRECTION, arp_direction);
+      part->Set(PART_SEQUENCER_ARP_RANGE, arp_range);
+      part->Set(PART_SEQUENCER_ARP_PATTERN, arp_pattern);
+      if (sequencer) {
+        SequencerSettings* seq = part->mutable_sequencer_settings();
+        copy(&steps[0], &steps[sequence_length], &seq->step[0]);
+        seq->num_steps = sequence_length;
+      }
+      multi.Start(false);
+      midi_in.Init(bytes);
+      while (now_ns < midi_in.duration_ns() + kSysTickNs) {
+        uint32_t played = part->lookahead_hits() + part->lookahead_misses();
+        uint64_t start = ReadCycleCounter();
+        SysTick();
+        uint64_t cycles = ReadCycleCounter() - start;
+        if (part->lookahead_hits() + part->lookahead_misses() != played) {
+          step_cycles[enabled].Add(cycles);
+        }
+        for (uint32_t i = 0; i < kDacTicksPerSysTick; ++i) {
+          DacTick();
+        }
+        MainLoop();
+        if (refresh_counter == 0) {
+          trace[enabled].push_back((cv[0] << 1) | gate[0]);
+        }
+        now_ns += kSysTickNs;
+      }
+      if (enabled) {
+        num_hits += part->lookahead_hits();
+        num_steps += part->lookahead_hits() + part->lookahead_misses();
+      }
+    }
+    for (size_t i = 0; i < trace[0].size(); ++i) {
+      num_mismatches += i >= trace[1].size() || trace[0][i] != trace[1][i];
+    }
+  }
+  printf("  %d steps, %.1f%% from the lookahead, %d CV/gate mismatches: %s\n",
+      static_cast<int>(num_steps),
+      100.0 * num_hits / num_steps,
+      static_cast<int>(num_mismatches),
+      num_mismatches ? "FAIL" : "OK");
+  const char* names[] = { "resolved inline", "from the lookahead" };
+  for (uint8_t i = 0; i < 2; ++i) {
+    printf("  SysTick with a step %-18s: mean %.0f, p99 %d cycles\n",
+        names[i],
+        step_cycles[i].mean(),
+        static_cast<int>(step_cycles[i].Percentile(0.99)));
+  }
+}
+
+int main(int argc, char** argv) {
+  TestMidiOutputEncoder();
+  TestEnvelope();
+  TestPhaseIncrementCache();
+  TestParaphonicOscillator();
+  TestWavetableOscillator();
+  TestDacFrameProducer();
+  TestInternalClock();
+  TestClockEventQueue();
+  TestModulationMatrix();
+  TestStepLookahead();
+  TestJustIntonation();
+  TestMidiReplay(argc > 1 ? argv[1] : NULL);
+  TestLooper();
+  TestStorageManager();
+  return 0;
+}
@@ -52,18 +52,18 @@ void Voice::Init() {
   note_source_ = note_target_ = note_portamento_ = 60 << 7;
   gate_ = false;
   
+  modulation_.Init();
   mod_velocity_ = 0x7f;
+  modulation_.set_source(MOD_SOURCE_VELOCITY, mod_velocity_ << 8);
+  vibrato_range_ = 0;
   ResetAllControllers();
   
   modulation_increment_ = lut_lfo_increments[50];
   modulation_sync_ticks_ = 0;
-  pitch_bend_range_ = 2;
-  vibrato_range_ = 0;
+  set_pitch_bend_range(2);
 
-  tremolo_mod_current_ = 0;
-  timbre_mod_lfo_current_ = 0;
-  timbre_mod_envelope_current_ = 0;
-  timbre_init_current_ = 0;
+  timbre_init_ = 0;
+  tremolo_drone_ = UINT16_MAX;
   
   synced_lfo_.Init();
   envelope_.Init();
@@ -91,7 +91,7 @@ void CVOutput::Init(bool reset_calibration) {
   }
   dirty_ = false;
 
-  dac_interpolator_.Init(24);
+  dc_dac_code_ = 0;
 }
 
 void CVOutput::Calibrate(uint16_t* calibrated_dac_code) {
@@ -127,9 +127,12 @@ void CVOutput::NoteToDacCode() {
 }
 
 void Voice::ResetAllControllers() {
-  mod_pitch_bend_ = 8192;
-  vibrato_mod_ = 0;
   std::fill(&mod_aux_[0], &mod_aux_[MOD_AUX_LAST - 1], 0);
+  mod_aux_[MOD_AUX_VELOCITY] = mod_velocity_ << 9;
+  PitchBend(8192);
+  Aftertouch(0);
+  modulation_.set_source(MOD_SOURCE_BREATH, 0);
+  set_vibrato_mod(0);
 }
 
 void Voice::set_modulation_rate(uint8_t modulation_rate, uint8_t index) {
@@ -145,34 +148,24 @@ void Voice::set_modulation_rate(uint8_t modulation_rate, uint8_t index) {
 }
 
 void Voice::Refresh(uint8_t voice_index) {
-  // Slew coarse inputs to avoid clicks
-  tremolo_mod_current_ = stmlib::slew(
-    tremolo_mod_current_, tremolo_mod_target_);
-  timbre_init_current_ = stmlib::slew(
-    timbre_init_current_, timbre_init_target_);
-  timbre_mod_lfo_current_ = stmlib::slew(
-    timbre_mod_lfo_current_, timbre_mod_lfo_target_);
-  timbre_mod_envelope_current_ = stmlib::slew(
-    timbre_mod_envelope_current_, timbre_mod_envelope_target_);
-
   // Compute base pitch with portamento.
-  portamento_phase_ += portamento_phase_increment_;
-  if (portamento_phase_ < portamento_phase_increment_) {
-    portamento_phase_ = 0;
-    portamento_phase_increment_ = 0;
-    note_source_ = note_target_;
+  int32_t note = note_target_;
+  if (portamento_phase_increment_) {
+    portamento_phase_ += portamento_phase_increment_;
+    if (portamento_phase_ < portamento_phase_increment_) {
+      portamento_phase_ = 0;
+      portamento_phase_increment_ = 0;
+      note_source_ = note_target_;
+    }
+    uint16_t portamento_level = portamento_exponential_shape_
+        ? Interpolate824(lut_env_expo, portamento_phase_)
+        : portamento_phase_ >> 16;
+    note = note_source_ + \
+        ((note_target_ - note_source_) * portamento_level >> 16);
   }
-  uint16_t portamento_level = portamento_exponential_shape_
-      ? Interpolate824(lut_env_expo, portamento_phase_)
-      : portamento_phase_ >> 16;
-  int32_t note = note_source_ + \
-      ((note_target_ - note_source_) * portamento_level >> 16);
 
   note_portamento_ = note;
   
-  // Add pitch-bend.
-  note += static_cast<int32_t>(mod_pitch_bend_ - 8192) * pitch_bend_range_ >> 6;
-  
   // Add transposition/fine tuning.
   note += tuning_;
   
@@ -185,35 +178,24 @@ void Voice::Refresh(uint8_t voice_index) {
   }
   // Use voice index to put voice LFOs in quadrature
   uint32_t lfo_phase = synced_lfo_.GetPhase();// + (voice_index << 30);
-
-  // Add vibrato.
-  int32_t vibrato_lfo = synced_lfo_.shape(LFO_SHAPE_TRIANGLE, lfo_phase);
-  int32_t scaled_vibrato_lfo = vibrato_lfo * vibrato_mod_;
-  note += scaled_vibrato_lfo * vibrato_range_ >> 15;
-
-  // Use quadrature phase for timbre modulation
-  int32_t timbre_lfo = synced_lfo_.shape(LFO_SHAPE_TRIANGLE, lfo_phase);
-  int32_t timbre_envelope_31 = envelope_.value() * timbre_mod_envelope_current_;
-  int32_t timbre_15 =
-    (timbre_init_current_ >> (16 - 15)) +
-    (timbre_envelope_31 >> (31 - 15)) +
-    (timbre_lfo * timbre_mod_lfo_current_ >> (31 - 15));
-  CONSTRAIN(timbre_15, 0, (1 << 15) - 1);
-
-  uint16_t tremolo_lfo = 32767 - synced_lfo_.shape(tremolo_shape_, lfo_phase);
-  uint16_t scaled_tremolo_lfo = tremolo_lfo * tremolo_mod_current_ >> 16;
-  uint16_t tremolo_drone = UINT16_MAX - scaled_tremolo_lfo;
+  int16_t lfo = synced_lfo_.shape(LFO_SHAPE_TRIANGLE, lfo_phase);
+  int16_t lfo_unipolar = modulation_.used(MOD_SOURCE_LFO_UNIPOLAR)
+      ? (32767 - synced_lfo_.shape(tremolo_shape_, lfo_phase)) >> 1
+      : 0;
+  modulation_.Process(envelope_.value() >> 1, lfo, lfo_unipolar);
+
+  // Add pitch-bend and vibrato.
+  note += modulation_.destination(MOD_DESTINATION_PITCH);
+
+  int32_t attenuation = modulation_.destination(MOD_DESTINATION_GAIN) << 1;
+  CONSTRAIN(attenuation, 0, UINT16_MAX);
+  uint16_t tremolo_drone = UINT16_MAX - attenuation;
   uint16_t tremolo_envelope = envelope_.value() * tremolo_drone >> 16;
-  uint16_t gain = oscillator_mode_ == OSCILLATOR_MODE_ENVELOPED ?
-    tremolo_envelope : tremolo_drone;
-
-  oscillator_.Refresh(note, timbre_15, gain);
+  tremolo_drone_ = tremolo_drone;
 
-  mod_aux_[MOD_AUX_VELOCITY] = mod_velocity_ << 9;
-  mod_aux_[MOD_AUX_MODULATION] = vibrato_mod_ << 9;
-  mod_aux_[MOD_AUX_BEND] = static_cast<uint16_t>(mod_pitch_bend_) << 2;
-  mod_aux_[MOD_AUX_VIBRATO_LFO] = (scaled_vibrato_lfo >> 7) + 32768;
-  mod_aux_[MOD_AUX_FULL_LFO] = vibrato_lfo + 32768;
+  mod_aux_[MOD_AUX_VIBRATO_LFO] = \
+      modulation_.destination(MOD_DESTINATION_AUX_CV) + 32768;
+  mod_aux_[MOD_AUX_FULL_LFO] = lfo + 32768;
   mod_aux_[MOD_AUX_ENVELOPE] = tremolo_envelope;
 
   if (retrigger_delay_) {
@@ -238,8 +220,8 @@ void Voice::Refresh(uint8_t voice_index) {
 void CVOutput::Refresh() {
   if (is_audio()) return;
   if (dc_role_ == DC_PITCH) NoteToDacCode();
-  dac_interpolator_.SetTarget((this->*dc_fn_table_[dc_role_])() >> 1);
-  dac_interpolator_.ComputeSlope();
+  // Envelopes are ramped by the DAC frame producer at 15-bit resolution.
+  dc_dac_code_ = (this->*dc_fn_table_[dc_role_])() & 0xfffe;
 }
 
 void Voice::NoteOn(
@@ -266,6 +248,8 @@ void Voice::NoteOn(
   }
 
   mod_velocity_ = velocity;
+  mod_aux_[MOD_AUX_VELOCITY] = velocity << 9;
+  modulation_.set_source(MOD_SOURCE_VELOCITY, velocity << 8);
 
   if (gate_ && trigger) {
     retrigger_delay_ = 3;
@@ -289,6 +273,7 @@ void Voice::ControlChange(uint8_t controller, uint8_t value) {
   switch (controller) {
     case kCCBreathController:
       mod_aux_[MOD_AUX_BREATH] = value << 9;
+      modulation_.set_source(MOD_SOURCE_BREATH, value << 8);
       break;
       
     case kCCFootPedalMsb:
@@ -34,8 +34,9 @@
 #include "stmlib/utils/ring_buffer.h"
 
 #include "yarns/envelope.h"
+#include "yarns/modulation_matrix.h"
 #include "yarns/oscillator.h"
-#include "yarns/interpolator.h"
+#include "yarns/paraphonic_oscillator.h"
 #include "yarns/synced_lfo.h"
 #include "yarns/part.h"
 
@@ -96,26 +97,37 @@ class Voice {
   void NoteOff();
   void ControlChange(uint8_t controller, uint8_t value);
   void PitchBend(uint16_t pitch_bend) {
-    mod_pitch_bend_ = pitch_bend;
+    mod_aux_[MOD_AUX_BEND] = pitch_bend << 2;
+    modulation_.set_source(
+        MOD_SOURCE_BEND, static_cast<int16_t>(pitch_bend - 8192) << 2);
   }
   void Aftertouch(uint8_t velocity) {
     mod_aux_[MOD_AUX_AFTERTOUCH] = velocity << 9;
+    modulation_.set_source(MOD_SOURCE_AFTERTOUCH, velocity << 8);
   }
 
-  inline void Clock() {
+  inline void Clock(const TickPhase& tick) {
     if (!modulation_sync_ticks_) { return; }
-    synced_lfo_.Tap(modulation_sync_ticks_);
+    synced_lfo_.Tap(modulation_sync_ticks_, tick);
   }
   void set_modulation_rate(uint8_t modulation_rate, uint8_t index);
   inline void set_pitch_bend_range(uint8_t pitch_bend_range) {
-    pitch_bend_range_ = pitch_bend_range;
+    modulation_.set_amount(
+        MOD_SOURCE_BEND, MOD_DESTINATION_PITCH, pitch_bend_range << 7);
   }
   inline void set_vibrato_range(uint8_t vibrato_range) {
     vibrato_range_ = vibrato_range;
+    UpdateVibratoRoutes();
+  }
+  inline void set_vibrato_mod(uint8_t n) {
+    vibrato_mod_ = n;
+    mod_aux_[MOD_AUX_MODULATION] = n << 9;
+    UpdateVibratoRoutes();
   }
-  inline void set_vibrato_mod(uint8_t n) { vibrato_mod_ = n; }
   inline void set_tremolo_mod(uint8_t n) {
-    tremolo_mod_target_ = n << (16 - 7); }
+    modulation_.set_amount(
+        MOD_SOURCE_LFO_UNIPOLAR, MOD_DESTINATION_GAIN, n << (15 - 7));
+  }
   inline void set_tremolo_shape(uint8_t n) {
     tremolo_shape_ = static_cast<LFOShape>(n); }
 
@@ -155,11 +167,13 @@ class Voice {
     oscillator_.set_shape(static_cast<OscillatorShape>(s));
   }
   inline void set_timbre_init(uint8_t n) {
-    timbre_init_target_ = n << (16 - 7); }
+    timbre_init_ = n << (15 - 7); }
   inline void set_timbre_mod_lfo(uint8_t n) {
-    timbre_mod_lfo_target_ = n << (16 - 7); }
+    modulation_.set_amount(
+        MOD_SOURCE_LFO, MOD_DESTINATION_TIMBRE, n << (15 - 7));
+  }
   inline void set_timbre_mod_envelope(int16_t n) {
-    timbre_mod_envelope_target_ = n;
+    modulation_.set_amount(MOD_SOURCE_ENVELOPE, MOD_DESTINATION_TIMBRE, n);
   }
   
   inline void set_tuning(int8_t coarse, int8_t fine) {
@@ -187,18 +201,47 @@ class Voice {
     return &envelope_;
   }
 
+  inline ModulationMatrix* modulation() {
+    return &modulation_;
+  }
+
+  // Hands the latest modulation over to the oscillator, once per block. The
+  // oscillator ramps timbre and gain towards these targets over the block.
+  inline void RefreshOscillator() {
+    modulation_.ProcessTimbre();
+    int32_t timbre_15 = timbre_init_ + \
+        modulation_.destination(MOD_DESTINATION_TIMBRE);
+    CONSTRAIN(timbre_15, 0, (1 << 15) - 1);
+    uint16_t gain = oscillator_mode_ == OSCILLATOR_MODE_ENVELOPED ?
+      mod_aux_[MOD_AUX_ENVELOPE] : tremolo_drone_;
+    oscillator_.Refresh(note_, timbre_15, gain);
+  }
+
   inline void RenderSamples() {
     envelope_.RenderSamples();
-    if (uses_audio()) oscillator_.Render();
+    if (uses_audio() && oscillator_.writable() >= kAudioBlockSize) {
+      RefreshOscillator();
+      oscillator_.Render();
+    }
   }
   inline uint16_t ReadSample() {
     return oscillator_.ReadSample();
   }
   
  private:
+  // The vibrato amount is the product of two settings, and the mod wheel also
+  // scales the LFO sent to the aux CV outputs.
+  inline void UpdateVibratoRoutes() {
+    modulation_.set_amount(
+        MOD_SOURCE_LFO, MOD_DESTINATION_PITCH, vibrato_mod_ * vibrato_range_);
+    modulation_.set_amount(
+        MOD_SOURCE_LFO, MOD_DESTINATION_AUX_CV, vibrato_mod_ << (15 - 7));
+  }
+
   SyncedLFO synced_lfo_;
   Envelope envelope_;
   Oscillator oscillator_;
+  ModulationMatrix modulation_;
 
   int32_t note_source_;
   int32_t note_target_;
@@ -207,11 +250,9 @@ class Voice {
   int32_t tuning_;
   bool gate_;
   
-  int16_t mod_pitch_bend_;
   uint16_t mod_aux_[MOD_AUX_LAST];
   uint8_t mod_velocity_;
   
-  uint8_t pitch_bend_range_;
   uint32_t modulation_increment_;
   uint16_t modulation_sync_ticks_;
   uint8_t vibrato_range_;
@@ -240,15 +281,8 @@ class Voice {
   uint32_t trigger_phase_increment_;
   uint32_t trigger_phase_;
 
-  uint16_t tremolo_mod_target_;
-  uint16_t tremolo_mod_current_;
-
-  uint16_t timbre_mod_lfo_target_;
-  uint16_t timbre_mod_lfo_current_;
-  uint16_t timbre_init_target_;
-  uint16_t timbre_init_current_;
-  int16_t timbre_mod_envelope_target_;
-  int16_t timbre_mod_envelope_current_;
+  int16_t timbre_init_;
+  uint16_t tremolo_drone_;
 
   bool has_audio_listener_;
 
@@ -276,10 +310,16 @@ class CVOutput {
     int32_t offset = volts_dac_code(0);
     // Combined audio amplitude 4Vpp
     int32_t scale = (offset - volts_dac_code(4)) / num_audio_voices_;
+    if (num_audio_voices_ > 1) {
+      paraphonic_oscillator.Init(num_audio_voices_, offset);
+    }
     for (uint8_t i = 0; i < num_audio_voices_; ++i) {
       Voice* audio_voice = audio_voices_[i] = dc_voice_ + i;
       audio_voice->oscillator()->Init(scale, offset);
       audio_voice->set_has_audio_listener(true);
+      if (num_audio_voices_ > 1) {
+        paraphonic_oscillator.set_oscillator(i, audio_voice->oscillator());
+      }
     }
   }
 
@@ -303,7 +343,21 @@ class CVOutput {
       (dc_role_ == DC_AUX_2 && dc_voice_->aux_2_envelope());
   }
 
+  // Called after the voices have rendered their blocks.
+  inline void RenderSamples() {
+    if (num_audio_voices_ > 1 && is_audio() &&
+        paraphonic_oscillator.writable() >= kAudioBlockSize) {
+      for (uint8_t i = 0; i < num_audio_voices_; ++i) {
+        audio_voices_[i]->RefreshOscillator();
+      }
+      paraphonic_oscillator.Render();
+    }
+  }
+
   inline uint16_t GetAudioSample() {
+    if (num_audio_voices_ > 1) {
+      return paraphonic_oscillator.ReadSample();
+    }
     uint16_t mix = 0;
     for (uint8_t i = 0; i < num_audio_voices_; ++i) {
       mix += audio_voices_[i]->ReadSample();
@@ -311,15 +365,10 @@ class CVOutput {
     return mix;
   }
 
-  inline uint16_t GetEnvelopeSample() {
-    dac_interpolator_.Tick();
-    return dac_interpolator_.value() << 1;
-  }
-
   void Refresh();
 
   inline uint16_t dc_dac_code() const {
-    return dac_interpolator_.target() << 1;
+    return dc_dac_code_;
   }
 
   inline uint16_t DacCodeFrom16BitValue(uint16_t value) const {
@@ -372,7 +421,7 @@ class CVOutput {
   uint16_t note_dac_code_;
   bool dirty_;  // Set to true when the calibration settings have changed.
   uint16_t calibrated_dac_code_[kNumOctaves];
-  Interpolator dac_interpolator_;
+  uint16_t dc_dac_code_;
 
   DISALLOW_COPY_AND_ASSIGN(CVOutput);
 };
@@ -34,6 +34,8 @@
 #include "yarns/drivers/gate_output.h"
 #include "yarns/drivers/midi_io.h"
 #include "yarns/drivers/system.h"
+#include "yarns/dac_frame_producer.h"
+#include "yarns/latency_tracer.h"
 #include "yarns/midi_handler.h"
 #include "yarns/multi.h"
 #include "yarns/settings.h"
@@ -65,8 +67,6 @@ extern "C" {
 
 uint16_t cv[4];
 bool gate[4];
-bool has_audio_source[4];
-bool has_envelope[4];
 uint16_t factory_testing_counter;
 uint8_t refresh_counter;
 
@@ -74,6 +74,7 @@ void SysTick_Handler() {
   // MIDI I/O, and CV/Gate refresh at 8kHz.
   // UI polling and LED refresh at 1kHz.
   static uint8_t counter;
+  latency_tracer.Tick();
   if ((++counter & 7) == 0) {
     ui.Poll();
     system_clock.Tick();
@@ -93,9 +94,9 @@ void SysTick_Handler() {
     }
   }
 
-  if (midi_handler.mutable_output_buffer()->readable()) {
+  if (midi_handler.mutable_output_encoder()->readable()) {
     if (midi_io.writable()) {
-      midi_io.Overwrite(midi_handler.mutable_output_buffer()->ImmediateRead());
+      midi_io.Overwrite(midi_handler.mutable_output_encoder()->ImmediateRead());
     }
   }
 
@@ -107,20 +108,13 @@ void SysTick_Handler() {
   if (refresh) {
     gate_output.Write(gate);
   }
+  multi.RefreshInternalClock();
   multi.ClockFast();
   if (refresh) {
     multi.Refresh();
     multi.GetCvGate(cv, gate);
+    dac_frame_producer.Delay(cv, gate);
   }
-  has_audio_source[0] = multi.cv_output(0).is_audio();
-  has_audio_source[1] = multi.cv_output(1).is_audio();
-  has_audio_source[2] = multi.cv_output(2).is_audio();
-  has_audio_source[3] = multi.cv_output(3).is_audio();
-  has_envelope[0] = multi.cv_output(0).is_envelope();
-  has_envelope[1] = multi.cv_output(1).is_envelope();
-  has_envelope[2] = multi.cv_output(2).is_envelope();
-  has_envelope[3] = multi.cv_output(3).is_envelope();
-  
   // In calibration mode, overrides the DAC outputs with the raw calibration
   // table values.
   if (ui.calibrating()) {
@@ -153,19 +147,13 @@ void TIM1_UP_IRQHandler(void) {
   TIM_ClearITPendingBit(TIM1, TIM_IT_Update);
 
   dac.Cycle();
-  if (has_audio_source[dac.channel()]) {
-    dac.Write(multi.mutable_cv_output(dac.channel())->GetAudioSample());
-  } else if (has_envelope[dac.channel()]) {
-    dac.Write(multi.mutable_cv_output(dac.channel())->GetEnvelopeSample());
+  uint16_t sample;
+  if (dac_frame_producer.Read(dac.channel(), &sample)) {
+    dac.Write(sample);
   } else {
     // Use value written there during previous CV refresh.
     dac.Write();
   }
-  
-  if (dac.channel() == 0) {
-    // Internal clock refresh at 48kHz
-    multi.RefreshInternalClock();
-  }
 }
 
 }
@@ -175,9 +163,11 @@ void Init() {
   
   setting_defs.Init();
   multi.Init(true);
+  dac_frame_producer.Init();
   ui.Init();
 
   // Load multi 0 on boot.
+  storage_manager.Init();
   storage_manager.LoadMulti(0);
   storage_manager.LoadCalibration();
   